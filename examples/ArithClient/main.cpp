@@ -22,6 +22,24 @@ public:
         writeByte(C2S_REQ_ADD);
         writeInt<uint32_t>(12);
         writeInt<uint32_t>(56);
+
+        // requests can be pipelined, each response is passed to its own callback
+        for (uint32_t i = 1; i <= 3; i++) {
+            size_t indx = prepareRPC(RPC_MUL, [i](FoxPeer *peer, RPCStatus status, PktSize) {
+                uint32_t resp;
+
+                if (status != RPC_OK) {
+                    std::cout << "rpc failed with status " << status << std::endl;
+                    return;
+                }
+
+                peer->readInt(resp);
+                std::cout << "got rpc result of " << i << " * 7 = " << resp << std::endl;
+            }, 1000);
+            writeInt<uint32_t>(i);
+            writeInt<uint32_t>(7);
+            patchVarPacket(indx);
+        }
     }
 
     void onPing(int64_t peerTime, int64_t currTime) {
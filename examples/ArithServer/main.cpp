@@ -6,10 +6,12 @@
 class ExamplePeer : public FoxServerPeer {
 private:
     DEF_FOXNET_PACKET(C2S_REQ_ADD);
+    DEF_FOXNET_RPC(RPC_MUL);
 
 public:
     ExamplePeer() {
         INIT_FOXNET_PACKET(C2S_REQ_ADD, sizeof(uint32_t) + sizeof(uint32_t))
+        INIT_FOXNET_RPC(RPC_MUL)
     }
 
     void onSend(uint8_t *data, size_t sz) {
@@ -38,6 +40,20 @@ DECLARE_FOXNET_PACKET(C2S_REQ_ADD, ExamplePeer) {
     peer->writeInt<uint32_t>(res);
 }
 
+DECLARE_FOXNET_RPC(RPC_MUL, ExamplePeer) {
+    uint32_t a, b;
+
+    peer->readInt<uint32_t>(a);
+    peer->readInt<uint32_t>(b);
+
+    std::cout << "got rpc (" << a << " * " << b << ")" << std::endl;
+
+    // respond to the request, the client matches it up using the rpcID
+    size_t indx = peer->prepareRPCResponse(rpcID);
+    peer->writeInt<uint32_t>(a * b);
+    peer->patchVarPacket(indx);
+}
+
 int main() {
     try {
         FoxNet::FoxServer<ExamplePeer> server(1337);
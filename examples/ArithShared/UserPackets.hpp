@@ -25,4 +25,8 @@ inline void xorData(uint8_t *data, size_t sz) {
 typedef enum {
     C2S_REQ_ADD = PKTID_USER_PACKET_START,
     S2C_NUM_RESPONSE,
-} UserPacketIDs;
\ No newline at end of file
+} UserPacketIDs;
+
+typedef enum {
+    RPC_MUL,
+} UserRPCMethods;
\ No newline at end of file
@@ -3,10 +3,18 @@
 #include <cstdlib>
 #include <cstdint>
 #include <climits>
+#include <cstring>
 #include <vector>
 
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
 #define BSTREAM_RESERVED 64
 
+// max bytes in a varint (a full 64 bit value)
+#define BSTREAM_VARINT_MAX 10
+
 namespace FoxNet {
     typedef unsigned char Byte;
 
@@ -39,6 +47,193 @@ namespace FoxNet {
         } 
     };
 
+    // zigzag maps small negative numbers to small positive ones (0, -1, 1, -2, ... -> 0, 1, 2, 3, ...) so they varint well
+    inline uint64_t zigzagEncode(int64_t val) {
+        return ((uint64_t)val << 1) ^ (uint64_t)(val >> 63);
+    }
+
+    inline int64_t zigzagDecode(uint64_t val) {
+        return (int64_t)(val >> 1) ^ -(int64_t)(val & 1);
+    }
+
+    // LEB128: 7 bits per byte, low bits first, the high bit is set on every byte but the last. returns the size
+    inline size_t encodeVarint(Byte *out, uint64_t val) {
+        size_t sz = 0;
+
+        while (val >= 0x80) {
+            out[sz++] = (Byte)(val | 0x80);
+            val >>= 7;
+        }
+
+        out[sz++] = (Byte)val;
+        return sz;
+    }
+
+    // squeezes the continuation bits out of a varint of up to 8 bytes loaded little endian (the bytes past its end
+    // already cleared), gathering its 7 bit groups without a branch per byte
+    inline uint64_t gatherVarint(uint64_t word) {
+        word &= 0x7F7F7F7F7F7F7F7FULL;
+        return (word & 0x7F) | ((word >> 1) & (0x7FULL << 7)) | ((word >> 2) & (0x7FULL << 14)) |
+            ((word >> 3) & (0x7FULL << 21)) | ((word >> 4) & (0x7FULL << 28)) | ((word >> 5) & (0x7FULL << 35)) |
+            ((word >> 6) & (0x7FULL << 42)) | ((word >> 7) & (0x7FULL << 49));
+    }
+
+    /*
+     * Decodes a varint from the avail bytes at data, returns its size or 0 if it's truncated or malformed. with 8
+     * bytes to spare (& a little endian host) a varint of up to 8 bytes is decoded from a single load: the end is
+     * found from the cleared high bits & the 7 bit groups are gathered without a branch per byte
+     */
+    inline size_t decodeVarint(const Byte *data, size_t avail, uint64_t &out) {
+#if !defined(__BYTE_ORDER__) || __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        if (avail >= sizeof(uint64_t)) {
+            uint64_t word, ends;
+
+            memcpy(&word, data, sizeof(word));
+            ends = ~word & 0x8080808080808080ULL;
+
+            if (ends != 0) {
+#ifdef _MSC_VER
+                unsigned long bit;
+                _BitScanForward64(&bit, ends);
+#else
+                int bit = __builtin_ctzll(ends);
+#endif
+                size_t sz = bit / 8 + 1;
+
+                // drop the bytes past the end, then squeeze out the continuation bits
+                if (sz < sizeof(uint64_t))
+                    word &= (1ULL << (sz * 8)) - 1;
+
+                out = gatherVarint(word);
+                return sz;
+            }
+        }
+#endif
+
+        // slowpath: near the end of the data, or a value too big for the fastpath
+        uint64_t val = 0;
+        for (size_t i = 0; i < avail && i < BSTREAM_VARINT_MAX; i++) {
+            val |= (uint64_t)(data[i] & 0x7F) << (7 * i);
+
+            if ((data[i] & 0x80) == 0) {
+                // the 10th byte only has room for the top bit
+                if (i == BSTREAM_VARINT_MAX - 1 && data[i] > 1)
+                    return 0;
+
+                out = val;
+                return i + 1;
+            }
+        }
+
+        return 0;
+    }
+
+    /*
+     * Decodes count varints into out, returns the bytes used or 0 if any of them were truncated or malformed. every
+     * varint that ends inside an 8 byte load is decoded out of that one load (a word of 1 byte varints is just
+     * widened), so a run of small values costs about a load per 8 bytes instead of a full decodeVarint() each
+     */
+    size_t decodeVarints(const Byte *data, size_t avail, uint64_t *out, size_t count);
+
+    /*
+     * Read-only window over bytes owned by someone else
+     *
+     *  Nothing is copied, so a view is only valid as long as its owner says (eg. FoxPeer::getPacketView() is valid
+     * until the packet handler returns). The read functions decode from it in place, moving its cursor forward.
+     */
+    class ByteView {
+    private:
+        const Byte *data = nullptr;
+        size_t size = 0;
+        size_t head = 0;
+        bool flipEndian = false;
+
+    public:
+        ByteView(void) {}
+        ByteView(const Byte *d, size_t sz, bool flip = false): data(d), size(sz), flipEndian(flip) {}
+
+        const Byte *getData(void) const { return data; }
+        size_t getSize(void) const { return size; }
+
+        // the bytes past the cursor
+        const Byte *getRemaining(void) const { return data + head; }
+        size_t sizeRemaining(void) const { return size - head; }
+
+        bool readBytes(Byte *out, size_t sz) {
+            if (size - head < sz)
+                return false;
+
+            memcpy(out, data + head, sz);
+            head += sz;
+            return true;
+        }
+
+        // the next sz bytes as their own view
+        bool readView(ByteView &out, size_t sz) {
+            if (size - head < sz)
+                return false;
+
+            out = ByteView(data + head, sz, flipEndian);
+            head += sz;
+            return true;
+        }
+
+        bool skip(size_t sz) {
+            if (size - head < sz)
+                return false;
+
+            head += sz;
+            return true;
+        }
+
+        inline bool readByte(Byte &out) {
+            return readBytes(&out, 1);
+        }
+
+        template <typename T>
+        bool readInt(T& out) {
+            Byte *dest = (Byte*)&out;
+
+            if (size - head < sizeof(T))
+                return false;
+
+            if (flipEndian) {
+                for (size_t k = 0; k < sizeof(T); k++)
+                    dest[k] = data[head + sizeof(T) - k - 1];
+            } else {
+                memcpy(dest, data + head, sizeof(T));
+            }
+
+            head += sizeof(T);
+            return true;
+        }
+
+        bool readVarint(uint64_t &out) {
+            size_t sz = decodeVarint(data + head, size - head, out);
+
+            head += sz;
+            return sz > 0;
+        }
+
+        bool readSignedVarint(int64_t &out) {
+            uint64_t val;
+
+            if (!readVarint(val))
+                return false;
+
+            out = zigzagDecode(val);
+            return true;
+        }
+
+        // reads a run of count varints, see decodeVarints()
+        bool readVarints(uint64_t *out, size_t count) {
+            size_t sz = decodeVarints(data + head, size - head, out, count);
+
+            head += sz;
+            return sz > 0 || count == 0;
+        }
+    };
+
     /*
      * ByteStream
      */
@@ -46,10 +241,30 @@ namespace FoxNet {
     protected:
         std::vector<Byte> inBuffer; // all read operations operate on this buffer
         std::vector<Byte> outBuffer; // all write operations operate on this buffer
+        const Byte *inView = nullptr; // while set, reads come from here instead of inBuffer (see setInView())
+        size_t inViewSize = 0;
+        size_t inHead = 0; // read cursor into inBuffer (or inView)
         bool flipEndian = false;
 
         void rawWriteIn(Byte *in, size_t sz); // write to the in buffer
 
+        // reads come from data instead of inBuffer until the next flushIn(), data isn't copied so it has to outlive that
+        void setInView(const Byte *data, size_t sz);
+
+        inline const Byte *inCursor(void) {
+            return (inView != nullptr ? inView : inBuffer.data()) + inHead;
+        }
+
+        inline void advanceIn(size_t sz) {
+            inHead += sz;
+
+            // everything was read, start over instead of letting the buffer grow
+            if (inView == nullptr && inHead == inBuffer.size()) {
+                inBuffer.clear();
+                inHead = 0;
+            }
+        }
+
     public:
         ByteStream(void);
 
@@ -66,7 +281,10 @@ namespace FoxNet {
 
         virtual bool readBytes(Byte *out, size_t sz);
         virtual void writeBytes(Byte *in, size_t sz);
-        bool patchBytes(Byte *in, size_t sz, size_t indx);
+        virtual bool patchBytes(Byte *in, size_t sz, size_t indx);
+
+        // reads sz bytes without copying them, out is only valid until the in buffer is next written to or flushed
+        bool readView(ByteView &out, size_t sz);
 
         inline void writeByte(Byte in) {
             writeBytes(&in, 1);
@@ -79,6 +297,14 @@ namespace FoxNet {
         template <typename T>
         bool readInt(T& data) {
             bool result;
+
+            // fastpath: decode straight out of the buffer
+            if (!flipEndian && sizeIn() >= sizeof(T)) {
+                memcpy(&data, inCursor(), sizeof(T));
+                advanceIn(sizeof(T));
+                return true;
+            }
+
             if (flipEndian) {
                 union {
                     T u;
@@ -150,6 +376,16 @@ namespace FoxNet {
             return result;
         }
 
+        // varints take 1 byte for values under 128, 2 under 16384, etc. (up to BSTREAM_VARINT_MAX), they don't
+        // depend on endianness. signed varints are zigzag encoded first, so small negative values stay small too
+        void writeVarint(uint64_t val);
+        void writeSignedVarint(int64_t val);
+        bool readVarint(uint64_t &out);
+        bool readSignedVarint(int64_t &out);
+
+        // reads a run of count varints (see decodeVarints()), nothing is read if any of them are malformed
+        bool readVarints(uint64_t *out, size_t count);
+
         template<typename T>
         inline void writeData(const T& data) {
             writeBytes((Byte*)(&data), sizeof(T));
@@ -160,4 +396,52 @@ namespace FoxNet {
             readBytes((Byte*)(&data), sizeof(T));
         }
     };
+
+    /*
+     * Packs values of any bit width (1-64) into a ByteStream, low bits first
+     *
+     *  Whole bytes are written to the stream as they fill up, the last partial byte is padded with zeroes by
+     * flush(). flush() before patchVarPacket() (or anything else that needs to see every byte written), it's also
+     * flushed when the writer goes away.
+     */
+    class BitWriter {
+    private:
+        ByteStream &stream;
+        uint64_t bits = 0; // pending bits, the oldest in the lowest bits
+        int count = 0;
+
+    public:
+        BitWriter(ByteStream &s): stream(s) {}
+        ~BitWriter(void);
+
+        void write(uint64_t val, int width);
+        void writeBool(bool val);
+
+        // maps val (clamped to [min, max]) onto width bits (up to 32), precise to (max - min) / (2^width - 1)
+        void writeFloat(float val, float min, float max, int width);
+
+        void flush(void);
+    };
+
+    /*
+     * Reads values packed by a BitWriter, from a ByteStream or a ByteView. bytes are pulled from the source as
+     * they're needed, the padding bits of the last one are dropped with the reader
+     */
+    class BitReader {
+    private:
+        ByteStream *stream = nullptr;
+        ByteView *view = nullptr;
+        uint64_t bits = 0;
+        int count = 0;
+
+        bool pull(void);
+
+    public:
+        BitReader(ByteStream &s): stream(&s) {}
+        BitReader(ByteView &v): view(&v) {}
+
+        bool read(uint64_t &out, int width);
+        bool readBool(bool &out);
+        bool readFloat(float &out, float min, float max, int width);
+    };
 }
\ No newline at end of file
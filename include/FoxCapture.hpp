@@ -0,0 +1,93 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "FoxPacket.hpp"
+
+#define FOXCAPTURE_MAGIC "FOXCAP"
+#define FOXCAPTURE_MAGICLEN 6
+#define FOXCAPTURE_VERSION 1
+
+// the writer thread wakes up to write out buffered records at least this often (in ms)
+#define FOXCAPTURE_FLUSH_INTERVAL 100
+
+// ... or as soon as this many bytes are buffered
+#define FOXCAPTURE_FLUSH_SIZE (1024 * 1024)
+
+// data is dropped instead of buffering more than this, so a slow disk can't eat all of our memory
+#define FOXCAPTURE_MAX_BUFFERED (64 * 1024 * 1024)
+
+namespace FoxNet {
+    /*
+     * capture file layout (little endian):
+     *  header: "FOXCAP" | uint8_t version | uint8_t reserved
+     *  record: uint8_t type | int64_t time (ns since the capture started) | uint32_t peer | uint32_t size | size bytes
+     */
+    enum FoxCaptureType : Byte {
+        CAPTURE_OPEN, // a peer started being captured
+        CAPTURE_DATA, // raw bytes received from the peer, before onRecv()
+        CAPTURE_CLOSE // the peer is gone (or stopped being captured)
+    };
+
+    struct FoxCaptureRecord {
+        FoxCaptureType type;
+        int64_t time;
+        uint32_t peer;
+        std::vector<Byte> data;
+    };
+
+    /*
+     * Records the raw inbound traffic of peers to a file (see FoxPeer::setCapture())
+     *
+     *  Records are appended to an in-memory buffer which a background thread writes out, so capturing never waits on
+     * the disk. if the writer falls too far behind, data records are refused and the peer stops being captured
+     * (its stream would have a hole in it anyways).
+     */
+    class FoxCapture {
+    private:
+        FILE *file;
+        std::mutex lock;
+        std::condition_variable wake;
+        std::vector<Byte> buffered;
+        std::thread writer;
+        bool stopping = false;
+        int64_t startTime;
+        std::atomic<uint32_t> nextPeer{1};
+        std::atomic<uint64_t> dropped{0};
+
+        void writerThread(void);
+        bool addRecord(FoxCaptureType type, uint32_t peer, const Byte *data, uint32_t sz, bool force);
+
+    public:
+        // NOTE: this function can throw a FoxException!
+        FoxCapture(const std::string &path);
+        ~FoxCapture(void); // writes out everything still buffered
+
+        uint32_t openPeer(void); // returns the peer's id in the capture
+        bool recordData(uint32_t peer, const Byte *data, size_t sz); // returns false if the data had to be dropped
+        void closePeer(uint32_t peer);
+
+        uint64_t getDropped(void); // data records dropped because the writer fell behind
+    };
+
+    // reads a capture file back, record by record
+    class FoxCaptureReader {
+    private:
+        FILE *file;
+
+    public:
+        // NOTE: this function can throw a FoxException!
+        FoxCaptureReader(const std::string &path);
+        ~FoxCaptureReader(void);
+
+        // returns false once the end of the capture is reached
+        // NOTE: this function can throw a FoxException! (truncated or corrupt capture)
+        bool next(FoxCaptureRecord &record);
+    };
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "ByteStream.hpp"
+
+namespace FoxNet {
+    /*
+     * CRC32C (Castagnoli), used for FoxNet's integrity frames (see FoxPeer::setIntegrity())
+     *
+     *  Uses the cpu's crc32 instructions where it has them (SSE4.2 on x86, the CRC extension on ARMv8), picked at
+     * runtime so the library doesn't have to be built for them. otherwise it falls back to slicing-by-8 tables.
+     */
+    class FoxChecksum {
+    public:
+        // checksum of sz bytes at data, pass the previous result as crc to continue over more bytes (0 to start)
+        static uint32_t crc32c(const Byte *data, size_t sz, uint32_t crc = 0);
+
+        // same as crc32c(), but always on the slicing-by-8 tables (eg. to check the cpu's instructions against)
+        static uint32_t crc32cPortable(const Byte *data, size_t sz, uint32_t crc = 0);
+
+        // is crc32c() running on the cpu's crc instructions?
+        static bool isAccelerated(void);
+    };
+}
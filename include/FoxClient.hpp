@@ -3,20 +3,105 @@
 #include <string>
 #include "FoxPeer.hpp"
 #include "FoxPoll.hpp"
+#include "FoxConnector.hpp"
 
 namespace FoxNet {
+    class FoxClientGroup;
+
     class FoxClient : public FoxPeer {
     private:
-        FoxPollList pList;
+        FoxPollList *pList = nullptr; // either ownList, or our group's list
+        FoxPollList *ownList = nullptr; // only allocated if we aren't in a group
+        FoxClientGroup *group = nullptr;
+        FoxConnector connector;
+        bool connecting = false;
+        bool dirty = false; // written to since the last flush? (only tracked in a group)
+        std::vector<FoxPollEvent> events;
+        std::vector<FoxDatagram*> deadDatagrams; // closed, but events for them might still be in the current batch
+        int helloTries = 0;
+        int64_t nextHello = 0;
+
+        FoxPollList &getPollList(void);
+        void sendHandshake(void);
+        void killClient(void);
+        void sendDatagramHello(void);
+        void pollDatagrams(void);
+        void closeDatagrams(void);
+
+    protected:
+        void acceptDatagramOffer(uint16_t port);
+
+        friend class FoxClientGroup;
 
     public:
         FoxClient(void);
+        ~FoxClient(void);
+
+        /*
+         * with fastOpen (linux) the handshake rides on the SYN if we've connected to this server before, saving a round
+         * trip. connect() then returns before the server has answered, an unreachable server shows up as a disconnect.
+         * packets written before connecting (or before the response) are pipelined right behind the handshake, so
+         * with fastOpen they can ride on the SYN too
+         * NOTE: this function can throw a FoxException!
+         */
+        void connect(std::string ip, std::string port, bool fastOpen = false);
 
+        /*
+         * Connects to a FoxServer::listenUnix() socket, a path starting with '@' is in the abstract namespace. with shm
+         * set the connection is moved onto a FoxShmTransport after the handshake (if the server can set one up),
+         * see isShmActive()
+         * NOTE: this function can throw a FoxException!
+         */
+        void connectUnix(const std::string &path, bool shm = false);
+
+        /*
+         * Starts connecting without blocking, the connect is driven by pollPeer(). onReady() is fired once we're
+         * connected and the handshake was accepted, or onConnectFailed() if every address failed or timeout (in ms)
+         * ran out. packets can be written while connecting, they're sent right behind the handshake.
+         */
+        void connectAsync(std::string ip, std::string port, int timeout = FOXNET_CONNECT_TIMEOUT);
+
+        // connects over transport (eg. one end of a FoxPipe) instead of a kernel socket, we take ownership of it
         // NOTE: this function can throw a FoxException!
-        void connect(std::string ip, std::string port);
+        void connectTransport(FoxTransport *transport);
+        bool isConnecting(void);
 
-        // timeout in ms, if timeout is -1 poll() will block
+        /*
+         * Takes the server up on its datagram channel (see FoxServer::enableDatagrams()) once we're connected, until
+         * it's up PKTLANE_DATAGRAM is sent over the stream. call this before connecting
+         */
+        void enableDatagrams(void);
+
+        /*
+         * Offers CAP_RESUME in the handshake, the server hands us a token for our session (see getResumeToken()) if it
+         * has FoxServer::enableResumption() on. if our connection drops, a new client connecting with that token takes
+         * the session back over (see isResumed()) & gets everything the server queued for it meanwhile. call this
+         * before connecting
+         */
+        void enableResumption(uint64_t token = 0);
+
+        virtual void onConnectFailed(void);
+
+        void writeBytes(Byte *in, size_t sz);
+
+        // handles a poll event on our socket or one of our connect attempts. returns false if we were killed
         // NOTE: this function can throw a FoxException!
+        bool handleEvent(FoxPollEvent &event);
+
+        // sends anything written since the last flush, returns false if we were killed
+        bool flush(void);
+
+        // checks rpc timeouts & drives connectAsync(), call this after handling events
+        void tick(void);
+
+        // clamps a poll timeout (in ms) so we wake up for the next rpc timeout or connect attempt
+        int getTimeout(int timeout);
+
+        // does tick() need to be called? (we're connecting or have outstanding rpcs)
+        bool needsTick(void);
+
+        // timeout in ms, if timeout is -1 poll() will block
+        // NOTE: this function can throw a FoxException! (not allowed if we're in a FoxClientGroup, poll the group instead)
         void pollPeer(int timeout);
     };
-}
\ No newline at end of file
+}
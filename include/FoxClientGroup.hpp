@@ -0,0 +1,52 @@
+#pragma once
+
+#include <unordered_set>
+#include <vector>
+
+#include "FoxClient.hpp"
+#include "FoxPoll.hpp"
+
+namespace FoxNet {
+    /*
+     * Drives many FoxClients from a single poll loop
+     *
+     *  Every client in the group shares the group's FoxPollList, so one thread can handle thousands of connections
+     * and all of the events from a wakeup are handled in one batch. The group doesn't own its clients. To spread
+     * clients over N reactors, use N groups, each polled from its own thread.
+     */
+    class FoxClientGroup {
+    private:
+        FoxPollList pollList;
+        std::unordered_set<FoxClient*> clients;
+        std::vector<FoxClient*> dirtyClients; // written to since the last flush
+        std::unordered_set<FoxClient*> tickingClients; // connecting, or have outstanding rpcs
+        std::vector<FoxPollEvent> events;
+        std::vector<FoxDatagram*> deadDatagrams; // closed by our clients, but events for them might still be in the current batch
+
+        void markDirty(FoxClient *client);
+        void markTicking(FoxClient *client);
+
+        friend class FoxClient;
+
+    public:
+        FoxClientGroup(size_t reserved = 64);
+        virtual ~FoxClientGroup(void);
+
+        // adds a client to the group, the client must not be connected yet
+        void addClient(FoxClient *client);
+        void rmvClient(FoxClient *client);
+
+        // fired when a client is killed (or its connectAsync() failed), the client is left in the group.
+        // NOTE: don't delete the client from here, remove & delete it after pollClients() returns
+        virtual void onClientKilled(FoxClient *client);
+
+        // timeout in ms, if timeout is -1 poll() will block. returns true if an event was processed
+        bool pollClients(int timeout);
+
+        // see FoxPollList::enableEdgeTriggered()
+        void enableEdgeTriggered(void);
+
+        std::vector<FoxClient*> getClientList(void);
+        size_t getClientCount(void);
+    };
+}
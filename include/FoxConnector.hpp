@@ -0,0 +1,97 @@
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "FoxSocket.hpp"
+#include "FoxPoll.hpp"
+
+// default timeout (in ms) for FoxClient::connectAsync()
+#define FOXNET_CONNECT_TIMEOUT 10000
+
+// how long (in ms) to wait on a connection attempt before racing the next address [see: RFC 8305 section 5]
+#define FOXNET_CONNECT_ATTEMPT_DELAY 250
+
+// how many threads (at most) resolve hostnames for every FoxConnector in the process
+#define FOXNET_RESOLVER_THREADS 4
+
+// without a wake fd (windows), the poll loop checks on a hostname being resolved this often (in ms)
+#define FOXNET_RESOLVE_POLL_INTERVAL 10
+
+namespace FoxNet {
+    // a socket racing to connect, owner is the socket that'll take over the connection if it wins
+    class FoxConnectAttempt : public FoxSocket {
+    public:
+        FoxSocket *owner;
+
+        FoxConnectAttempt(FoxSocket *o): owner(o) {}
+    };
+
+    /*
+     * Non-blocking connect driven by a FoxPollList
+     *
+     *  Hostnames are resolved by a small pool of threads shared by every connector, which wakes the poll list once
+     * the lookup is done (numeric addresses are resolved immediately). The addresses are then raced Happy-Eyeballs
+     * style: families are interleaved and a new attempt is started every FOXNET_CONNECT_ATTEMPT_DELAY ms (or as soon
+     * as one fails), the first attempt to connect wins.
+     */
+    class FoxConnector {
+    private:
+        struct Candidate {
+            struct sockaddr_storage addr;
+            socklen_t addrLen;
+        };
+
+        // shared with the resolver pool, so the connector can be destroyed while a lookup is still running
+        struct Resolve {
+            std::mutex lock;
+            bool done = false;
+            std::vector<Candidate> result;
+            FoxPollList *plist; // woken once done, cleared when the connector lets go of the lookup
+        };
+
+        std::shared_ptr<Resolve> resolving;
+        std::vector<Candidate> candidates;
+        size_t nextCandidate = 0;
+        std::vector<FoxConnectAttempt*> attempts;
+        std::vector<FoxConnectAttempt*> deadAttempts; // closed, but events for them might still be in the current batch
+        FoxSocket *owner;
+        int64_t deadline = 0;
+        int64_t nextAttempt = 0;
+        bool active = false;
+
+        static std::vector<Candidate> resolve(const std::string &ip, const std::string &port, bool numericOnly, bool &ok);
+        void setCandidates(std::vector<Candidate> &&result);
+        void abandonResolve(void);
+        void removeAttempt(FoxPollList &plist, FoxConnectAttempt *attempt);
+        void launchAttempts(FoxPollList &plist);
+
+    public:
+        FoxConnector(FoxSocket *owner);
+        ~FoxConnector(void);
+
+        // plist is the list tick() & cancel() will be called with, it's woken once a hostname is resolved
+        void start(FoxPollList &plist, std::string ip, std::string port, int timeout);
+
+        // starts new attempts & checks timeouts, call this every iteration of the poll loop once events are handled
+        void tick(FoxPollList &plist);
+
+        /*
+         * handles a poll event on one of our attempts (see ownsSock())
+         * returns: the winning socket if the event finished the connect, take its connection with takeSock() and
+         * delete it. every other attempt is closed, and freed on the next tick()
+         */
+        FoxConnectAttempt *handleEvent(FoxPollList &plist, FoxPollEvent &event);
+
+        // removes every attempt from plist & closes them, the connect is no longer active
+        void cancel(FoxPollList &plist);
+
+        // clamps a poll timeout (in ms) so we wake up for the next attempt or the deadline
+        int getTimeout(int timeout);
+
+        bool ownsSock(FoxSocket *sock);
+        bool isActive(void); // false once the connect has finished, or failed
+    };
+}
@@ -0,0 +1,251 @@
+#pragma once
+
+/*
+ * Optional C++20 coroutine layer. FoxNet itself is built as C++17, this header is only usable from C++20 code.
+ *
+ *  FoxTask session(ExampleClient *client) {
+ *      co_await FoxNet::connect(*client, "127.0.0.1", "1337");
+ *
+ *      client->writeByte(C2S_REQ_ADD);
+ *      ...
+ *      co_await FoxNet::flush(*client);
+ *
+ *      PktSize sz = co_await FoxNet::recv(*client, S2C_NUM_RESPONSE);
+ *      client->readInt(resp); // the packet body is only valid until the next co_await!
+ *  }
+ *
+ * Coroutines are resumed from the peer's own poll loop (FoxClient::pollPeer() or FoxServer::pollPeers()), so they
+ * run on the reactor thread just like packet handlers. exceptions thrown inside a coroutine are rethrown from
+ * whatever resumed it. if the peer is killed while a coroutine is suspended on it, the co_await throws a
+ * FoxException, if the coroutine lets that (or anything else) escape it's logged & dropped, killing a peer never
+ * throws. frames are allocated from a per-thread pool, so suspending & spawning sessions doesn't hit the heap.
+ */
+
+#if !defined(__cpp_impl_coroutine) || !__has_include(<coroutine>)
+#error "FoxCoro.hpp requires C++20 coroutines"
+#endif
+
+#include <coroutine>
+#include <exception>
+#include <string>
+
+#include "FoxPeer.hpp"
+#include "FoxClient.hpp"
+
+// frames are pooled in 64 byte size classes up to this size, anything larger goes to the heap
+#define FOXCORO_POOL_MAX 2048
+#define FOXCORO_POOL_GRANULARITY 64
+
+namespace FoxNet {
+    /*
+     * per-thread free lists of coroutine frames, frames are never returned to the heap so the pool settles at
+     * the peak number of live coroutines. a frame can finish on a different thread than the one that made it (all
+     * frames come from the heap, so it just joins the pool of the thread it finished on), and one that finishes
+     * after its thread's pool is gone (eg. from another thread_local's destructor) goes straight back to the heap
+     */
+    class FoxFramePool {
+    private:
+        struct FreeFrame {
+            FreeFrame *next;
+        };
+
+        enum PoolState {
+            POOL_NONE,
+            POOL_ALIVE,
+            POOL_DESTROYED
+        };
+
+        FreeFrame *freeLists[FOXCORO_POOL_MAX / FOXCORO_POOL_GRANULARITY] = {};
+
+        // (trivially destructible, so it can still be checked while the thread's other thread_locals are destroyed)
+        static PoolState &state(void) {
+            static thread_local PoolState s = POOL_NONE;
+            return s;
+        }
+
+        // nullptr once this thread's pool is destroyed
+        static FoxFramePool *get(void) {
+            if (state() == POOL_DESTROYED)
+                return nullptr;
+
+            static thread_local FoxFramePool pool;
+            return &pool;
+        }
+
+        FoxFramePool(void) {
+            state() = POOL_ALIVE;
+        }
+
+        static size_t sizeClass(size_t sz) {
+            return (sz + FOXCORO_POOL_GRANULARITY - 1) / FOXCORO_POOL_GRANULARITY - 1;
+        }
+
+    public:
+        ~FoxFramePool(void) {
+            state() = POOL_DESTROYED;
+
+            for (FreeFrame *&list : freeLists) {
+                while (list != nullptr) {
+                    FreeFrame *next = list->next;
+                    ::operator delete(list);
+                    list = next;
+                }
+            }
+        }
+
+        static void *allocate(size_t sz) {
+            FoxFramePool *pool = get();
+
+            if (sz > FOXCORO_POOL_MAX || pool == nullptr)
+                return ::operator new(sz);
+
+            size_t cls = sizeClass(sz);
+            FreeFrame *&list = pool->freeLists[cls];
+            if (list == nullptr)
+                return ::operator new((cls + 1) * FOXCORO_POOL_GRANULARITY);
+
+            FreeFrame *frame = list;
+            list = frame->next;
+            return frame;
+        }
+
+        static void release(void *ptr, size_t sz) {
+            FoxFramePool *pool = get();
+
+            if (sz > FOXCORO_POOL_MAX || pool == nullptr) {
+                ::operator delete(ptr);
+                return;
+            }
+
+            FreeFrame *frame = (FreeFrame*)ptr;
+            FreeFrame *&list = pool->freeLists[sizeClass(sz)];
+            frame->next = list;
+            list = frame;
+        }
+    };
+
+    namespace _FoxCoro {
+        // exceptions escaping a coroutine are parked here until whoever resumed it can rethrow them
+        inline thread_local std::exception_ptr pendingException;
+
+        inline void resume(std::coroutine_handle<> handle) {
+            handle.resume();
+
+            if (pendingException) {
+                std::exception_ptr e = pendingException;
+                pendingException = nullptr;
+                std::rethrow_exception(e);
+            }
+        }
+
+        // shared by every awaiter, resumes the coroutine waiting on the peer
+        struct PeerAwaiter {
+            FoxPeer *peer;
+            PktSize size = 0;
+            void *handle = nullptr;
+
+            static void wake(void *ud, FoxPeer *, PktSize size) {
+                PeerAwaiter *awaiter = (PeerAwaiter*)ud;
+                awaiter->size = size;
+                resume(std::coroutine_handle<>::from_address(awaiter->handle));
+            }
+
+            void wait(std::coroutine_handle<> h, PeerWaitEvent event, PktID id) {
+                handle = h.address();
+                peer->addWaiter(event, id, wake, this);
+            }
+
+            void check(void) {
+                if (!peer->isAlive()) {
+                    FOXFATAL("peer was killed while a coroutine was waiting on it!")
+                }
+            }
+        };
+    }
+
+    /*
+     * fire-and-forget coroutine, it starts running as soon as it's called and cleans itself up when it finishes
+     */
+    struct FoxTask {
+        struct promise_type {
+            FoxTask get_return_object(void) { return {}; }
+            std::suspend_never initial_suspend(void) noexcept { return {}; }
+            std::suspend_never final_suspend(void) noexcept { return {}; }
+            void return_void(void) {}
+
+            void unhandled_exception(void) {
+                _FoxCoro::pendingException = std::current_exception();
+            }
+
+            static void *operator new(size_t sz) {
+                return FoxFramePool::allocate(sz);
+            }
+
+            static void operator delete(void *ptr, size_t sz) {
+                FoxFramePool::release(ptr, sz);
+            }
+        };
+    };
+
+    // call a FoxTask through this so exceptions thrown before its first suspend aren't lost
+    template<typename Fn, typename... Args>
+    void spawn(Fn &&fn, Args&&... args) {
+        fn(std::forward<Args>(args)...);
+
+        if (_FoxCoro::pendingException) {
+            std::exception_ptr e = _FoxCoro::pendingException;
+            _FoxCoro::pendingException = nullptr;
+            std::rethrow_exception(e);
+        }
+    }
+
+    // resumes with the size of the next packet with the given id, the body is left in the stream to be read.
+    // the packet still has to be registered, either with a handler or with FoxPeer::registerPacket()
+    struct RecvAwaiter : _FoxCoro::PeerAwaiter {
+        PktID id;
+
+        bool await_ready(void) { return false; }
+        void await_suspend(std::coroutine_handle<> h) { wait(h, PEERWAIT_PACKET, id); }
+        PktSize await_resume(void) { check(); return size; }
+    };
+
+    // resumes once everything written so far has been handed to the kernel
+    struct FlushAwaiter : _FoxCoro::PeerAwaiter {
+        bool await_ready(void) { return peer->isAlive() && peer->pendingOut() == 0; }
+        void await_suspend(std::coroutine_handle<> h) { wait(h, PEERWAIT_FLUSH, PKTID_NONE); }
+        void await_resume(void) { check(); }
+    };
+
+    // resumes once the handshake has been accepted
+    struct ReadyAwaiter : _FoxCoro::PeerAwaiter {
+        bool await_ready(void) { return peer->isAlive() && peer->getHandshake(); }
+        void await_suspend(std::coroutine_handle<> h) { wait(h, PEERWAIT_READY, PKTID_NONE); }
+        void await_resume(void) { check(); }
+    };
+
+    inline RecvAwaiter recv(FoxPeer &peer, PktID id) {
+        RecvAwaiter awaiter;
+        awaiter.peer = &peer;
+        awaiter.id = id;
+        return awaiter;
+    }
+
+    inline FlushAwaiter flush(FoxPeer &peer) {
+        FlushAwaiter awaiter;
+        awaiter.peer = &peer;
+        return awaiter;
+    }
+
+    inline ReadyAwaiter ready(FoxPeer &peer) {
+        ReadyAwaiter awaiter;
+        awaiter.peer = &peer;
+        return awaiter;
+    }
+
+    // connects the client without blocking (see FoxClient::connectAsync()) & resumes once the handshake has been
+    // accepted, throws a FoxException if the connect failed
+    inline ReadyAwaiter connect(FoxClient &client, std::string ip, std::string port, int timeout = FOXNET_CONNECT_TIMEOUT) {
+        client.connectAsync(ip, port, timeout);
+        return ready(client);
+    }
+}
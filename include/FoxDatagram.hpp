@@ -0,0 +1,81 @@
+#pragma once
+
+#include <vector>
+
+#include "FoxSocket.hpp"
+
+// max bytes per datagram (header included), small enough to not be fragmented on the usual paths
+#define FOXNET_DATAGRAM_MTU 1200
+
+// max datagrams read or written per syscall
+#define FOXNET_DATAGRAM_BATCH 32
+
+// max recvBatch() calls per wakeup, so a flood of datagrams can't starve the streams
+#define FOXNET_DATAGRAM_READS 4
+
+// uint32_t (session) & uint32_t (sequence number), little endian
+#define FOXNET_DATAGRAM_HEADER 8
+
+// how often (in ms) a client resends its hello until the server acks it, and how many times before giving up
+#define FOXNET_DATAGRAM_HELLO_INTERVAL 100
+#define FOXNET_DATAGRAM_HELLO_TRIES 20
+
+namespace FoxNet {
+    /*
+     * UDP socket carrying the datagram channel of FoxPeers (see PKTLANE_DATAGRAM)
+     *
+     *  The server offers a session id & token right after the handshake, the client then sends a hello (sequence
+     * number 0, followed by the token) until the server acks it over the stream, which binds the client's address
+     * to the session. every other datagram holds whole packets, framed like they are on the stream. a server shares
+     * one FoxDatagram between all of its peers, a client has its own connected one.
+     *  Datagrams are read & written in batches, on linux a whole batch is a single recvmmsg()/sendmmsg().
+     */
+    class FoxDatagram : public FoxSocket {
+    public:
+        struct Message {
+            struct sockaddr_storage addr;
+            socklen_t addrLen;
+            size_t size; // 0 if the datagram was truncated
+            Byte data[FOXNET_DATAGRAM_MTU];
+        };
+
+    private:
+        std::vector<Message> in;
+        std::vector<Message> out;
+        size_t outCount = 0;
+
+    public:
+        FoxSocket *owner; // the client we belong to, nullptr on a server
+
+        FoxDatagram(FoxSocket *o = nullptr);
+
+        // reads up to FOXNET_DATAGRAM_BATCH datagrams, returns how many were read into getRecv()
+        size_t recvBatch(void);
+        Message &getRecv(size_t i);
+
+        // queues a datagram of up to FOXNET_DATAGRAM_MTU bytes, addr is ignored (and can be nullptr) if we're connected
+        void queue(const Byte *data, size_t sz, const struct sockaddr *addr, socklen_t addrLen);
+
+        // sends everything queued, datagrams the kernel doesn't have room for are dropped
+        void flush(void);
+
+        uint16_t getPort(void);
+
+        // the header is always little endian, whatever the stream's endian is
+        template <typename T>
+        static void putInt(Byte *out, T val) {
+            for (size_t i = 0; i < sizeof(T); i++)
+                out[i] = (Byte)(val >> (i * 8));
+        }
+
+        template <typename T>
+        static T getInt(const Byte *in) {
+            T val = 0;
+
+            for (size_t i = 0; i < sizeof(T); i++)
+                val |= (T)in[i] << (i * 8);
+
+            return val;
+        }
+    };
+}
@@ -0,0 +1,159 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+#include "FoxPacket.hpp"
+
+// histograms use power of two buckets, the last bucket also catches everything larger
+#define FOXMETRICS_BUCKETS 32
+
+/*
+ * metric hooks compile to nothing unless FoxNet was configured with FOXNET_ENABLE_METRICS (on by default).
+ * eg. FOXMETRIC(addAccept())
+ */
+#ifdef FOXNET_ENABLE_METRICS
+#define FOXMETRIC(x) \
+    FoxNet::FoxMetrics::local().x;
+#else
+#define FOXMETRIC(x)
+#endif
+
+namespace FoxNet {
+    template<typename T>
+    struct FoxMetricsHistogram {
+        T buckets[FOXMETRICS_BUCKETS] = {}; // bucket i holds values in [2^(i-1), 2^i), bucket 0 holds 0
+        T count = {};
+        T sum = {};
+
+        static int bucketOf(uint64_t val) {
+            int bucket;
+
+#if defined(__GNUC__) || defined(__clang__)
+            bucket = val == 0 ? 0 : 64 - __builtin_clzll(val);
+#else
+            for (bucket = 0; val != 0; val >>= 1)
+                bucket++;
+#endif
+
+            return bucket < FOXMETRICS_BUCKETS ? bucket : FOXMETRICS_BUCKETS - 1;
+        }
+    };
+
+    template<typename T>
+    struct FoxMetricsData {
+        // per packet id, bytes include the packet's header
+        T packetsIn[256] = {};
+        T bytesIn[256] = {};
+        T packetsOut[256] = {};
+        T bytesOut[256] = {};
+        FoxMetricsHistogram<T> handlerTime[256]; // ns spent in the packet's handler
+
+        FoxMetricsHistogram<T> pollTime; // ns spent handling the events of a wakeup
+        FoxMetricsHistogram<T> pollEvents; // events per wakeup
+        FoxMetricsHistogram<T> sendQueue; // bytes queued when a flush starts
+
+        T socketBytesIn = {};
+        T socketBytesOut = {};
+        T pollOutSet = {};
+        T pollOutCleared = {};
+        T accepts = {};
+        T acceptsRejected = {}; // closed by admission control before a peer was made
+        T disconnects = {};
+        T detaches = {}; // dropped connections whose session was kept for resumption, see FoxServer::enableResumption()
+        T resumes = {}; // detached sessions a reconnecting client took back over
+        T datagramsIn = {};
+        T datagramsOut = {};
+        T datagramsDropped = {}; // malformed, unauthenticated, or couldn't be sent
+        T sendfileBytesOut = {}; // payload bytes sent straight from files, see FoxPeer::sendFile()
+        T zeroCopyBytesOut = {}; // payload bytes sent with MSG_ZEROCOPY, see FoxPeer::sendZeroCopy()
+        T zeroCopyCopied = {}; // MSG_ZEROCOPY sends the kernel ended up copying anyways
+        T integrityFailures = {}; // integrity frames that failed their check, see FoxPeer::setIntegrity()
+    };
+
+    /*
+     * per-thread counters, only ever written by their own thread so an update is a plain load & store. snapshots read
+     * them from other threads, which can miss the latest updates but never sees a torn value
+     */
+    class FoxMetricsShard : public FoxMetricsData<std::atomic<uint64_t>> {
+    private:
+        static void add(std::atomic<uint64_t> &counter, uint64_t val) {
+            counter.store(counter.load(std::memory_order_relaxed) + val, std::memory_order_relaxed);
+        }
+
+        static void record(FoxMetricsHistogram<std::atomic<uint64_t>> &hist, uint64_t val) {
+            add(hist.buckets[FoxMetricsHistogram<std::atomic<uint64_t>>::bucketOf(val)], 1);
+            add(hist.count, 1);
+            add(hist.sum, val);
+        }
+
+    public:
+        void addPacketIn(PktID id, size_t sz, int64_t handlerNanos) {
+            add(packetsIn[id], 1);
+            add(bytesIn[id], sz);
+            record(handlerTime[id], handlerNanos);
+        }
+
+        void addPacketOut(PktID id, size_t sz) {
+            add(packetsOut[id], 1);
+            add(bytesOut[id], sz);
+        }
+
+        void addPoll(int64_t nanos) { record(pollTime, nanos); }
+        void addPollEvents(size_t events) { record(pollEvents, events); }
+        void addSendQueue(size_t sz) { record(sendQueue, sz); }
+        void addSocketIn(size_t sz) { add(socketBytesIn, sz); }
+        void addSocketOut(size_t sz) { add(socketBytesOut, sz); }
+        void addPollOutSet(void) { add(pollOutSet, 1); }
+        void addPollOutCleared(void) { add(pollOutCleared, 1); }
+        void addAccept(void) { add(accepts, 1); }
+        void addAcceptRejected(void) { add(acceptsRejected, 1); }
+        void addDisconnect(void) { add(disconnects, 1); }
+        void addDetach(void) { add(detaches, 1); }
+        void addResume(void) { add(resumes, 1); }
+        void addDatagramsIn(size_t count) { add(datagramsIn, count); }
+        void addDatagramsOut(size_t count) { add(datagramsOut, count); }
+        void addDatagramsDropped(size_t count) { add(datagramsDropped, count); }
+        void addSendfileOut(size_t sz) { add(sendfileBytesOut, sz); }
+        void addZeroCopyOut(size_t sz) { add(zeroCopyBytesOut, sz); }
+        void addZeroCopyCopied(size_t count) { add(zeroCopyCopied, count); }
+        void addIntegrityFailure(void) { add(integrityFailures, 1); }
+    };
+
+    // every shard summed together
+    class FoxMetricsSnapshot : public FoxMetricsData<uint64_t> {
+    public:
+        void merge(FoxMetricsShard &shard);
+
+        std::string toPrometheus(void);
+        std::string toJSON(void);
+    };
+
+    /*
+     * Process-wide metrics registry
+     *
+     *  Every thread that touches FoxNet gets its own shard, so the reactor threads never contend on a counter.
+     * shards outlive their threads (a new thread picks up a retired shard) so nothing is lost when a thread exits.
+     */
+    class FoxMetrics {
+    private:
+        static thread_local FoxMetricsShard *shard;
+
+        static FoxMetricsShard *attach(void);
+
+    public:
+        static FoxMetricsShard &local(void) {
+            FoxMetricsShard *s = shard;
+            return s != nullptr ? *s : *attach();
+        }
+
+        static int64_t now(void) {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+
+        static FoxMetricsSnapshot snapshot(void);
+        static bool isEnabled(void);
+    };
+}
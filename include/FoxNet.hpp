@@ -19,7 +19,7 @@
 #define FOXNET_MINOR _FOXNET_VER_MINOR
 #else // fixes intellisense
 #define FOXNET_MINOR 0
-#define FOXNET_MAJOR 0
+#define FOXNET_MAJOR 1
 #endif
 
 #define FOXMAGIC "FOX\71"
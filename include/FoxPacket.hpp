@@ -2,6 +2,7 @@
 
 #include <map>
 #include <chrono>
+#include <functional>
 
 #include "FoxNet.hpp"
 #include "ByteStream.hpp"
@@ -16,7 +17,9 @@ namespace FoxNet {
 
     /*
     * reserved packet ids for internal packets
-    * we have room for up to 256 different packet types (including user-defined packets)
+    * we have room for up to 256 different packet types (including user-defined packets). ids below
+    * PKTID_USER_PACKET_START are reserved for FoxNet, new internal packets are added there so user packet ids
+    * never move (changing an internal id is a protocol change, bump FOXNET_VERSION_MAJOR with it)
     * to start your user-defined packet id enum, do like so:
     * enum {
     *     USERPACKET1 = PKTID_USER_PACKET_START,
@@ -30,16 +33,110 @@ namespace FoxNet {
         PKTID_PING,
         PKTID_PONG, // (sent in response to PKTID_PING)
         PKTID_VAR_LENGTH, // uint32_t (pkt body size) & uint8_t (pkt ID) follows
-        PKTID_HANDSHAKE_REQ, // sends info like FoxNet version & endian flag
-        PKTID_HANDSHAKE_RES, // responds to PKTID_HANDSHAKE_REQ, tells if the handshake is accepted
+        // the handshake packets keep their ids & layout across versions, so peers on different versions can still turn each other down
+        PKTID_HANDSHAKE_REQ, // sends info like FoxNet version & endian flag, PKTID_SESSION_REQ follows
+        PKTID_HANDSHAKE_RES, // responds to PKTID_SESSION_REQ (or to PKTID_HANDSHAKE_REQ on a version mismatch), tells if the handshake is accepted
+        PKTID_RPC_REQ, // (var) uint32_t (request id) & uint8_t (method) follows, then the method's arguments
+        PKTID_RPC_RES, // (var) uint32_t (request id) & uint8_t (RPCStatus) follows, then the method's response
+        PKTID_LARGE_DATA, // uint8_t (pkt ID), uint32_t (total size), uint32_t (offset) & uint32_t (size) follows, then size bytes of payload. see FoxPeer::sendFile()
+        PKTID_SNAPSHOT, // (var) uint32_t (seq) & uint32_t (baseline seq) follows, then the delta. see FoxSnapshotSender
+        PKTID_SNAPSHOT_ACK, // uint32_t (seq) follows, the newest snapshot we got
+        PKTID_AGGREGATE, // uint16_t (frame size) follows, then packets back to back: uint8_t (pkt ID), a varint body size (var packets only) & the body. see FoxPeer::setAggregation()
         // ======= CLIENT TO SERVER PACKETS =======
+        PKTID_SESSION_REQ, // uint32_t (the PeerCapability bits we offer) & uint64_t (resumption token, 0 for none) follows
+        PKTID_SHM_REQ, // asks to move the connection onto shared memory, see FoxClient::connectUnix()
         // ======= SERVER TO CLIENT PACKETS =======
-        PKTID_USER_PACKET_START, // marks the start of user packets
+        PKTID_SESSION_RES, // follows an accepting PKTID_HANDSHAKE_RES, uint32_t (the capabilities both sides have), uint8_t (resumed) & uint64_t (next resumption token) follows
+        PKTID_SHM_RES, // uint8_t (accepted) follows, the segment's fds are passed along with it
+        PKTID_DATAGRAM_OFFER, // uint32_t (session), uint64_t (token) & uint16_t (udp port) follows, see FoxDatagram
+        PKTID_DATAGRAM_ACK, // the client's hello datagram made it, datagrams can be sent both ways
+        PKTID_USER_PACKET_START = 64, // marks the start of user packets, pinned so internal packets have room to grow
     } PEER_PACKET_ID;
 
+    /*
+    * capability bits exchanged in the handshake, each side offers the ones it supports & the server answers with the
+    * ones both sides have (see FoxPeer::getCapabilities()). the bits are laid out per major version, a newer minor
+    * version only adds bits, which older peers just leave out of the answer
+    */
+    typedef enum {
+        CAP_INTEGRITY = 1 << 0, // CRC32C checked frames both ways, see FoxPeer::setIntegrity()
+        CAP_AGGREGATE = 1 << 1, // can receive PKTID_AGGREGATE frames, see FoxPeer::setAggregation()
+        CAP_RESUME = 1 << 2, // the server hands out resumption tokens, see FoxServer::enableResumption()
+        CAP_USER_START = 1 << 16 // marks the start of user capabilities, see FoxPeer::setCapabilities()
+    } PeerCapability;
+
+    /*
+    * outbound lanes, each peer keeps a separate send queue per lane. the control lane is always flushed first,
+    * the remaining lanes share the connection by weight (see FoxPeer::setLaneShare()). lanes are interleaved at
+    * packet boundaries, so packets written to the same lane are always received in the order they were written.
+    */
+    typedef enum {
+        PKTLANE_CONTROL, // internal & latency critical packets (pings, handshakes, acks)
+        PKTLANE_REALTIME, // default lane
+        PKTLANE_BULK, // large transfers (state blobs, assets, etc.)
+        PKTLANE_DATAGRAM, // sent over the datagram channel once it's up, otherwise (or if it's too big) like PKTLANE_REALTIME
+        PKTLANE_MAX
+    } PktLane;
+
+    /*
+    * how a packet id may be delivered, set on the receiving side (see FoxPeer::setPacketDelivery()). only packets
+    * that aren't reliable are accepted from the datagram channel, they can also still arrive over the stream
+    */
+    typedef enum {
+        PKTDELIVERY_RELIABLE, // only over the stream (default)
+        PKTDELIVERY_UNRELIABLE, // datagrams too, can be lost or arrive out of order
+        PKTDELIVERY_SEQUENCED, // datagrams too, can be lost but anything older than the newest one received is dropped
+    } PktDelivery;
+
     typedef void (*PktHandler)(FoxPeer *peer);
     typedef void (*PktVarHandler)(FoxPeer *peer, PktSize size);
 
+    /*
+    * rpc methods have their own id space, so they don't eat into the packet ids
+    */
+    typedef Byte RPCMethod;
+    typedef uint32_t RPCID;
+
+    typedef enum {
+        RPC_OK,
+        RPC_NOMETHOD, // the peer doesn't have a handler for the requested method
+        RPC_TIMEOUT, // no response was received before the request's timeout (set locally)
+        RPC_DISCONNECTED, // the connection was lost before a response was received (set locally)
+    } RPCStatus;
+
+    // fired on the receiving peer, respond with prepareRPCResponse(id), now or later
+    typedef void (*RPCHandler)(FoxPeer *peer, RPCID id, PktSize size);
+
+    // fired on the requesting peer, the response body (if status is RPC_OK) is left in the stream to be read
+    typedef std::function<void(FoxPeer *peer, RPCStatus status, PktSize size)> RPCCallback;
+
+    // fired once the kernel is done with a large send's file or buffer (see FoxPeer::sendFile()), sent is false if
+    // it was dropped instead (eg. the peer was killed)
+    typedef std::function<void(FoxPeer *peer, bool sent)> LargeSendCallback;
+
+    /*
+    * one-shot peer waiters, these let code outside of the packet handlers (eg. coroutines, see FoxCoro.hpp) wait
+    * on a peer. waiters are always fired, if the peer is killed they're fired with the peer dead (check isAlive())
+    */
+    typedef enum {
+        PEERWAIT_PACKET, // fired instead of the packet's handler, the packet body is left in the stream to be read
+        PEERWAIT_FLUSH, // fired once everything queued has been handed to the kernel
+        PEERWAIT_READY, // fired once the handshake has been accepted
+    } PeerWaitEvent;
+
+    typedef void (*PeerWaitCallback)(void *ud, FoxPeer *peer, PktSize size);
+
+    /*
+    * what FoxPeer::handlePollIn() & co. ran into. only a dropped connection keeps a resumable session around (see
+    * FoxServer::enableResumption()), a peer that broke the protocol or was killed is gone for good
+    */
+    typedef enum {
+        PEERPOLL_OK,
+        PEERPOLL_DROPPED, // the connection was closed or failed
+        PEERPOLL_VIOLATION, // the peer broke the protocol (eg. a malformed packet or a frame that failed its CRC)
+        PEERPOLL_KILLED, // a handler kill()ed the peer
+    } PeerPollResult;
+
     struct PacketInfo {
         union {
             PktHandler handler;
@@ -47,8 +144,9 @@ namespace FoxNet {
         };
         PktSize size;
         bool variable; // is a variable length packet?
+        PktDelivery delivery;
 
-        PacketInfo(): handler(nullptr), size(0), variable(false) {}
+        PacketInfo(): handler(nullptr), size(0), variable(false), delivery(PKTDELIVERY_RELIABLE) {}
     };
 
     inline Byte isBigEndian() {
@@ -63,4 +161,9 @@ namespace FoxNet {
     inline int64_t getTimestamp() {
         return std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
     }
+
+    // monotonic clock in ms, use this for timeouts
+    inline int64_t getTicks() {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
 }
\ No newline at end of file
@@ -2,40 +2,306 @@
 
 #include <cstdio>
 #include <map>
+#include <deque>
+#include <list>
 #include <unordered_set>
+#include <unordered_map>
 
 #include "ByteStream.hpp"
 #include "FoxSocket.hpp"
 #include "FoxPacket.hpp"
 #include "FoxException.hpp"
 #include "FoxPoll.hpp"
+#include "FoxCapture.hpp"
+#include "FoxDatagram.hpp"
+#include "FoxSnapshot.hpp"
 
 #define FOXNET_PACKET_HANDLER(ID) HANDLER_##ID
 
 #define DEF_FOXNET_PACKET(ID) static void FOXNET_PACKET_HANDLER(ID)(FoxPeer *peer);
-#define DECLARE_FOXNET_PACKET(ID, className) void className::FOXNET_PACKET_HANDLER(ID)(FoxPeer *peer)
+#define DECLARE_FOXNET_PACKET(ID, className) void className::FOXNET_PACKET_HANDLER(ID)([[maybe_unused]] FoxPeer *peer)
 #define INIT_FOXNET_PACKET(ID, sz) PKTMAP[ID].handler = FOXNET_PACKET_HANDLER(ID); PKTMAP[ID].size = sz; PKTMAP[ID].variable = false;
 
 #define DEF_FOXNET_VAR_PACKET(ID) static void FOXNET_PACKET_HANDLER(ID)(FoxPeer *peer, PktSize varSize);
-#define DECLARE_FOXNET_VAR_PACKET(ID, className) void className::FOXNET_PACKET_HANDLER(ID)(FoxPeer *peer, PktSize varSize)
+#define DECLARE_FOXNET_VAR_PACKET(ID, className) void className::FOXNET_PACKET_HANDLER(ID)([[maybe_unused]] FoxPeer *peer, \
+    [[maybe_unused]] PktSize varSize)
 #define INIT_FOXNET_VAR_PACKET(ID) PKTMAP[ID].varhandler = FOXNET_PACKET_HANDLER(ID); PKTMAP[ID].size = 0; PKTMAP[ID].variable = true;
 
+#define DEF_FOXNET_RPC(ID) static void FOXNET_PACKET_HANDLER(ID)(FoxPeer *peer, RPCID rpcID, PktSize varSize);
+#define DECLARE_FOXNET_RPC(ID, className) void className::FOXNET_PACKET_HANDLER(ID)([[maybe_unused]] FoxPeer *peer, \
+    [[maybe_unused]] RPCID rpcID, [[maybe_unused]] PktSize varSize)
+#define INIT_FOXNET_RPC(ID) RPCMAP[ID] = FOXNET_PACKET_HANDLER(ID);
+
+// max amount of queued bytes handed to the socket per send, lanes can only preempt each other between these batches
+#define FOXNET_SEND_BATCH 16384
+
+// max amount of bytes read from the socket per recv()
+#define FOXNET_RECV_BATCH 16384
+
+// per-peer budgets for each pollIn, once a peer has read this many bytes or handled this many packets it's put
+// back in line behind the other peers (see FoxPollList::setReady()) so one busy peer can't starve the rest
+#ifndef FOXNET_RECV_BUDGET
+#define FOXNET_RECV_BUDGET (FOXNET_RECV_BATCH * 8)
+#endif
+
+#ifndef FOXNET_PACKET_BUDGET
+#define FOXNET_PACKET_BUDGET 1024
+#endif
+
+// large sends are framed in segments of up to this many bytes, lanes can only preempt a large send between segments
+#ifndef FOXNET_LARGE_SEGMENT
+#define FOXNET_LARGE_SEGMENT (64 * 1024)
+#endif
+
+// small var packets committed back to back on a lane are bundled into one PKTID_AGGREGATE frame of up to this many
+// bytes (header included), if their bodies are at most FOXNET_AGGREGATE_ENTRY bytes
+#ifndef FOXNET_AGGREGATE_MAX
+#define FOXNET_AGGREGATE_MAX 1024
+#endif
+
+#ifndef FOXNET_AGGREGATE_ENTRY
+#define FOXNET_AGGREGATE_ENTRY 64
+#endif
+
+#if FOXNET_AGGREGATE_MAX > MAX_PACKET_SIZE
+#error "FOXNET_AGGREGATE_MAX can't be larger than MAX_PACKET_SIZE"
+#endif
+
+// with integrity checks on, the stream is sent as frames of a uint32_t size & a uint32_t CRC32C followed by up to
+// FOXNET_INTEGRITY_FRAME bytes, see FoxPeer::setIntegrity()
+#define FOXNET_INTEGRITY_HEADER (sizeof(uint32_t) * 2)
+
+#ifndef FOXNET_INTEGRITY_FRAME
+#define FOXNET_INTEGRITY_FRAME (64 * 1024)
+#endif
+
+// default lane shares, under contention the realtime lane gets 8x the bandwidth of the bulk lane
+#define FOXNET_LANE_SHARE_REALTIME 8
+#define FOXNET_LANE_SHARE_BULK 1
+
 namespace FoxNet {
     class FoxPeer : public FoxSocket {
     private:
+        struct PendingRPC {
+            RPCCallback callback;
+            std::multimap<int64_t, RPCID>::iterator deadline; // rpcDeadlines.end() if there's no timeout
+        };
+
+        struct PeerWaiter {
+            PeerWaitEvent event;
+            PktID id;
+            PeerWaitCallback callback;
+            void *ud;
+        };
+
+        struct LargeSend {
+            PktID id;
+            int fd; // -1 if we're sending from data
+            uint64_t fileOffset;
+            const Byte *data;
+            uint32_t size;
+            uint32_t segments = 0; // segments still waiting on their payload to be handed to the kernel
+            int64_t zeroCopyLast = -1; // id of the payload's last MSG_ZEROCOPY send, -1 if there weren't any
+            LargeSendCallback callback;
+        };
+
+        struct OutChunk {
+            size_t size; // bytes in the lane's buf
+            LargeSend *large; // if set, the chunk ends with a large segment's header & its payload follows it
+            uint32_t offset; // (where the segment's payload starts)
+            uint32_t payload; // (size of the segment's payload)
+            bool transformed = false; // already went through onSend() (kept across a detach), see scheduleChunk()
+        };
+
+        struct OutLane {
+            std::vector<Byte> buf; // committed packets waiting to be scheduled
+            std::deque<OutChunk> chunks; // each committed chunk in buf
+            size_t head = 0; // start of the first unscheduled chunk in buf
+            uint64_t vtime = 0; // virtual finish time, the lane with the lowest vtime is scheduled next
+            uint16_t share = 1;
+            bool aggOpen = false; // the last chunk is a small var packet (or a frame of them) more can be bundled into
+            bool aggFramed = false; // (it's already a frame)
+            PktID aggID = PKTID_NONE; // (the lone var packet's id)
+        };
+
+        // a chunk in sendBuffer, positions count every byte that ever went through sendBuffer (see sendOffset)
+        struct SentChunk {
+            uint64_t start;
+            uint64_t end; // (integrity headers inside the chunk are counted)
+            PktLane lane;
+            bool large;
+        };
+
+        enum ShmState {
+            SHM_NONE,
+            SHM_REQUESTED, // (client) sent PKTID_SHM_REQ, waiting on the response
+            SHM_ACKING, // (server) reading from the transport, writing to the socket until PKTID_SHM_RES is sent
+            SHM_ACTIVE // both directions are on the transport
+        };
+
+        enum RecvState {
+            RECV_ID, // waiting on a packet id
+            RECV_VAR_SIZE, // got PKTID_VAR_LENGTH, waiting on the size
+            RECV_VAR_ID, // waiting on the var packet's id
+            RECV_BODY, // waiting on pktSize bytes of body
+            RECV_LARGE_HEADER, // got PKTID_LARGE_DATA, waiting on the segment's header
+            RECV_LARGE_BODY, // handing the segment's payload over as it arrives
+            RECV_AGG_SIZE, // got PKTID_AGGREGATE, waiting on the frame size
+            RECV_AGG_BODY // waiting on pktSize bytes of bundled packets
+        };
+
         PktID currentPkt = PKTID_NONE;
-        PktSize pktSize;
-        bool setPollOut = false;
+        PktSize pktSize = 0;
+        RecvState recvState = RECV_ID;
+        std::vector<Byte> recvBuffer; // raw bytes from the socket that haven't been parsed yet
+        size_t recvHead = 0; // start of the unparsed bytes in recvBuffer
+        size_t recvChecked = 0; // (with integrityIn) end of the bytes in recvBuffer that passed their frame's check
+        PktID varPacketID = PKTID_NONE; // id of the var packet being written, see prepareVarPacket()
+        PktID largeInID = PKTID_NONE; // the large segment being received, see onLargePacket()
+        uint32_t largeInTotal = 0;
+        uint32_t largeInOffset = 0;
+        uint32_t largeInLeft = 0;
+
+        FoxCapture *capture = nullptr;
+        uint32_t captureID = 0;
+
+        OutLane lanes[PKTLANE_MAX];
+        PktLane writeLane = PKTLANE_REALTIME;
+        uint64_t laneClock = 0; // vtime of the last scheduled chunk
+        bool aggregate = true; // bundle small var packets, see setAggregation()
+        std::vector<Byte> sendBuffer; // scheduled bytes currently being written to the socket
+        size_t sendFramed = 0; // bytes at the start of sendBuffer that are already framed (or were sent before framing)
+        uint64_t sendOffset = 0; // bytes handed to the kernel from sendBuffer so far
+        std::deque<SentChunk> sentChunks; // (with a resume token) the chunks in sendBuffer, see detachConnection()
+        std::deque<uint64_t> sentHeaders; // (with a resume token) where the integrity headers in sendBuffer start
+
+        bool integrityIn = false; // the other end's bytes come in checked frames
+        bool integrityOut = false; // we send ours in checked frames
+        size_t integrityMark = 0; // control lane chunks left to schedule before framing starts
+
+        std::list<LargeSend> largeSends; // queued, or waiting on their completion
+        LargeSend *largeActive = nullptr; // the large segment whose payload is being sent, its header already was
+        uint32_t largeOffset = 0;
+        uint32_t largeLeft = 0;
+        uint64_t largePending = 0; // payload bytes of large sends not yet handed to the kernel
+        uint32_t zeroCopyDone = 0; // every MSG_ZEROCOPY send before this id has completed
+        std::map<uint32_t, uint32_t> zeroCopyRanges; // completions that arrived past zeroCopyDone, first id -> last id
+
+        std::unordered_map<RPCID, PendingRPC> pendingRPCs;
+        std::multimap<int64_t, RPCID> rpcDeadlines; // ordered by deadline, so timeouts are cheap to check
+        RPCID nextRPCID = 1;
+
+        std::vector<PeerWaiter> waiters;
+
+        ShmState shmState = SHM_NONE;
+        bool shmWanted = false;
+        bool shmRegister = false; // the transport still needs to be added to the poll list
+        size_t switchMark = 0; // control lane chunks left to schedule before sending is held
+        bool sendHeld = false; // nothing else is scheduled until the switch to the transport is done
+
+        struct sockaddr_storage datagramAddr; // (server) the client's address, bound by its hello
+        socklen_t datagramAddrLen = 0;
+        uint32_t datagramSeqOut = 1; // 0 is the hello
+        uint32_t datagramSeqIn = 0; // sequence number of the datagram being dispatched, 0 if we're dispatching the stream
+        std::unordered_map<PktID, uint32_t> sequencedIn; // newest sequence number dispatched per PKTDELIVERY_SEQUENCED id
+        std::vector<Byte> datagramBuffer; // holds the stream's unparsed bytes while a datagram is parsed
+
+        std::deque<FoxSnapshot> snapshotsIn; // snapshots we got, newest last, kept as baselines for the next ones
+        uint32_t snapshotAcked = 0; // newest snapshot the other end acked, see FoxSnapshotSender
+
+        bool recvHeld = false; // (server) the handshake resumed a session, what's left is parsed by the session's peer
+
+        void dispatchPacket(void); // runs the handler (or waiter) of currentPkt, the body is in the in buffer
+        // dispatches every complete packet in recvBuffer (or until budget runs out, if given), returns false on a
+        // malformed packet
+        bool parseIn(size_t *budget = nullptr);
+        // checks & strips the headers of arrived integrity frames until need bytes are checked past recvHead, returns
+        // false if one failed
+        bool checkFrames(size_t need);
+        void sealFrames(void); // frames the unframed bytes at the end of sendBuffer
+        // dispatches the packets bundled in a PKTID_AGGREGATE frame, returns false if it was malformed
+        bool dispatchAggregate(Byte *data, size_t sz, size_t *budget);
+        bool scheduleChunk(void); // moves the next chunk from the lanes into sendBuffer, returns false if the lanes are empty
+        PktLane commitTarget(size_t sz); // the lane a chunk of sz bytes written to writeLane is committed to
+        void commitChunk(LargeSend *large, uint32_t offset, uint32_t payload); // see commitPacket()
+        void commitVarPacket(PktID id, size_t body); // commits the var packet in the out buffer, bundling it if it's small
+        void bundleVarPacket(OutLane &lane, PktID id, size_t body); // appends it to the frame at the end of lane
+        void queueLarge(LargeSend &&send, PktLane lane); // splits a large send into segments on lane
+        RawSockCode sendLarge(void); // sends the payload of largeActive, right behind its header
+        void dispatchLarge(Byte *data, size_t sz); // hands a piece of the large segment being received to onLargePacket()
+        void finishLargeSends(bool cancel); // fires the callbacks of large sends the kernel is done with (or of all of them)
+        bool fireWaiter(PeerWaitEvent event, PktID id, PktSize size); // fires the oldest matching waiter, returns false if there wasn't one
+        void fireWaiters(PeerWaitEvent event); // fires every waiter waiting on event
+        void failWaiters(void); // fires every waiter with the peer dead, exceptions they throw are logged & dropped
+        void holdSendAfter(void); // holds sending once the last packet written to the control lane is scheduled
+        void requestShm(void);
 
         DEF_FOXNET_PACKET(PKTID_PING)
         DEF_FOXNET_PACKET(PKTID_PONG)
         DEF_FOXNET_PACKET(PKTID_HANDSHAKE_RES)
         DEF_FOXNET_PACKET(PKTID_HANDSHAKE_REQ)
+        DEF_FOXNET_PACKET(PKTID_SESSION_RES)
+        DEF_FOXNET_PACKET(PKTID_SESSION_REQ)
+        DEF_FOXNET_VAR_PACKET(PKTID_RPC_REQ)
+        DEF_FOXNET_VAR_PACKET(PKTID_RPC_RES)
+        DEF_FOXNET_PACKET(PKTID_SHM_REQ)
+        DEF_FOXNET_PACKET(PKTID_SHM_RES)
+        DEF_FOXNET_PACKET(PKTID_DATAGRAM_OFFER)
+        DEF_FOXNET_PACKET(PKTID_DATAGRAM_ACK)
+        DEF_FOXNET_VAR_PACKET(PKTID_SNAPSHOT)
+        DEF_FOXNET_PACKET(PKTID_SNAPSHOT_ACK)
 
     protected:
         PacketInfo PKTMAP[UINT8_MAX+1];
+        RPCHandler RPCMAP[UINT8_MAX+1];
         SOCKET sock;
         bool handshook = false;
+        bool versionMatched = false; // PKTID_HANDSHAKE_REQ/RES went through, the PKTID_SESSION_* packets can follow
+        bool integrityWanted = false; // see setIntegrity()
+        uint32_t userCaps = 0; // see setCapabilities()
+        uint32_t caps = 0; // negotiated in the handshake, see getCapabilities()
+        bool resumable = false; // offer CAP_RESUME in the handshake
+        bool resumed = false; // see isResumed()
+        uint64_t resumeToken = 0; // see getResumeToken()
+        bool setPollOut = false; // are we waiting on POLLOUT? (the kernel's send buffer is full)
+
+        FoxDatagram *datagram = nullptr; // our datagram channel, the server's socket or our own (see datagramOwned)
+        bool datagramOwned = false;
+        bool datagramWanted = false; // (client) take the server up on its offer
+        bool datagramReady = false; // is PKTLANE_DATAGRAM going over the datagram channel?
+        uint32_t datagramSession = 0;
+        uint64_t datagramToken = 0;
+
+        // (client) the server offered a datagram channel on port, set up datagram & send the hello
+        virtual void acceptDatagramOffer(uint16_t port);
+
+        // everything sent after the last packet written to the control lane goes out in integrity frames
+        void frameSendAfter(void);
+
+        // (client) commits the handshake request written to the control lane ahead of anything already queued, packets
+        // written before connecting are pipelined right behind it
+        void queueHandshake(void);
+
+        uint32_t getOfferedCaps(void); // the PeerCapability bits we offer in the handshake
+
+        /*
+         * (server) fired by an accepted handshake that negotiated CAP_RESUME with the client's token (0 if it didn't
+         * have one). returns the token the client is handed for next time, & sets resumed if token named a detached
+         * session the connection is handed over to. see FoxServer::enableResumption()
+         */
+        virtual uint64_t resumeSession(uint64_t token, bool &resumed);
+
+        /*
+         * (server) the connection dropped but the session is kept for the client to resume: kills the socket & resets
+         * everything tied to the connection, but keeps whole packets queued on the lanes. whatever was already in the
+         * send batch may have been half sent, so it's dropped along with large sends (their payload isn't ours to
+         * keep). rpcs we sent are failed with RPC_DISCONNECTED & waiters are fired with us dead
+         */
+        void detachConnection(void);
+
+        // (server) takes over fresh's connection, along with what the client pipelined behind its handshake & our
+        // response, which goes out ahead of everything we queued while detached. fresh is left dead
+        void takeConnection(FoxPeer *fresh);
 
         bool isPacketVar(PktID);
         PktSize getPacketSize(PktID);
@@ -44,6 +310,21 @@ namespace FoxNet {
 
     public:
         FoxPeer(void);
+        ~FoxPeer(void);
+
+        /*
+         * The body of the packet being handled, read in place out of our receive buffer (already passed through
+         * onRecv()). only valid until the handler returns, an empty view outside of one. reads through the peer
+         * (readInt() etc.) come from the same bytes, the view has its own cursor
+         */
+        ByteView getPacketView(void);
+
+        /*
+         * Writes a whole packet, eg. to forward one from another peer's getPacketView() without copying it out first.
+         * id has to be registered on this peer, and body has to match its size if it isn't a var packet
+         * NOTE: this function can throw a FoxException!
+         */
+        void writePacket(PktID id, const ByteView &body);
 
         /*
          * This should be called prior to writing packet data to the stream.
@@ -58,14 +339,185 @@ namespace FoxNet {
          */
         void patchVarPacket(size_t indx);
 
+        /*
+         * Selects the lane following writes are queued to, anything written to the previous lane is committed first.
+         * returns: the previously selected lane, so internal writes can restore it
+         */
+        PktLane setLane(PktLane lane);
+        PktLane getLane(void);
+
+        // sets the relative bandwidth share of a non-control lane
+        void setLaneShare(PktLane lane, uint16_t share);
+
+        /*
+         * Marks the end of a packet, lanes can only be interleaved between committed packets. patchVarPacket() and
+         * setLane() commit automatically, anything left uncommitted is committed as one chunk on the next flush.
+         */
+        void commitPacket(void);
+
+        // bytes written but not yet handed to the kernel
+        size_t pendingOut(void);
+
+        /*
+         * Small var packets (bodies of up to FOXNET_AGGREGATE_ENTRY bytes) committed back to back on the same lane
+         * are bundled into a PKTID_AGGREGATE frame until the lane is flushed, each packet's 4 byte header shrinks to
+         * its id & a varint size and the other end dispatches the whole frame in one pass. a lone packet is sent as
+         * is. only once the other end offered CAP_AGGREGATE in the handshake, on by default. frames go through
+         * onSend() like everything else, turn this off to keep every packet in its own frame on the wire
+         */
+        void setAggregation(bool enabled);
+        bool getAggregation(void);
+
+        /*
+         * Checks the whole stream (after the handshake) with CRC32C on top of tcp's checksum, for links where
+         * corruption slips through anyways (eg. buggy middleboxes). everything is sent in frames of a flush batch
+         * each, checked before any packet in them is dispatched, a frame that fails kills the peer (counted by
+         * FoxMetrics). large payloads (see sendFile()) are never copied through us, so they aren't covered.
+         * (client) asks for it in the handshake, call before connecting. (server) the server always honors it,
+         * a peer set to want it (eg. from onNewPeer()) rejects handshakes that don't ask for it
+         */
+        void setIntegrity(bool enabled);
+        bool isIntegrityActive(void);
+
+        /*
+         * Sets the user capability bits (CAP_USER_START & up) we offer in the handshake, eg. for compression or
+         * encryption done in onSend()/onRecv(). call before connecting (client) or from onNewPeer() (server).
+         * packets can be pipelined behind the handshake request, so anything the client writes before onReady() can't
+         * depend on the outcome
+         */
+        void setCapabilities(uint32_t bits);
+
+        // the PeerCapability bits both sides offered, 0 until the handshake is done
+        uint32_t getCapabilities(void);
+        bool hasCapability(uint32_t cap);
+
+        /*
+         * The token the server handed out in the handshake (if both sides offered CAP_RESUME), 0 if there isn't one.
+         * a client that drops can present it to reconnect to its session, see FoxClient::enableResumption(). each
+         * token is only good once, the next one comes with the resumed handshake
+         */
+        uint64_t getResumeToken(void);
+
+        // did the handshake take back over a detached session? (check it from onReady() to skip eg. logging in again)
+        bool isResumed(void);
+
+        /*
+         * Sends size bytes of fd (starting at offset) as a large packet, without copying them through userspace
+         * (sendfile() on linux). the payload is split into FOXNET_LARGE_SEGMENT segments that each get a small header,
+         * lanes only preempt it between segments. callback is fired once the kernel is done with the file, so fd has
+         * to stay open until then. the payload skips onSend() & onRecv(), only its framing passes through them.
+         * the other end gets it through onLargePacket()
+         */
+        void sendFile(PktID id, int fd, uint64_t offset, uint32_t size, LargeSendCallback callback = nullptr, PktLane lane = PKTLANE_BULK);
+
+        /*
+         * Like sendFile(), but from a buffer the kernel sends from in place with MSG_ZEROCOPY (linux tcp, otherwise
+         * it's copied like any other send). data has to stay untouched until callback is fired, which for zerocopy
+         * is once the completions for all of it have shown up in the socket's error queue (see handlePollErr())
+         */
+        void sendZeroCopy(PktID id, const Byte *data, uint32_t size, LargeSendCallback callback = nullptr, PktLane lane = PKTLANE_BULK);
+
+        /*
+         * Starts an rpc request, write the method's arguments to the stream then call patchVarPacket() with the
+         * result. any number of requests can be outstanding at once, and responses may arrive in any order.
+         * callback is fired exactly once: with the response, or on timeout (in ms, -1 for none) or disconnect.
+         */
+        size_t prepareRPC(RPCMethod method, RPCCallback callback, int timeout = -1);
+
+        /*
+         * Starts the response to an rpc request, write the response then call patchVarPacket() with the result.
+         * this doesn't need to be called from the method's handler, responses can be sent out of order.
+         */
+        size_t prepareRPCResponse(RPCID id, RPCStatus status = RPC_OK);
+
+        // fires the callbacks of requests that have timed out, or of every request if we've been killed
+        void checkRPCTimeouts(void);
+
+        // clamps a poll timeout (in ms) so we wake up for the next rpc deadline
+        int getRPCTimeout(int timeout);
+
+        size_t getPendingRPCs(void);
+
+        // registers a packet without a handler, for packets that are only ever waited on (see addWaiter())
+        void registerPacket(PktID id, PktSize size);
+        void registerVarPacket(PktID id);
+
+        // lets id be received over the datagram channel, see PktDelivery
+        void setPacketDelivery(PktID id, PktDelivery delivery);
+
+        // registers a one-shot waiter, id is only used for PEERWAIT_PACKET
+        void addWaiter(PeerWaitEvent event, PktID id, PeerWaitCallback callback, void *ud);
+
+        // fires every waiter with the peer dead (& the callbacks of unfinished large sends), call this once the peer
+        // has been killed. a waiter that throws doesn't stop the rest, the exception is logged & dropped
+        void cancelWaiters(void);
+
         // events
         virtual void onReady(void); // fired when we got a handshake response from the server and it went well :)
         virtual void onStep(void); // fired when sendStep() is called
         virtual void onPing(int64_t peerTime, int64_t currTime); // fired when PKTID_PING is received
         virtual void onPong(int64_t peerTime, int64_t currTime); // fired when PKTID_PONG is received
 
-        bool handlePollIn(FoxPollList &plist);
-        bool handlePollOut(FoxPollList &plist);
+        // fired for each piece of a large packet as it arrives, in order. offset is where data starts in the payload
+        // & total is the size of the whole payload. data is only valid until we return
+        virtual void onLargePacket(PktID id, uint32_t offset, uint32_t total, ByteView data);
+
+        // fired when a snapshot from a FoxSnapshotSender arrives, older ones than the newest we got are dropped
+        virtual void onSnapshot(const FoxSnapshot &snap);
+
+        PeerPollResult handlePollIn(FoxPollList &plist);
+        PeerPollResult handlePollOut(FoxPollList &plist);
+
+        // drains the socket's error queue (zerocopy completions), PEERPOLL_DROPPED if the socket has failed
+        PeerPollResult handlePollErr(FoxPollList &plist);
+
+        /*
+         * Handles raw bytes as if they were just received from the socket, they're passed through onRecv() and
+         * every complete packet is dispatched. used by FoxReplay, returns false if the stream is malformed
+         * NOTE: this function can throw a FoxException!
+         */
+        bool feedIn(const Byte *data, size_t sz);
+
+        /*
+         * Asks the server to move us onto a FoxShmTransport once the handshake is accepted, only honored on unix
+         * sockets on the same host. packets written meanwhile are held back and sent over the new transport
+         */
+        void setWantShm(bool want);
+
+        // are both directions on shared memory?
+        bool isShmActive(void);
+
+        // (server) ties us to a datagram socket, the channel is offered once the handshake is accepted
+        void setDatagramChannel(FoxDatagram *dgram, uint32_t session, uint64_t token);
+        uint32_t getDatagramSession(void);
+        bool isDatagramReady(void);
+
+        // (server) binds the sender's address to our session if the hello's token matches, returns false if it didn't
+        bool handleDatagramHello(const FoxDatagram::Message &msg);
+
+        // is addr the address bound by our hello?
+        bool isDatagramFrom(const struct sockaddr *addr, socklen_t addrLen);
+
+        /*
+         * Dispatches the packets in a datagram (header included) like they came from the stream, packets that
+         * aren't allowed over datagrams (or are stale, see PKTDELIVERY_SEQUENCED) are skipped. onRecv() is called on
+         * datagrams too, so it can't depend on the position in the stream.
+         * NOTE: this function can throw a FoxException!
+         */
+        void handleDatagram(const Byte *data, size_t sz);
+
+        // packs everything committed to PKTLANE_DATAGRAM into datagrams, they don't wait on the stream
+        void flushDatagrams(void);
+
+        // drops everything written but not yet sent, unfinished large sends are fired as not sent
+        void discardOut(void);
+
+        // newest snapshot seq the other end acked, 0 if none
+        uint32_t getSnapshotAck(void);
+
+        // starts recording our inbound traffic to cap (or stops, if cap is nullptr). cap must outlive the capture
+        void setCapture(FoxCapture *cap);
+        FoxCapture *getCapture(void);
 
         SOCKET getRawSock(void);
         bool getHandshake(void);
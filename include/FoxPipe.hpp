@@ -0,0 +1,82 @@
+#pragma once
+
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "FoxTransport.hpp"
+
+// default bytes in flight (per direction) before FoxPipe::send() would block
+#define FOXPIPE_DEFAULT_CAPACITY (256 * 1024)
+
+namespace FoxNet {
+    struct FoxPipeOptions {
+        int latency = 0; // ms before written bytes can be read by the other end
+        size_t bandwidth = 0; // bytes per second (per direction), 0 for unlimited
+        size_t capacity = FOXPIPE_DEFAULT_CAPACITY; // bytes in flight (per direction) before send() would block
+        size_t maxRead = 0; // caps every recv() to this many bytes (0 for no cap), forces partial reads
+        size_t maxWrite = 0; // caps every send() to this many bytes (0 for no cap), forces partial writes
+    };
+
+    /*
+     * In-memory FoxTransport, made in connected pairs
+     *
+     *  Lets a FoxServer & FoxClient talk without the kernel, either on the same thread or across threads. the pipe
+     * can simulate latency, a bandwidth cap & partial reads/writes, a small capacity makes every send hit the
+     * POLLOUT path. eg.
+     *
+     *  auto pipe = FoxPipe::create();
+     *  server.acceptTransport(pipe.first);
+     *  client.connectTransport(pipe.second);
+     */
+    class FoxPipe : public FoxTransport {
+    private:
+        struct Chunk {
+            int64_t readyAt; // ns (steady clock), 0 if it can be read right away
+            std::vector<Byte> data;
+            size_t head = 0;
+        };
+
+        // one direction of the pipe
+        struct Flow {
+            std::deque<Chunk> chunks;
+            size_t inFlight = 0;
+            int64_t linkFree = 0; // when the bandwidth capped link is done sending what's already queued
+            bool writerClosed = false;
+            bool readerClosed = false;
+            FoxPollList *reader = nullptr; // woken when data is sent
+            FoxPollList *writer = nullptr; // woken when room frees up
+        };
+
+        struct Shared {
+            std::mutex lock;
+            FoxPipeOptions opts;
+            Flow flows[2]; // flows[i] is read by end i
+        };
+
+        std::shared_ptr<Shared> shared;
+        int side;
+
+        FoxPipe(std::shared_ptr<Shared> s, int sd);
+
+        Flow &inFlow(void) { return shared->flows[side]; }
+        Flow &outFlow(void) { return shared->flows[side ^ 1]; }
+
+    public:
+        // returns both ends of a new pipe, whoever gets an end owns it (FoxSocket::setTransport() takes ownership)
+        static std::pair<FoxPipe*, FoxPipe*> create(const FoxPipeOptions &opts = FoxPipeOptions());
+
+        ~FoxPipe(void);
+
+        int recv(Byte *buf, size_t sz);
+        int send(const Byte *buf, size_t sz);
+        void close(void);
+
+        bool readable(void);
+        bool writable(void);
+        int pollTimeout(void);
+        void setPollList(FoxPollList *list);
+    };
+}
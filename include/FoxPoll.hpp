@@ -1,17 +1,24 @@
 #pragma once
 
+#include <atomic>
 #include <iterator>
 #include <cstddef>
+#include <unordered_map>
+#include <unordered_set>
 
 #include "FoxSocket.hpp"
 
+// without a wake fd (windows), sockets on a FoxTransport are re-checked at least this often (in ms)
+#define FOXNET_TRANSPORT_POLL_INTERVAL 1
+
 namespace FoxNet {
     struct FoxPollEvent {
         FoxSocket *sock;
         bool pollIn;
         bool pollOut;
+        bool pollErr; // the socket's error queue has something for us (eg. zerocopy completions), or it failed
 
-        FoxPollEvent(FoxSocket*, bool, bool);
+        FoxPollEvent(FoxSocket*, bool, bool, bool = false);
     };
 
     class FoxPollList {
@@ -23,8 +30,29 @@ namespace FoxNet {
         std::vector<PollFD> fds; // raw poll descriptor
 #endif
         std::map<SOCKET, FoxSocket*> sockMap;
+        struct TransportEntry {
+            bool pollOut = false;
+            int wakeFd = -1; // the transport's getWakeFd()
+            bool fdOut = false; // events on an upgraded socket's fd, merged into the transport's events
+            bool fdHup = false;
+        };
+
+        std::unordered_map<FoxSocket*, TransportEntry> transportSocks; // sockets on a FoxTransport
+        std::unordered_set<FoxSocket*> readySocks; // stopped reading before they were drained, see setReady()
+        SOCKET wakeRead = INVALID_SOCKET; // readable after a wake(), see enableWake()
+        SOCKET wakeWrite = INVALID_SOCKET;
+        std::atomic<bool> wakePending{false}; // skips the syscall if the wake fd is already readable
+        bool edgeTriggered = false;
 
         void _setup(size_t res);
+        bool transportsReady(void);
+        void pollTransports(std::vector<FoxPollEvent> &events);
+        int getTransportTimeout(int timeout);
+        void addTransportEntry(FoxSocket *sock);
+        void modSock(FoxSocket *sock, bool pollOut);
+        void drainFd(int fd);
+        void drainWake(void);
+        void pollReady(std::vector<FoxPollEvent> &events);
 
     public:
         FoxPollList(void);
@@ -33,10 +61,35 @@ namespace FoxNet {
 
         void addSock(FoxSocket*);
         void rmvSock(FoxSocket*);
+
+        // starts polling the transport of a socket that's already in the list (see FoxSocket::upgradeTransport()),
+        // call this once its reads have switched to the transport
+        void addTransport(FoxSocket*);
         void addPollOut(FoxSocket*);
         void rmvPollOut(FoxSocket*);
 
+        /*
+         * Switches every socket (current & future) to edge-triggered epoll (linux only, a no-op elsewhere). read &
+         * write interest stay registered for good so addPollOut()/rmvPollOut() no longer cost a syscall, but an event
+         * is only reported when new data (or room) shows up: whoever handles it has to read until EAGAIN, or
+         * setReady() the socket if it stops early (eg. it ran out of its budget)
+         */
+        void enableEdgeTriggered(void);
+        bool isEdgeTriggered(void);
+
+        // the socket still has data to handle, it gets a pollIn event from the next pollList() (which won't sleep)
+        void setReady(FoxSocket*);
+
         std::vector<FoxPollEvent> pollList(int timeout);
+        void pollList(int timeout, std::vector<FoxPollEvent> &events); // same as above, but reuses the caller's event vector
         std::vector<FoxSocket*> getList(void);
+
+        // sets up the wake fd, this is done for you when a socket on a FoxTransport is added. (only call this from
+        // the polling thread)
+        void enableWake(void);
+
+        // interrupts a pollList() that's sleeping (or makes the next one return right away), safe to call from any
+        // thread once enableWake() was called
+        void wake(void);
     };
 }
\ No newline at end of file
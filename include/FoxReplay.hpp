@@ -0,0 +1,120 @@
+#pragma once
+
+#include <thread>
+#include <unordered_map>
+
+#include "FoxNet.hpp"
+#include "FoxPeer.hpp"
+#include "FoxCapture.hpp"
+
+namespace FoxNet {
+    struct FoxReplayStats {
+        uint64_t peers = 0;
+        uint64_t records = 0;
+        uint64_t bytes = 0;
+        uint64_t failedPeers = 0; // peers whose stream was malformed, or whose handlers threw
+        double seconds = 0;
+    };
+
+    /*
+     * Plays a capture (see FoxServer::startCapture()) back through fresh peers, without any sockets
+     *
+     *  Every captured peer gets a new peerType, and its recorded bytes are fed through FoxPeer::feedIn() so they hit
+     * the same parsing & dispatch path as live traffic. anything the handlers write is discarded. Use this to
+     * benchmark or profile handler changes against real traffic:
+     *
+     *  FoxReplay<ExamplePeer> replay("traffic.foxcap");
+     *  FoxReplayStats stats = replay.replay();
+     */
+    template<typename peerType>
+    class FoxReplay {
+    private:
+        FoxCaptureReader reader;
+        std::unordered_map<uint32_t, peerType*> peers;
+
+        void dropPeer(uint32_t id) {
+            auto iter = peers.find(id);
+            if (iter == peers.end())
+                return;
+
+            onPeerDisconnect(iter->second);
+            iter->second->cancelWaiters();
+            delete iter->second;
+            peers.erase(iter);
+        }
+
+    public:
+        // NOTE: this function can throw a FoxException!
+        FoxReplay(const std::string &path): reader(path) {}
+
+        virtual ~FoxReplay() {
+            for (auto &pair : peers)
+                delete pair.second;
+        }
+
+        /*
+         * feeds the whole capture through, as fast as possible or (if paced) keeping the original timing between
+         * records. this is single threaded & deterministic, the same capture always dispatches the same packets
+         * NOTE: this function can throw a FoxException! (corrupt capture)
+         */
+        FoxReplayStats replay(bool paced = false) {
+            FoxReplayStats stats;
+            FoxCaptureRecord record;
+            auto start = std::chrono::steady_clock::now();
+
+            while (reader.next(record)) {
+                stats.records++;
+
+                if (paced) {
+                    std::this_thread::sleep_until(start + std::chrono::nanoseconds(record.time));
+                }
+
+                switch (record.type) {
+                    case CAPTURE_OPEN: {
+                        peerType *peer = new peerType();
+
+                        dropPeer(record.peer);
+                        peers[record.peer] = peer;
+                        stats.peers++;
+                        onNewPeer(peer);
+                        break;
+                    }
+                    case CAPTURE_DATA: {
+                        auto iter = peers.find(record.peer);
+                        if (iter == peers.end()) // the peer already failed
+                            break;
+
+                        peerType *peer = iter->second;
+                        stats.bytes += record.data.size();
+
+                        try {
+                            if (!peer->feedIn(record.data.data(), record.data.size())) {
+                                stats.failedPeers++;
+                                dropPeer(record.peer);
+                                break;
+                            }
+                        } catch(...) {
+                            stats.failedPeers++;
+                            dropPeer(record.peer);
+                            break;
+                        }
+
+                        // there's no one to send responses to
+                        peer->discardOut();
+                        break;
+                    }
+                    case CAPTURE_CLOSE:
+                        dropPeer(record.peer);
+                        break;
+                }
+            }
+
+            stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            return stats;
+        }
+
+        // events, same as FoxServer's
+        virtual void onNewPeer(peerType *peer) {}
+        virtual void onPeerDisconnect(peerType *peer) {}
+    };
+}
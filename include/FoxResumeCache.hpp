@@ -0,0 +1,62 @@
+#pragma once
+
+#include <map>
+#include <random>
+#include <unordered_map>
+
+#include "FoxPacket.hpp"
+
+// defaults for FoxServer::enableResumption(), ms a detached session is kept & how many are kept at once
+#ifndef FOXNET_RESUME_TIMEOUT
+#define FOXNET_RESUME_TIMEOUT (30 * 1000)
+#endif
+
+#ifndef FOXNET_RESUME_MAX
+#define FOXNET_RESUME_MAX 1024
+#endif
+
+// a peer with more than this queued when its connection drops isn't worth keeping, it's dropped like usual
+#ifndef FOXNET_RESUME_MAX_QUEUE
+#define FOXNET_RESUME_MAX_QUEUE (1024 * 1024)
+#endif
+
+namespace FoxNet {
+    class FoxServerPeer;
+
+    /*
+     * Detached sessions waiting on their client to reconnect, see FoxServer::enableResumption()
+     *
+     *  Each session is kept under the resumption token its client was last given, until the client presents it in
+     * a new handshake or the session times out. when full, the session closest to timing out makes room. tokens come
+     * straight from std::random_device, they're all that's needed to take a session over.
+     */
+    class FoxResumeCache {
+    private:
+        struct Entry {
+            FoxServerPeer *peer;
+            std::multimap<int64_t, uint64_t>::iterator expiry;
+        };
+
+        std::unordered_map<uint64_t, Entry> detached; // by token
+        std::multimap<int64_t, uint64_t> expiries; // tick the session times out -> token, soonest first
+        std::random_device tokenSource;
+        int timeout;
+        size_t maxDetached;
+
+    public:
+        FoxResumeCache(int timeout = FOXNET_RESUME_TIMEOUT, size_t maxDetached = FOXNET_RESUME_MAX);
+
+        uint64_t newToken(void); // a fresh token, never 0
+
+        // keeps peer under token, returns the session that was pushed out to make room (or nullptr)
+        FoxServerPeer *detach(uint64_t token, FoxServerPeer *peer);
+
+        // takes the session kept under token out of the cache, nullptr if there isn't one (or it timed out)
+        FoxServerPeer *claim(uint64_t token);
+
+        // takes out a session that timed out by tick, nullptr once there are none left
+        FoxServerPeer *expire(int64_t tick);
+
+        size_t size(void);
+    };
+}
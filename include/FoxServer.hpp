@@ -1,15 +1,55 @@
 #pragma once
 
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <unordered_map>
+
 #include "FoxNet.hpp"
 #include "FoxSocket.hpp"
 #include "FoxPeer.hpp"
+#include "FoxMetrics.hpp"
+#include "FoxCapture.hpp"
 #include "FoxPoll.hpp"
+#include "FoxDatagram.hpp"
+#include "FoxSnapshotSender.hpp"
+#include "FoxResumeCache.hpp"
+
+// how often (in ms) FoxServer checks its peers for timed out rpcs
+#define FOXNET_RPC_SWEEP_INTERVAL 100
+
+// connections accepted per listening socket per pollPeers(), anything past it waits for the next poll so a connect
+// storm can't starve the peers we already have
+#ifndef FOXNET_ACCEPT_BUDGET
+#define FOXNET_ACCEPT_BUDGET 64
+#endif
+
+// ms a listening socket is left alone after running out of file descriptors, the connection stays in the backlog
+#ifndef FOXNET_ACCEPT_BACKOFF
+#define FOXNET_ACCEPT_BACKOFF 100
+#endif
 
 namespace FoxNet {
     // base FoxServer peer class, make a parent class of this and add your own custom packet ids
     class FoxServerPeer : public FoxPeer {
+    private:
+        std::vector<FoxServerPeer*> *dirtyList = nullptr; // our server's list of peers to flush
+        std::string admitAddress; // the address we're counted under for setMaxPeersPerAddress()
+        bool dirty = false;
+        bool killed = false; // out of our server's poll list, events still queued for it are skipped
+        FoxResumeCache *resumeCache = nullptr; // our server's detached sessions, see FoxServer::enableResumption()
+        FoxServerPeer *resumeTarget = nullptr; // the detached session our handshake claimed
+
+        template<typename peerType> friend class FoxServer;
+
+    protected:
+        uint64_t resumeSession(uint64_t token, bool &resumed);
+
     public:
         FoxServerPeer(void);
+
+        void writeBytes(Byte *in, size_t sz);
     };
 
     template<typename peerType>
@@ -17,16 +57,371 @@ namespace FoxNet {
         static_assert(std::is_base_of<FoxServerPeer, peerType>::value, "peerType must derive from FoxServerPeer");
 
     private:
-        SOCKET sock;
         uint16_t port;
-        socklen_t addressSize;
-        struct sockaddr_in address;
+        FoxBindOptions bindOpts;
         FoxPollList pollList;
+        std::vector<FoxServerPeer*> dirtyPeers; // written to outside of their own handlers
+        int64_t lastRPCSweep = 0;
+        bool pendingRPCs = false; // did the last sweep find outstanding rpcs?
+        std::unique_ptr<FoxCapture> capture; // destroyed after the peers, they record their close on delete
+        std::mutex transportLock;
+        std::vector<FoxTransport*> pendingTransports; // handed to us by acceptTransport(), set up by pollPeers()
+        std::vector<FoxSocket*> listeners; // listening sockets besides us, see listenUnix()
+        std::vector<std::string> unixPaths; // socket files to clean up
+        FoxDatagram *datagram = nullptr; // see enableDatagrams()
+        std::unordered_map<uint32_t, peerType*> sessions; // peers by datagram session id
+        std::mt19937_64 sessionRng;
+        uint32_t nextSession = 0;
+        size_t peerCount = 0;
+        size_t maxPeers = 0; // 0 for no limit
+        size_t maxPeersPerAddress = 0;
+        int acceptBudget = FOXNET_ACCEPT_BUDGET;
+        std::vector<FoxSocket*> starvedListeners; // out of the poll list until acceptResume, see acceptPeers()
+        int64_t acceptResume = 0;
+        std::unordered_map<std::string, size_t> addressPeers; // peers per remote ip
+        std::unique_ptr<FoxResumeCache> resumeCache; // see enableResumption()
+        std::vector<peerType*> deadPeers; // killed, but events for them might still be in the current batch
+
+        // the remote ip as raw bytes (v4-mapped addresses count as their ipv4 address), empty for unix sockets
+        static std::string addressKey(const struct sockaddr_storage &address) {
+            if (address.ss_family == AF_INET) {
+                const struct sockaddr_in *addr4 = (const struct sockaddr_in *)&address;
+
+                return std::string((const char *)&addr4->sin_addr, sizeof(addr4->sin_addr));
+            } else if (address.ss_family == AF_INET6) {
+                const struct sockaddr_in6 *addr6 = (const struct sockaddr_in6 *)&address;
+
+                if (IN6_IS_ADDR_V4MAPPED(&addr6->sin6_addr))
+                    return std::string((const char *)&addr6->sin6_addr + 12, 4);
+
+                return std::string((const char *)&addr6->sin6_addr, sizeof(addr6->sin6_addr));
+            }
+
+            return std::string();
+        }
+
+        // our own sockets, anything else in the poll list is a peer
+        bool isListener(FoxSocket *sock) {
+            return sock == this || sock == datagram || std::find(listeners.begin(), listeners.end(), sock) != listeners.end();
+        }
+
+        void addPeer(peerType *peer) {
+            peerCount++;
+            peer->dirtyList = &dirtyPeers;
+            if (capture != nullptr)
+                peer->setCapture(capture.get());
+
+            // (peers on unix sockets & transports are on our host, they don't need it)
+            if (datagram != nullptr && peer->getTransport() == nullptr && !peer->isUnixSocket()) {
+                if (++nextSession == 0)
+                    nextSession = 1;
+
+                sessions[nextSession] = peer;
+                peer->setDatagramChannel(datagram, nextSession, sessionRng());
+            }
+
+            // (same goes for resuming, a local connection doesn't blip)
+            if (resumeCache != nullptr && peer->getTransport() == nullptr && !peer->isUnixSocket()) {
+                peer->resumeCache = resumeCache.get();
+                peer->resumable = true;
+            }
+
+            onNewPeer(peer);
+            pollList.addSock(dynamic_cast<FoxSocket*>(peer));
+            FOXMETRIC(addAccept())
+        }
+
+        // drains up to acceptBudget connections from listener, rejected ones are closed before a peer is made for them
+        void acceptPeers(FoxSocket *listener) {
+            struct sockaddr_storage address;
+            socklen_t addressSize;
+            SOCKET sock;
+            FoxSocket::AcceptCode code = FoxSocket::ACCEPT_OK;
+            int i;
+
+            for (i = 0; i < acceptBudget; i++) {
+                if ((code = listener->acceptNext(sock, address, addressSize)) != FoxSocket::ACCEPT_OK)
+                    break;
+
+                std::string key = addressKey(address);
+                bool admit = maxPeers == 0 || peerCount < maxPeers;
+
+                if (admit && maxPeersPerAddress != 0 && !key.empty()) {
+                    auto iter = addressPeers.find(key);
+                    admit = iter == addressPeers.end() || iter->second < maxPeersPerAddress;
+                }
+
+                if (!admit || !admitPeer((struct sockaddr *)&address, addressSize)) {
+                    FoxSocket::closeSock(sock);
+                    FOXMETRIC(addAcceptRejected())
+                    continue;
+                }
+
+                peerType *peer = new peerType();
+                peer->adoptSock(sock);
+                if (!key.empty()) {
+                    peer->admitAddress = key;
+                    addressPeers[key]++;
+                }
+
+                addPeer(peer);
+            }
+
+            // out of fds, retrying now would just fail again (and a level-triggered listener would spin). it's taken
+            // out of the poll list and marked ready again once the backoff is up, see resumeListeners()
+            if (code == FoxSocket::ACCEPT_FULL) {
+                FOXWARN("out of file descriptors, backing off accept()");
+                pollList.rmvSock(listener);
+                starvedListeners.push_back(listener);
+                acceptResume = getTicks() + FOXNET_ACCEPT_BACKOFF;
+                return;
+            }
+
+            // unless accept() told us the backlog is empty there might be more waiting, come back for it after the peers
+            // had their turn. an edge-triggered listener won't be reported again for connections that are already queued
+            if (code != FoxSocket::ACCEPT_EMPTY)
+                pollList.setReady(listener);
+        }
+
+        // puts listeners that backed off in acceptPeers() back once their time is up, returns the timeout to use
+        int resumeListeners(int timeout) {
+            if (starvedListeners.empty())
+                return timeout;
+
+            int64_t wait = acceptResume - getTicks();
+            if (wait > 0)
+                return timeout < 0 || timeout > wait ? (int)wait : timeout;
+
+            for (FoxSocket *listener : starvedListeners) {
+                pollList.addSock(listener);
+                pollList.setReady(listener);
+            }
+            starvedListeners.clear();
+
+            return timeout;
+        }
+
+        // returns true if any peers were added
+        bool acceptTransports() {
+            std::vector<FoxTransport*> transports;
+
+            {
+                std::lock_guard<std::mutex> guard(transportLock);
+                transports.swap(pendingTransports);
+            }
+
+            for (FoxTransport *transport : transports) {
+                peerType *peer = new peerType();
+
+                peer->setTransport(transport);
+                addPeer(peer);
+            }
+
+            return !transports.empty();
+        }
+
+        // uncounts the peer for setMaxPeers() & setMaxPeersPerAddress()
+        void releasePeer(FoxServerPeer *peer) {
+            peerCount--;
+            if (!peer->admitAddress.empty()) {
+                auto iter = addressPeers.find(peer->admitAddress);
+                if (--iter->second == 0)
+                    addressPeers.erase(iter);
+            }
+        }
+
+        // with detach set the connection dropped (PEERPOLL_DROPPED rather than the peer misbehaving), so a resumable
+        // session is kept
+        void killPeer(peerType *peer, bool detach = false) {
+            // (a peer can be killed from more than one place in a batch, eg. a datagram & then its own event)
+            if (peer->killed)
+                return;
+
+            detach = detach && resumeCache != nullptr && peer->getResumeToken() != 0 && peer->getTransport() == nullptr &&
+                peer->pendingOut() <= FOXNET_RESUME_MAX_QUEUE;
+
+            if (detach)
+                onPeerDetached(peer);
+            else
+                onPeerDisconnect(peer);
 
-        void killPeer(peerType *peer) {
-            onPeerDisconnect(peer);
             pollList.rmvSock(peer);
-            delete peer;
+            peer->killed = true;
+            FOXMETRIC(addDisconnect())
+
+            if (peer->dirty) {
+                dirtyPeers.erase(std::find(dirtyPeers.begin(), dirtyPeers.end(), peer));
+                peer->dirty = false;
+            }
+
+            if (peer->getDatagramSession() != 0)
+                sessions.erase(peer->getDatagramSession());
+
+            if (detach) {
+                // (writes to it are held until it's resumed, so it stays off dirtyPeers)
+                peer->dirtyList = nullptr;
+                peer->detachConnection();
+                dropDetached(static_cast<peerType*>(resumeCache->detach(peer->getResumeToken(), peer)));
+                FOXMETRIC(addDetach())
+                return;
+            }
+
+            releasePeer(peer);
+            deadPeers.push_back(peer);
+
+            // fail anything the peer is still waiting on (it's already unlinked, so a callback throwing can't leak it)
+            peer->kill();
+            peer->checkRPCTimeouts();
+            peer->cancelWaiters();
+        }
+
+        // a detached session that timed out (or was pushed out of the cache), it's gone for good
+        void dropDetached(peerType *peer) {
+            if (peer == nullptr)
+                return;
+
+            onPeerDisconnect(peer);
+            releasePeer(peer);
+            deadPeers.push_back(peer);
+            peer->cancelWaiters();
+        }
+
+        // the handshake on fresh's connection claimed a detached session, the session's peer takes the connection
+        // over & fresh is dropped. returns the session's peer
+        peerType *resumePeer(peerType *fresh) {
+            peerType *peer = static_cast<peerType*>(fresh->resumeTarget);
+
+            fresh->resumeTarget = nullptr;
+            pollList.rmvSock(fresh);
+            fresh->killed = true;
+            if (fresh->dirty)
+                dirtyPeers.erase(std::find(dirtyPeers.begin(), dirtyPeers.end(), fresh));
+
+            if (fresh->getDatagramSession() != 0)
+                sessions[fresh->getDatagramSession()] = peer;
+
+            // the session is counted under the address it's on now, fresh is uncounted in its place
+            peer->admitAddress.swap(fresh->admitAddress);
+            releasePeer(fresh);
+
+            peer->takeConnection(fresh);
+            peer->dirtyList = &dirtyPeers;
+            deadPeers.push_back(fresh);
+            onPeerDisconnect(fresh);
+            fresh->checkRPCTimeouts();
+            fresh->cancelWaiters();
+
+            // the client's packets pipelined behind its request are already buffered, & everything queued while it
+            // was gone goes out with the next flush
+            peer->killed = false;
+            pollList.addSock(dynamic_cast<FoxSocket*>(peer));
+            pollList.setReady(peer);
+            peer->dirty = true;
+            dirtyPeers.push_back(peer);
+
+            onPeerResumed(peer);
+            FOXMETRIC(addResume())
+            return peer;
+        }
+
+        // frees the peers killed since the last poll, nothing can point at them anymore
+        void reapPeers() {
+            for (peerType *peer : deadPeers)
+                delete peer;
+            deadPeers.clear();
+        }
+
+        // sends everything written to peers outside of their own handlers (broadcasts, pings, etc.)
+        void flushPeers() {
+            std::vector<FoxServerPeer*> peers;
+
+            // killPeer() edits dirtyPeers, so work on a copy
+            peers.swap(dirtyPeers);
+            for (FoxServerPeer *p : peers) {
+                peerType *peer = static_cast<peerType*>(p);
+
+                peer->dirty = false;
+                try {
+                    PeerPollResult res = peer->handlePollOut(pollList);
+
+                    if (res != PEERPOLL_OK)
+                        killPeer(peer, res == PEERPOLL_DROPPED);
+                } catch(...) {
+                    killPeer(peer);
+                }
+            }
+
+            // every peer's datagrams go out in as few syscalls as possible
+            if (datagram != nullptr)
+                datagram->flush();
+        }
+
+        void pollDatagrams() {
+            size_t count = FOXNET_DATAGRAM_BATCH;
+
+            for (int i = 0; i < FOXNET_DATAGRAM_READS && count == FOXNET_DATAGRAM_BATCH; i++) {
+                count = datagram->recvBatch();
+
+                for (size_t j = 0; j < count; j++) {
+                    FoxDatagram::Message &msg = datagram->getRecv(j);
+                    bool ok = false;
+
+                    if (msg.size < FOXNET_DATAGRAM_HEADER) {
+                        FOXMETRIC(addDatagramsDropped(1))
+                        continue;
+                    }
+
+                    auto iter = sessions.find(FoxDatagram::getInt<uint32_t>(msg.data));
+                    if (iter == sessions.end()) {
+                        FOXMETRIC(addDatagramsDropped(1))
+                        continue;
+                    }
+
+                    peerType *peer = iter->second;
+                    try {
+                        // a hello binds the sender's address, after that only datagrams from it are accepted
+                        if (FoxDatagram::getInt<uint32_t>(msg.data + sizeof(uint32_t)) == 0) {
+                            ok = peer->handleDatagramHello(msg);
+                        } else if (peer->isDatagramFrom((struct sockaddr *)&msg.addr, msg.addrLen)) {
+                            peer->handleDatagram(msg.data, msg.size);
+                            ok = true;
+                        }
+
+                        if (!peer->isAlive())
+                            killPeer(peer);
+                    } catch(...) {
+                        killPeer(peer);
+                    }
+
+                    if (!ok) {
+                        FOXMETRIC(addDatagramsDropped(1))
+                    }
+                }
+            }
+
+            if (count == FOXNET_DATAGRAM_BATCH)
+                pollList.setReady(datagram);
+        }
+
+        // checking every peer is O(n), so timeouts are only checked every FOXNET_RPC_SWEEP_INTERVAL ms
+        void sweepRPCs() {
+            int64_t currTick = getTicks();
+
+            if (currTick - lastRPCSweep < FOXNET_RPC_SWEEP_INTERVAL)
+                return;
+
+            lastRPCSweep = currTick;
+            pendingRPCs = false;
+            for (peerType *peer : getPeerList()) {
+                peer->checkRPCTimeouts();
+                pendingRPCs |= peer->getPendingRPCs() > 0;
+            }
+
+            // (the cache won't hand out a timed out session, this just frees them)
+            if (resumeCache != nullptr) {
+                for (peerType *peer; (peer = static_cast<peerType*>(resumeCache->expire(currTick))) != nullptr;)
+                    dropDetached(peer);
+            }
         }
 
     public:
@@ -40,24 +435,179 @@ namespace FoxNet {
             std::cout << "Peer " << peer << " disconnected!" << std::endl;
         }
 
+        // fired when a resumable peer's connection drops, the peer is kept until it's resumed or times out (then
+        // onPeerDisconnect() is fired). see enableResumption()
+        virtual void onPeerDetached(peerType *) {
+            // stubbed
+        }
+
+        // fired when a client took its detached session back over, peer is the session's peer (the peer made for
+        // the new connection is disconnected without ever being ready)
+        virtual void onPeerResumed(peerType *) {
+            // stubbed
+        }
+
+        // fired for each connection that got past setMaxPeers() & setMaxPeersPerAddress(), before a peer is made for
+        // it. return false to close it (eg. a ban list)
+        virtual bool admitPeer(const struct sockaddr *, socklen_t) {
+            return true;
+        }
+
 // ============================================= [[ Base FoxServer implementation ]] =============================================
 
-        FoxServer(uint16_t p): port(p) {
+        // see FoxBindOptions, by default we listen on every ipv4 & ipv6 address
+        FoxServer(uint16_t p, const FoxBindOptions &opts = FoxBindOptions()): port(p), bindOpts(opts) {
             // binds the socket a port
-            bind(p);
+            bind(p, opts);
+            setNonBlocking(); // so acceptPeers() can drain the backlog
 
             pollList.addSock(this);
+
+            // so acceptTransport() can wake us
+            pollList.enableWake();
+        }
+
+        // doesn't listen on a port, peers can only be added with listenUnix() or acceptTransport()
+        FoxServer(): port(0) {
+            pollList.enableWake();
         }
 
         ~FoxServer() {
             std::vector<FoxSocket*> peers = pollList.getList();
 
+            for (FoxTransport *transport : pendingTransports)
+                delete transport;
+
+            reapPeers();
+
+            if (resumeCache != nullptr) {
+                for (FoxServerPeer *peer; (peer = resumeCache->expire(INT64_MAX)) != nullptr;)
+                    delete static_cast<peerType*>(peer);
+            }
+
             for (FoxSocket* peer : peers) {
-                if (peer == this) // skip us
+                if (isListener(peer)) // skip us
                     continue;
 
+                // (the poll list outlives the peers, it can't be left holding them)
+                pollList.rmvSock(peer);
                 delete dynamic_cast<peerType*>(peer);
             }
+
+            for (FoxSocket *listener : listeners)
+                delete listener;
+
+            if (datagram != nullptr) {
+                pollList.rmvSock(datagram);
+                delete datagram;
+            }
+
+#ifndef _WIN32
+            for (const std::string &path : unixPaths)
+                ::unlink(path.c_str());
+#endif
+        }
+
+        /*
+         * Also accepts peers on a unix domain socket, can be called more than once. a path starting with '@' is in
+         * the abstract namespace (linux only), otherwise the socket file is removed when the server is destroyed
+         * NOTE: this function can throw a FoxException!
+         */
+        void listenUnix(const std::string &path) {
+            FoxSocket *listener = new FoxSocket();
+
+            try {
+                listener->bindUnix(path);
+            } catch(...) {
+                delete listener;
+                throw;
+            }
+            listener->setNonBlocking();
+
+            listeners.push_back(listener);
+            pollList.addSock(listener);
+            if (path[0] != '@')
+                unixPaths.push_back(path);
+        }
+
+        /*
+         * Offers every new peer (connected over tcp) a datagram channel on udp port, 0 for the same port number as
+         * ours. see PKTLANE_DATAGRAM & FoxClient::enableDatagrams()
+         *  The socket is bound to the same address as ours, but never with reusePort: a datagram from a peer has to
+         * reach the server that owns its session, so servers sharing a port need a datagram port each.
+         * NOTE: this function can throw a FoxException!
+         */
+        void enableDatagrams(uint16_t p = 0) {
+            FoxDatagram *dgram;
+
+            if (datagram != nullptr) {
+                FOXFATAL("datagrams are already enabled!")
+            }
+
+            dgram = new FoxDatagram();
+            try {
+                FoxBindOptions opts = bindOpts;
+
+                opts.reusePort = false;
+                dgram->bindDatagram(p != 0 ? p : port, opts);
+            } catch(...) {
+                delete dgram;
+                throw;
+            }
+            dgram->setNonBlocking();
+
+            // session ids are only a lookup key (the token is the secret), but there's no need to make them guessable
+            sessionRng.seed(std::random_device()());
+            nextSession = (uint32_t)sessionRng();
+
+            datagram = dgram;
+            pollList.addSock(datagram);
+        }
+
+        /*
+         * Keeps the session of a peer whose connection drops around for up to timeout ms, so the client can reconnect
+         * to it with the token it was handed in the handshake (see FoxClient::enableResumption()). packets written to
+         * the peer meanwhile (& whole packets we hadn't written to the socket yet when it dropped) are sent once it's
+         * resumed, what the kernel already took (or a packet that was partly written) is lost with it, as is the
+         * control lane. at most maxDetached sessions are kept, the one closest to timing out makes room. only for tcp
+         * peers whose handshake negotiated CAP_RESUME, a peer killed by an exception or with more than
+         * FOXNET_RESUME_MAX_QUEUE bytes queued is dropped like usual. the whole packets kept from the dropped
+         * connection already went through onSend() & go out as they are, a stateful onSend()/onRecv() (eg. a cipher)
+         * has to carry its state over itself. call before accepting peers
+         */
+        void enableResumption(int timeout = FOXNET_RESUME_TIMEOUT, size_t maxDetached = FOXNET_RESUME_MAX) {
+            resumeCache.reset(new FoxResumeCache(timeout, maxDetached));
+        }
+
+        // detached sessions waiting on their client
+        size_t getDetachedCount() {
+            return resumeCache != nullptr ? resumeCache->size() : 0;
+        }
+
+        /*
+         * Admission control, connections past these limits are closed as soon as they're accepted. 0 for no limit.
+         * per address limits count peers by remote ip (unix socket & transport peers aren't counted)
+         */
+        void setMaxPeers(size_t max) {
+            maxPeers = max;
+        }
+
+        void setMaxPeersPerAddress(size_t max) {
+            maxPeersPerAddress = max;
+        }
+
+        // connections accepted per listening socket per pollPeers(), see FOXNET_ACCEPT_BUDGET
+        void setAcceptBudget(int budget) {
+            acceptBudget = budget;
+        }
+
+        size_t getPeerCount() {
+            return peerCount;
+        }
+
+        // see FoxPollList::enableEdgeTriggered(), peers are read until EAGAIN within their FOXNET_RECV_BUDGET
+        void enableEdgeTriggered() {
+            pollList.enableEdgeTriggered();
         }
 
         // used for connection keep-alive, actual packet will be sent on the next call to pollPeers()
@@ -65,9 +615,20 @@ namespace FoxNet {
             int64_t currTime = getTimestamp();
 
             // ping all peers (will be sent on next call to pollPeers())
-            for (FoxSocket *peer : pollList.getList()) {
+            for (peerType *peer : getPeerList()) {
+                PktLane lane = peer->setLane(PKTLANE_CONTROL);
                 peer->writeByte(PKTID_PING);
                 peer->writeInt(currTime);
+                peer->setLane(lane);
+            }
+        }
+
+        // sends the sender's newest snapshot to every peer that's done its handshake, on the next call to pollPeers()
+        // NOTE: this function can throw a FoxException!
+        void broadcastSnapshot(FoxSnapshotSender &sender) {
+            for (peerType *peer : getPeerList()) {
+                if (peer->getHandshake())
+                    sender.sendTo(peer);
             }
         }
 
@@ -76,53 +637,114 @@ namespace FoxNet {
             std::vector<FoxPollEvent> events;
             peerType *peer;
 
+            // if any rpcs are outstanding, make sure we wake up for the next sweep
+            if (pendingRPCs && (timeout < 0 || timeout > FOXNET_RPC_SWEEP_INTERVAL))
+                timeout = FOXNET_RPC_SWEEP_INTERVAL;
+
+            reapPeers();
+            flushPeers();
+            timeout = resumeListeners(timeout);
             events = pollList.pollList(timeout);
+            sweepRPCs();
+
+            if (acceptTransports() && events.size() == 0)
+                return true;
 
             if (events.size() == 0) // no events to handle, out timeout must've ran out
                 return false;
 
-            for (FoxPollEvent &e : events) {
-                // check if event was on our bound port
-                if (e.sock == this) {
-                    peer = new peerType();
+#ifdef FOXNET_ENABLE_METRICS
+            int64_t pollStart = FoxMetrics::now();
+#endif
 
-                    // accept the new connection :D
-                    peer->acceptFrom(this);
-                    peer->setNonBlocking();
+            for (FoxPollEvent &e : events) {
+                if (e.sock == datagram) {
+                    pollDatagrams();
+                    continue;
+                }
 
-                    onNewPeer(peer);
-                    pollList.addSock(dynamic_cast<FoxSocket*>(peer));
+                // check if event was on our bound port (or one of our other listeners)
+                if (isListener(e.sock)) {
+                    // accept the new connections :D
+                    acceptPeers(e.sock);
                     continue;
                 }
 
-                // grab peer
+                // grab peer, skipping ones killed earlier in this batch
                 peer = dynamic_cast<peerType*>(e.sock);
+                if (peer->killed)
+                    continue;
 
-                // handle poll events
+                // handle poll events (no normal event = connection reset)
+                PeerPollResult res = e.pollIn || e.pollOut || e.pollErr ? PEERPOLL_OK : PEERPOLL_DROPPED;
                 try {
-                    if (e.pollIn && !peer->handlePollIn(pollList))
-                        killPeer(peer);
-
-                    if (e.pollOut && !peer->handlePollOut(pollList))
-                        killPeer(peer);
-
-                    if (!e.pollIn && !e.pollOut) // no normal event = connection reset or error
-                        killPeer(peer);
+                    if (res == PEERPOLL_OK && e.pollIn)
+                        res = peer->handlePollIn(pollList);
+                    if (res == PEERPOLL_OK && e.pollOut)
+                        res = peer->handlePollOut(pollList);
+                    if (res == PEERPOLL_OK && e.pollErr)
+                        res = peer->handlePollErr(pollList);
                 } catch(...) {
-                    killPeer(peer);
+                    res = PEERPOLL_VIOLATION;
                 }
+
+                // its handshake claimed a detached session, the connection is handed over to the session's peer
+                if (peer->resumeTarget != nullptr)
+                    peer = resumePeer(peer);
+
+                // only a dropped connection can be resumed, a peer that broke the protocol is dropped for good
+                if (res != PEERPOLL_OK)
+                    killPeer(peer, res == PEERPOLL_DROPPED);
             }
 
+            // handlers might've written to other peers
+            flushPeers();
+
+            FOXMETRIC(addPoll(FoxMetrics::now() - pollStart))
             return true;
         }
 
+        /*
+         * Adds a peer that's connected over transport (eg. one end of a FoxPipe) instead of a kernel socket, we take
+         * ownership of it. safe to call from any thread, the peer is set up by the next pollPeers()
+         */
+        void acceptTransport(FoxTransport *transport) {
+            std::lock_guard<std::mutex> guard(transportLock);
+
+            pendingTransports.push_back(transport);
+            pollList.wake();
+        }
+
+        /*
+         * Records the raw inbound traffic of every peer (current & future) to path, see FoxReplay to play it back.
+         * a capture that was already running is stopped first
+         * NOTE: this function can throw a FoxException!
+         */
+        void startCapture(const std::string &path) {
+            stopCapture();
+            capture.reset(new FoxCapture(path));
+
+            for (peerType *peer : getPeerList())
+                peer->setCapture(capture.get());
+        }
+
+        void stopCapture() {
+            if (capture == nullptr)
+                return;
+
+            for (peerType *peer : getPeerList())
+                peer->setCapture(nullptr);
+
+            capture.reset();
+        }
+
         std::vector<peerType*> getPeerList() {
             std::vector<peerType*> groomedPeers;
             std::vector<FoxSocket*> peers = pollList.getList();
 
-            groomedPeers.reserve(peers.size() - 1);
+            groomedPeers.reserve(peers.size());
             for (FoxSocket *peer : peers) {
-                if (peer == this)
+                if (isListener(peer))
                     continue;
 
                 groomedPeers.push_back(dynamic_cast<peerType*>(peer));
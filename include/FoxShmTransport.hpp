@@ -0,0 +1,84 @@
+#pragma once
+
+#include <atomic>
+#include <vector>
+
+#include "FoxTransport.hpp"
+
+// bytes per direction, must be a power of 2
+#ifndef FOXNET_SHM_RING_SIZE
+#define FOXNET_SHM_RING_SIZE (1024 * 1024)
+#endif
+
+#define FOXSHM_MAGIC "FOXSHM"
+#define FOXSHM_MAGICLEN 6
+#define FOXSHM_VERSION 1
+
+namespace FoxNet {
+    /*
+     * Shared memory FoxTransport between two processes on the same host (linux only)
+     *
+     *  The segment is a memfd holding one single producer/single consumer ring per direction, each end has an eventfd
+     * the other end writes to when a ring goes from empty to non-empty (or full to not full), so a busy stream
+     * doesn't make any syscalls at all. Connections are moved onto it after the handshake (see
+     * FoxClient::connectUnix()), the memfd & eventfds are passed over the unix socket, which stays open so a crashed
+     * peer is still noticed.
+     */
+    class FoxShmTransport : public FoxTransport {
+    private:
+        struct Ring {
+            alignas(64) std::atomic<uint64_t> head; // total bytes read
+            alignas(64) std::atomic<uint64_t> tail; // total bytes written
+            alignas(64) std::atomic<uint32_t> writerClosed;
+            std::atomic<uint32_t> readerClosed;
+        };
+
+        // start of the segment, followed by the ring data (rings[i] is read by end i)
+        struct Header {
+            char magic[FOXSHM_MAGICLEN];
+            Byte version;
+            Byte reserved;
+            uint32_t ringSize;
+            Ring rings[2];
+        };
+
+        Header *header = nullptr;
+        Byte *data[2]; // ring data, same indexing as header->rings
+        size_t mapSize = 0;
+        size_t ringSize = 0;
+        int side;
+        int memFd = -1;
+        int wakeFds[2] = {-1, -1}; // wakeFds[i] wakes end i
+        bool closed = false;
+
+        FoxShmTransport(int side);
+
+        bool map(size_t sz);
+        void signal(int fd);
+
+        Ring &inRing(void) { return header->rings[side]; }
+        Ring &outRing(void) { return header->rings[side ^ 1]; }
+
+    public:
+        ~FoxShmTransport(void);
+
+        // makes a new segment, returns nullptr if it couldn't be set up (or shared memory isn't supported)
+        static FoxShmTransport *create(size_t ringSize = FOXNET_SHM_RING_SIZE);
+
+        // opens the other end of a segment from the fds of getSharedFds(), we take ownership of them (they're closed on
+        // failure too). returns nullptr if the segment is invalid
+        static FoxShmTransport *attach(const std::vector<int> &fds);
+
+        // the fds to pass to the other end: memfd, our eventfd & theirs
+        std::vector<int> getSharedFds(void);
+
+        int recv(Byte *buf, size_t sz);
+        int send(const Byte *buf, size_t sz);
+        void close(void);
+
+        bool readable(void);
+        bool writable(void);
+        int getWakeFd(void);
+        void setPollList(FoxPollList *list);
+    };
+}
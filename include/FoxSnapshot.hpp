@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "ByteStream.hpp"
+
+// snapshots each end keeps around as baselines, a peer that's acked nothing newer than this gets a full snapshot
+#ifndef FOXNET_SNAPSHOT_HISTORY
+#define FOXNET_SNAPSHOT_HISTORY 32
+#endif
+
+namespace FoxNet {
+    /*
+     * A replicated state snapshot, a flat array of integer fields (see FoxSnapshotSender)
+     *
+     *  The app maps its state onto fields however it likes (quantize floats, give each entity a fixed range of
+     * fields, etc.), fields that stay the same between snapshots cost a bit each. Snapshots are encoded against a
+     * baseline the other end already has: a varint field count, a bitmask of the fields that changed, then the
+     * zigzag varint delta of each changed field. without a baseline every field is diffed against 0.
+     */
+    class FoxSnapshot {
+    private:
+        std::vector<int64_t> fields;
+        uint32_t seq = 0; // 0 until it's published
+
+    public:
+        FoxSnapshot(void) {}
+        FoxSnapshot(size_t count);
+
+        void resize(size_t count);
+        size_t size(void) const;
+
+        // set() grows the snapshot to fit i, get() is 0 past the end
+        void set(size_t i, int64_t val);
+        int64_t get(size_t i) const;
+
+        void setSeq(uint32_t s);
+        uint32_t getSeq(void) const;
+
+        // appends the fields that differ from baseline (or every non-zero field, if it's nullptr) to out
+        void encodeDelta(const FoxSnapshot *baseline, ByteStream &out) const;
+
+        // replaces our fields with baseline plus the delta read from data, returns false if it was malformed
+        bool decodeDelta(const FoxSnapshot *baseline, ByteView &data);
+    };
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <deque>
+#include <unordered_map>
+
+#include "FoxPeer.hpp"
+#include "FoxSnapshot.hpp"
+
+namespace FoxNet {
+    /*
+     * Replicates a stream of FoxSnapshots to any number of peers
+     *
+     *  Every published snapshot is kept (up to FOXNET_SNAPSHOT_HISTORY) as a possible baseline. each peer acks the
+     * snapshots it gets (PKTID_SNAPSHOT_ACK), and is sent the newest snapshot as a delta against the newest one it
+     * acked, or a full one if that's too old. peers that acked the same baseline share a single encoding, so a
+     * broadcast (see FoxServer::broadcastSnapshot()) usually only encodes a handful of times. the other end gets
+     * them through FoxPeer::onSnapshot().
+     *  Snapshots are sent on PKTLANE_DATAGRAM by default, lost or reordered snapshots are fine since every delta
+     * is against a baseline the peer confirmed it has. a peer should only be sent snapshots by one sender.
+     */
+    class FoxSnapshotSender {
+    private:
+        std::deque<FoxSnapshot> history; // published snapshots, newest last
+        std::unordered_map<uint32_t, ByteStream> encodings; // the newest snapshot by baseline seq (0 for none)
+        uint32_t nextSeq = 1;
+        PktLane lane;
+
+        const FoxSnapshot *findBaseline(uint32_t seq);
+
+    public:
+        FoxSnapshotSender(PktLane lane = PKTLANE_DATAGRAM);
+
+        // makes snap the newest snapshot, returns its sequence number
+        uint32_t publish(const FoxSnapshot &snap);
+
+        /*
+         * Writes the newest snapshot to peer, delta encoded against the newest snapshot it acked
+         * NOTE: this function can throw a FoxException! (if the encoding doesn't fit in a packet)
+         */
+        void sendTo(FoxPeer *peer);
+
+        // how many distinct encodings of the newest snapshot were made so far
+        size_t getEncodingCount(void);
+    };
+}
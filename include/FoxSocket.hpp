@@ -18,6 +18,7 @@
     #define poll WSAPoll
     #define FN_ERRNO WSAGetLastError()
     #define FN_EWOULD WSAEWOULDBLOCK
+    #define FN_EINPROGRESS WSAEWOULDBLOCK
     #define FN_MSG_NOSIGNAL 0
     #define SOCKETINVALID(x) (x == INVALID_SOCKET)
     #define SOCKETERROR(x) (x == SOCKET_ERROR)
@@ -25,8 +26,10 @@
 // posix platform
     #include <sys/types.h>
     #include <sys/socket.h>
+    #include <sys/un.h>
     #include <netdb.h>
     #include <netinet/in.h>
+    #include <netinet/tcp.h>
     #include <arpa/inet.h>
     #include <poll.h>
 #ifdef __linux__
@@ -42,27 +45,52 @@
     #define PollFD struct pollfd
     #define FN_ERRNO errno
     #define FN_EWOULD EWOULDBLOCK
+    #define FN_EINPROGRESS EINPROGRESS
     #define FN_MSG_NOSIGNAL MSG_NOSIGNAL
     #define INVALID_SOCKET -1
     #define SOCKETINVALID(x) (x < 0)
     #define SOCKETERROR(x) (x == -1)
 #endif
 #include <fcntl.h>
+#include <string>
 
 #include "FoxNet.hpp"
 #include "FoxPacket.hpp"
 #include "ByteStream.hpp"
+#include "FoxTransport.hpp"
+
+// max fds collected from a single read, see FoxSocket::setAcceptFds()
+#define FOXNET_MAX_PASSED_FDS 8
 
 namespace FoxNet {
     void _FoxNet_Init(void);
     void _FoxNet_Cleanup(void);
 
+    struct FoxBindOptions {
+        std::string address; // numeric ipv4/ipv6 address to listen on, empty for any (ipv6 if the host supports it)
+        bool dualStack = true; // an ipv6 socket also accepts ipv4 (as v4-mapped addresses)
+        int backlog = SOMAXCONN;
+        bool reusePort = false; // SO_REUSEPORT, several sockets can share the port & the kernel balances between them
+        int deferAccept = 0; // TCP_DEFER_ACCEPT (linux), secs to hold a connection until its first bytes arrive
+        int fastOpen = 0; // TCP_FASTOPEN queue length, 0 to disable (linux needs the net.ipv4.tcp_fastopen server bit)
+    };
+
     class FoxSocket : public ByteStream {
     private:
         SOCKET sock = INVALID_SOCKET;
+        FoxTransport *transport = nullptr;
+        bool transportOpen = false;
+        bool recvTransport = false; // are reads/writes going through the transport instead of sock?
+        bool sendTransport = false;
+        std::vector<int> sendFds; // passed along with the next write to sock, see passFds()
+        std::vector<int> recvFds; // passed to us, see setAcceptFds()
+        bool acceptFds = false;
+        int zeroCopyMode = 0; // SO_ZEROCOPY: 0 if we haven't tried yet, 1 if it's on, -1 if the socket doesn't support it
+        uint32_t zeroCopySent = 0; // MSG_ZEROCOPY sends so far, the kernel numbers its completions the same way
+
+        void openBound(int type, uint16_t port, const FoxBindOptions &opts); // opens sock & binds it, for bind()/bindDatagram()
 
     protected:
-
         enum RawSockCode {
             RAWSOCK_OK,
             RAWSOCK_ERROR,
@@ -75,24 +103,99 @@ namespace FoxNet {
             int processed;
         };
 
-        RawSockReturn rawRecv(size_t sz); // reads bytes from socket
+        RawSockReturn rawRecv(size_t sz); // reads bytes from socket onto the in buffer, passing them through onRecv()
+        RawSockReturn rawRecv(std::vector<Byte> &buf, size_t sz); // reads up to sz bytes from socket onto the end of buf, RAWSOCK_POLL if there was nothing to read
         RawSockReturn rawSend(size_t sz); // writes bytes to socket
+        RawSockReturn rawSend(std::vector<Byte> &buf, size_t sz); // writes bytes from buf to socket
+        RawSockReturn sendOnce(const Byte *data, size_t sz, int flags = 0); // one send() (or transport send), can be partial
+        RawSockReturn sentReturn(int sent); // sorts out the result of a send
+
+        // writes up to sz bytes of fd (from offset) to the socket with sendfile() on linux, otherwise (or on a
+        // transport) through a bounce buffer. the file's position isn't touched
+        RawSockReturn rawSendFile(int fd, uint64_t offset, size_t sz);
+
+        // writes up to sz bytes of data to the socket with MSG_ZEROCOPY if the socket supports it (linux tcp). the
+        // kernel reads data until the send's completion, zeroCopyID is its id (see readZeroCopyDone()) or -1 if it
+        // was copied like a normal send
+        RawSockReturn rawSendZeroCopy(const Byte *data, size_t sz, int64_t &zeroCopyID);
+
+        // drains the socket's error queue, adding the [first, last] id ranges of completed zerocopy sends to done.
+        // returns false if the socket has failed
+        bool readZeroCopyDone(std::vector<std::pair<uint32_t, uint32_t>> &done);
 
     public:
         FoxSocket(void);
-        ~FoxSocket(void);
+        virtual ~FoxSocket(void);
+
+        // with fastOpen the first write rides the SYN (TCP_FASTOPEN_CONNECT, linux), a failed connect then only shows
+        // up as a dead socket
+        void connect(std::string ip, std::string port, bool fastOpen = false);
+
+        // opens a non-blocking socket & starts connecting to addr, returns false if the attempt failed immediately
+        bool beginConnect(const struct sockaddr *addr, socklen_t addrLen);
+
+        // checks the result of beginConnect(), call this once the socket is writable. returns true if we're connected
+        bool finishConnect(void);
+
+        // takes over another socket's connection, leaving it dead
+        void takeSock(FoxSocket *other);
+        // NOTE: this function can throw a FoxException!
+        void bind(uint16_t port, const FoxBindOptions &opts = FoxBindOptions()); // bind socket to port & listen
+
+        // unix domain sockets, a path starting with '@' is in the abstract namespace (linux only), otherwise a stale
+        // socket file left at path (nothing accepts connections on it) is replaced. bindUnix() fails if something's
+        // still listening on path or it isn't a socket
+        // NOTE: these functions can throw a FoxException! (not supported on windows)
+        void bindUnix(const std::string &path);
+        void connectUnix(const std::string &path);
+
+        // udp sockets, see FoxDatagram. connectDatagram() only fixes the address we send to & receive from
+        // NOTE: these functions can throw a FoxException!
+        void bindDatagram(uint16_t port, const FoxBindOptions &opts = FoxBindOptions());
+        void connectDatagram(const struct sockaddr *addr, socklen_t addrLen);
+        void acceptFrom(FoxSocket *sock); // setup socket by accepting from another socket (note: host must have been bind()ed)
 
-        bool readBytes(Byte *out, size_t sz);
-        void writeBytes(Byte *in, size_t sz);
+        enum AcceptCode {
+            ACCEPT_OK,
+            ACCEPT_EMPTY, // the backlog is drained
+            ACCEPT_FULL, // out of file descriptors, the connection is still waiting in the backlog
+            ACCEPT_ERROR
+        };
 
-        void connect(std::string ip, std::string port);
-        void bind(uint16_t port); // bind socket to port
-        void acceptFrom(FoxSocket *sock); // setup socket by accepting from another socket (note: host must have been bind()ed)
+        /*
+         * Accepts the next pending connection on a bound non-blocking socket into out, which is already non-blocking
+         * (accept4() on linux saves the fcntl() calls). connections that were aborted before we got to them (and
+         * interrupted calls) are skipped over. the caller owns out until it's handed to adoptSock() or closeSock()
+         */
+        AcceptCode acceptNext(SOCKET &out, struct sockaddr_storage &address, socklen_t &addressSize);
+        void adoptSock(SOCKET s); // takes ownership of an already connected socket
+        static void closeSock(SOCKET s);
         bool setNonBlocking(void);
 
+        // runs the socket on a transport (eg. a FoxPipe) instead of a kernel socket, we take ownership of it
+        void setTransport(FoxTransport *transport);
+        FoxTransport *getTransport(void);
+
+        /*
+         * Adds a transport to an already connected socket (eg. FoxShmTransport), reads & writes stay on the socket
+         * until switchRecv() / switchSend(). the socket is kept open alongside the transport
+         */
+        void upgradeTransport(FoxTransport *transport);
+        void switchRecv(void);
+        void switchSend(void);
+        bool isRecvOnTransport(void);
+        bool isSendOnTransport(void);
+
+        // unix sockets can pass fds: passFds() sends them (SCM_RIGHTS) along with the next write, and once
+        // setAcceptFds(true) is set, fds passed to us are collected until takeFds()
+        bool isUnixSocket(void);
+        void passFds(const std::vector<int> &fds);
+        void setAcceptFds(bool accept);
+        std::vector<int> takeFds(void);
+
         virtual void onKilled(void); // fired when we have been killed (peer disconnect)
-        virtual void onSend(Byte *data, size_t sz); // fired before data is sent over the socket
-        virtual void onRecv(Byte *data, size_t sz); // fired after data was received from the socket, and is being read
+        virtual void onSend(Byte *data, size_t sz); // fired on data about to be sent, in the order it's sent, can change it in place
+        virtual void onRecv(Byte *data, size_t sz); // fired once on data received from the socket before it's read, can change it in place
 
         void kill(void);
         bool isAlive(void);
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#define FOXTRACE_X86
+#endif
+
+// events kept per thread, once the ring is full the oldest events are overwritten (must be a power of 2)
+#ifndef FOXTRACE_RING_SIZE
+#define FOXTRACE_RING_SIZE 16384
+#endif
+
+/*
+ * trace points compile to nothing unless FoxNet was configured with FOXNET_ENABLE_TRACING (off by default).
+ * eg.
+ *  FOXTRACE_SCOPE(trace, "rawRecv")
+ *  ...
+ *  FOXTRACE_ARG(trace, bytesRead)
+ */
+#ifdef FOXNET_ENABLE_TRACING
+#define FOXTRACE_SCOPE(var, name) \
+    FoxNet::FoxTraceScope var(name);
+#define FOXTRACE_ARG(var, val) \
+    var.arg = (uint64_t)(val);
+#else
+#define FOXTRACE_SCOPE(var, name)
+#define FOXTRACE_ARG(var, val)
+#endif
+
+namespace FoxNet {
+    struct FoxTraceEvent {
+        const char *name; // must be a string literal (or otherwise outlive the trace)
+        uint64_t begin;
+        uint64_t end;
+        uint64_t arg;
+    };
+
+    // single writer ring, only its own thread pushes to it
+    class FoxTraceRing {
+    public:
+        FoxTraceEvent events[FOXTRACE_RING_SIZE];
+        std::atomic<uint64_t> head{0}; // total events ever pushed
+        uint32_t tid;
+        std::string threadName;
+
+        void push(const char *name, uint64_t begin, uint64_t end, uint64_t arg) {
+            uint64_t h = head.load(std::memory_order_relaxed);
+
+            events[h & (FOXTRACE_RING_SIZE - 1)] = {name, begin, end, arg};
+            head.store(h + 1, std::memory_order_release);
+        }
+    };
+
+    /*
+     * Per-thread trace buffers
+     *
+     *  Trace points record a begin & end timestamp (read straight from the TSC where available) into the calling
+     * thread's ring. dumpChrome() writes every ring out as Chrome trace JSON, which can be loaded in
+     * chrome://tracing or https://ui.perfetto.dev. dumping doesn't stop the writers, events overwritten while
+     * they're being copied are dropped.
+     */
+    class FoxTrace {
+    private:
+        static thread_local FoxTraceRing *ring;
+
+        static FoxTraceRing *attach(void);
+
+    public:
+        static FoxTraceRing &local(void) {
+            FoxTraceRing *r = ring;
+            return r != nullptr ? *r : *attach();
+        }
+
+        // raw timestamp, only meaningful relative to other timestamps
+        static uint64_t now(void) {
+#if defined(FOXTRACE_X86)
+            return __rdtsc();
+#elif defined(__aarch64__)
+            uint64_t val;
+            asm volatile("mrs %0, cntvct_el0" : "=r"(val));
+            return val;
+#else
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+        }
+
+        // shows up as the thread's name in the trace viewer
+        static void setThreadName(const std::string &name);
+
+        static std::string toChromeJSON(void);
+        static bool dumpChrome(const std::string &path); // returns false if the file couldn't be written
+        static bool isEnabled(void);
+    };
+
+    class FoxTraceScope {
+    private:
+        const char *name;
+        uint64_t begin;
+
+    public:
+        uint64_t arg = 0;
+
+        FoxTraceScope(const char *n): name(n), begin(FoxTrace::now()) {}
+
+        ~FoxTraceScope(void) {
+            FoxTrace::local().push(name, begin, FoxTrace::now(), arg);
+        }
+    };
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "FoxPacket.hpp"
+
+namespace FoxNet {
+    class FoxPollList;
+
+    /*
+     * A byte stream a FoxSocket can run on instead of a kernel socket (see FoxSocket::setTransport())
+     *
+     *  Transports don't have a file descriptor, so FoxPollList asks them for their readiness directly. A transport
+     * that becomes ready because of another thread (eg. the other end of a FoxPipe wrote to it) has to wake() the
+     * poll list it was given, otherwise the poller could sleep through it.
+     */
+    class FoxTransport {
+    public:
+        enum {
+            TRANSPORT_WOULDBLOCK = -1, // nothing to read, or no room to write right now
+            TRANSPORT_ERROR = -2
+        };
+
+        virtual ~FoxTransport(void) {}
+
+        // returns the bytes read, 0 if the other end closed, or TRANSPORT_WOULDBLOCK/TRANSPORT_ERROR
+        virtual int recv(Byte *buf, size_t sz) = 0;
+
+        // returns the bytes written (can be less than sz), or TRANSPORT_WOULDBLOCK/TRANSPORT_ERROR
+        virtual int send(const Byte *buf, size_t sz) = 0;
+
+        // the other end sees a close once it has read everything that was sent before it
+        virtual void close(void) = 0;
+
+        virtual bool readable(void) = 0; // would recv() return something other than TRANSPORT_WOULDBLOCK?
+        virtual bool writable(void) = 0; // would send() return something other than TRANSPORT_WOULDBLOCK?
+
+        // ms until readable() might change without a wake (eg. data still in flight), or -1 if it won't
+        virtual int pollTimeout(void) { return -1; }
+
+        // an fd that becomes readable when our readiness might've changed (eg. an eventfd another process writes to),
+        // FoxPollList polls & drains it alongside its kernel sockets. -1 if we don't have one
+        virtual int getWakeFd(void) { return -1; }
+
+        // the poll list to wake() when we become ready, nullptr once we're removed from it
+        virtual void setPollList(FoxPollList *list) = 0;
+    };
+}
@@ -1,7 +1,75 @@
 #include "ByteStream.hpp"
 
+#include <cmath>
+
 using namespace FoxNet;
 
+size_t FoxNet::decodeVarints(const Byte *data, size_t avail, uint64_t *out, size_t count) {
+    size_t head = 0, i = 0;
+
+#if !defined(__BYTE_ORDER__) || __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    // (a word holds at most 8 varints, so the loop doesn't have to watch count)
+    while (count - i >= sizeof(uint64_t) && avail - head >= sizeof(uint64_t)) {
+        uint64_t word, ends;
+        size_t used = 0;
+
+        memcpy(&word, data + head, sizeof(word));
+        ends = ~word & 0x8080808080808080ULL;
+
+        // 8 values under 128, no continuation bits to squeeze out
+        if (ends == 0x8080808080808080ULL) {
+            for (size_t j = 0; j < sizeof(uint64_t); j++)
+                out[i + j] = data[head + j];
+
+            i += sizeof(uint64_t);
+            head += sizeof(uint64_t);
+            continue;
+        }
+
+        // longer than 8 bytes, leave it to the slowpath
+        if (ends == 0) {
+            size_t sz = decodeVarint(data + head, avail - head, out[i]);
+
+            if (sz == 0)
+                return 0;
+
+            i++;
+            head += sz;
+            continue;
+        }
+
+        // every varint that ends in this word, a varint that runs past it is picked up by the next load
+        for (; ends != 0; ends &= ends - 1) {
+#ifdef _MSC_VER
+            unsigned long bit;
+            _BitScanForward64(&bit, ends);
+#else
+            int bit = __builtin_ctzll(ends);
+#endif
+            size_t end = bit / 8 + 1;
+
+            // (shifted down to the varint's first byte, masked past its last)
+            out[i++] = gatherVarint((word >> (used * 8)) & (~0ULL >> (64 - (end - used) * 8)));
+            used = end;
+        }
+
+        head += used;
+    }
+#endif
+
+    // the last few values & bytes (or everything on a big endian host), one at a time
+    for (; i < count; i++) {
+        size_t sz = decodeVarint(data + head, avail - head, out[i]);
+
+        if (sz == 0)
+            return 0;
+
+        head += sz;
+    }
+
+    return head;
+}
+
 // constructors
 ByteStream::ByteStream() {
     inBuffer.reserve(BSTREAM_RESERVED);
@@ -12,6 +80,12 @@ void ByteStream::rawWriteIn(Byte *in, size_t sz) {
     inBuffer.insert(inBuffer.end(), &in[0], &in[sz]);
 }
 
+void ByteStream::setInView(const Byte *data, size_t sz) {
+    inView = data;
+    inViewSize = sz;
+    inHead = 0;
+}
+
 std::vector<Byte>& ByteStream::getOutBuffer() {
     return outBuffer;
 }
@@ -28,6 +102,9 @@ void ByteStream::flushOut() {
 void ByteStream::flushIn() {
     inBuffer.clear();
     inBuffer.reserve(BSTREAM_RESERVED);
+    inView = nullptr;
+    inViewSize = 0;
+    inHead = 0;
 }
 
 size_t ByteStream::sizeOut() {
@@ -35,7 +112,7 @@ size_t ByteStream::sizeOut() {
 }
 
 size_t ByteStream::sizeIn() {
-    return inBuffer.size();
+    return (inView != nullptr ? inViewSize : inBuffer.size()) - inHead;
 }
 
 void ByteStream::setFlipEndian(bool _e) {
@@ -44,12 +121,20 @@ void ByteStream::setFlipEndian(bool _e) {
 
 bool ByteStream::readBytes(Byte *out, size_t sz) {
     // make sure we can actually read that data :P
-    if (inBuffer.size() < sz)
+    if (sizeIn() < sz)
         return false;
 
-    std::copy(inBuffer.begin(), inBuffer.begin() + sz, out);
-    inBuffer.erase(inBuffer.begin(), inBuffer.begin() + sz);
+    memcpy(out, inCursor(), sz);
+    advanceIn(sz);
+    return true;
+}
+
+bool ByteStream::readView(ByteView &out, size_t sz) {
+    if (sizeIn() < sz)
+        return false;
 
+    out = ByteView(inCursor(), sz, flipEndian);
+    inHead += sz;
     return true;
 }
 
@@ -59,9 +144,153 @@ void ByteStream::writeBytes(Byte *in, size_t sz) {
 
 bool ByteStream::patchBytes(Byte *in, size_t sz, size_t indx) {
     // sanity check
-    if (indx + 1 > outBuffer.size())
+    if (indx + sz > outBuffer.size())
         return false;
 
     std::copy(in, in + sz, outBuffer.begin() + indx);
-    return false;
-}
\ No newline at end of file
+    return true;
+}
+
+void ByteStream::writeVarint(uint64_t val) {
+    Byte buf[BSTREAM_VARINT_MAX];
+
+    writeBytes(buf, encodeVarint(buf, val));
+}
+
+void ByteStream::writeSignedVarint(int64_t val) {
+    writeVarint(zigzagEncode(val));
+}
+
+bool ByteStream::readVarint(uint64_t &out) {
+    size_t sz = decodeVarint(inCursor(), sizeIn(), out);
+
+    if (sz == 0)
+        return false;
+
+    advanceIn(sz);
+    return true;
+}
+
+bool ByteStream::readSignedVarint(int64_t &out) {
+    uint64_t val;
+
+    if (!readVarint(val))
+        return false;
+
+    out = zigzagDecode(val);
+    return true;
+}
+
+bool ByteStream::readVarints(uint64_t *out, size_t count) {
+    size_t sz = decodeVarints(inCursor(), sizeIn(), out, count);
+
+    if (sz == 0)
+        return count == 0;
+
+    advanceIn(sz);
+    return true;
+}
+
+BitWriter::~BitWriter() {
+    flush();
+}
+
+void BitWriter::write(uint64_t val, int width) {
+    if (width < 64)
+        val &= (1ULL << width) - 1;
+
+    // whatever doesn't fit in the pending bits is carried over once they're written
+    bits |= val << count;
+    if (count + width < 64) {
+        count += width;
+    } else {
+        int fit = 64 - count;
+        Byte buf[sizeof(uint64_t)];
+
+        for (size_t i = 0; i < sizeof(buf); i++)
+            buf[i] = (Byte)(bits >> (i * 8));
+
+        stream.writeBytes(buf, sizeof(buf));
+        bits = fit < 64 ? val >> fit : 0;
+        count = width - fit;
+    }
+}
+
+void BitWriter::writeBool(bool val) {
+    write(val ? 1 : 0, 1);
+}
+
+void BitWriter::writeFloat(float val, float min, float max, int width) {
+    uint64_t steps = (1ULL << width) - 1;
+    float norm = (std::min(std::max(val, min), max) - min) / (max - min);
+
+    write((uint64_t)std::lround(norm * (double)steps), width);
+}
+
+void BitWriter::flush() {
+    Byte buf[sizeof(uint64_t)];
+    size_t sz = (count + 7) / 8;
+
+    for (size_t i = 0; i < sz; i++)
+        buf[i] = (Byte)(bits >> (i * 8));
+
+    if (sz > 0)
+        stream.writeBytes(buf, sz);
+
+    bits = 0;
+    count = 0;
+}
+
+bool BitReader::pull() {
+    Byte b;
+
+    if (!(stream != nullptr ? stream->readByte(b) : view->readByte(b)))
+        return false;
+
+    bits |= (uint64_t)b << count;
+    count += 8;
+    return true;
+}
+
+bool BitReader::read(uint64_t &out, int width) {
+    // at most 7 bits are left over, so a full 64 bit value is read in two halves
+    if (width > 56) {
+        uint64_t low, high;
+
+        if (!read(low, 32) || !read(high, width - 32))
+            return false;
+
+        out = low | (high << 32);
+        return true;
+    }
+
+    while (count < width) {
+        if (!pull())
+            return false;
+    }
+
+    out = bits & ((1ULL << width) - 1);
+    bits >>= width;
+    count -= width;
+    return true;
+}
+
+bool BitReader::readBool(bool &out) {
+    uint64_t val;
+
+    if (!read(val, 1))
+        return false;
+
+    out = val != 0;
+    return true;
+}
+
+bool BitReader::readFloat(float &out, float min, float max, int width) {
+    uint64_t val;
+
+    if (!read(val, width))
+        return false;
+
+    out = min + (float)((double)val / (double)((1ULL << width) - 1)) * (max - min);
+    return true;
+}
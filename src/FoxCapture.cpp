@@ -0,0 +1,176 @@
+#include "FoxCapture.hpp"
+
+#include <cstring>
+
+using namespace FoxNet;
+
+#define FOXCAPTURE_HEADER_SIZE (FOXCAPTURE_MAGICLEN + 2)
+#define FOXCAPTURE_RECORD_SIZE (sizeof(Byte) + sizeof(int64_t) + sizeof(uint32_t) + sizeof(uint32_t))
+
+static int64_t captureNanos() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void putLE(Byte *out, uint64_t val, size_t sz) {
+    for (size_t i = 0; i < sz; i++)
+        out[i] = (Byte)(val >> (i * 8));
+}
+
+static uint64_t getLE(const Byte *in, size_t sz) {
+    uint64_t val = 0;
+
+    for (size_t i = 0; i < sz; i++)
+        val |= (uint64_t)in[i] << (i * 8);
+
+    return val;
+}
+
+// ============================================= [[ FoxCapture ]] =============================================
+
+FoxCapture::FoxCapture(const std::string &path) {
+    Byte header[FOXCAPTURE_HEADER_SIZE] = {};
+
+    file = fopen(path.c_str(), "wb");
+    if (file == NULL) {
+        FOXFATAL("couldn't open capture file!")
+    }
+
+    memcpy(header, FOXCAPTURE_MAGIC, FOXCAPTURE_MAGICLEN);
+    header[FOXCAPTURE_MAGICLEN] = FOXCAPTURE_VERSION;
+    fwrite(header, 1, sizeof(header), file);
+
+    startTime = captureNanos();
+    buffered.reserve(FOXCAPTURE_FLUSH_SIZE);
+    writer = std::thread(&FoxCapture::writerThread, this);
+}
+
+FoxCapture::~FoxCapture() {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+
+    wake.notify_one();
+    writer.join();
+    fclose(file);
+}
+
+void FoxCapture::writerThread() {
+    std::vector<Byte> writing;
+    std::unique_lock<std::mutex> guard(lock);
+
+    while (true) {
+        wake.wait_for(guard, std::chrono::milliseconds(FOXCAPTURE_FLUSH_INTERVAL), [this]() {
+            return stopping || buffered.size() >= FOXCAPTURE_FLUSH_SIZE;
+        });
+
+        // swap the buffers so the reactor can keep appending while we hit the disk
+        writing.swap(buffered);
+        bool done = stopping;
+        guard.unlock();
+
+        if (!writing.empty()) {
+            fwrite(writing.data(), 1, writing.size(), file);
+            fflush(file);
+            writing.clear();
+        }
+
+        guard.lock();
+        if (done && buffered.empty())
+            return;
+    }
+}
+
+bool FoxCapture::addRecord(FoxCaptureType type, uint32_t peer, const Byte *data, uint32_t sz, bool force) {
+    Byte header[FOXCAPTURE_RECORD_SIZE];
+    std::lock_guard<std::mutex> guard(lock);
+
+    if (!force && buffered.size() + sizeof(header) + sz > FOXCAPTURE_MAX_BUFFERED) {
+        dropped++;
+        return false;
+    }
+
+    header[0] = type;
+    putLE(header + 1, (uint64_t)(captureNanos() - startTime), sizeof(int64_t));
+    putLE(header + 1 + sizeof(int64_t), peer, sizeof(uint32_t));
+    putLE(header + 1 + sizeof(int64_t) + sizeof(uint32_t), sz, sizeof(uint32_t));
+
+    buffered.insert(buffered.end(), header, header + sizeof(header));
+    if (sz > 0)
+        buffered.insert(buffered.end(), data, data + sz);
+
+    if (buffered.size() >= FOXCAPTURE_FLUSH_SIZE)
+        wake.notify_one();
+
+    return true;
+}
+
+uint32_t FoxCapture::openPeer() {
+    uint32_t peer = nextPeer++;
+
+    addRecord(CAPTURE_OPEN, peer, nullptr, 0, true);
+    return peer;
+}
+
+bool FoxCapture::recordData(uint32_t peer, const Byte *data, size_t sz) {
+    return addRecord(CAPTURE_DATA, peer, data, (uint32_t)sz, false);
+}
+
+void FoxCapture::closePeer(uint32_t peer) {
+    // always recorded, otherwise a replay can't tell the peer's stream was cut short
+    addRecord(CAPTURE_CLOSE, peer, nullptr, 0, true);
+}
+
+uint64_t FoxCapture::getDropped() {
+    return dropped.load();
+}
+
+// ============================================= [[ FoxCaptureReader ]] =============================================
+
+FoxCaptureReader::FoxCaptureReader(const std::string &path) {
+    Byte header[FOXCAPTURE_HEADER_SIZE];
+
+    file = fopen(path.c_str(), "rb");
+    if (file == NULL) {
+        FOXFATAL("couldn't open capture file!")
+    }
+
+    if (fread(header, 1, sizeof(header), file) != sizeof(header) || memcmp(header, FOXCAPTURE_MAGIC, FOXCAPTURE_MAGICLEN) != 0) {
+        fclose(file);
+        FOXFATAL("not a FoxNet capture file!")
+    }
+
+    if (header[FOXCAPTURE_MAGICLEN] != FOXCAPTURE_VERSION) {
+        fclose(file);
+        FOXFATAL("unsupported capture file version!")
+    }
+}
+
+FoxCaptureReader::~FoxCaptureReader() {
+    fclose(file);
+}
+
+bool FoxCaptureReader::next(FoxCaptureRecord &record) {
+    Byte header[FOXCAPTURE_RECORD_SIZE];
+    size_t read = fread(header, 1, sizeof(header), file);
+    uint32_t sz;
+
+    if (read == 0)
+        return false;
+
+    if (read != sizeof(header) || header[0] > CAPTURE_CLOSE) {
+        FOXFATAL("corrupt capture file!")
+    }
+
+    record.type = (FoxCaptureType)header[0];
+    record.time = (int64_t)getLE(header + 1, sizeof(int64_t));
+    record.peer = (uint32_t)getLE(header + 1 + sizeof(int64_t), sizeof(uint32_t));
+    sz = (uint32_t)getLE(header + 1 + sizeof(int64_t) + sizeof(uint32_t), sizeof(uint32_t));
+
+    record.data.resize(sz);
+    if (sz > 0 && fread(record.data.data(), 1, sz, file) != sz) {
+        FOXFATAL("truncated capture file!")
+    }
+
+    return true;
+}
@@ -0,0 +1,158 @@
+#include "FoxChecksum.hpp"
+
+#include <cstring>
+
+#if (defined(__x86_64__) || defined(_M_X64)) && (defined(__GNUC__) || defined(_MSC_VER))
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#include <nmmintrin.h>
+#define FOXCRC_X86
+#elif defined(__aarch64__) && defined(__GNUC__)
+#include <arm_acle.h>
+#ifdef __linux__
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+#define FOXCRC_ARM
+#endif
+
+using namespace FoxNet;
+
+typedef uint32_t (*CrcFunc)(uint32_t crc, const Byte *data, size_t sz);
+
+// reflected Castagnoli polynomial
+#define FOXCRC_POLY 0x82F63B78
+
+namespace {
+    struct SliceTables {
+        uint32_t t[8][256];
+
+        SliceTables() {
+            for (uint32_t i = 0; i < 256; i++) {
+                uint32_t crc = i;
+
+                for (int k = 0; k < 8; k++)
+                    crc = (crc >> 1) ^ ((crc & 1) ? FOXCRC_POLY : 0);
+
+                t[0][i] = crc;
+            }
+
+            // t[k][i] is the crc of byte i followed by k zero bytes
+            for (int k = 1; k < 8; k++) {
+                for (int i = 0; i < 256; i++)
+                    t[k][i] = (t[k - 1][i] >> 8) ^ t[0][t[k - 1][i] & 0xFF];
+            }
+        }
+    };
+
+    const SliceTables tables;
+}
+
+static uint32_t crcSliced(uint32_t crc, const Byte *data, size_t sz) {
+    const uint32_t (*t)[256] = tables.t;
+
+    // 8 bytes per step, each through its own table (bytes are loaded one by one, so this doesn't care about endianness)
+    while (sz >= 8) {
+        uint32_t lo = crc ^ ((uint32_t)data[0] | (uint32_t)data[1] << 8 | (uint32_t)data[2] << 16 | (uint32_t)data[3] << 24);
+
+        crc = t[7][lo & 0xFF] ^ t[6][(lo >> 8) & 0xFF] ^ t[5][(lo >> 16) & 0xFF] ^ t[4][lo >> 24] ^
+            t[3][data[4]] ^ t[2][data[5]] ^ t[1][data[6]] ^ t[0][data[7]];
+        data += 8;
+        sz -= 8;
+    }
+
+    while (sz-- > 0)
+        crc = t[0][(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+
+    return crc;
+}
+
+#ifdef FOXCRC_X86
+#ifndef _MSC_VER
+__attribute__((target("sse4.2")))
+#endif
+static uint32_t crcHardware(uint32_t crc, const Byte *data, size_t sz) {
+    uint64_t crc64 = crc;
+
+    while (sz >= 8) {
+        uint64_t word;
+
+        memcpy(&word, data, sizeof(word));
+        crc64 = _mm_crc32_u64(crc64, word);
+        data += 8;
+        sz -= 8;
+    }
+
+    crc = (uint32_t)crc64;
+    while (sz-- > 0)
+        crc = _mm_crc32_u8(crc, *data++);
+
+    return crc;
+}
+
+static bool hasHardware(void) {
+#ifdef _MSC_VER
+    int info[4];
+
+    __cpuid(info, 1);
+    return (info[2] & (1 << 20)) != 0;
+#else
+    return __builtin_cpu_supports("sse4.2");
+#endif
+}
+#elif defined(FOXCRC_ARM)
+#ifdef __clang__
+__attribute__((target("crc")))
+#else
+__attribute__((target("+crc")))
+#endif
+static uint32_t crcHardware(uint32_t crc, const Byte *data, size_t sz) {
+    while (sz >= 8) {
+        uint64_t word;
+
+        memcpy(&word, data, sizeof(word));
+        crc = __crc32cd(crc, word);
+        data += 8;
+        sz -= 8;
+    }
+
+    while (sz-- > 0)
+        crc = __crc32cb(crc, *data++);
+
+    return crc;
+}
+
+static bool hasHardware(void) {
+#if defined(__linux__)
+    return (getauxval(AT_HWCAP) & HWCAP_CRC32) != 0;
+#elif defined(__APPLE__)
+    return true; // every apple arm64 cpu has it
+#else
+    return false;
+#endif
+}
+#endif
+
+static CrcFunc pickCrc(void) {
+#if defined(FOXCRC_X86) || defined(FOXCRC_ARM)
+    if (hasHardware())
+        return crcHardware;
+#endif
+
+    return crcSliced;
+}
+
+static const CrcFunc crcImpl = pickCrc();
+
+uint32_t FoxChecksum::crc32c(const Byte *data, size_t sz, uint32_t crc) {
+    return ~crcImpl(~crc, data, sz);
+}
+
+uint32_t FoxChecksum::crc32cPortable(const Byte *data, size_t sz, uint32_t crc) {
+    return ~crcSliced(~crc, data, sz);
+}
+
+bool FoxChecksum::isAccelerated() {
+    return crcImpl != crcSliced;
+}
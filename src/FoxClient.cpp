@@ -1,54 +1,369 @@
 #include "FoxClient.hpp"
+#include "FoxClientGroup.hpp"
+#include "FoxMetrics.hpp"
 
+#include <algorithm>
 #include <cstring>
 
 using namespace FoxNet;
 
-FoxClient::FoxClient() {
+FoxClient::FoxClient(): connector(this) {
     // TODO
 }
 
-void FoxClient::connect(std::string ip, std::string port) {
-    // connect to ip & port
-    FoxSocket::connect(ip, port);
+FoxClient::~FoxClient() {
+    closeDatagrams();
 
-    // set our socket to non-blocking
-    setNonBlocking();
+    // make sure the group's poll list isn't left with dangling pointers to us
+    if (group != nullptr)
+        group->rmvClient(this);
+
+    for (FoxDatagram *dgram : deadDatagrams)
+        delete dgram;
+
+    // a hostname still being resolved mustn't wake our list once it's gone
+    if (isConnecting())
+        connector.cancel(getPollList());
+
+    delete ownList;
+}
+
+FoxPollList &FoxClient::getPollList() {
+    // clients in a group share the group's poll list, so we only need our own if we're on our own
+    if (pList == nullptr) {
+        ownList = new FoxPollList(1);
+        pList = ownList;
+    }
 
-    pList.addSock(static_cast<FoxSocket*>(this));
+    return *pList;
+}
 
+void FoxClient::sendHandshake() {
     // connection successful! send handshake
+    PktLane lane = setLane(PKTLANE_CONTROL);
     writeData((PktID)PKTID_HANDSHAKE_REQ);
     writeBytes((Byte*)FOXMAGIC, FOXMAGICLEN);
     writeByte(FOXNET_MAJOR);
     writeByte(FOXNET_MINOR);
     writeByte(isBigEndian());
+    writeByte(PKTID_SESSION_REQ);
+    writeInt<uint32_t>(getOfferedCaps());
+    writeInt<uint64_t>(resumeToken);
 
-    if (!handlePollOut(pList))
+    // we don't wait on the response, the server parses whatever we send behind the request once it accepted it.
+    // (it turns on whatever we ask for, so framing starts right after the request too)
+    queueHandshake();
+    setLane(lane);
+
+    if (!flush())
         FOXFATAL("couldn't send PKTID_HANDSHAKE_REQ!")
 }
 
-void FoxClient::pollPeer(int timeout) {
-    if (!isAlive()) {
-        FOXWARN("pollPeer() called on a dead connection!");
+void FoxClient::killClient() {
+    closeDatagrams();
+    getPollList().rmvSock(this);
+    kill();
+    checkRPCTimeouts();
+    cancelWaiters();
+}
+
+void FoxClient::connect(std::string ip, std::string port, bool fastOpen) {
+    // connect to ip & port
+    FoxSocket::connect(ip, port, fastOpen);
+
+    // set our socket to non-blocking
+    setNonBlocking();
+
+    getPollList().addSock(static_cast<FoxSocket*>(this));
+    sendHandshake();
+}
+
+void FoxClient::connectUnix(const std::string &path, bool shm) {
+    FoxSocket::connectUnix(path);
+    setNonBlocking();
+    setWantShm(shm);
+
+    getPollList().addSock(static_cast<FoxSocket*>(this));
+    sendHandshake();
+}
+
+void FoxClient::connectAsync(std::string ip, std::string port, int timeout) {
+    if (isAlive()) {
+        FOXFATAL("socket already setup!")
+    }
+
+    connecting = true;
+    connector.start(getPollList(), ip, port, timeout);
+    tick();
+
+    if (group != nullptr)
+        group->markTicking(this);
+}
+
+void FoxClient::connectTransport(FoxTransport *transport) {
+    setTransport(transport);
+
+    getPollList().addSock(static_cast<FoxSocket*>(this));
+    sendHandshake();
+}
+
+void FoxClient::enableDatagrams() {
+    datagramWanted = true;
+}
+
+void FoxClient::enableResumption(uint64_t token) {
+    resumable = true;
+    resumeToken = token;
+}
+
+void FoxClient::acceptDatagramOffer(uint16_t port) {
+    struct sockaddr_storage address;
+    socklen_t addressSize = sizeof(address);
+    FoxDatagram *dgram;
+
+    // the server's datagram port is on the same address we're connected to
+    if (SOCKETERROR(::getpeername(FoxSocket::getRawSock(), (struct sockaddr *)&address, &addressSize)))
+        return;
+
+    if (address.ss_family == AF_INET) {
+        ((struct sockaddr_in *)&address)->sin_port = htons(port);
+    } else if (address.ss_family == AF_INET6) {
+        ((struct sockaddr_in6 *)&address)->sin6_port = htons(port);
+    } else {
         return;
     }
 
-    std::vector<FoxPollEvent> event = pList.pollList(timeout);
+    dgram = new FoxDatagram(this);
+    try {
+        dgram->connectDatagram((struct sockaddr *)&address, addressSize);
+    } catch(FoxException &e) {
+        delete dgram;
+        FOXWARN("couldn't open the datagram channel, staying on the stream");
+        return;
+    }
+    dgram->setNonBlocking();
+
+    datagram = dgram;
+    datagramOwned = true;
+    getPollList().addSock(datagram);
+
+    helloTries = 0;
+    sendDatagramHello();
+
+    if (group != nullptr)
+        group->markTicking(this);
+}
+
+void FoxClient::sendDatagramHello() {
+    Byte hello[FOXNET_DATAGRAM_HEADER + sizeof(uint64_t)];
 
-    if (event.size() != 1)
+    if (helloTries++ == FOXNET_DATAGRAM_HELLO_TRIES) {
+        FOXWARN("datagram hello went unanswered, staying on the stream");
+        closeDatagrams();
         return;
+    }
+
+    FoxDatagram::putInt<uint32_t>(hello, datagramSession);
+    FoxDatagram::putInt<uint32_t>(hello + sizeof(uint32_t), 0);
+    FoxDatagram::putInt<uint64_t>(hello + FOXNET_DATAGRAM_HEADER, datagramToken);
+    datagram->queue(hello, sizeof(hello), nullptr, 0);
+    datagram->flush();
+
+    nextHello = getTicks() + FOXNET_DATAGRAM_HELLO_INTERVAL;
+}
+
+void FoxClient::pollDatagrams() {
+    size_t count = FOXNET_DATAGRAM_BATCH;
+
+    for (int i = 0; i < FOXNET_DATAGRAM_READS && count == FOXNET_DATAGRAM_BATCH && isAlive(); i++) {
+        count = datagram->recvBatch();
+
+        for (size_t j = 0; j < count && isAlive(); j++) {
+            FoxDatagram::Message &msg = datagram->getRecv(j);
+
+            // (we're connected, so everything is from the server)
+            if (msg.size < FOXNET_DATAGRAM_HEADER || FoxDatagram::getInt<uint32_t>(msg.data) != datagramSession) {
+                FOXMETRIC(addDatagramsDropped(1))
+                continue;
+            }
+
+            handleDatagram(msg.data, msg.size);
+        }
+    }
+
+    if (count == FOXNET_DATAGRAM_BATCH && datagram != nullptr)
+        getPollList().setReady(datagram);
+}
+
+void FoxClient::closeDatagrams() {
+    if (datagram == nullptr)
+        return;
+
+    getPollList().rmvSock(datagram);
+
+    // we might be in the middle of the poll loop, it's freed by the next poll
+    if (group != nullptr)
+        group->deadDatagrams.push_back(datagram);
+    else
+        deadDatagrams.push_back(datagram);
+
+    datagram = nullptr;
+    datagramOwned = false;
+    datagramReady = false;
+}
+
+bool FoxClient::isConnecting() {
+    return connecting;
+}
+
+void FoxClient::onConnectFailed() {
+    FOXWARN("connectAsync() failed!");
+}
+
+void FoxClient::writeBytes(Byte *in, size_t sz) {
+    FoxPeer::writeBytes(in, sz);
+
+    // let the group know we have something to send
+    if (!dirty && group != nullptr) {
+        dirty = true;
+        group->markDirty(this);
+    }
+}
+
+bool FoxClient::handleEvent(FoxPollEvent &e) {
+    if (e.sock == datagram) {
+        // (an error on the datagram socket is just a lost datagram, reading clears it)
+        pollDatagrams();
+
+        if (!isAlive() || !flush()) {
+            killClient();
+            return false;
+        }
+
+        return true;
+    }
+
+    if (e.sock != this) {
+        // it's one of our connect attempts
+        if (!connector.ownsSock(e.sock))
+            return true;
+
+        FoxConnectAttempt *winner = connector.handleEvent(getPollList(), e);
+        if (winner == nullptr)
+            return true;
+
+        takeSock(winner);
+        delete winner;
+
+        connecting = false;
+        getPollList().addSock(static_cast<FoxSocket*>(this));
+        sendHandshake();
+        return true;
+    }
 
     // handle events
-    if (event[0].pollIn && !handlePollIn(pList))
-        goto _FC_kill;
+    if ((e.pollIn && handlePollIn(getPollList()) != PEERPOLL_OK) ||
+            (e.pollOut && handlePollOut(getPollList()) != PEERPOLL_OK) ||
+            (e.pollErr && handlePollErr(getPollList()) != PEERPOLL_OK) || (!e.pollIn && !e.pollOut && !e.pollErr)) {
+        // no events? socket error
+        killClient();
+        return false;
+    }
+
+    return true;
+}
+
+bool FoxClient::flush() {
+    dirty = false;
+
+    if (!isAlive())
+        return true;
+
+    // datagrams don't wait on the stream
+    flushDatagrams();
+
+    if (setPollOut || pendingOut() == 0)
+        return true;
+
+    if (handlePollOut(getPollList()) != PEERPOLL_OK) {
+        killClient();
+        return false;
+    }
+
+    return true;
+}
+
+void FoxClient::tick() {
+    if (connecting) {
+        connector.tick(getPollList());
+
+        // the connector gave up
+        if (!connector.isActive() && !isAlive()) {
+            connecting = false;
+            checkRPCTimeouts();
+            cancelWaiters();
+            onConnectFailed();
+            return;
+        }
+    }
+
+    if (datagram != nullptr && !datagramReady && getTicks() >= nextHello)
+        sendDatagramHello();
+
+    checkRPCTimeouts();
+}
+
+int FoxClient::getTimeout(int timeout) {
+    timeout = connector.getTimeout(getRPCTimeout(timeout));
+
+    // wake up to resend the hello
+    if (datagram != nullptr && !datagramReady) {
+        int64_t wait = std::max<int64_t>(nextHello - getTicks(), 0);
+
+        if (timeout < 0 || wait < timeout)
+            timeout = (int)wait;
+    }
+
+    return timeout;
+}
 
-    if (event[0].pollOut && !handlePollOut(pList))
-        goto _FC_kill;
+bool FoxClient::needsTick() {
+    return connecting || getPendingRPCs() > 0 || (datagram != nullptr && !datagramReady);
+}
+
+void FoxClient::pollPeer(int timeout) {
+    if (group != nullptr) {
+        FOXFATAL("pollPeer() called on a grouped client, use FoxClientGroup::pollClients()!")
+    }
 
-    if (!event[0].pollIn && !event[0].pollOut) { // no events? socket error
-_FC_kill:
-        kill();
+    if (!isAlive() && !isConnecting()) {
+        FOXWARN("pollPeer() called on a dead connection!");
         return;
     }
+
+    for (FoxDatagram *dgram : deadDatagrams)
+        delete dgram;
+    deadDatagrams.clear();
+
+    // send anything written since the last poll
+    if (!flush())
+        return;
+
+    // wake up in time for any rpc timeouts or connect attempts
+    getPollList().pollList(getTimeout(timeout), events);
+
+#ifdef FOXNET_ENABLE_METRICS
+    int64_t pollStart = FoxMetrics::now();
+#endif
+
+    for (FoxPollEvent &e : events) {
+        if (!handleEvent(e))
+            return;
+    }
+
+    tick();
+
+    if (events.size() > 0) {
+        FOXMETRIC(addPoll(FoxMetrics::now() - pollStart))
+    }
 }
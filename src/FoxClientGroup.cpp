@@ -0,0 +1,155 @@
+#include "FoxClientGroup.hpp"
+#include "FoxMetrics.hpp"
+
+#include <algorithm>
+
+using namespace FoxNet;
+
+FoxClientGroup::FoxClientGroup(size_t reserved): pollList(reserved) {
+    clients.reserve(reserved);
+}
+
+FoxClientGroup::~FoxClientGroup() {
+    // clients outlive us, cut them loose so they don't point to a dead group
+    for (FoxClient *client : getClientList())
+        rmvClient(client);
+
+    for (FoxDatagram *dgram : deadDatagrams)
+        delete dgram;
+}
+
+void FoxClientGroup::markDirty(FoxClient *client) {
+    dirtyClients.push_back(client);
+}
+
+void FoxClientGroup::markTicking(FoxClient *client) {
+    tickingClients.insert(client);
+}
+
+void FoxClientGroup::addClient(FoxClient *client) {
+    if (client->group != nullptr || client->pList != nullptr) {
+        FOXFATAL("client is already connected or in a group!")
+    }
+
+    client->group = this;
+    client->pList = &pollList;
+    clients.insert(client);
+}
+
+void FoxClientGroup::rmvClient(FoxClient *client) {
+    if (clients.erase(client) == 0)
+        return;
+
+    // the client can't use our poll list anymore
+    if (client->isConnecting())
+        client->connector.cancel(pollList);
+
+    if (client->isAlive())
+        pollList.rmvSock(client);
+
+    client->closeDatagrams();
+
+    client->group = nullptr;
+    client->pList = nullptr;
+    client->connecting = false;
+    client->dirty = false;
+
+    dirtyClients.erase(std::remove(dirtyClients.begin(), dirtyClients.end(), client), dirtyClients.end());
+    tickingClients.erase(client);
+}
+
+void FoxClientGroup::onClientKilled(FoxClient *) {
+    // stubbed
+}
+
+bool FoxClientGroup::pollClients(int timeout) {
+    FoxClient *client;
+
+    // nothing from the last batch can point at these anymore
+    for (FoxDatagram *dgram : deadDatagrams)
+        delete dgram;
+    deadDatagrams.clear();
+
+    // send everything that was written since the last poll in one go
+    for (size_t i = 0; i < dirtyClients.size(); i++) {
+        client = dirtyClients[i];
+
+        if (!client->flush())
+            onClientKilled(client);
+    }
+    dirtyClients.clear();
+
+    // wake up in time for the next rpc timeout or connect attempt
+    for (FoxClient *c : tickingClients)
+        timeout = c->getTimeout(timeout);
+
+    pollList.pollList(timeout, events);
+
+#ifdef FOXNET_ENABLE_METRICS
+    int64_t pollStart = FoxMetrics::now();
+#endif
+
+    for (FoxPollEvent &e : events) {
+        // events on connect attempts (and datagram sockets) belong to the client that started them
+        FoxConnectAttempt *attempt = dynamic_cast<FoxConnectAttempt*>(e.sock);
+        client = dynamic_cast<FoxClient*>(attempt != nullptr ? attempt->owner : e.sock);
+        if (client == nullptr) {
+            FoxDatagram *dgram = dynamic_cast<FoxDatagram*>(e.sock);
+
+            if (dgram == nullptr)
+                continue;
+
+            client = dynamic_cast<FoxClient*>(dgram->owner);
+            if (client == nullptr)
+                continue;
+        }
+
+        try {
+            if (!client->handleEvent(e)) {
+                onClientKilled(client);
+                continue;
+            }
+        } catch(...) {
+            client->killClient();
+            onClientKilled(client);
+            continue;
+        }
+
+        if (client->needsTick())
+            tickingClients.insert(client);
+    }
+
+    // only clients with timers are ticked, so this doesn't cost O(n) every wakeup
+    for (auto iter = tickingClients.begin(); iter != tickingClients.end();) {
+        client = *iter;
+        bool alive = client->isAlive() || client->isConnecting();
+
+        client->tick();
+
+        if (alive && !client->isAlive() && !client->isConnecting())
+            onClientKilled(client);
+
+        if (client->needsTick())
+            iter++;
+        else
+            iter = tickingClients.erase(iter);
+    }
+
+    if (events.size() > 0) {
+        FOXMETRIC(addPoll(FoxMetrics::now() - pollStart))
+    }
+
+    return events.size() > 0;
+}
+
+void FoxClientGroup::enableEdgeTriggered() {
+    pollList.enableEdgeTriggered();
+}
+
+std::vector<FoxClient*> FoxClientGroup::getClientList() {
+    return std::vector<FoxClient*>(clients.begin(), clients.end());
+}
+
+size_t FoxClientGroup::getClientCount() {
+    return clients.size();
+}
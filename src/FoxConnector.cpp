@@ -0,0 +1,311 @@
+#include "FoxConnector.hpp"
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <thread>
+
+using namespace FoxNet;
+
+// ============================================= [[ resolver pool ]] =============================================
+
+/*
+ * getaddrinfo() blocks, so lookups are handed to a few threads shared by every connector. threads are only started
+ * once lookups start piling up, and they're never stopped (the pool lives until the process exits), a lookup that's
+ * stuck in the resolver can't hold up anyone's shutdown
+ */
+class FoxResolverPool {
+private:
+    std::mutex lock;
+    std::condition_variable wake;
+    std::deque<std::function<void()>> jobs;
+    int threads = 0;
+    int idle = 0;
+
+    void worker() {
+        std::unique_lock<std::mutex> guard(lock);
+
+        while (true) {
+            idle++;
+            wake.wait(guard, [this]() { return !jobs.empty(); });
+            idle--;
+
+            std::function<void()> job = std::move(jobs.front());
+            jobs.pop_front();
+
+            guard.unlock();
+            job();
+            guard.lock();
+        }
+    }
+
+public:
+    static FoxResolverPool &get() {
+        // leaked on purpose, detached workers might still be using it while statics are destroyed
+        static FoxResolverPool *pool = new FoxResolverPool();
+
+        return *pool;
+    }
+
+    void queue(std::function<void()> &&job) {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+
+            jobs.push_back(std::move(job));
+            if (idle < (int)jobs.size() && threads < FOXNET_RESOLVER_THREADS) {
+                threads++;
+                std::thread(&FoxResolverPool::worker, this).detach();
+            }
+        }
+
+        wake.notify_one();
+    }
+};
+
+// ============================================= [[ FoxConnector ]] =============================================
+
+FoxConnector::FoxConnector(FoxSocket *o): owner(o) {}
+
+FoxConnector::~FoxConnector() {
+    abandonResolve();
+
+    // we don't have the poll list anymore, the attempts close their sockets when deleted
+    for (FoxConnectAttempt *attempt : attempts)
+        delete attempt;
+
+    for (FoxConnectAttempt *attempt : deadAttempts)
+        delete attempt;
+}
+
+std::vector<FoxConnector::Candidate> FoxConnector::resolve(const std::string &ip, const std::string &port, bool numericOnly, bool &ok) {
+    struct addrinfo res, *result, *curr;
+    std::vector<Candidate> candidates;
+
+    // zero out our address info and setup the type
+    memset(&res, 0, sizeof(addrinfo));
+    res.ai_family = AF_UNSPEC;
+    res.ai_socktype = SOCK_STREAM;
+    res.ai_flags = numericOnly ? AI_NUMERICHOST : 0;
+
+    ok = ::getaddrinfo(ip.c_str(), port.c_str(), &res, &result) == 0;
+    if (!ok)
+        return candidates;
+
+    for (curr = result; curr != NULL; curr = curr->ai_next) {
+        Candidate cand;
+
+        if (curr->ai_addrlen > sizeof(cand.addr))
+            continue;
+
+        memcpy(&cand.addr, curr->ai_addr, curr->ai_addrlen);
+        cand.addrLen = (socklen_t)curr->ai_addrlen;
+        candidates.push_back(cand);
+    }
+    freeaddrinfo(result);
+
+    return candidates;
+}
+
+void FoxConnector::setCandidates(std::vector<Candidate> &&result) {
+    std::vector<Candidate> first, second;
+
+    // interleave the address families, starting with whichever family the resolver preferred [see: RFC 8305 section 4]
+    for (Candidate &cand : result) {
+        if (first.empty() || cand.addr.ss_family == first[0].addr.ss_family)
+            first.push_back(cand);
+        else
+            second.push_back(cand);
+    }
+
+    candidates.clear();
+    for (size_t i = 0; i < first.size() || i < second.size(); i++) {
+        if (i < first.size())
+            candidates.push_back(first[i]);
+        if (i < second.size())
+            candidates.push_back(second[i]);
+    }
+
+    nextCandidate = 0;
+    nextAttempt = getTicks();
+}
+
+void FoxConnector::abandonResolve() {
+    if (resolving == nullptr)
+        return;
+
+    // the lookup finishes on its own, just make sure it doesn't wake a poll list that might be gone by then
+    std::lock_guard<std::mutex> lock(resolving->lock);
+    resolving->plist = nullptr;
+    resolving = nullptr;
+}
+
+void FoxConnector::start(FoxPollList &plist, std::string ip, std::string port, int timeout) {
+    std::vector<Candidate> result;
+    bool ok;
+
+    if (active) {
+        FOXFATAL("connect already in progress!")
+    }
+
+    active = true;
+    candidates.clear();
+    deadline = getTicks() + timeout;
+
+    // fastpath: numeric addresses don't need a lookup
+    result = resolve(ip, port, true, ok);
+    if (ok) {
+        setCandidates(std::move(result));
+        return;
+    }
+
+    // it's a hostname, resolve it on the pool so we don't block the poll loop. it wakes us once it's done
+    std::shared_ptr<Resolve> state = std::make_shared<Resolve>();
+    state->plist = &plist;
+    resolving = state;
+    plist.enableWake();
+
+    FoxResolverPool::get().queue([state, ip, port]() {
+        bool ok;
+        std::vector<Candidate> result = resolve(ip, port, false, ok);
+
+        std::lock_guard<std::mutex> lock(state->lock);
+        state->result = std::move(result);
+        state->done = true;
+
+        if (state->plist != nullptr)
+            state->plist->wake();
+    });
+}
+
+void FoxConnector::removeAttempt(FoxPollList &plist, FoxConnectAttempt *attempt) {
+    plist.rmvSock(attempt);
+    attempts.erase(std::find(attempts.begin(), attempts.end(), attempt));
+}
+
+void FoxConnector::cancel(FoxPollList &plist) {
+    // the current batch of poll events might still point to these, so they're only closed for now
+    for (FoxConnectAttempt *attempt : attempts) {
+        plist.rmvSock(attempt);
+        attempt->kill();
+        deadAttempts.push_back(attempt);
+    }
+
+    attempts.clear();
+    abandonResolve();
+    active = false;
+}
+
+void FoxConnector::launchAttempts(FoxPollList &plist) {
+    int64_t currTick = getTicks();
+
+    // race the next address if the last attempt is taking too long
+    while (nextCandidate < candidates.size() && (attempts.empty() || currTick >= nextAttempt)) {
+        Candidate &cand = candidates[nextCandidate++];
+        FoxConnectAttempt *attempt = new FoxConnectAttempt(owner);
+
+        if (!attempt->beginConnect((struct sockaddr*)&cand.addr, cand.addrLen)) {
+            // failed immediately, try the next one
+            delete attempt;
+            continue;
+        }
+
+        // we're notified with POLLOUT once the connect finishes
+        plist.addSock(attempt);
+        plist.addPollOut(attempt);
+        attempts.push_back(attempt);
+        nextAttempt = currTick + FOXNET_CONNECT_ATTEMPT_DELAY;
+    }
+
+    // nothing left to try
+    if (attempts.empty() && nextCandidate >= candidates.size())
+        cancel(plist);
+}
+
+void FoxConnector::tick(FoxPollList &plist) {
+    // events have been handled, it's safe to free closed attempts now
+    for (FoxConnectAttempt *attempt : deadAttempts)
+        delete attempt;
+    deadAttempts.clear();
+
+    if (!active)
+        return;
+
+    // check on the resolver
+    if (resolving != nullptr) {
+        std::unique_lock<std::mutex> lock(resolving->lock);
+
+        if (resolving->done) {
+            std::vector<Candidate> result = std::move(resolving->result);
+
+            lock.unlock();
+            resolving = nullptr;
+            setCandidates(std::move(result));
+        }
+    }
+
+    if (getTicks() >= deadline) {
+        cancel(plist);
+        return;
+    }
+
+    if (resolving == nullptr)
+        launchAttempts(plist);
+}
+
+FoxConnectAttempt *FoxConnector::handleEvent(FoxPollList &plist, FoxPollEvent &event) {
+    FoxConnectAttempt *attempt = (FoxConnectAttempt*)event.sock;
+
+    removeAttempt(plist, attempt);
+
+    if (event.pollOut && attempt->finishConnect()) {
+        // we have a winner! cleanup the rest
+        cancel(plist);
+        return attempt;
+    }
+
+    // this address didn't work out, start the next attempt right away
+    attempt->kill();
+    deadAttempts.push_back(attempt);
+    nextAttempt = getTicks();
+    launchAttempts(plist);
+    return nullptr;
+}
+
+int FoxConnector::getTimeout(int timeout) {
+    int64_t wake;
+    int64_t currTick;
+
+    if (!active)
+        return timeout;
+
+    currTick = getTicks();
+    if (resolving == nullptr && nextCandidate < candidates.size())
+        wake = std::min(nextAttempt, deadline) - currTick;
+    else // (the resolver pool wakes us once the lookup is done)
+        wake = deadline - currTick;
+
+#ifdef _WIN32
+    // no wake fd, check on the resolver every so often
+    if (resolving != nullptr && wake > FOXNET_RESOLVE_POLL_INTERVAL)
+        wake = FOXNET_RESOLVE_POLL_INTERVAL;
+#endif
+
+    if (wake < 0)
+        wake = 0;
+
+    return (timeout < 0 || wake < timeout) ? (int)wake : timeout;
+}
+
+bool FoxConnector::ownsSock(FoxSocket *sock) {
+    for (FoxConnectAttempt *attempt : attempts) {
+        if (attempt == sock)
+            return true;
+    }
+
+    return false;
+}
+
+bool FoxConnector::isActive(void) {
+    return active;
+}
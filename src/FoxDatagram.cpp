@@ -0,0 +1,134 @@
+#include "FoxDatagram.hpp"
+#include "FoxMetrics.hpp"
+
+#include <cstring>
+
+using namespace FoxNet;
+
+FoxDatagram::FoxDatagram(FoxSocket *o): in(FOXNET_DATAGRAM_BATCH), out(FOXNET_DATAGRAM_BATCH), owner(o) {}
+
+size_t FoxDatagram::recvBatch() {
+    size_t count = 0;
+
+#ifdef __linux__
+    struct mmsghdr msgs[FOXNET_DATAGRAM_BATCH];
+    struct iovec iovs[FOXNET_DATAGRAM_BATCH];
+    int rcvd;
+
+    memset(msgs, 0, sizeof(msgs));
+    for (size_t i = 0; i < FOXNET_DATAGRAM_BATCH; i++) {
+        iovs[i].iov_base = in[i].data;
+        iovs[i].iov_len = FOXNET_DATAGRAM_MTU;
+        msgs[i].msg_hdr.msg_name = &in[i].addr;
+        msgs[i].msg_hdr.msg_namelen = sizeof(in[i].addr);
+        msgs[i].msg_hdr.msg_iov = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    if ((rcvd = ::recvmmsg(getRawSock(), msgs, FOXNET_DATAGRAM_BATCH, MSG_DONTWAIT, NULL)) <= 0)
+        return 0;
+
+    count = (size_t)rcvd;
+    for (size_t i = 0; i < count; i++) {
+        in[i].addrLen = msgs[i].msg_hdr.msg_namelen;
+        in[i].size = (msgs[i].msg_hdr.msg_flags & MSG_TRUNC) ? 0 : msgs[i].msg_len;
+    }
+#else
+    for (; count < FOXNET_DATAGRAM_BATCH; count++) {
+        Message &msg = in[count];
+        int rcvd;
+
+        msg.addrLen = sizeof(msg.addr);
+        rcvd = ::recvfrom(getRawSock(), (buffer_t*)msg.data, FOXNET_DATAGRAM_MTU, 0, (struct sockaddr *)&msg.addr, &msg.addrLen);
+        if (rcvd < 0)
+            break;
+
+        msg.size = rcvd;
+    }
+#endif
+
+    FOXMETRIC(addDatagramsIn(count))
+    return count;
+}
+
+FoxDatagram::Message &FoxDatagram::getRecv(size_t i) {
+    return in[i];
+}
+
+void FoxDatagram::queue(const Byte *data, size_t sz, const struct sockaddr *addr, socklen_t addrLen) {
+    Message &msg = out[outCount++];
+
+    memcpy(msg.data, data, sz);
+    msg.size = sz;
+    msg.addrLen = addr != nullptr ? addrLen : 0;
+    if (msg.addrLen > 0)
+        memcpy(&msg.addr, addr, addrLen);
+
+    if (outCount == FOXNET_DATAGRAM_BATCH)
+        flush();
+}
+
+void FoxDatagram::flush() {
+    size_t sent = 0, dropped = 0;
+
+    if (outCount == 0)
+        return;
+
+#ifdef __linux__
+    struct mmsghdr msgs[FOXNET_DATAGRAM_BATCH];
+    struct iovec iovs[FOXNET_DATAGRAM_BATCH];
+
+    memset(msgs, 0, sizeof(mmsghdr) * outCount);
+    for (size_t i = 0; i < outCount; i++) {
+        iovs[i].iov_base = out[i].data;
+        iovs[i].iov_len = out[i].size;
+        msgs[i].msg_hdr.msg_name = out[i].addrLen > 0 ? &out[i].addr : NULL;
+        msgs[i].msg_hdr.msg_namelen = out[i].addrLen;
+        msgs[i].msg_hdr.msg_iov = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    while (sent + dropped < outCount) {
+        int n = ::sendmmsg(getRawSock(), msgs + sent + dropped, outCount - sent - dropped, FN_MSG_NOSIGNAL);
+
+        if (n > 0) {
+            sent += n;
+        } else if (FN_ERRNO == FN_EWOULD) {
+            // no room, the rest are lost like they would've been on the wire
+            dropped = outCount - sent;
+        } else {
+            // this one failed (eg. an icmp error for an earlier datagram), skip it
+            dropped++;
+        }
+    }
+#else
+    for (size_t i = 0; i < outCount; i++) {
+        Message &msg = out[i];
+
+        if (::sendto(getRawSock(), (buffer_t*)msg.data, msg.size, FN_MSG_NOSIGNAL, msg.addrLen > 0 ? (struct sockaddr *)&msg.addr : NULL, msg.addrLen) < 0) {
+            dropped++;
+        } else {
+            sent++;
+        }
+    }
+#endif
+
+    outCount = 0;
+    FOXMETRIC(addDatagramsOut(sent))
+    if (dropped > 0) {
+        FOXMETRIC(addDatagramsDropped(dropped))
+    }
+}
+
+uint16_t FoxDatagram::getPort() {
+    struct sockaddr_storage address;
+    socklen_t addressSize = sizeof(address);
+
+    if (SOCKETERROR(::getsockname(getRawSock(), (struct sockaddr *)&address, &addressSize)))
+        return 0;
+
+    if (address.ss_family == AF_INET6)
+        return ntohs(((struct sockaddr_in6 *)&address)->sin6_port);
+
+    return ntohs(((struct sockaddr_in *)&address)->sin_port);
+}
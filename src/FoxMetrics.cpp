@@ -0,0 +1,237 @@
+#include "FoxMetrics.hpp"
+
+#include <mutex>
+#include <sstream>
+#include <vector>
+
+using namespace FoxNet;
+
+namespace {
+    std::mutex shardLock;
+    std::vector<FoxMetricsShard*> shards; // never freed, snapshots can read them at any time
+    std::vector<FoxMetricsShard*> retiredShards; // shards whose thread exited
+
+    // hands our shard back when the thread exits
+    struct ShardOwner {
+        FoxMetricsShard *shard = nullptr;
+
+        ~ShardOwner(void) {
+            if (shard == nullptr)
+                return;
+
+            std::lock_guard<std::mutex> lock(shardLock);
+            retiredShards.push_back(shard);
+        }
+    };
+
+    thread_local ShardOwner owner;
+
+    void mergeHistogram(FoxMetricsHistogram<uint64_t> &out, FoxMetricsHistogram<std::atomic<uint64_t>> &in) {
+        for (int i = 0; i < FOXMETRICS_BUCKETS; i++)
+            out.buckets[i] += in.buckets[i].load(std::memory_order_relaxed);
+
+        out.count += in.count.load(std::memory_order_relaxed);
+        out.sum += in.sum.load(std::memory_order_relaxed);
+    }
+
+    // upper bound of a bucket, scaled to the unit we report in
+    double bucketBound(int bucket, double scale) {
+        return (double)((uint64_t)1 << bucket) * scale;
+    }
+
+    void writePromHistogram(std::ostringstream &out, const std::string &name, const std::string &labels,
+        FoxMetricsHistogram<uint64_t> &hist, double scale) {
+        std::string sep = labels.empty() ? "" : ",";
+        uint64_t total = 0;
+
+        for (int i = 0; i < FOXMETRICS_BUCKETS - 1; i++) {
+            total += hist.buckets[i];
+            out << name << "_bucket{" << labels << sep << "le=\"" << bucketBound(i, scale) << "\"} " << total << "\n";
+        }
+
+        out << name << "_bucket{" << labels << sep << "le=\"+Inf\"} " << hist.count << "\n";
+        out << name << "_sum" << (labels.empty() ? "" : "{" + labels + "}") << " " << hist.sum * scale << "\n";
+        out << name << "_count" << (labels.empty() ? "" : "{" + labels + "}") << " " << hist.count << "\n";
+    }
+
+    void writeJSONHistogram(std::ostringstream &out, FoxMetricsHistogram<uint64_t> &hist) {
+        bool first = true;
+
+        // only the non-empty buckets, keyed by their upper bound
+        out << "{\"count\": " << hist.count << ", \"sum\": " << hist.sum << ", \"buckets\": {";
+        for (int i = 0; i < FOXMETRICS_BUCKETS; i++) {
+            if (hist.buckets[i] == 0)
+                continue;
+
+            out << (first ? "" : ", ") << "\"" << (i == FOXMETRICS_BUCKETS - 1 ? "+Inf" : std::to_string((uint64_t)1 << i))
+                << "\": " << hist.buckets[i];
+            first = false;
+        }
+        out << "}}";
+    }
+}
+
+thread_local FoxMetricsShard *FoxMetrics::shard = nullptr;
+
+FoxMetricsShard *FoxMetrics::attach() {
+    std::lock_guard<std::mutex> lock(shardLock);
+
+    if (!retiredShards.empty()) {
+        shard = retiredShards.back();
+        retiredShards.pop_back();
+    } else {
+        shard = new FoxMetricsShard();
+        shards.push_back(shard);
+    }
+
+    owner.shard = shard;
+    return shard;
+}
+
+FoxMetricsSnapshot FoxMetrics::snapshot() {
+    FoxMetricsSnapshot snap;
+    std::lock_guard<std::mutex> lock(shardLock);
+
+    for (FoxMetricsShard *s : shards)
+        snap.merge(*s);
+
+    return snap;
+}
+
+bool FoxMetrics::isEnabled() {
+#ifdef FOXNET_ENABLE_METRICS
+    return true;
+#else
+    return false;
+#endif
+}
+
+void FoxMetricsSnapshot::merge(FoxMetricsShard &s) {
+    for (int i = 0; i < 256; i++) {
+        packetsIn[i] += s.packetsIn[i].load(std::memory_order_relaxed);
+        bytesIn[i] += s.bytesIn[i].load(std::memory_order_relaxed);
+        packetsOut[i] += s.packetsOut[i].load(std::memory_order_relaxed);
+        bytesOut[i] += s.bytesOut[i].load(std::memory_order_relaxed);
+        mergeHistogram(handlerTime[i], s.handlerTime[i]);
+    }
+
+    mergeHistogram(pollTime, s.pollTime);
+    mergeHistogram(pollEvents, s.pollEvents);
+    mergeHistogram(sendQueue, s.sendQueue);
+
+    socketBytesIn += s.socketBytesIn.load(std::memory_order_relaxed);
+    socketBytesOut += s.socketBytesOut.load(std::memory_order_relaxed);
+    pollOutSet += s.pollOutSet.load(std::memory_order_relaxed);
+    pollOutCleared += s.pollOutCleared.load(std::memory_order_relaxed);
+    accepts += s.accepts.load(std::memory_order_relaxed);
+    acceptsRejected += s.acceptsRejected.load(std::memory_order_relaxed);
+    disconnects += s.disconnects.load(std::memory_order_relaxed);
+    detaches += s.detaches.load(std::memory_order_relaxed);
+    resumes += s.resumes.load(std::memory_order_relaxed);
+    datagramsIn += s.datagramsIn.load(std::memory_order_relaxed);
+    datagramsOut += s.datagramsOut.load(std::memory_order_relaxed);
+    datagramsDropped += s.datagramsDropped.load(std::memory_order_relaxed);
+    sendfileBytesOut += s.sendfileBytesOut.load(std::memory_order_relaxed);
+    zeroCopyBytesOut += s.zeroCopyBytesOut.load(std::memory_order_relaxed);
+    zeroCopyCopied += s.zeroCopyCopied.load(std::memory_order_relaxed);
+    integrityFailures += s.integrityFailures.load(std::memory_order_relaxed);
+}
+
+std::string FoxMetricsSnapshot::toPrometheus() {
+    std::ostringstream out;
+
+    out << "# TYPE foxnet_socket_bytes_in_total counter\nfoxnet_socket_bytes_in_total " << socketBytesIn << "\n";
+    out << "# TYPE foxnet_socket_bytes_out_total counter\nfoxnet_socket_bytes_out_total " << socketBytesOut << "\n";
+    out << "# TYPE foxnet_pollout_set_total counter\nfoxnet_pollout_set_total " << pollOutSet << "\n";
+    out << "# TYPE foxnet_pollout_cleared_total counter\nfoxnet_pollout_cleared_total " << pollOutCleared << "\n";
+    out << "# TYPE foxnet_accepts_total counter\nfoxnet_accepts_total " << accepts << "\n";
+    out << "# TYPE foxnet_accepts_rejected_total counter\nfoxnet_accepts_rejected_total " << acceptsRejected << "\n";
+    out << "# TYPE foxnet_disconnects_total counter\nfoxnet_disconnects_total " << disconnects << "\n";
+    out << "# TYPE foxnet_detaches_total counter\nfoxnet_detaches_total " << detaches << "\n";
+    out << "# TYPE foxnet_resumes_total counter\nfoxnet_resumes_total " << resumes << "\n";
+    out << "# TYPE foxnet_datagrams_in_total counter\nfoxnet_datagrams_in_total " << datagramsIn << "\n";
+    out << "# TYPE foxnet_datagrams_out_total counter\nfoxnet_datagrams_out_total " << datagramsOut << "\n";
+    out << "# TYPE foxnet_datagrams_dropped_total counter\nfoxnet_datagrams_dropped_total " << datagramsDropped << "\n";
+    out << "# TYPE foxnet_sendfile_bytes_out_total counter\nfoxnet_sendfile_bytes_out_total " << sendfileBytesOut << "\n";
+    out << "# TYPE foxnet_zerocopy_bytes_out_total counter\nfoxnet_zerocopy_bytes_out_total " << zeroCopyBytesOut << "\n";
+    out << "# TYPE foxnet_zerocopy_copied_total counter\nfoxnet_zerocopy_copied_total " << zeroCopyCopied << "\n";
+    out << "# TYPE foxnet_integrity_failures_total counter\nfoxnet_integrity_failures_total " << integrityFailures << "\n";
+
+    // per packet id, ids that were never seen are skipped
+    out << "# TYPE foxnet_packets_in_total counter\n";
+    for (int i = 0; i < 256; i++) {
+        if (packetsIn[i] > 0)
+            out << "foxnet_packets_in_total{id=\"" << i << "\"} " << packetsIn[i] << "\n";
+    }
+
+    out << "# TYPE foxnet_packet_bytes_in_total counter\n";
+    for (int i = 0; i < 256; i++) {
+        if (packetsIn[i] > 0)
+            out << "foxnet_packet_bytes_in_total{id=\"" << i << "\"} " << bytesIn[i] << "\n";
+    }
+
+    out << "# TYPE foxnet_packets_out_total counter\n";
+    for (int i = 0; i < 256; i++) {
+        if (packetsOut[i] > 0)
+            out << "foxnet_packets_out_total{id=\"" << i << "\"} " << packetsOut[i] << "\n";
+    }
+
+    out << "# TYPE foxnet_packet_bytes_out_total counter\n";
+    for (int i = 0; i < 256; i++) {
+        if (packetsOut[i] > 0)
+            out << "foxnet_packet_bytes_out_total{id=\"" << i << "\"} " << bytesOut[i] << "\n";
+    }
+
+    out << "# TYPE foxnet_handler_duration_seconds histogram\n";
+    for (int i = 0; i < 256; i++) {
+        if (handlerTime[i].count > 0)
+            writePromHistogram(out, "foxnet_handler_duration_seconds", "id=\"" + std::to_string(i) + "\"", handlerTime[i], 1e-9);
+    }
+
+    out << "# TYPE foxnet_poll_duration_seconds histogram\n";
+    writePromHistogram(out, "foxnet_poll_duration_seconds", "", pollTime, 1e-9);
+    out << "# TYPE foxnet_poll_events histogram\n";
+    writePromHistogram(out, "foxnet_poll_events", "", pollEvents, 1);
+    out << "# TYPE foxnet_send_queue_bytes histogram\n";
+    writePromHistogram(out, "foxnet_send_queue_bytes", "", sendQueue, 1);
+
+    return out.str();
+}
+
+std::string FoxMetricsSnapshot::toJSON() {
+    std::ostringstream out;
+    bool first = true;
+
+    out << "{\"socket_bytes_in\": " << socketBytesIn << ", \"socket_bytes_out\": " << socketBytesOut
+        << ", \"pollout_set\": " << pollOutSet << ", \"pollout_cleared\": " << pollOutCleared
+        << ", \"accepts\": " << accepts << ", \"accepts_rejected\": " << acceptsRejected
+        << ", \"disconnects\": " << disconnects << ", \"detaches\": " << detaches << ", \"resumes\": " << resumes
+        << ", \"datagrams_in\": " << datagramsIn << ", \"datagrams_out\": " << datagramsOut
+        << ", \"datagrams_dropped\": " << datagramsDropped
+        << ", \"sendfile_bytes_out\": " << sendfileBytesOut << ", \"zerocopy_bytes_out\": " << zeroCopyBytesOut
+        << ", \"zerocopy_copied\": " << zeroCopyCopied << ", \"integrity_failures\": " << integrityFailures;
+
+    out << ", \"packets\": [";
+    for (int i = 0; i < 256; i++) {
+        if (packetsIn[i] == 0 && packetsOut[i] == 0)
+            continue;
+
+        out << (first ? "" : ", ") << "{\"id\": " << i << ", \"packets_in\": " << packetsIn[i] << ", \"bytes_in\": "
+            << bytesIn[i] << ", \"packets_out\": " << packetsOut[i] << ", \"bytes_out\": " << bytesOut[i]
+            << ", \"handler_ns\": ";
+        writeJSONHistogram(out, handlerTime[i]);
+        out << "}";
+        first = false;
+    }
+    out << "]";
+
+    out << ", \"poll_ns\": ";
+    writeJSONHistogram(out, pollTime);
+    out << ", \"poll_events\": ";
+    writeJSONHistogram(out, pollEvents);
+    out << ", \"send_queue_bytes\": ";
+    writeJSONHistogram(out, sendQueue);
+    out << "}";
+
+    return out.str();
+}
@@ -1,19 +1,41 @@
 #include "FoxPeer.hpp"
 #include "FoxPacket.hpp"
+#include "FoxMetrics.hpp"
+#include "FoxTrace.hpp"
+#include "FoxShmTransport.hpp"
+#include "FoxChecksum.hpp"
 
 #include <iostream>
 #include <iomanip>
+#include <cstring>
+#include <algorithm>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
 
 using namespace FoxNet;
 
+// writes val like writeInt() would, for bytes that are already queued
+template <typename T>
+static void putInt(Byte *out, T val, bool flip) {
+    memcpy(out, &val, sizeof(val));
+
+    if (flip)
+        std::reverse(out, out + sizeof(val));
+}
+
 DECLARE_FOXNET_PACKET(PKTID_PING, FoxPeer) {
     int64_t peerTime;
     int64_t currTime = getTimestamp();
 
     peer->readInt<int64_t>(peerTime);
 
+    // pongs skip whatever is queued on the other lanes
+    PktLane lane = peer->setLane(PKTLANE_CONTROL);
     peer->writeByte(PKTID_PONG);
     peer->writeInt<int64_t>(currTime);
+    peer->setLane(lane);
 
     peer->onPing(peerTime, currTime);
 }
@@ -33,55 +55,389 @@ DECLARE_FOXNET_PACKET(PKTID_HANDSHAKE_RES, FoxPeer) {
 
     peer->readBytes((Byte*)magic, FOXMAGICLEN);
     peer->readByte(response);
-    peer->setHandshake(response);
 
-    if (response)
-        peer->onReady();
-    else
+    // PKTID_SESSION_RES follows, unless the server is on another version (then it's all it knows to send)
+    if (memcmp(magic, FOXMAGIC, FOXMAGICLEN) || !response) {
+        FOXWARN("server rejected our handshake, it doesn't speak protocol version " << FOXNET_MAJOR << " or we're missing a capability it wants");
         peer->kill();
+        return;
+    }
+
+    peer->versionMatched = true;
+}
+
+DECLARE_FOXNET_PACKET(PKTID_SESSION_RES, FoxPeer) {
+    Byte resumed;
+    uint32_t caps;
+    uint64_t token;
+
+    if (!peer->versionMatched || peer->handshook) {
+        FOXFATAL("PKTID_SESSION_RES sent out of order!")
+    }
+
+    peer->readInt(caps);
+    peer->readByte(resumed);
+    peer->readInt(token);
+    peer->setHandshake(true);
+
+    // (the server only answers with bits we offered, but don't take its word for it)
+    peer->caps = caps & peer->getOfferedCaps();
+    peer->resumed = resumed && (peer->caps & CAP_RESUME);
+    peer->resumeToken = (peer->caps & CAP_RESUME) ? token : 0;
+
+    // the server's bytes after this are framed, ours have been since the request
+    if (peer->integrityWanted) {
+        if (!(peer->caps & CAP_INTEGRITY)) {
+            FOXFATAL("server didn't turn on integrity checks!")
+        }
+
+        peer->integrityIn = true;
+        peer->recvChecked = peer->recvHead;
+    }
+
+    if (peer->shmWanted)
+        peer->requestShm();
+
+    peer->onReady();
+    peer->fireWaiters(PEERWAIT_READY);
 }
 
 DECLARE_FOXNET_PACKET(PKTID_HANDSHAKE_REQ, FoxPeer) {
     char magic[FOXMAGICLEN];
     Byte minor, major, endian;
-    Byte response;
 
     peer->readBytes((Byte*)magic, FOXMAGICLEN);
     peer->readByte(major);
     peer->readByte(minor);
     peer->readByte(endian);
 
-    response = !memcmp(magic, FOXMAGIC, FOXMAGICLEN) && major == FOXNET_MAJOR;
-
     // if our endians are different, set the peer to flip the endians!
     peer->setFlipEndian(endian != isBigEndian());
 
+    // the rest of the request (PKTID_SESSION_REQ) is laid out per major version, so don't read any of it on a mismatch
+    if (memcmp(magic, FOXMAGIC, FOXMAGICLEN) || major != FOXNET_MAJOR) {
+        Byte res[sizeof(PktID) + FOXMAGICLEN + 1];
+
+        // the peer is dropped right after this, so the refusal goes straight out instead of waiting in a lane. nothing
+        // was sent before it, so it goes through onSend() just like it would've from a lane
+        res[0] = PKTID_HANDSHAKE_RES;
+        memcpy(res + sizeof(PktID), magic, FOXMAGICLEN);
+        res[sizeof(res) - 1] = 0;
+        peer->onSend(res, sizeof(res));
+
+        std::vector<Byte> out(res, res + sizeof(res));
+        peer->rawSend(out, out.size());
+
+        FOXWARN("rejected a handshake from protocol version " << (int)major << "." << (int)minor << ", we speak " << FOXNET_MAJOR << "." << FOXNET_MINOR);
+        FOXFATAL("PKTID_HANDSHAKE_REQ failed, missmatched versions!")
+    }
+
+    peer->versionMatched = true;
+}
+
+DECLARE_FOXNET_PACKET(PKTID_SESSION_REQ, FoxPeer) {
+    Byte response;
+    uint32_t caps;
+    uint64_t token, nextToken = 0;
+    bool resumed = false;
+
+    if (!peer->versionMatched || peer->handshook) {
+        FOXFATAL("PKTID_SESSION_REQ sent out of order!")
+    }
+
+    peer->readInt(caps);
+    peer->readInt(token);
+
+    // bits we don't know of (eg. from a newer minor version) are left out. we turn integrity on for whoever asks
+    peer->caps = caps & (peer->getOfferedCaps() | CAP_INTEGRITY);
+    response = !peer->integrityWanted || (peer->caps & CAP_INTEGRITY);
+
+    if (response && (peer->caps & CAP_RESUME))
+        nextToken = peer->resumeSession(token, resumed);
+
     // now respond
+    PktLane lane = peer->setLane(PKTLANE_CONTROL);
     peer->writeByte(PKTID_HANDSHAKE_RES);
-    peer->writeBytes((Byte*)magic, FOXMAGICLEN);
+    peer->writeBytes((Byte*)FOXMAGIC, FOXMAGICLEN);
     peer->writeByte(response);
+    if (response) {
+        peer->writeByte(PKTID_SESSION_RES);
+        peer->writeInt<uint32_t>(peer->caps);
+        peer->writeByte(resumed);
+        peer->writeInt<uint64_t>(nextToken);
+    }
+    peer->setLane(lane);
     peer->setHandshake(response);
 
     if (!response) {
-        FOXFATAL("PKTID_HANDSHAKE_REQ failed, missmatched versions!")
+        FOXFATAL("PKTID_SESSION_REQ failed, missmatched capabilities!")
+    }
+
+    // the client frames everything after its request, we frame everything after our response
+    if (peer->caps & CAP_INTEGRITY) {
+        peer->integrityIn = true;
+        peer->recvChecked = peer->recvHead;
+        peer->frameSendAfter();
+    }
+
+    // the client's hello proves it got the token, then it's ready to go
+    if (peer->datagram != nullptr) {
+        lane = peer->setLane(PKTLANE_CONTROL);
+        peer->writeByte(PKTID_DATAGRAM_OFFER);
+        peer->writeInt<uint32_t>(peer->datagramSession);
+        peer->writeInt<uint64_t>(peer->datagramToken);
+        peer->writeInt<uint16_t>(peer->datagram->getPort());
+        peer->setLane(lane);
+    }
+
+    // the session's peer takes it from here, nothing past the request is ours to parse
+    if (resumed) {
+        peer->recvHeld = true;
+        return;
     }
 
     peer->onReady();
-} 
+    peer->fireWaiters(PEERWAIT_READY);
+}
+
+DECLARE_FOXNET_VAR_PACKET(PKTID_RPC_REQ, FoxPeer) {
+    RPCID id;
+    RPCMethod method;
+    RPCHandler hndlr;
+
+    if (varSize < sizeof(RPCID) + sizeof(RPCMethod)) {
+        FOXFATAL("malformed PKTID_RPC_REQ!")
+    }
+
+    peer->readInt<RPCID>(id);
+    peer->readByte(method);
+
+    hndlr = peer->RPCMAP[method];
+    if (hndlr == nullptr) {
+        // let the requester know now instead of making them wait for the timeout
+        size_t indx = peer->prepareRPCResponse(id, RPC_NOMETHOD);
+        peer->patchVarPacket(indx);
+        return;
+    }
+
+    hndlr(peer, id, varSize - sizeof(RPCID) - sizeof(RPCMethod));
+}
+
+DECLARE_FOXNET_VAR_PACKET(PKTID_RPC_RES, FoxPeer) {
+    RPCID id;
+    Byte status;
+
+    if (varSize < sizeof(RPCID) + sizeof(Byte)) {
+        FOXFATAL("malformed PKTID_RPC_RES!")
+    }
+
+    peer->readInt<RPCID>(id);
+    peer->readByte(status);
+
+    auto iter = peer->pendingRPCs.find(id);
+    if (iter == peer->pendingRPCs.end()) // probably timed out, ignore it
+        return;
+
+    RPCCallback callback = std::move(iter->second.callback);
+    if (iter->second.deadline != peer->rpcDeadlines.end())
+        peer->rpcDeadlines.erase(iter->second.deadline);
+    peer->pendingRPCs.erase(iter);
+
+    callback(peer, (RPCStatus)status, varSize - sizeof(RPCID) - sizeof(Byte));
+}
+
+DECLARE_FOXNET_PACKET(PKTID_SHM_REQ, FoxPeer) {
+    FoxShmTransport *transport = nullptr;
+
+    // only a unix socket can pass the fds, which also means they're on our host
+    if (peer->shmState == SHM_NONE && peer->getTransport() == nullptr && peer->isUnixSocket())
+        transport = FoxShmTransport::create();
+
+    PktLane lane = peer->setLane(PKTLANE_CONTROL);
+    peer->writeByte(PKTID_SHM_RES);
+    peer->writeByte(transport != nullptr);
+    peer->setLane(lane);
+
+    if (transport == nullptr)
+        return;
+
+    // the client doesn't write to the socket after its request, but we keep writing to it until they have the fds
+    peer->upgradeTransport(transport);
+    peer->switchRecv();
+    peer->passFds(transport->getSharedFds());
+    peer->holdSendAfter();
+    peer->shmRegister = true;
+    peer->shmState = SHM_ACKING;
+}
+
+DECLARE_FOXNET_PACKET(PKTID_SHM_RES, FoxPeer) {
+    FoxShmTransport *transport = nullptr;
+    std::vector<int> fds;
+    Byte accepted;
+
+    peer->readByte(accepted);
+
+    if (peer->shmState != SHM_REQUESTED) {
+        FOXFATAL("unexpected PKTID_SHM_RES!")
+    }
+
+    // the fds arrive with (or before) the response
+    fds = peer->takeFds();
+    peer->setAcceptFds(false);
+
+    if (accepted) {
+        transport = FoxShmTransport::attach(fds);
+    } else {
+#ifndef _WIN32
+        for (int fd : fds)
+            ::close(fd);
+#endif
+    }
+
+    if (transport != nullptr) {
+        peer->upgradeTransport(transport);
+        peer->switchRecv();
+        peer->switchSend();
+        peer->shmRegister = true;
+        peer->shmState = SHM_ACTIVE;
+    } else {
+        // the socket works just as well, carry on without it
+        peer->shmState = SHM_NONE;
+    }
+
+    peer->sendHeld = false;
+}
+
+DECLARE_FOXNET_PACKET(PKTID_DATAGRAM_OFFER, FoxPeer) {
+    uint16_t port;
+
+    peer->readInt<uint32_t>(peer->datagramSession);
+    peer->readInt<uint64_t>(peer->datagramToken);
+    peer->readInt<uint16_t>(port);
+
+    if (peer->datagramWanted && peer->datagram == nullptr)
+        peer->acceptDatagramOffer(port);
+}
+
+DECLARE_FOXNET_PACKET(PKTID_DATAGRAM_ACK, FoxPeer) {
+    if (peer->datagram != nullptr)
+        peer->datagramReady = true;
+}
+
+DECLARE_FOXNET_VAR_PACKET(PKTID_SNAPSHOT, FoxPeer) {
+    ByteView body = peer->getPacketView();
+    const FoxSnapshot *baseline = nullptr;
+    uint32_t seq, baseSeq;
+    FoxSnapshot snap;
+
+    if (!body.readInt(seq) || !body.readInt(baseSeq) || seq == 0) {
+        FOXFATAL("malformed PKTID_SNAPSHOT!")
+    }
+
+    // we already have a newer one (eg. datagrams arrived out of order)
+    if (!peer->snapshotsIn.empty() && (int32_t)(seq - peer->snapshotsIn.back().getSeq()) <= 0)
+        return;
+
+    if (baseSeq != 0) {
+        for (const FoxSnapshot &old : peer->snapshotsIn) {
+            if (old.getSeq() == baseSeq)
+                baseline = &old;
+        }
+
+        // we never acked it, nothing to apply the delta to
+        if (baseline == nullptr)
+            return;
+    }
+
+    if (!snap.decodeDelta(baseline, body)) {
+        FOXFATAL("malformed PKTID_SNAPSHOT!")
+    }
+
+    snap.setSeq(seq);
+    peer->snapshotsIn.push_back(std::move(snap));
+    if (peer->snapshotsIn.size() > FOXNET_SNAPSHOT_HISTORY)
+        peer->snapshotsIn.pop_front();
+
+    PktLane lane = peer->setLane(PKTLANE_DATAGRAM);
+    peer->writeByte(PKTID_SNAPSHOT_ACK);
+    peer->writeInt<uint32_t>(seq);
+    peer->setLane(lane);
+
+    peer->onSnapshot(peer->snapshotsIn.back());
+}
+
+DECLARE_FOXNET_PACKET(PKTID_SNAPSHOT_ACK, FoxPeer) {
+    uint32_t seq;
+
+    peer->readInt<uint32_t>(seq);
+
+    // acks can arrive out of order over datagrams, only ever move forward
+    if (peer->snapshotAcked == 0 || (int32_t)(seq - peer->snapshotAcked) > 0)
+        peer->snapshotAcked = seq;
+}
 
 FoxPeer::FoxPeer() {
     for (int i = 0; i < UINT8_MAX; i++)
         PKTMAP[i] = PacketInfo();
 
+    for (int i = 0; i <= UINT8_MAX; i++)
+        RPCMAP[i] = nullptr;
+
     INIT_FOXNET_PACKET(PKTID_PING, sizeof(int64_t))
     INIT_FOXNET_PACKET(PKTID_PONG, sizeof(int64_t))
     INIT_FOXNET_PACKET(PKTID_HANDSHAKE_RES, (sizeof(Byte) + FOXMAGICLEN))
     INIT_FOXNET_PACKET(PKTID_HANDSHAKE_REQ, (sizeof(Byte) + sizeof(Byte) + sizeof(Byte) + FOXMAGICLEN))
+    INIT_FOXNET_PACKET(PKTID_SESSION_RES, (sizeof(uint32_t) + sizeof(Byte) + sizeof(uint64_t)))
+    INIT_FOXNET_PACKET(PKTID_SESSION_REQ, (sizeof(uint32_t) + sizeof(uint64_t)))
+    INIT_FOXNET_VAR_PACKET(PKTID_RPC_REQ)
+    INIT_FOXNET_VAR_PACKET(PKTID_RPC_RES)
+    INIT_FOXNET_PACKET(PKTID_SHM_REQ, 0)
+    INIT_FOXNET_PACKET(PKTID_SHM_RES, sizeof(Byte))
+    INIT_FOXNET_PACKET(PKTID_DATAGRAM_OFFER, (sizeof(uint32_t) + sizeof(uint64_t) + sizeof(uint16_t)))
+    INIT_FOXNET_PACKET(PKTID_DATAGRAM_ACK, 0)
+    INIT_FOXNET_VAR_PACKET(PKTID_SNAPSHOT)
+    INIT_FOXNET_PACKET(PKTID_SNAPSHOT_ACK, sizeof(uint32_t))
+
+    // every snapshot is against a baseline the receiver acked, so losing some is fine
+    PKTMAP[PKTID_SNAPSHOT].delivery = PKTDELIVERY_UNRELIABLE;
+    PKTMAP[PKTID_SNAPSHOT_ACK].delivery = PKTDELIVERY_UNRELIABLE;
+
+    lanes[PKTLANE_REALTIME].share = FOXNET_LANE_SHARE_REALTIME;
+    lanes[PKTLANE_BULK].share = FOXNET_LANE_SHARE_BULK;
+}
+
+FoxPeer::~FoxPeer() {
+    // mark the end of our stream in the capture
+    setCapture(nullptr);
+}
+
+ByteView FoxPeer::getPacketView() {
+    return ByteView(inView, inViewSize, flipEndian);
+}
+
+void FoxPeer::writePacket(PktID id, const ByteView &body) {
+    if (isPacketVar(id)) {
+        size_t indx = prepareVarPacket(id);
+        writeBytes((Byte*)body.getData(), body.getSize());
+        patchVarPacket(indx);
+        return;
+    }
+
+    if (body.getSize() != getPacketSize(id)) {
+        FOXFATAL("packet body doesn't match its registered size!")
+    }
+
+    writeByte(id);
+    writeBytes((Byte*)body.getData(), body.getSize());
+    commitPacket();
 }
 
 size_t FoxPeer::prepareVarPacket(PktID id) {
     uint16_t dummySize = 0;
 
+    // anything written before this packet is complete, commit it so the lanes can be interleaved here
+    commitPacket();
+
     writeByte(PKTID_VAR_LENGTH);
 
     size_t indx = sizeOut();
@@ -91,6 +447,7 @@ size_t FoxPeer::prepareVarPacket(PktID id) {
 
     // then write our packet id
     writeByte(id);
+    varPacketID = id;
 
     return indx;
 }
@@ -101,177 +458,1491 @@ void FoxPeer::patchVarPacket(size_t indx) {
 
     // now patch the dummy size, (first 2 bytes)
     patchInt(pSize, indx);
+    commitVarPacket(varPacketID, pSize);
+
+    FOXMETRIC(addPacketOut(varPacketID, sizeof(PktID) * 2 + sizeof(uint16_t) + pSize))
 }
 
-bool FoxPeer::isPacketVar(PktID id) {
-    return PKTMAP[id].variable;
+PktLane FoxPeer::setLane(PktLane lane) {
+    PktLane prev = writeLane;
+
+    if (lane != writeLane) {
+        commitPacket();
+        writeLane = lane;
+    }
+
+    return prev;
 }
 
-PktHandler FoxPeer::getPacketHandler(PktID id) {
-    return PKTMAP[id].handler;
+PktLane FoxPeer::getLane() {
+    return writeLane;
 }
 
-PktVarHandler FoxPeer::getVarPacketHandler(PktID id) {
-    return PKTMAP[id].varhandler;
+void FoxPeer::setLaneShare(PktLane lane, uint16_t share) {
+    // the control lane is always scheduled first, and the datagram lane isn't scheduled at all
+    if (lane == PKTLANE_CONTROL || lane >= PKTLANE_DATAGRAM)
+        return;
+
+    lanes[lane].share = share > 0 ? share : 1;
 }
 
-PktSize FoxPeer::getPacketSize(PktID id) {
-    return PKTMAP[id].size;
+void FoxPeer::commitPacket() {
+#ifdef FOXNET_ENABLE_METRICS
+    // fixed length packets aren't framed, so they're counted by walking what's committed using their registered
+    // sizes. var packets are counted by patchVarPacket(), so we stop at the first one
+    for (size_t pos = 0; pos < outBuffer.size();) {
+        PktID id = outBuffer[pos];
+        size_t sz = sizeof(PktID) + getPacketSize(id);
+
+        if (id == PKTID_VAR_LENGTH || id == PKTID_LARGE_DATA || id == PKTID_AGGREGATE || isPacketVar(id) ||
+                pos + sz > outBuffer.size())
+            break;
+
+        FOXMETRIC(addPacketOut(id, sz))
+        pos += sz;
+    }
+#endif
+
+    commitChunk(nullptr, 0, 0);
 }
 
-void FoxPeer::onReady() {
-    // stubbed
+PktLane FoxPeer::commitTarget(size_t sz) {
+    // datagrams go over the stream until the channel is up, or if they wouldn't fit in one
+    if (writeLane == PKTLANE_DATAGRAM && (!datagramReady || sz > FOXNET_DATAGRAM_MTU - FOXNET_DATAGRAM_HEADER))
+        return PKTLANE_REALTIME;
+
+    return writeLane;
 }
 
-void FoxPeer::onStep() {
-    // stubbed
+void FoxPeer::commitChunk(LargeSend *large, uint32_t offset, uint32_t payload) {
+    size_t sz = sizeOut();
+
+    if (sz == 0)
+        return;
+
+    OutLane &lane = lanes[commitTarget(sz)];
+
+    if (lane.chunks.empty()) {
+        // the lane was idle, don't let it catch up on bandwidth it didn't use
+        if (lane.vtime < laneClock)
+            lane.vtime = laneClock;
+
+        // fastpath: nothing is queued on the lane, just steal the out buffer
+        lane.buf.swap(outBuffer);
+        lane.head = 0;
+        flushOut();
+    } else {
+        lane.buf.insert(lane.buf.end(), outBuffer.begin(), outBuffer.end());
+        flushOut();
+    }
+
+    lane.chunks.push_back({sz, large, offset, payload});
+    lane.aggOpen = false;
 }
 
-void FoxPeer::onPing(int64_t peerTime, int64_t currTime) {
-    // stubbed
+void FoxPeer::commitVarPacket(PktID id, size_t body) {
+    PktLane target = commitTarget(sizeOut());
+    Byte sizeBytes[BSTREAM_VARINT_MAX];
+
+    // (prepareVarPacket() commits first, so the out buffer holds just this packet)
+    if (!aggregate || !(caps & CAP_AGGREGATE) || body > FOXNET_AGGREGATE_ENTRY) {
+        commitPacket();
+        return;
+    }
+
+    OutLane &lane = lanes[target];
+    size_t limit = target == PKTLANE_DATAGRAM ? FOXNET_DATAGRAM_MTU - FOXNET_DATAGRAM_HEADER : FOXNET_AGGREGATE_MAX;
+
+    if (lane.aggOpen) {
+        size_t last = lane.chunks.back().size;
+        size_t sz = last + sizeof(PktID) + encodeVarint(sizeBytes, body) + body;
+
+        // a lone packet grows by its size varint when it's turned into a frame
+        if (!lane.aggFramed)
+            sz += encodeVarint(sizeBytes, last - sizeof(PktID) * 2 - sizeof(PktSize));
+
+        if (sz <= limit) {
+            bundleVarPacket(lane, id, body);
+            return;
+        }
+    }
+
+    // start a new run, it's only turned into a frame once another packet joins it
+    commitPacket();
+    lane.aggOpen = true;
+    lane.aggFramed = false;
+    lane.aggID = id;
 }
 
-void FoxPeer::onPong(int64_t peerTime, int64_t currTime) {
-    // stubbed
+void FoxPeer::bundleVarPacket(OutLane &lane, PktID id, size_t body) {
+    const size_t header = sizeof(PktID) * 2 + sizeof(PktSize); // PKTID_VAR_LENGTH, the size & the id
+    OutChunk &last = lane.chunks.back();
+    size_t start = lane.buf.size() - last.size;
+    Byte sizeBytes[BSTREAM_VARINT_MAX];
+    size_t sizeLen;
+
+    if (!lane.aggFramed) {
+        // [PKTID_VAR_LENGTH][size][id][body] -> [PKTID_AGGREGATE][frame size][id][body size][body]
+        sizeLen = encodeVarint(sizeBytes, last.size - header);
+        lane.buf.insert(lane.buf.begin() + start + header, sizeBytes, sizeBytes + sizeLen);
+        lane.buf[start] = PKTID_AGGREGATE;
+        lane.buf[start + header - sizeof(PktID)] = lane.aggID;
+        last.size += sizeLen;
+        lane.aggFramed = true;
+    }
+
+    // the entry's header takes the tail end of the var packet's header, then its body follows
+    sizeLen = encodeVarint(sizeBytes, body);
+    Byte *entry = outBuffer.data() + header - sizeof(PktID) - sizeLen;
+    entry[0] = id;
+    memcpy(entry + sizeof(PktID), sizeBytes, sizeLen);
+
+    lane.buf.insert(lane.buf.end(), entry, outBuffer.data() + outBuffer.size());
+    last.size += outBuffer.data() + outBuffer.size() - entry;
+    flushOut();
+
+    putInt<PktSize>(&lane.buf[start + sizeof(PktID)], (PktSize)(last.size - sizeof(PktID) - sizeof(PktSize)), flipEndian);
 }
 
-bool FoxPeer::handlePollIn(FoxPollList& plist) {
-    RawSockReturn recv;
-    PktSize pSize;
+void FoxPeer::setAggregation(bool enabled) {
+    aggregate = enabled;
+}
 
-    switch(currentPkt) {
-        case PKTID_NONE: // we're queued to receive a packet
-            recv = rawRecv(sizeof(PktID));
+bool FoxPeer::getAggregation() {
+    return aggregate;
+}
 
-            switch (recv.code) {
-                case RAWSOCK_OK:
-                    readByte(currentPkt);
-                    pktSize = getPacketSize(currentPkt);
-                    break;
-                case RAWSOCK_CLOSED:
-                case RAWSOCK_ERROR:
-                default: // ??
-                    return false;
-            }
-            break;
-        case PKTID_VAR_LENGTH:
-            if (pktSize == 0) {
-                // grab packet length
-                recv = rawRecv(sizeof(PktSize));
-
-                switch (recv.code) {
-                    case RAWSOCK_OK:
-                        readInt<uint16_t>(pSize);
-                        pktSize = pSize;
-
-                        // if they try sending a packet larger than MAX_PACKET_SIZE kill em'
-                        if (pktSize > MAX_PACKET_SIZE)
-                            return false;
-                        break;
-                    case RAWSOCK_CLOSED:
-                    case RAWSOCK_ERROR:
-                    default: // ??
-                        return false;
-                }
-            } else {
-                recv = rawRecv(sizeof(PktID));
-
-                switch (recv.code) {
-                    case RAWSOCK_OK:
-                        readByte(currentPkt);
-                        break;
-                    case RAWSOCK_CLOSED:
-                    case RAWSOCK_ERROR:
-                    default: // ??
-                        return false;
-                }
-            }
-            break;
-        default: {
-            int rec;
-            int expectedRec = (int)(pktSize - sizeIn());
-
-            // try to get our packet, if we error return false
-            if (expectedRec != 0) {
-                recv = rawRecv(expectedRec);
-
-                switch (recv.code) {
-                    case RAWSOCK_OK:
-                        break;
-                    case RAWSOCK_CLOSED:
-                    case RAWSOCK_ERROR:
-                    default: // ??
-                        return false;
-                }
-            }
+size_t FoxPeer::pendingOut() {
+    size_t sz = sizeOut() + sendBuffer.size() + largePending;
 
-            if (sizeIn() == pktSize) {
-                // check if they're authorized
-                if (!handshook && currentPkt != PKTID_HANDSHAKE_REQ && currentPkt != PKTID_HANDSHAKE_RES) {
-                    FOXFATAL("Peer tried sending non-authorized packet!")
-                }
+    for (int i = 0; i < PKTLANE_MAX; i++)
+        sz += lanes[i].buf.size() - lanes[i].head;
 
-                // dispatch packet
-                if (isPacketVar(currentPkt)) {
-                    PktVarHandler hndlr = getVarPacketHandler(currentPkt);
-                    if (hndlr != nullptr) {
-                        hndlr(this, pktSize);
-                    }
-                } else {
-                    // dispatch Packet Handler
-                    PktHandler hndlr = getPacketHandler(currentPkt);
-                    if (hndlr != nullptr) {
-                        hndlr(this);
-                    }
-                }
+    return sz;
+}
 
-                // reset
-                flushIn(); // just make sure we don't leave any unused bytes in the queue so we don't mess up future received packets
-                currentPkt = PKTID_NONE;
-                break;
-            }
+void FoxPeer::sendFile(PktID id, int fd, uint64_t offset, uint32_t size, LargeSendCallback callback, PktLane lane) {
+    LargeSend send;
 
-            break;
+    send.id = id;
+    send.fd = fd;
+    send.fileOffset = offset;
+    send.data = nullptr;
+    send.size = size;
+    send.callback = std::move(callback);
+    queueLarge(std::move(send), lane);
+}
+
+void FoxPeer::sendZeroCopy(PktID id, const Byte *data, uint32_t size, LargeSendCallback callback, PktLane lane) {
+    LargeSend send;
+
+    send.id = id;
+    send.fd = -1;
+    send.fileOffset = 0;
+    send.data = data;
+    send.size = size;
+    send.callback = std::move(callback);
+    queueLarge(std::move(send), lane);
+}
+
+void FoxPeer::queueLarge(LargeSend &&send, PktLane lane) {
+    uint32_t offset = 0;
+
+    largeSends.push_back(std::move(send));
+    LargeSend *large = &largeSends.back();
+    largePending += large->size;
+
+    // the payload can't go in a datagram, but it's fine on any other lane
+    commitPacket();
+    PktLane prev = setLane(lane == PKTLANE_DATAGRAM ? PKTLANE_BULK : lane);
+
+    // every segment gets its own header, so the other end can hand each piece over as it arrives
+    do {
+        uint32_t sz = std::min<uint32_t>(large->size - offset, FOXNET_LARGE_SEGMENT);
+
+        writeByte(PKTID_LARGE_DATA);
+        writeByte(large->id);
+        writeInt<uint32_t>(large->size);
+        writeInt<uint32_t>(offset);
+        writeInt<uint32_t>(sz);
+        commitChunk(large, offset, sz);
+        large->segments++;
+
+        FOXMETRIC(addPacketOut(PKTID_LARGE_DATA, sizeof(PktID) * 2 + sizeof(uint32_t) * 3 + sz))
+        offset += sz;
+    } while (offset < large->size);
+
+    setLane(prev);
+}
+
+FoxPeer::RawSockCode FoxPeer::sendLarge() {
+    LargeSend *large = largeActive;
+
+    while (largeLeft > 0) {
+        int64_t zeroCopyID = -1;
+        RawSockReturn sent;
+
+        if (large->fd != -1)
+            sent = rawSendFile(large->fd, large->fileOffset + largeOffset, largeLeft);
+        else
+            sent = rawSendZeroCopy(large->data + largeOffset, largeLeft, zeroCopyID);
+
+        if (sent.code != RAWSOCK_OK)
+            return sent.code;
+
+        if (zeroCopyID != -1)
+            large->zeroCopyLast = zeroCopyID;
+
+        largeOffset += sent.processed;
+        largeLeft -= sent.processed;
+        largePending -= sent.processed;
+    }
+
+    // the segment is out, the scheduler can move on
+    largeActive = nullptr;
+    if (--large->segments == 0)
+        finishLargeSends(false);
+
+    return RAWSOCK_OK;
+}
+
+void FoxPeer::finishLargeSends(bool cancel) {
+    std::vector<std::pair<LargeSendCallback, bool>> fired;
+
+    for (auto iter = largeSends.begin(); iter != largeSends.end();) {
+        // zerocopy ids complete in order (early ones are held in zeroCopyRanges), so the last id covers the rest
+        bool done = iter->segments == 0 && (iter->zeroCopyLast == -1 || (int32_t)(zeroCopyDone - (uint32_t)iter->zeroCopyLast) > 0);
+
+        if (!done && !cancel) {
+            iter++;
+            continue;
         }
+
+        if (iter->callback)
+            fired.push_back({std::move(iter->callback), done});
+        iter = largeSends.erase(iter);
     }
 
-    // we have data to send and handePollOut returns an error, return error result
-    if (sizeOut() > 0 && !handlePollOut(plist))
+    // (callbacks are free to queue another send)
+    for (auto &pair : fired)
+        pair.first(this, pair.second);
+}
+
+bool FoxPeer::scheduleChunk() {
+    OutLane *lane = nullptr;
+    bool startFraming = false;
+    size_t sz;
+
+    // nothing cuts in between a large segment's header & its payload
+    if (sendHeld || largeActive != nullptr)
         return false;
 
-    return isAlive();
+    if (!lanes[PKTLANE_CONTROL].chunks.empty()) {
+        lane = &lanes[PKTLANE_CONTROL];
+
+        // everything after this chunk has to wait for the transport switch
+        if (switchMark > 0 && --switchMark == 0)
+            sendHeld = true;
+
+        // everything after this chunk is framed
+        startFraming = integrityMark > 0 && --integrityMark == 0;
+    } else {
+        // pick the lane furthest behind on its share
+        for (int i = PKTLANE_CONTROL + 1; i < PKTLANE_DATAGRAM; i++) {
+            if (!lanes[i].chunks.empty() && (lane == nullptr || lanes[i].vtime < lane->vtime))
+                lane = &lanes[i];
+        }
+
+        if (lane == nullptr)
+            return false;
+
+        laneClock = lane->vtime;
+        lane->vtime += ((lane->chunks.front().size + lane->chunks.front().payload) * 256) / lane->share;
+    }
+
+    OutChunk chunk = lane->chunks.front();
+    sz = chunk.size;
+    lane->chunks.pop_front();
+
+    // (the frame is on its way, nothing more can join it)
+    if (lane->chunks.empty())
+        lane->aggOpen = false;
+
+    if (chunk.large != nullptr) {
+        largeActive = chunk.large;
+        largeOffset = chunk.offset;
+        largeLeft = chunk.payload;
+    }
+
+    if (sendBuffer.empty() && lane->chunks.empty() && lane->head == 0) {
+        // fastpath: the whole lane is being scheduled, swap instead of copying
+        sendBuffer.swap(lane->buf);
+        lane->buf.clear();
+    } else {
+        sendBuffer.insert(sendBuffer.end(), lane->buf.begin() + lane->head, lane->buf.begin() + lane->head + sz);
+        lane->head += sz;
+
+        // lane is drained, reset it
+        if (lane->chunks.empty()) {
+            lane->buf.clear();
+            lane->head = 0;
+        }
+    }
+
+    // the lanes are interleaved here, so this is where the bytes are in the order they go out on the wire
+    if (!chunk.transformed)
+        onSend(sendBuffer.data() + sendBuffer.size() - sz, sz);
+
+    // a resumable session keeps whatever didn't make it out, so it needs to know where each chunk is
+    if (resumeToken != 0) {
+        uint64_t end = sendOffset + sendBuffer.size();
+
+        sentChunks.push_back({end - sz, end, (PktLane)(lane - lanes), chunk.large != nullptr});
+    }
+
+    // everything up to & including this chunk goes out as is
+    if (startFraming) {
+        integrityOut = true;
+        sendFramed = sendBuffer.size();
+    }
+
+    return true;
 }
 
-bool FoxPeer::handlePollOut(FoxPollList& plist) {
-    RawSockReturn sent;
+void FoxPeer::frameSendAfter() {
+    commitPacket();
 
-    // sanity check
-    if (sizeOut() == 0)
-        return true;
+    // (like holdSendAfter())
+    integrityMark = lanes[PKTLANE_CONTROL].chunks.size();
+}
 
-    onStep();
-    sent = rawSend(sizeOut());
+void FoxPeer::sealFrames() {
+    Byte header[FOXNET_INTEGRITY_HEADER];
 
-    switch(sent.code) {
-        case RAWSOCK_OK: // we're ok!
-            if (setPollOut) { // if POLLOUT was set, unset it
-                plist.rmvPollOut(this);
-                setPollOut = false;
-            }
-            return true;
-        case RAWSOCK_POLL: // we've been asked to set the POLLOUT flag
-            if (!setPollOut) { // if POLLOUT wasn't set, set it so we'll be notified whenever the kernel has room :)
-                plist.addPollOut(this);
-                setPollOut = true;
+    // usually the whole batch is one frame, a huge chunk is split up so the other end doesn't have to hold all of it
+    while (sendFramed < sendBuffer.size()) {
+        uint32_t sz = (uint32_t)std::min<size_t>(sendBuffer.size() - sendFramed, FOXNET_INTEGRITY_FRAME);
+
+        // the size is covered by the checksum too
+        putInt<uint32_t>(header, sz, flipEndian);
+        uint32_t crc = FoxChecksum::crc32c(header, sizeof(uint32_t));
+        crc = FoxChecksum::crc32c(sendBuffer.data() + sendFramed, sz, crc);
+        putInt<uint32_t>(header + sizeof(uint32_t), crc, flipEndian);
+
+        // (the chunks after it move along)
+        if (resumeToken != 0) {
+            uint64_t at = sendOffset + sendFramed;
+
+            for (auto iter = sentChunks.rbegin(); iter != sentChunks.rend() && iter->end > at; iter++) {
+                if (iter->start >= at)
+                    iter->start += sizeof(header);
+                iter->end += sizeof(header);
             }
-            return true;
-        default:
-        case RAWSOCK_CLOSED:
-        case RAWSOCK_ERROR:
-            return false;
+
+            sentHeaders.push_back(at);
+        }
+
+        sendBuffer.insert(sendBuffer.begin() + sendFramed, header, header + sizeof(header));
+        sendFramed += sizeof(header) + sz;
     }
 }
 
+bool FoxPeer::checkFrames(size_t need) {
+    // the next frame is only checked once the parser runs out, what comes after a large segment's header isn't a frame
+    while (recvChecked < recvBuffer.size() && recvChecked - recvHead < need) {
+        size_t raw = recvBuffer.size() - recvChecked;
+        Byte *header = recvBuffer.data() + recvChecked;
+        uint32_t sz, crc;
+
+        // a large segment's payload isn't framed, it follows the frame that ended with its header
+        if (recvState == RECV_LARGE_BODY) {
+            recvChecked += std::min<size_t>(raw, need - (recvChecked - recvHead));
+            return true;
+        }
+
+        if (raw < FOXNET_INTEGRITY_HEADER)
+            return true;
+
+        ByteView view(header, FOXNET_INTEGRITY_HEADER, flipEndian);
+        view.readInt(sz);
+        view.readInt(crc);
+
+        if (sz > FOXNET_INTEGRITY_FRAME) {
+            FOXMETRIC(addIntegrityFailure())
+            return false;
+        }
+
+        if (raw < FOXNET_INTEGRITY_HEADER + sz)
+            return true;
+
+        if (FoxChecksum::crc32c(header + FOXNET_INTEGRITY_HEADER, sz, FoxChecksum::crc32c(header, sizeof(uint32_t))) != crc) {
+            FOXMETRIC(addIntegrityFailure())
+            return false;
+        }
+
+        // drop the header by sliding the checked bytes that haven't been parsed yet (usually none) over it
+        memmove(recvBuffer.data() + recvHead + FOXNET_INTEGRITY_HEADER, recvBuffer.data() + recvHead, recvChecked - recvHead);
+        recvHead += FOXNET_INTEGRITY_HEADER;
+        recvChecked += FOXNET_INTEGRITY_HEADER + sz;
+    }
+
+    return true;
+}
+
+void FoxPeer::queueHandshake() {
+    OutLane &lane = lanes[PKTLANE_CONTROL];
+
+    commitPacket();
+
+    // move the request (the last chunk) in front of whatever was written to the lane before we connected
+    if (lane.chunks.size() > 1) {
+        OutChunk chunk = lane.chunks.back();
+
+        std::rotate(lane.buf.begin() + lane.head, lane.buf.end() - chunk.size, lane.buf.end());
+        lane.chunks.pop_back();
+        lane.chunks.push_front(chunk);
+    }
+
+    // (like frameSendAfter(), the request is the first chunk now)
+    if (integrityWanted)
+        integrityMark = 1;
+}
+
+uint32_t FoxPeer::getOfferedCaps() {
+    return userCaps | CAP_AGGREGATE | (integrityWanted ? CAP_INTEGRITY : 0) | (resumable ? CAP_RESUME : 0);
+}
+
+uint64_t FoxPeer::resumeSession(uint64_t, bool &) {
+    // stubbed
+    return 0;
+}
+
+void FoxPeer::detachConnection() {
+    std::vector<Byte> keptBufs[PKTLANE_MAX];
+    std::deque<OutChunk> keptChunks[PKTLANE_MAX];
+    size_t header = 0;
+
+    kill();
+    commitPacket();
+
+    // chunks that are still whole go back in front of their lanes, stripped of their integrity headers (the next
+    // connection frames them again) & marked so they don't go through onSend() twice. one that was partly written
+    // is lost, the other end dropped its half
+    for (SentChunk &sent : sentChunks) {
+        std::vector<Byte> &buf = keptBufs[sent.lane];
+        size_t before = buf.size();
+
+        if (sent.start < sendOffset || sent.large || sent.lane == PKTLANE_CONTROL)
+            continue;
+
+        for (uint64_t pos = sent.start; pos < sent.end;) {
+            while (header < sentHeaders.size() && sentHeaders[header] + FOXNET_INTEGRITY_HEADER <= pos)
+                header++;
+
+            if (header < sentHeaders.size() && sentHeaders[header] <= pos) {
+                pos = sentHeaders[header] + FOXNET_INTEGRITY_HEADER;
+                continue;
+            }
+
+            uint64_t next = header < sentHeaders.size() ? std::min<uint64_t>(sentHeaders[header], sent.end) : sent.end;
+            buf.insert(buf.end(), sendBuffer.begin() + (pos - sendOffset), sendBuffer.begin() + (next - sendOffset));
+            pos = next;
+        }
+
+        keptChunks[sent.lane].push_back({buf.size() - before, nullptr, 0, 0, true});
+    }
+
+    sendOffset += sendBuffer.size();
+    sendBuffer.clear();
+    sendFramed = 0;
+    sentChunks.clear();
+    sentHeaders.clear();
+    setPollOut = false;
+
+    // only whole packets are kept. the control lane belongs to the connection (its handshake, datagram offer,
+    // pongs...) & the datagram lane is unreliable anyways, both are dropped
+    for (PktLane i : {PKTLANE_CONTROL, PKTLANE_DATAGRAM}) {
+        lanes[i].buf.clear();
+        lanes[i].chunks.clear();
+        lanes[i].head = 0;
+    }
+
+    for (int i = PKTLANE_CONTROL + 1; i < PKTLANE_DATAGRAM; i++) {
+        OutLane &lane = lanes[i];
+        std::vector<Byte> buf = std::move(keptBufs[i]);
+        std::deque<OutChunk> chunks = std::move(keptChunks[i]);
+        size_t pos = lane.head;
+
+        for (OutChunk &chunk : lane.chunks) {
+            if (chunk.large == nullptr) {
+                buf.insert(buf.end(), lane.buf.begin() + pos, lane.buf.begin() + pos + chunk.size);
+                chunks.push_back(chunk);
+            }
+
+            pos += chunk.size;
+        }
+
+        lane.buf.swap(buf);
+        lane.chunks.swap(chunks);
+        lane.head = 0;
+        lane.aggOpen = false;
+    }
+
+    largeActive = nullptr;
+    largeLeft = 0;
+    largePending = 0;
+    finishLargeSends(true);
+
+    // the next connection starts a fresh stream, with fresh frames
+    recvBuffer.clear();
+    recvHead = recvChecked = 0;
+    recvState = RECV_ID;
+    currentPkt = PKTID_NONE;
+    integrityIn = integrityOut = false;
+    integrityMark = 0;
+    zeroCopyDone = 0;
+    zeroCopyRanges.clear();
+
+    // the client's datagram channel & its snapshot baselines went with it
+    datagram = nullptr;
+    datagramReady = false;
+    datagramAddrLen = 0;
+    datagramSession = 0;
+    datagramToken = 0;
+    sequencedIn.clear();
+    snapshotsIn.clear();
+    snapshotAcked = 0;
+
+    // (like cancelWaiters(), minus discarding what's queued)
+    checkRPCTimeouts();
+    failWaiters();
+}
+
+void FoxPeer::takeConnection(FoxPeer *fresh) {
+    takeSock(fresh);
+    setFlipEndian(fresh->flipEndian);
+    handshook = fresh->handshook;
+    versionMatched = fresh->versionMatched;
+    caps = fresh->caps;
+    resumed = true;
+    resumeToken = fresh->resumeToken;
+
+    // (it stopped parsing right after the request)
+    recvBuffer.swap(fresh->recvBuffer);
+    recvHead = fresh->recvHead;
+    recvChecked = fresh->recvChecked;
+    recvState = fresh->recvState;
+    integrityIn = fresh->integrityIn;
+    integrityOut = fresh->integrityOut;
+    integrityMark = fresh->integrityMark;
+    sendBuffer.swap(fresh->sendBuffer);
+    sendFramed = fresh->sendFramed;
+    sendOffset = fresh->sendOffset;
+    sentChunks.swap(fresh->sentChunks);
+    sentHeaders.swap(fresh->sentHeaders);
+    setPollOut = false;
+
+    // the response goes first, integrityMark counts from the front of the control lane so it still holds
+    fresh->commitPacket();
+    for (int i = 0; i < PKTLANE_MAX; i++) {
+        OutLane &lane = lanes[i], &first = fresh->lanes[i];
+
+        if (first.chunks.empty())
+            continue;
+
+        first.buf.erase(first.buf.begin(), first.buf.begin() + first.head);
+        first.buf.insert(first.buf.end(), lane.buf.begin() + lane.head, lane.buf.end());
+        lane.buf.swap(first.buf);
+        lane.head = 0;
+        lane.chunks.insert(lane.chunks.begin(), first.chunks.begin(), first.chunks.end());
+        lane.aggOpen = false;
+    }
+
+    datagram = fresh->datagram;
+    datagramSession = fresh->datagramSession;
+    datagramToken = fresh->datagramToken;
+    fresh->datagram = nullptr;
+}
+
+uint64_t FoxPeer::getResumeToken() {
+    return resumeToken;
+}
+
+bool FoxPeer::isResumed() {
+    return resumed;
+}
+
+void FoxPeer::setCapabilities(uint32_t bits) {
+    if (bits & (CAP_USER_START - 1)) {
+        FOXFATAL("setCapabilities() only takes user capability bits!")
+    }
+
+    userCaps = bits;
+}
+
+uint32_t FoxPeer::getCapabilities() {
+    return caps;
+}
+
+bool FoxPeer::hasCapability(uint32_t cap) {
+    return (caps & cap) == cap;
+}
+
+void FoxPeer::setIntegrity(bool enabled) {
+    integrityWanted = enabled;
+}
+
+bool FoxPeer::isIntegrityActive() {
+    return integrityIn && integrityOut;
+}
+
+void FoxPeer::holdSendAfter() {
+    commitPacket();
+
+    // control chunks are scheduled in order, so the last one we wrote is this many chunks away
+    switchMark = lanes[PKTLANE_CONTROL].chunks.size();
+}
+
+void FoxPeer::requestShm() {
+    // the server passes the fds along with its response, be ready for them before asking
+    setAcceptFds(true);
+
+    PktLane lane = setLane(PKTLANE_CONTROL);
+    writeByte(PKTID_SHM_REQ);
+    setLane(lane);
+
+    // the server reads everything after the request from the transport, so nothing else goes on the socket
+    holdSendAfter();
+    shmState = SHM_REQUESTED;
+}
+
+size_t FoxPeer::prepareRPC(RPCMethod method, RPCCallback callback, int timeout) {
+    RPCID id = nextRPCID++;
+    PendingRPC &pending = pendingRPCs[id];
+
+    // 0 is never handed out, so it can be used as a 'no request' value
+    if (nextRPCID == 0)
+        nextRPCID = 1;
+
+    pending.callback = std::move(callback);
+    pending.deadline = timeout >= 0 ? rpcDeadlines.emplace(getTicks() + timeout, id) : rpcDeadlines.end();
+
+    size_t indx = prepareVarPacket(PKTID_RPC_REQ);
+    writeInt<RPCID>(id);
+    writeByte(method);
+
+    return indx;
+}
+
+size_t FoxPeer::prepareRPCResponse(RPCID id, RPCStatus status) {
+    size_t indx = prepareVarPacket(PKTID_RPC_RES);
+    writeInt<RPCID>(id);
+    writeByte(status);
+
+    return indx;
+}
+
+void FoxPeer::checkRPCTimeouts() {
+    int64_t currTick;
+
+    if (pendingRPCs.empty())
+        return;
+
+    // the connection is gone, nothing is getting answered anymore
+    if (!isAlive()) {
+        std::unordered_map<RPCID, PendingRPC> pending;
+
+        pending.swap(pendingRPCs);
+        rpcDeadlines.clear();
+
+        for (auto &pair : pending)
+            pair.second.callback(this, RPC_DISCONNECTED, 0);
+        return;
+    }
+
+    currTick = getTicks();
+    while (!rpcDeadlines.empty() && rpcDeadlines.begin()->first <= currTick) {
+        auto iter = pendingRPCs.find(rpcDeadlines.begin()->second);
+        RPCCallback callback = std::move(iter->second.callback);
+
+        rpcDeadlines.erase(rpcDeadlines.begin());
+        pendingRPCs.erase(iter);
+
+        callback(this, RPC_TIMEOUT, 0);
+    }
+}
+
+int FoxPeer::getRPCTimeout(int timeout) {
+    int64_t wait;
+
+    if (rpcDeadlines.empty())
+        return timeout;
+
+    wait = rpcDeadlines.begin()->first - getTicks();
+    if (wait < 0)
+        wait = 0;
+
+    return (timeout < 0 || wait < timeout) ? (int)wait : timeout;
+}
+
+size_t FoxPeer::getPendingRPCs() {
+    return pendingRPCs.size();
+}
+
+void FoxPeer::registerPacket(PktID id, PktSize size) {
+    PKTMAP[id].handler = nullptr;
+    PKTMAP[id].size = size;
+    PKTMAP[id].variable = false;
+}
+
+void FoxPeer::registerVarPacket(PktID id) {
+    PKTMAP[id].varhandler = nullptr;
+    PKTMAP[id].size = 0;
+    PKTMAP[id].variable = true;
+}
+
+void FoxPeer::setPacketDelivery(PktID id, PktDelivery delivery) {
+    PKTMAP[id].delivery = delivery;
+}
+
+void FoxPeer::addWaiter(PeerWaitEvent event, PktID id, PeerWaitCallback callback, void *ud) {
+    waiters.push_back({event, id, callback, ud});
+}
+
+bool FoxPeer::fireWaiter(PeerWaitEvent event, PktID id, PktSize size) {
+    for (auto iter = waiters.begin(); iter != waiters.end(); iter++) {
+        if (iter->event == event && iter->id == id) {
+            // waiters are one-shot, remove it first since the callback is free to add another
+            PeerWaiter waiter = *iter;
+            waiters.erase(iter);
+
+            waiter.callback(waiter.ud, this, size);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void FoxPeer::fireWaiters(PeerWaitEvent event) {
+    std::vector<PeerWaiter> fired;
+
+    for (auto iter = waiters.begin(); iter != waiters.end();) {
+        if (iter->event == event) {
+            fired.push_back(*iter);
+            iter = waiters.erase(iter);
+        } else {
+            iter++;
+        }
+    }
+
+    for (PeerWaiter &waiter : fired)
+        waiter.callback(waiter.ud, this, 0);
+}
+
+void FoxPeer::failWaiters() {
+    std::vector<PeerWaiter> fired;
+
+    fired.swap(waiters);
+    for (PeerWaiter &waiter : fired) {
+        // the peer is being torn down, whatever a waiter throws can't be allowed to stop that (or the other waiters)
+        try {
+            waiter.callback(waiter.ud, this, 0);
+        } catch(std::exception &e) {
+            FOXWARN("a waiter threw while its peer was killed: " << e.what());
+        } catch(...) {
+            FOXWARN("a waiter threw while its peer was killed!");
+        }
+    }
+}
+
+void FoxPeer::cancelWaiters() {
+    // nothing queued is going anywhere anymore
+    if (!largeSends.empty())
+        discardOut();
+
+    failWaiters();
+}
+
+bool FoxPeer::isPacketVar(PktID id) {
+    return PKTMAP[id].variable;
+}
+
+PktHandler FoxPeer::getPacketHandler(PktID id) {
+    return PKTMAP[id].handler;
+}
+
+PktVarHandler FoxPeer::getVarPacketHandler(PktID id) {
+    return PKTMAP[id].varhandler;
+}
+
+PktSize FoxPeer::getPacketSize(PktID id) {
+    return PKTMAP[id].size;
+}
+
+void FoxPeer::onReady() {
+    // stubbed
+}
+
+void FoxPeer::acceptDatagramOffer(uint16_t) {
+    // stubbed
+}
+
+void FoxPeer::onStep() {
+    // stubbed
+}
+
+void FoxPeer::onPing(int64_t peerTime, int64_t currTime) {
+    // stubbed
+}
+
+void FoxPeer::onPong(int64_t peerTime, int64_t currTime) {
+    // stubbed
+}
+
+void FoxPeer::onLargePacket(PktID, uint32_t, uint32_t, ByteView) {
+    // stubbed
+}
+
+void FoxPeer::onSnapshot(const FoxSnapshot &) {
+    // stubbed
+}
+
+void FoxPeer::dispatchLarge(Byte *data, size_t sz) {
+    uint32_t offset = largeInOffset;
+
+    largeInOffset += sz;
+    largeInLeft -= sz;
+    if (largeInLeft == 0)
+        recvState = RECV_ID;
+
+    onLargePacket(largeInID, offset, largeInTotal, ByteView(data, sz, flipEndian));
+}
+
+void FoxPeer::dispatchPacket() {
+    // check if they're authorized (packets pipelined behind the handshake request are parsed after it, so they are)
+    if (!handshook && currentPkt != PKTID_HANDSHAKE_REQ && currentPkt != PKTID_HANDSHAKE_RES &&
+        currentPkt != PKTID_SESSION_REQ && currentPkt != PKTID_SESSION_RES) {
+        FOXFATAL("Peer tried sending non-authorized packet!")
+    }
+
+#ifdef FOXNET_ENABLE_METRICS
+    int64_t dispatchStart = FoxMetrics::now();
+#endif
+    FOXTRACE_SCOPE(trace, "dispatch")
+    FOXTRACE_ARG(trace, currentPkt)
+
+    // datagrams can only carry packets that opted in
+    if (datagramSeqIn != 0) {
+        PktDelivery delivery = PKTMAP[currentPkt].delivery;
+
+        if (delivery == PKTDELIVERY_RELIABLE)
+            return;
+
+        if (delivery == PKTDELIVERY_SEQUENCED) {
+            auto iter = sequencedIn.find(currentPkt);
+
+            // (packets in the same datagram share its sequence number, they're still in order)
+            if (iter != sequencedIn.end() && (int32_t)(datagramSeqIn - iter->second) < 0)
+                return;
+
+            sequencedIn[currentPkt] = datagramSeqIn;
+        }
+    }
+
+    // dispatch packet, waiters get first dibs
+    if (!waiters.empty() && fireWaiter(PEERWAIT_PACKET, currentPkt, pktSize)) {
+        // handled by the waiter
+    } else if (isPacketVar(currentPkt)) {
+        PktVarHandler hndlr = getVarPacketHandler(currentPkt);
+        if (hndlr != nullptr) {
+            hndlr(this, pktSize);
+        }
+    } else {
+        // dispatch Packet Handler
+        PktHandler hndlr = getPacketHandler(currentPkt);
+        if (hndlr != nullptr) {
+            hndlr(this);
+        }
+    }
+
+    // var packets also carry the PKTID_VAR_LENGTH byte & their size
+    FOXMETRIC(addPacketIn(currentPkt, sizeof(PktID) + pktSize + (isPacketVar(currentPkt) ? sizeof(PktID) + sizeof(PktSize) : 0),
+        FoxMetrics::now() - dispatchStart))
+}
+
+bool FoxPeer::dispatchAggregate(Byte *data, size_t sz, size_t *budget) {
+    bool wasAlive = isAlive();
+    ByteView frame(data, sz, flipEndian);
+    ByteView body;
+    uint64_t bodySize;
+    PktID id;
+
+    // the whole frame already went through onRecv(), its packets are dispatched back to back straight out of it
+    while (frame.sizeRemaining() > 0 && !(wasAlive && !isAlive())) {
+        frame.readByte(id);
+
+        if (id == PKTID_NONE || id == PKTID_VAR_LENGTH || id == PKTID_LARGE_DATA || id == PKTID_AGGREGATE)
+            return false;
+
+        if (isPacketVar(id)) {
+            if (!frame.readVarint(bodySize))
+                return false;
+        } else {
+            bodySize = getPacketSize(id);
+        }
+
+        if (bodySize > frame.sizeRemaining())
+            return false;
+
+        frame.readView(body, bodySize);
+        currentPkt = id;
+        pktSize = (PktSize)bodySize;
+        setInView(body.getData(), bodySize);
+        try {
+            dispatchPacket();
+        } catch(...) {
+            flushIn();
+            throw;
+        }
+
+        flushIn();
+
+        // (a frame is never split, so it can run a little over the budget)
+        if (budget != nullptr && *budget > 0)
+            (*budget)--;
+    }
+
+    currentPkt = PKTID_NONE;
+    return true;
+}
+
+bool FoxPeer::parseIn(size_t *budget) {
+    bool wasAlive = isAlive();
+    PktSize pSize;
+
+    // handle every complete packet we have buffered, stopping if a handler kills us
+    while (!(wasAlive && !isAlive()) && !recvHeld && (budget == nullptr || *budget > 0)) {
+        // (datagrams aren't framed, they're checked by udp)
+        bool checked = integrityIn && datagramSeqIn == 0;
+
+        size_t need = 0;
+
+        switch (recvState) {
+            case RECV_ID: need = sizeof(PktID); break;
+            case RECV_VAR_SIZE: need = sizeof(PktSize); break;
+            case RECV_VAR_ID: need = sizeof(PktID); break;
+            case RECV_BODY: need = pktSize; break;
+            case RECV_LARGE_HEADER: need = sizeof(PktID) + sizeof(uint32_t) * 3; break;
+            case RECV_LARGE_BODY: need = largeInLeft; break;
+            case RECV_AGG_SIZE: need = sizeof(PktSize); break;
+            case RECV_AGG_BODY: need = pktSize; break;
+        }
+
+        // only bytes that passed their frame's check are parsed
+        if (checked && !checkFrames(need))
+            return false;
+
+        size_t avail = (checked ? recvChecked : recvBuffer.size()) - recvHead;
+
+        // a large payload is handed over in whatever pieces we have
+        if (recvState == RECV_LARGE_BODY)
+            need = std::min<size_t>(avail, need);
+
+        if (avail < need || (recvState == RECV_LARGE_BODY && avail == 0))
+            break;
+
+        // every byte passes through onRecv() exactly once, in place, then it's decoded right out of recvBuffer.
+        // (except large payloads, the sender doesn't pass them through onSend() either)
+        Byte *data = recvBuffer.data() + recvHead;
+        if (recvState != RECV_LARGE_BODY)
+            onRecv(data, need);
+        recvHead += need;
+
+        switch (recvState) {
+            case RECV_ID:
+                currentPkt = data[0];
+
+                if (currentPkt == PKTID_VAR_LENGTH) {
+                    recvState = RECV_VAR_SIZE;
+                } else if (currentPkt == PKTID_LARGE_DATA) {
+                    recvState = RECV_LARGE_HEADER;
+                } else if (currentPkt == PKTID_AGGREGATE) {
+                    recvState = RECV_AGG_SIZE;
+                } else if (currentPkt != PKTID_NONE) {
+                    pktSize = getPacketSize(currentPkt);
+                    recvState = RECV_BODY;
+                }
+                break;
+            case RECV_VAR_SIZE:
+                if (!ByteView(data, need, flipEndian).readInt(pSize))
+                    return false;
+                pktSize = pSize;
+
+                // if they try sending a packet larger than MAX_PACKET_SIZE kill em'
+                if (pktSize > MAX_PACKET_SIZE)
+                    return false;
+
+                recvState = RECV_VAR_ID;
+                break;
+            case RECV_VAR_ID:
+                currentPkt = data[0];
+
+                if (currentPkt == PKTID_NONE || currentPkt == PKTID_VAR_LENGTH || currentPkt == PKTID_LARGE_DATA ||
+                        currentPkt == PKTID_AGGREGATE)
+                    return false;
+
+                recvState = RECV_BODY;
+                break;
+            case RECV_BODY:
+                // the handler reads the body where it sits (see getPacketView())
+                setInView(data, need);
+                try {
+                    dispatchPacket();
+                } catch(...) {
+                    flushIn();
+                    throw;
+                }
+
+                if (budget != nullptr)
+                    (*budget)--;
+
+                // reset
+                flushIn(); // just make sure we don't leave any unused bytes in the queue so we don't mess up future received packets
+                currentPkt = PKTID_NONE;
+                recvState = RECV_ID;
+                break;
+            case RECV_LARGE_HEADER: {
+                ByteView header(data, need, flipEndian);
+                uint32_t offset, size;
+
+                if (!handshook) {
+                    FOXFATAL("Peer tried sending non-authorized packet!")
+                }
+
+                if (!header.readByte(largeInID) || !header.readInt(largeInTotal) || !header.readInt(offset) ||
+                        !header.readInt(size))
+                    return false;
+
+                // never over the datagram channel, and the segment has to fit in its payload
+                if (datagramSeqIn != 0 || (uint64_t)offset + size > largeInTotal)
+                    return false;
+
+                FOXMETRIC(addPacketIn(PKTID_LARGE_DATA, sizeof(PktID) + need + size, 0))
+                currentPkt = PKTID_NONE;
+                largeInOffset = offset;
+                largeInLeft = size;
+                recvState = RECV_LARGE_BODY;
+
+                // an empty payload still gets its (empty) piece
+                if (size == 0)
+                    dispatchLarge(data + need, 0);
+                break;
+            }
+            case RECV_LARGE_BODY:
+                dispatchLarge(data, need);
+
+                if (budget != nullptr)
+                    (*budget)--;
+                break;
+            case RECV_AGG_SIZE:
+                if (!handshook) {
+                    FOXFATAL("Peer tried sending non-authorized packet!")
+                }
+
+                if (!ByteView(data, need, flipEndian).readInt(pSize))
+                    return false;
+                pktSize = pSize;
+
+                if (pktSize > MAX_PACKET_SIZE)
+                    return false;
+
+                recvState = RECV_AGG_BODY;
+                break;
+            case RECV_AGG_BODY:
+                currentPkt = PKTID_NONE;
+                recvState = RECV_ID;
+
+                if (!dispatchAggregate(data, need, budget))
+                    return false;
+                break;
+        }
+    }
+
+    // drop what we've parsed, keeping any partial packet around for the next recv
+    if (recvHead == recvBuffer.size()) {
+        recvBuffer.clear();
+        recvHead = 0;
+
+        if (datagramSeqIn == 0)
+            recvChecked = 0;
+    } else if (recvHead > recvBuffer.size() / 2) {
+        recvBuffer.erase(recvBuffer.begin(), recvBuffer.begin() + recvHead);
+
+        if (datagramSeqIn == 0 && integrityIn)
+            recvChecked -= recvHead;
+
+        recvHead = 0;
+    }
+
+    return true;
+}
+
+bool FoxPeer::feedIn(const Byte *data, size_t sz) {
+    recvBuffer.insert(recvBuffer.end(), data, data + sz);
+    return parseIn();
+}
+
+void FoxPeer::setWantShm(bool want) {
+    shmWanted = want;
+}
+
+bool FoxPeer::isShmActive() {
+    return shmState == SHM_ACTIVE;
+}
+
+void FoxPeer::setDatagramChannel(FoxDatagram *dgram, uint32_t session, uint64_t token) {
+    datagram = dgram;
+    datagramSession = session;
+    datagramToken = token;
+}
+
+uint32_t FoxPeer::getDatagramSession() {
+    return datagramSession;
+}
+
+bool FoxPeer::isDatagramReady() {
+    return datagramReady;
+}
+
+bool FoxPeer::handleDatagramHello(const FoxDatagram::Message &msg) {
+    if (!handshook || msg.size != FOXNET_DATAGRAM_HEADER + sizeof(uint64_t) ||
+            FoxDatagram::getInt<uint64_t>(msg.data + FOXNET_DATAGRAM_HEADER) != datagramToken)
+        return false;
+
+    // hellos keep coming until the ack arrives, only the first (or one from a new address) is acked
+    if (isDatagramFrom((const struct sockaddr *)&msg.addr, msg.addrLen))
+        return true;
+
+    memcpy(&datagramAddr, &msg.addr, msg.addrLen);
+    datagramAddrLen = msg.addrLen;
+    datagramReady = true;
+
+    PktLane lane = setLane(PKTLANE_CONTROL);
+    writeByte(PKTID_DATAGRAM_ACK);
+    setLane(lane);
+    return true;
+}
+
+bool FoxPeer::isDatagramFrom(const struct sockaddr *addr, socklen_t addrLen) {
+    return datagramAddrLen == addrLen && memcmp(&datagramAddr, addr, addrLen) == 0;
+}
+
+void FoxPeer::handleDatagram(const Byte *data, size_t sz) {
+    size_t streamHead = recvHead;
+    RecvState streamState = recvState;
+    PktID streamPkt = currentPkt;
+    PktSize streamSize = pktSize;
+    bool ok;
+
+    if (sz <= FOXNET_DATAGRAM_HEADER)
+        return;
+
+    // the datagram goes through the stream's parser, with the stream's partial packet set aside
+    recvBuffer.swap(datagramBuffer);
+    recvBuffer.assign(data + FOXNET_DATAGRAM_HEADER, data + sz);
+    recvHead = 0;
+    recvState = RECV_ID;
+    currentPkt = PKTID_NONE;
+    datagramSeqIn = FoxDatagram::getInt<uint32_t>(data + sizeof(uint32_t));
+
+    auto restore = [&]() {
+        datagramSeqIn = 0;
+        recvBuffer.swap(datagramBuffer);
+        recvHead = streamHead;
+        recvState = streamState;
+        currentPkt = streamPkt;
+        pktSize = streamSize;
+    };
+
+    try {
+        // datagrams only hold whole packets, anything left over is malformed
+        ok = parseIn() && recvState == RECV_ID && recvHead == recvBuffer.size();
+    } catch(...) {
+        restore();
+        throw;
+    }
+
+    restore();
+
+    if (!ok) {
+        FOXMETRIC(addDatagramsDropped(1))
+    }
+}
+
+void FoxPeer::flushDatagrams() {
+    OutLane &lane = lanes[PKTLANE_DATAGRAM];
+    Byte dgram[FOXNET_DATAGRAM_MTU];
+    size_t sz = 0;
+
+    commitPacket();
+    if (lane.chunks.empty() || datagram == nullptr)
+        return;
+
+    // pack as many packets into each datagram as will fit, a packet is never split
+    while (!lane.chunks.empty()) {
+        size_t chunk = lane.chunks.front().size;
+
+        if (sz > 0 && sz + chunk > FOXNET_DATAGRAM_MTU) {
+            datagram->queue(dgram, sz, (const struct sockaddr *)&datagramAddr, datagramAddrLen);
+            sz = 0;
+        }
+
+        if (sz == 0) {
+            FoxDatagram::putInt<uint32_t>(dgram, datagramSession);
+            FoxDatagram::putInt<uint32_t>(dgram + sizeof(uint32_t), datagramSeqOut);
+            sz = FOXNET_DATAGRAM_HEADER;
+
+            if (++datagramSeqOut == 0)
+                datagramSeqOut = 1;
+        }
+
+        memcpy(dgram + sz, lane.buf.data() + lane.head, chunk);
+        onSend(dgram + sz, chunk);
+        sz += chunk;
+        lane.head += chunk;
+        lane.chunks.pop_front();
+    }
+
+    datagram->queue(dgram, sz, (const struct sockaddr *)&datagramAddr, datagramAddrLen);
+    lane.buf.clear();
+    lane.head = 0;
+    lane.aggOpen = false;
+
+    // the server flushes its shared socket once per poll
+    if (datagramOwned)
+        datagram->flush();
+}
+
+void FoxPeer::discardOut() {
+    flushOut();
+    sendOffset += sendBuffer.size();
+    sendBuffer.clear();
+    sendFramed = 0;
+    sentChunks.clear();
+    sentHeaders.clear();
+
+    for (int i = 0; i < PKTLANE_MAX; i++) {
+        lanes[i].buf.clear();
+        lanes[i].chunks.clear();
+        lanes[i].head = 0;
+        lanes[i].aggOpen = false;
+    }
+
+    largeActive = nullptr;
+    largeLeft = 0;
+    largePending = 0;
+    finishLargeSends(true);
+}
+
+uint32_t FoxPeer::getSnapshotAck() {
+    return snapshotAcked;
+}
+
+void FoxPeer::setCapture(FoxCapture *cap) {
+    if (capture != nullptr)
+        capture->closePeer(captureID);
+
+    capture = cap;
+    if (capture != nullptr)
+        captureID = capture->openPeer();
+}
+
+FoxCapture *FoxPeer::getCapture() {
+    return capture;
+}
+
+PeerPollResult FoxPeer::handlePollIn(FoxPollList& plist) {
+    size_t packets = FOXNET_PACKET_BUDGET, bytes = 0;
+    PeerPollResult res;
+    bool drained = false;
+
+    // packets left over from when we last ran out of budget
+    if (!parseIn(&packets))
+        return PEERPOLL_VIOLATION;
+
+    // level-triggered we're told again if there's more, so one read is enough. edge-triggered we have to keep
+    // reading until the kernel runs dry
+    do {
+        size_t start = recvBuffer.size();
+        RawSockReturn recv;
+
+        if (packets == 0 || !isAlive() || recvHeld)
+            break;
+
+        // grab what the kernel has for us (up to FOXNET_RECV_BATCH), then parse as many packets out of it as we can
+        recv = rawRecv(recvBuffer, FOXNET_RECV_BATCH);
+
+        switch (recv.code) {
+            case RAWSOCK_OK:
+                break;
+            case RAWSOCK_POLL: // nothing (left) to read
+                drained = true;
+                break;
+            case RAWSOCK_CLOSED:
+            case RAWSOCK_ERROR:
+            default: // ??
+                return PEERPOLL_DROPPED;
+        }
+
+        if (drained)
+            break;
+
+        // the capture gets the raw bytes, a replay passes them through onRecv() again
+        if (capture != nullptr && !capture->recordData(captureID, recvBuffer.data() + start, recv.processed))
+            setCapture(nullptr);
+
+        bytes += recv.processed;
+        if (!parseIn(&packets))
+            return PEERPOLL_VIOLATION;
+    } while (plist.isEdgeTriggered() && bytes < FOXNET_RECV_BUDGET);
+
+    // out of budget with packets still buffered (or unread), we'll be back after everyone else had their turn
+    if (isAlive() && (packets == 0 || (plist.isEdgeTriggered() && !drained)))
+        plist.setReady(this);
+
+    // a transport was negotiated, it's polled alongside our socket from now on
+    if (shmRegister && isAlive()) {
+        shmRegister = false;
+        plist.addTransport(this);
+
+        // (the server is still writing to the socket, which could be waiting on POLLOUT)
+        if (setPollOut && !isSendOnTransport())
+            plist.addPollOut(this);
+        else
+            setPollOut = false;
+    }
+
+    flushDatagrams();
+
+    // we have data to send and handePollOut returns an error, return error result
+    // (if POLLOUT is set the kernel buffer is full, we'll flush everything once it has room again)
+    if (!setPollOut && pendingOut() > 0 && (res = handlePollOut(plist)) != PEERPOLL_OK)
+        return res;
+
+    return isAlive() ? PEERPOLL_OK : PEERPOLL_KILLED;
+}
+
+PeerPollResult FoxPeer::handlePollOut(FoxPollList& plist) {
+    RawSockCode code;
+    FOXTRACE_SCOPE(trace, "handlePollOut")
+
+    // queue anything written since the last flush
+    commitPacket();
+    flushDatagrams();
+
+    // PKTID_SHM_RES is out, everything from here on goes over the transport
+    if (sendHeld && shmState == SHM_ACKING && sendBuffer.empty()) {
+        switchSend();
+        sendHeld = false;
+        shmState = SHM_ACTIVE;
+    }
+
+    // sanity check
+    if (sendBuffer.empty() && largeActive == nullptr && !scheduleChunk())
+        return PEERPOLL_OK;
+
+    FOXMETRIC(addSendQueue(pendingOut()))
+    onStep();
+
+    do {
+        // top off the send buffer, the scheduler is re-run between batches so control packets can cut in line
+        while (sendBuffer.size() < FOXNET_SEND_BATCH && scheduleChunk());
+
+        // the checksums are taken over the whole batch at once
+        if (integrityOut)
+            sealFrames();
+
+        if (sendBuffer.empty()) {
+            code = RAWSOCK_OK;
+        } else {
+            RawSockReturn ret = rawSend(sendBuffer, sendBuffer.size());
+
+            code = ret.code;
+            sendFramed -= std::min<size_t>(sendFramed, ret.processed);
+            sendOffset += ret.processed;
+
+            while (!sentChunks.empty() && sentChunks.front().end <= sendOffset)
+                sentChunks.pop_front();
+            while (!sentHeaders.empty() && sentHeaders.front() + FOXNET_INTEGRITY_HEADER <= sendOffset)
+                sentHeaders.pop_front();
+        }
+
+        // a large segment's payload goes right after its header, straight from its file or buffer
+        if (code == RAWSOCK_OK && largeActive != nullptr)
+            code = sendLarge();
+
+        switch(code) {
+            case RAWSOCK_OK: // we're ok!
+                break;
+            case RAWSOCK_POLL: // we've been asked to set the POLLOUT flag
+                if (!setPollOut) { // if POLLOUT wasn't set, set it so we'll be notified whenever the kernel has room :)
+                    plist.addPollOut(this);
+                    setPollOut = true;
+                    FOXMETRIC(addPollOutSet())
+                }
+                return PEERPOLL_OK;
+            default:
+            case RAWSOCK_CLOSED:
+            case RAWSOCK_ERROR:
+                // (a peer that was kill()ed outside of its handlers has no socket left to send on)
+                return isAlive() ? PEERPOLL_DROPPED : PEERPOLL_KILLED;
+        }
+    } while (scheduleChunk());
+
+    if (setPollOut) { // if POLLOUT was set, unset it
+        plist.rmvPollOut(this);
+        setPollOut = false;
+        FOXMETRIC(addPollOutCleared())
+    }
+
+    // we stopped at PKTID_SHM_RES, switch & send the rest
+    if (sendHeld && shmState == SHM_ACKING)
+        return handlePollOut(plist);
+
+    if (!waiters.empty())
+        fireWaiters(PEERWAIT_FLUSH);
+
+    return PEERPOLL_OK;
+}
+
+PeerPollResult FoxPeer::handlePollErr(FoxPollList&) {
+    std::vector<std::pair<uint32_t, uint32_t>> done;
+    bool ok = readZeroCopyDone(done);
+
+    for (auto &range : done) {
+        // usually in order, but the kernel doesn't promise it
+        if (range.first != zeroCopyDone) {
+            zeroCopyRanges[range.first] = range.second;
+            continue;
+        }
+
+        zeroCopyDone = range.second + 1;
+        for (auto iter = zeroCopyRanges.find(zeroCopyDone); iter != zeroCopyRanges.end(); iter = zeroCopyRanges.find(zeroCopyDone)) {
+            zeroCopyDone = iter->second + 1;
+            zeroCopyRanges.erase(iter);
+        }
+    }
+
+    if (!done.empty())
+        finishLargeSends(false);
+
+    if (!ok)
+        return PEERPOLL_DROPPED;
+
+    return isAlive() ? PEERPOLL_OK : PEERPOLL_KILLED;
+}
+
 SOCKET FoxPeer::getRawSock() {
     return sock;
 }
@@ -0,0 +1,170 @@
+#include "FoxPipe.hpp"
+#include "FoxPoll.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+using namespace FoxNet;
+
+static int64_t pipeNanos() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+FoxPipe::FoxPipe(std::shared_ptr<Shared> s, int sd): shared(s), side(sd) {}
+
+std::pair<FoxPipe*, FoxPipe*> FoxPipe::create(const FoxPipeOptions &opts) {
+    std::shared_ptr<Shared> s = std::make_shared<Shared>();
+
+    s->opts = opts;
+    if (s->opts.capacity == 0)
+        s->opts.capacity = 1;
+
+    return {new FoxPipe(s, 0), new FoxPipe(s, 1)};
+}
+
+FoxPipe::~FoxPipe() {
+    close();
+}
+
+int FoxPipe::recv(Byte *buf, size_t sz) {
+    std::lock_guard<std::mutex> guard(shared->lock);
+    FoxPipeOptions &opts = shared->opts;
+    Flow &in = inFlow();
+    int64_t now = pipeNanos();
+    size_t copied = 0;
+
+    if (in.readerClosed)
+        return TRANSPORT_ERROR;
+
+    if (opts.maxRead > 0)
+        sz = std::min(sz, opts.maxRead);
+
+    while (copied < sz && !in.chunks.empty() && in.chunks.front().readyAt <= now) {
+        Chunk &chunk = in.chunks.front();
+        size_t take = std::min(sz - copied, chunk.data.size() - chunk.head);
+
+        memcpy(buf + copied, chunk.data.data() + chunk.head, take);
+        copied += take;
+        chunk.head += take;
+
+        if (chunk.head == chunk.data.size())
+            in.chunks.pop_front();
+    }
+
+    if (copied == 0)
+        return in.writerClosed && in.chunks.empty() ? 0 : TRANSPORT_WOULDBLOCK;
+
+    // the writer only waits on us if it filled the pipe
+    if (in.inFlight >= opts.capacity && in.writer != nullptr)
+        in.writer->wake();
+
+    in.inFlight -= copied;
+    return (int)copied;
+}
+
+int FoxPipe::send(const Byte *buf, size_t sz) {
+    std::lock_guard<std::mutex> guard(shared->lock);
+    FoxPipeOptions &opts = shared->opts;
+    Flow &out = outFlow();
+    int64_t readyAt = 0;
+
+    if (out.writerClosed || out.readerClosed)
+        return TRANSPORT_ERROR;
+
+    if (out.inFlight >= opts.capacity)
+        return TRANSPORT_WOULDBLOCK;
+
+    sz = std::min(sz, opts.capacity - out.inFlight);
+    if (opts.maxWrite > 0)
+        sz = std::min(sz, opts.maxWrite);
+
+    if (opts.latency > 0 || opts.bandwidth > 0) {
+        int64_t now = pipeNanos();
+
+        // bytes queue up behind whatever the link is still sending
+        if (opts.bandwidth > 0) {
+            out.linkFree = std::max(now, out.linkFree) + (int64_t)(sz * 1000000000.0 / opts.bandwidth);
+            now = out.linkFree;
+        }
+
+        readyAt = now + (int64_t)opts.latency * 1000000;
+    }
+
+    // chunks that are readable right away are merged, so an unshaped pipe is just a byte queue. (chunks that are
+    // being read from aren't grown, the bytes already read are only freed once the whole chunk is)
+    if (!out.chunks.empty() && out.chunks.back().readyAt == readyAt && out.chunks.back().head == 0) {
+        out.chunks.back().data.insert(out.chunks.back().data.end(), buf, buf + sz);
+    } else {
+        out.chunks.push_back({readyAt, std::vector<Byte>(buf, buf + sz)});
+    }
+
+    out.inFlight += sz;
+    if (out.reader != nullptr)
+        out.reader->wake();
+
+    return (int)sz;
+}
+
+void FoxPipe::close() {
+    std::lock_guard<std::mutex> guard(shared->lock);
+    Flow &in = inFlow(), &out = outFlow();
+
+    if (in.readerClosed)
+        return;
+
+    // nobody is going to read what's left
+    in.readerClosed = true;
+    in.reader = nullptr;
+    in.chunks.clear();
+    in.inFlight = 0;
+    out.writerClosed = true;
+    out.writer = nullptr;
+
+    // let the other end see the close
+    if (in.writer != nullptr)
+        in.writer->wake();
+    if (out.reader != nullptr)
+        out.reader->wake();
+}
+
+bool FoxPipe::readable() {
+    std::lock_guard<std::mutex> guard(shared->lock);
+    Flow &in = inFlow();
+
+    if (in.chunks.empty())
+        return in.writerClosed;
+
+    return in.chunks.front().readyAt <= pipeNanos();
+}
+
+bool FoxPipe::writable() {
+    std::lock_guard<std::mutex> guard(shared->lock);
+    Flow &out = outFlow();
+
+    // a closed pipe is "writable" so the writer finds out about it
+    return out.readerClosed || out.inFlight < shared->opts.capacity;
+}
+
+int FoxPipe::pollTimeout() {
+    std::lock_guard<std::mutex> guard(shared->lock);
+    Flow &in = inFlow();
+    int64_t wait;
+
+    if (in.chunks.empty())
+        return -1;
+
+    // round up, waking early would just be a spurious wakeup
+    wait = in.chunks.front().readyAt - pipeNanos();
+    return wait > 0 ? (int)((wait + 999999) / 1000000) : 0;
+}
+
+void FoxPipe::setPollList(FoxPollList *list) {
+    std::lock_guard<std::mutex> guard(shared->lock);
+
+    if (inFlow().readerClosed)
+        return;
+
+    inFlow().reader = list;
+    outFlow().writer = list;
+}
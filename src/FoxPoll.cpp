@@ -1,8 +1,30 @@
 #include "FoxPoll.hpp"
+#include "FoxMetrics.hpp"
+#include "FoxTrace.hpp"
+#include "FoxTransport.hpp"
+
+#include <algorithm>
+
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
 
 using namespace FoxNet;
 
-FoxPollEvent::FoxPollEvent(FoxSocket *s, bool pI, bool pO): sock(s), pollIn(pI), pollOut(pO) {}
+#ifdef __linux__
+// events a socket's fd is registered with
+static uint32_t sockEvents(bool recvOnTransport, bool pollOut, bool edgeTriggered) {
+    // once reads come from a transport, the fd is only watched for hangups
+    uint32_t events = recvOnTransport ? EPOLLRDHUP : EPOLLIN;
+
+    if (edgeTriggered)
+        return events | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+
+    return events | (pollOut ? (uint32_t)EPOLLOUT : 0);
+}
+#endif
+
+FoxPollEvent::FoxPollEvent(FoxSocket *s, bool pI, bool pO, bool pE): sock(s), pollIn(pI), pollOut(pO), pollErr(pE) {}
 
 void FoxPollList::_setup(size_t reserved) {
     _FoxNet_Init();
@@ -27,21 +49,194 @@ FoxPollList::FoxPollList() {
 }
 
 FoxPollList::~FoxPollList() {
+    // make sure no transport wakes us after we're gone
+    for (auto &pair : transportSocks)
+        pair.first->getTransport()->setPollList(nullptr);
+
 #ifdef __linux__
     close(epollfd);
 #endif
 
+#ifndef _WIN32
+    if (!SOCKETINVALID(wakeRead))
+        close(wakeRead);
+    if (!SOCKETINVALID(wakeWrite) && wakeWrite != wakeRead)
+        close(wakeWrite);
+#endif
+
     _FoxNet_Cleanup();
 }
 
+void FoxPollList::enableWake() {
+    if (!SOCKETINVALID(wakeRead))
+        return;
+
+#ifdef __linux__
+    if ((wakeRead = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) == -1) {
+        FOXFATAL("eventfd() failed!");
+    }
+    wakeWrite = wakeRead;
+
+    // the wake fd is the only thing in our epoll without a FoxSocket
+    ev.events = EPOLLIN;
+    ev.data.ptr = nullptr;
+    if (epoll_ctl(epollfd, EPOLL_CTL_ADD, wakeRead, &ev) == -1) {
+        FOXFATAL("epoll_ctl [ADD] failed");
+    }
+#elif !defined(_WIN32)
+    int pipefds[2];
+
+    if (pipe(pipefds) == -1) {
+        FOXFATAL("pipe() failed!");
+    }
+
+    wakeRead = pipefds[0];
+    wakeWrite = pipefds[1];
+    fcntl(wakeRead, F_SETFL, fcntl(wakeRead, F_GETFL, 0) | O_NONBLOCK);
+    fcntl(wakeWrite, F_SETFL, fcntl(wakeWrite, F_GETFL, 0) | O_NONBLOCK);
+    fds.push_back({wakeRead, POLLIN});
+#endif
+    // (windows has no cheap wake fd, pollList() just doesn't sleep longer than FOXNET_TRANSPORT_POLL_INTERVAL)
+}
+
+void FoxPollList::wake() {
+    if (wakePending.exchange(true))
+        return;
+
+#ifdef __linux__
+    uint64_t one = 1;
+
+    // if the counter is somehow full, a wake is already pending anyways
+    if (write(wakeWrite, &one, sizeof(one)) == -1) {}
+#elif !defined(_WIN32)
+    Byte one = 1;
+
+    if (write(wakeWrite, &one, sizeof(one)) == -1) {}
+#endif
+}
+
+void FoxPollList::drainWake() {
+    wakePending = false;
+    drainFd(wakeRead);
+}
+
+void FoxPollList::drainFd(int fd) {
+#ifndef _WIN32
+    Byte buf[64];
+
+    while (read(fd, buf, sizeof(buf)) > 0);
+#endif
+}
+
+bool FoxPollList::transportsReady() {
+    for (auto &pair : transportSocks) {
+        FoxTransport *transport = pair.first->getTransport();
+
+        if (!pair.first->isAlive())
+            continue;
+
+        if (transport->readable() || (pair.second.pollOut && transport->writable()))
+            return true;
+    }
+
+    return false;
+}
+
+void FoxPollList::pollTransports(std::vector<FoxPollEvent> &events) {
+    for (auto &pair : transportSocks) {
+        FoxSocket *sock = pair.first;
+        TransportEntry &entry = pair.second;
+        bool hup = entry.fdHup, fdOut = entry.fdOut;
+        bool pollIn, pollOut;
+
+        entry.fdHup = entry.fdOut = false;
+
+        // killed, but not removed yet (same as a closed fd in the epoll)
+        if (!sock->isAlive())
+            continue;
+
+        pollIn = sock->getTransport()->readable();
+        pollOut = fdOut || (entry.pollOut && sock->getTransport()->writable());
+
+        // a hangup on an upgraded socket's fd with nothing left to read is reported as an error
+        if (pollIn || pollOut || hup)
+            events.push_back(FoxPollEvent(sock, pollIn, pollOut));
+    }
+}
+
+int FoxPollList::getTransportTimeout(int timeout) {
+    for (auto &pair : transportSocks) {
+        int wait;
+
+        if (!pair.first->isAlive() || (wait = pair.first->getTransport()->pollTimeout()) < 0)
+            continue;
+
+        if (timeout < 0 || wait < timeout)
+            timeout = wait;
+    }
+
+#ifdef _WIN32
+    if (timeout < 0 || timeout > FOXNET_TRANSPORT_POLL_INTERVAL)
+        timeout = FOXNET_TRANSPORT_POLL_INTERVAL;
+#endif
+
+    return timeout;
+}
+
+void FoxPollList::addTransportEntry(FoxSocket *sock) {
+    TransportEntry &entry = transportSocks[sock];
+
+    enableWake();
+    sock->getTransport()->setPollList(this);
+    entry.wakeFd = sock->getTransport()->getWakeFd();
+
+#ifdef __linux__
+    // the wake fd is tagged with the low bit of its socket's pointer, so we know to drain it
+    if (entry.wakeFd != -1) {
+        ev.events = EPOLLIN;
+        ev.data.ptr = (void*)((uintptr_t)sock | 1);
+        if (epoll_ctl(epollfd, EPOLL_CTL_ADD, entry.wakeFd, &ev) == -1) {
+            FOXFATAL("epoll_ctl [ADD] failed");
+        }
+    }
+#endif
+    // (without epoll, transports with a wake fd are only polled when something else wakes us up)
+}
+
+void FoxPollList::modSock(FoxSocket *sock, bool pollOut) {
+    SOCKET rawSock = sock->getRawSock();
+
+#ifdef __linux__
+    ev.events = sockEvents(sock->isRecvOnTransport(), pollOut, edgeTriggered);
+    ev.data.ptr = (void*)sock;
+    if (epoll_ctl(epollfd, EPOLL_CTL_MOD, rawSock, &ev) == -1) {
+        // non-fatal error, socket probably just didn't exist, so ignore it.
+        FOXWARN("epoll_ctl [MOD] failed");
+    }
+#else
+    for (auto iter = fds.begin(); iter != fds.end(); iter++) {
+        if ((*iter).fd == rawSock) {
+            (*iter).events = (sock->isRecvOnTransport() ? 0 : POLLIN) | (pollOut ? POLLOUT : 0);
+            return;
+        }
+    }
+#endif
+}
+
 void FoxPollList::addSock(FoxSocket *sock) {
     SOCKET rawSock = sock->getRawSock();
 
+    // transports don't have an fd to poll, we ask them directly
+    if (SOCKETINVALID(rawSock) && sock->getTransport() != nullptr) {
+        addTransportEntry(sock);
+        return;
+    }
+
     // add socket to map
     sockMap[rawSock] = sock;
 
 #ifdef __linux__
-    ev.events = EPOLLIN;
+    ev.events = sockEvents(false, false, edgeTriggered);
     ev.data.ptr = (void*)sock;
     if (epoll_ctl(epollfd, EPOLL_CTL_ADD, sock->getRawSock(), &ev) == -1) {
         FOXFATAL("epoll_ctl [ADD] failed");
@@ -51,8 +246,33 @@ void FoxPollList::addSock(FoxSocket *sock) {
 #endif
 }
 
+void FoxPollList::addTransport(FoxSocket *sock) {
+    addTransportEntry(sock);
+    modSock(sock, false);
+}
+
 void FoxPollList::rmvSock(FoxSocket *sock) {
     SOCKET rawSock = sock->getRawSock();
+    auto transportIter = transportSocks.find(sock);
+
+    readySocks.erase(sock);
+
+    if (transportIter != transportSocks.end()) {
+        if (sock->getTransport() != nullptr)
+            sock->getTransport()->setPollList(nullptr);
+
+#ifdef __linux__
+        if (transportIter->second.wakeFd != -1 && epoll_ctl(epollfd, EPOLL_CTL_DEL, transportIter->second.wakeFd, &ev) == -1) {
+            FOXWARN("epoll_ctl [DEL] failed");
+        }
+#endif
+
+        transportSocks.erase(transportIter);
+
+        // an upgraded socket still has its fd to remove
+        if (SOCKETINVALID(rawSock))
+            return;
+    }
 
     // remove from socket map
     sockMap.erase(rawSock);
@@ -74,88 +294,183 @@ void FoxPollList::rmvSock(FoxSocket *sock) {
 }
 
 void FoxPollList::addPollOut(FoxSocket *sock) {
-    SOCKET rawSock = sock->getRawSock();
+    auto transportIter = transportSocks.find(sock);
 
-#ifdef __linux__
-    ev.events = EPOLLIN | EPOLLOUT;
-    ev.data.ptr = (void*)sock;
-    if (epoll_ctl(epollfd, EPOLL_CTL_MOD, sock->getRawSock(), &ev) == -1) {
-        // non-fatal error, socket probably just didn't exist, so ignore it.
-        FOXWARN("epoll_ctl [MOD] failed");
-    }
-#else
-    for (auto iter = fds.begin(); iter != fds.end(); iter++) {
-        if ((*iter).fd == rawSock) {
-            (*iter).events = POLLIN | POLLOUT;
-            return;
-        }
+    // (an upgraded socket still writes to its fd until it switches)
+    if (transportIter != transportSocks.end() && (SOCKETINVALID(sock->getRawSock()) || sock->isSendOnTransport())) {
+        transportIter->second.pollOut = true;
+        return;
     }
-#endif
+
+    // (write interest is always registered)
+    if (!edgeTriggered)
+        modSock(sock, true);
 }
 
 void FoxPollList::rmvPollOut(FoxSocket *sock) {
-    SOCKET rawSock = sock->getRawSock();
+    auto transportIter = transportSocks.find(sock);
 
-#ifdef __linux__
-    ev.events = EPOLLIN;
-    ev.data.ptr = (void*)sock;
-    if (epoll_ctl(epollfd, EPOLL_CTL_MOD, sock->getRawSock(), &ev) == -1) {
-        // non-fatal error, socket probably just didn't exist, so ignore it.
-        FOXWARN("epoll_ctl [MOD] failed");
-    }
-#else
-    for (auto iter = fds.begin(); iter != fds.end(); iter++) {
-        if ((*iter).fd == rawSock) {
-            (*iter).events = POLLIN;
+    if (transportIter != transportSocks.end()) {
+        transportIter->second.pollOut = false;
+
+        if (SOCKETINVALID(sock->getRawSock()))
             return;
-        }
     }
+
+    if (!edgeTriggered)
+        modSock(sock, false);
+}
+
+void FoxPollList::enableEdgeTriggered() {
+#ifdef __linux__
+    if (edgeTriggered)
+        return;
+
+    edgeTriggered = true;
+
+    // re-arming reports anything that's already waiting, so nothing is lost in the switch
+    for (auto &pair : sockMap)
+        modSock(pair.second, false);
 #endif
 }
 
+bool FoxPollList::isEdgeTriggered() {
+    return edgeTriggered;
+}
+
+void FoxPollList::setReady(FoxSocket *sock) {
+    readySocks.insert(sock);
+}
+
+void FoxPollList::pollReady(std::vector<FoxPollEvent> &events) {
+    std::vector<FoxSocket*> ready(readySocks.begin(), readySocks.end());
+    size_t fresh = events.size();
+
+    // (handlers can setReady() again, that's for the next pollList())
+    readySocks.clear();
+
+    // they go after the kernel's events, so sockets that were waiting get served first
+    for (FoxSocket *sock : ready) {
+        auto iter = std::find_if(events.begin(), events.begin() + fresh, [sock](FoxPollEvent &e) { return e.sock == sock; });
+
+        if (iter == events.begin() + fresh)
+            events.push_back(FoxPollEvent(sock, true, false));
+        else
+            iter->pollIn = true;
+    }
+}
+
 std::vector<FoxPollEvent> FoxPollList::pollList(int timeout) {
     std::vector<FoxPollEvent> events;
+
+    pollList(timeout, events);
+    return events;
+}
+
+void FoxPollList::pollList(int timeout, std::vector<FoxPollEvent> &events) {
     int nEvents;
 
+    events.clear();
+
+    // if a transport is ready we only grab what the kernel has right now, otherwise we sleep until one of them wakes
+    // us (or has data land)
+    if (!transportSocks.empty())
+        timeout = transportsReady() ? 0 : getTransportTimeout(timeout);
+
+    // something's still waiting on us, just grab what the kernel has
+    if (!readySocks.empty())
+        timeout = 0;
+
 #ifdef __linux__
 // fastpath: we store the FoxSocket* pointer directly in the epoll_data_t, saving us a lookup into our sockMap[].
 //      not to mention the various improvements epoll() has over poll() :D
-    nEvents = epoll_wait(epollfd, ep_events, MAX_EPOLL_EVENTS, timeout);
+    {
+        FOXTRACE_SCOPE(trace, "epoll_wait")
+        nEvents = epoll_wait(epollfd, ep_events, MAX_EPOLL_EVENTS, timeout);
+        FOXTRACE_ARG(trace, nEvents)
+    }
 
     if (SOCKETERROR(nEvents)) {
         FOXFATAL("epoll_wait() failed!");
     }
 
+    FOXMETRIC(addPollEvents(nEvents))
+
     for (int i = 0; i < nEvents; i++) {
-        events.push_back(FoxPollEvent((FoxSocket*)ep_events[i].data.ptr, ep_events[i].events & EPOLLIN, ep_events[i].events & EPOLLOUT));
+        void *ptr = ep_events[i].data.ptr;
+
+        if (ptr == nullptr) { // our wake fd
+            drainWake();
+            continue;
+        }
+
+        if (!transportSocks.empty()) {
+            // a transport's wake fd
+            if ((uintptr_t)ptr & 1) {
+                auto iter = transportSocks.find((FoxSocket*)((uintptr_t)ptr & ~(uintptr_t)1));
+                if (iter != transportSocks.end())
+                    drainFd(iter->second.wakeFd);
+                continue;
+            }
+
+            // the fd of an upgraded socket, merged with its transport's events below
+            auto iter = transportSocks.find((FoxSocket*)ptr);
+            if (iter != transportSocks.end()) {
+                iter->second.fdOut |= (ep_events[i].events & EPOLLOUT) != 0;
+                iter->second.fdHup |= (ep_events[i].events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)) != 0;
+                continue;
+            }
+        }
+
+        events.push_back(FoxPollEvent((FoxSocket*)ep_events[i].data.ptr, ep_events[i].events & EPOLLIN, ep_events[i].events & EPOLLOUT,
+            ep_events[i].events & EPOLLERR));
     }
 #else
-    nEvents = ::poll(fds.data(), fds.size(), timeout); // poll returns -1 for error, or the number of events
+    {
+        FOXTRACE_SCOPE(trace, "poll")
+        nEvents = ::poll(fds.data(), fds.size(), timeout); // poll returns -1 for error, or the number of events
+        FOXTRACE_ARG(trace, nEvents)
+    }
 
     if (SOCKETERROR(nEvents)) {
         FOXFATAL("poll() failed!");
     }
 
+    FOXMETRIC(addPollEvents(nEvents))
+
     // walk through the returned poll fds, if they have an event, add it to our events vector
     for (auto iter = fds.begin(); iter != fds.end() && nEvents > 0; iter++) {
         PollFD pfd = (*iter);
-        if (pfd.revents != 0) {
-            events.push_back(FoxPollEvent(sockMap[(SOCKET)pfd.fd], pfd.revents & POLLIN, pfd.revents & POLLOUT));
+        if (pfd.revents != 0 && (SOCKET)pfd.fd == wakeRead) {
+            drainWake();
+            --nEvents;
+        } else if (pfd.revents != 0) {
+            events.push_back(FoxPollEvent(sockMap[(SOCKET)pfd.fd], pfd.revents & POLLIN, pfd.revents & POLLOUT, pfd.revents & POLLERR));
             --nEvents; // decrement the remaining events
         }
     }
 #endif
 
-    return events;
+    if (!transportSocks.empty())
+        pollTransports(events);
+
+    if (!readySocks.empty())
+        pollReady(events);
 }
 
 std::vector<FoxSocket*> FoxPollList::getList(void) {
     std::vector<FoxSocket*> sockList;
-    sockList.reserve(sockMap.size());
+    sockList.reserve(sockMap.size() + transportSocks.size());
 
     for (auto pair : sockMap) {
         sockList.push_back(pair.second);
     }
 
+    // (upgraded sockets are already in sockMap)
+    for (auto &pair : transportSocks) {
+        if (SOCKETINVALID(pair.first->getRawSock()))
+            sockList.push_back(pair.first);
+    }
+
     return sockList;
 }
\ No newline at end of file
@@ -0,0 +1,60 @@
+#include "FoxResumeCache.hpp"
+
+using namespace FoxNet;
+
+FoxResumeCache::FoxResumeCache(int t, size_t max): timeout(t), maxDetached(max) {}
+
+uint64_t FoxResumeCache::newToken() {
+    uint64_t token;
+
+    // (0 means 'no token' in the handshake)
+    do {
+        token = ((uint64_t)tokenSource() << 32) | tokenSource();
+    } while (token == 0 || detached.count(token) > 0);
+
+    return token;
+}
+
+FoxServerPeer *FoxResumeCache::detach(uint64_t token, FoxServerPeer *peer) {
+    FoxServerPeer *evicted = nullptr;
+
+    if (maxDetached == 0)
+        return peer;
+
+    // full, push out whoever was going to time out first
+    if (detached.size() >= maxDetached)
+        evicted = expire(INT64_MAX);
+
+    detached[token] = {peer, expiries.insert({getTicks() + timeout, token})};
+    return evicted;
+}
+
+FoxServerPeer *FoxResumeCache::claim(uint64_t token) {
+    auto iter = detached.find(token);
+    FoxServerPeer *peer;
+
+    if (iter == detached.end() || iter->second.expiry->first <= getTicks())
+        return nullptr;
+
+    peer = iter->second.peer;
+    expiries.erase(iter->second.expiry);
+    detached.erase(iter);
+    return peer;
+}
+
+FoxServerPeer *FoxResumeCache::expire(int64_t tick) {
+    FoxServerPeer *peer;
+
+    if (expiries.empty() || expiries.begin()->first > tick)
+        return nullptr;
+
+    auto iter = detached.find(expiries.begin()->second);
+    peer = iter->second.peer;
+    detached.erase(iter);
+    expiries.erase(expiries.begin());
+    return peer;
+}
+
+size_t FoxResumeCache::size() {
+    return detached.size();
+}
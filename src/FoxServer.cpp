@@ -5,4 +5,26 @@ using namespace FoxNet;
 
 FoxServerPeer::FoxServerPeer() {
     // TODO
-}
\ No newline at end of file
+}
+
+void FoxServerPeer::writeBytes(Byte *in, size_t sz) {
+    FoxPeer::writeBytes(in, sz);
+
+    // let the server know we have something to send
+    if (!dirty && dirtyList != nullptr) {
+        dirty = true;
+        dirtyList->push_back(this);
+    }
+}
+
+uint64_t FoxServerPeer::resumeSession(uint64_t token, bool &resumed) {
+    if (resumeCache == nullptr)
+        return 0;
+
+    // (the server hands the connection over once we're done handling the request)
+    if (token != 0)
+        resumeTarget = resumeCache->claim(token);
+
+    resumed = resumeTarget != nullptr;
+    return resumeToken = resumeCache->newToken();
+}
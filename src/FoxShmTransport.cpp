@@ -0,0 +1,238 @@
+#include "FoxShmTransport.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#ifdef __linux__
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace FoxNet;
+
+// the ring data starts on its own page
+#define FOXSHM_DATA_OFFSET (((sizeof(Header) + 4095) / 4096) * 4096)
+
+FoxShmTransport::FoxShmTransport(int s): side(s) {}
+
+FoxShmTransport::~FoxShmTransport() {
+    close();
+
+#ifdef __linux__
+    if (header != nullptr)
+        munmap(header, mapSize);
+
+    if (memFd != -1)
+        ::close(memFd);
+
+    for (int fd : wakeFds) {
+        if (fd != -1)
+            ::close(fd);
+    }
+#endif
+}
+
+bool FoxShmTransport::map(size_t sz) {
+#ifdef __linux__
+    void *mem = mmap(NULL, sz, PROT_READ | PROT_WRITE, MAP_SHARED, memFd, 0);
+
+    if (mem == MAP_FAILED)
+        return false;
+
+    header = (Header*)mem;
+    mapSize = sz;
+    return true;
+#else
+    return false;
+#endif
+}
+
+FoxShmTransport *FoxShmTransport::create(size_t ringSize) {
+#ifdef __linux__
+    FoxShmTransport *shm = new FoxShmTransport(0);
+    size_t sz = FOXSHM_DATA_OFFSET + ringSize * 2;
+
+    shm->ringSize = ringSize;
+
+    // the ring indexes are masked, so the size has to be a power of 2
+    if (ringSize == 0 || (ringSize & (ringSize - 1)) != 0) {
+        delete shm;
+        return nullptr;
+    }
+
+    shm->memFd = memfd_create("foxnet-shm", MFD_CLOEXEC);
+    shm->wakeFds[0] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    shm->wakeFds[1] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (shm->memFd == -1 || shm->wakeFds[0] == -1 || shm->wakeFds[1] == -1 || ftruncate(shm->memFd, sz) != 0 || !shm->map(sz)) {
+        delete shm;
+        return nullptr;
+    }
+
+    // a fresh memfd is zeroed, so the rings start out empty & open
+    memcpy(shm->header->magic, FOXSHM_MAGIC, FOXSHM_MAGICLEN);
+    shm->header->version = FOXSHM_VERSION;
+    shm->header->ringSize = (uint32_t)ringSize;
+    shm->data[0] = (Byte*)shm->header + FOXSHM_DATA_OFFSET;
+    shm->data[1] = shm->data[0] + ringSize;
+    return shm;
+#else
+    return nullptr;
+#endif
+}
+
+FoxShmTransport *FoxShmTransport::attach(const std::vector<int> &fds) {
+#ifdef __linux__
+    FoxShmTransport *shm = new FoxShmTransport(1);
+    struct stat info;
+
+    if (fds.size() != 3) {
+        for (int fd : fds)
+            ::close(fd);
+
+        delete shm;
+        return nullptr;
+    }
+
+    shm->memFd = fds[0];
+    shm->wakeFds[0] = fds[1];
+    shm->wakeFds[1] = fds[2];
+
+    // don't trust anything in the segment until we know it's big enough to hold it
+    if (fstat(shm->memFd, &info) != 0 || (size_t)info.st_size < FOXSHM_DATA_OFFSET || !shm->map(info.st_size)) {
+        delete shm;
+        return nullptr;
+    }
+
+    // (the other end could change the header later, so we keep our own copy of the size)
+    size_t ringSize = shm->ringSize = shm->header->ringSize;
+    if (memcmp(shm->header->magic, FOXSHM_MAGIC, FOXSHM_MAGICLEN) != 0 || shm->header->version != FOXSHM_VERSION ||
+            ringSize == 0 || (ringSize & (ringSize - 1)) != 0 || FOXSHM_DATA_OFFSET + ringSize * 2 != shm->mapSize) {
+        delete shm;
+        return nullptr;
+    }
+
+    shm->data[0] = (Byte*)shm->header + FOXSHM_DATA_OFFSET;
+    shm->data[1] = shm->data[0] + ringSize;
+    return shm;
+#else
+    for (int fd : fds)
+        ::close(fd);
+
+    return nullptr;
+#endif
+}
+
+std::vector<int> FoxShmTransport::getSharedFds() {
+    return {memFd, wakeFds[0], wakeFds[1]};
+}
+
+void FoxShmTransport::signal(int fd) {
+#ifdef __linux__
+    uint64_t one = 1;
+
+    // if the counter is somehow full, a wake is already pending anyways
+    if (write(fd, &one, sizeof(one)) == -1) {}
+#endif
+}
+
+int FoxShmTransport::recv(Byte *buf, size_t sz) {
+    Ring &in = inRing();
+    uint64_t head, tail, indx;
+    size_t first;
+
+    if (closed)
+        return TRANSPORT_ERROR;
+
+    head = in.head.load(std::memory_order_relaxed);
+    tail = in.tail.load();
+
+    if (tail == head) {
+        // the writer closes after its last write, so if it's closed & still empty there's nothing left coming
+        if (in.writerClosed.load() && in.tail.load() == head)
+            return 0;
+
+        return TRANSPORT_WOULDBLOCK;
+    }
+
+    // the other process can scribble over the segment, never trust it to index out of the ring
+    if (tail - head > ringSize)
+        return TRANSPORT_ERROR;
+
+    sz = std::min<size_t>(sz, tail - head);
+    indx = head & (ringSize - 1);
+    first = std::min<size_t>(sz, ringSize - indx);
+    memcpy(buf, data[side] + indx, first);
+    memcpy(buf + first, data[side], sz - first);
+    in.head.store(head + sz);
+
+    // the ring was full, the writer might be waiting on us to make room
+    if (in.tail.load() - head == ringSize)
+        signal(wakeFds[side ^ 1]);
+
+    return (int)sz;
+}
+
+int FoxShmTransport::send(const Byte *buf, size_t sz) {
+    Ring &out = outRing();
+    uint64_t head, tail, indx;
+    size_t first;
+
+    if (closed || out.readerClosed.load())
+        return TRANSPORT_ERROR;
+
+    tail = out.tail.load(std::memory_order_relaxed);
+    head = out.head.load();
+
+    if (tail - head > ringSize)
+        return TRANSPORT_ERROR;
+
+    if (tail - head == ringSize)
+        return TRANSPORT_WOULDBLOCK;
+
+    sz = std::min<size_t>(sz, ringSize - (tail - head));
+    indx = tail & (ringSize - 1);
+    first = std::min<size_t>(sz, ringSize - indx);
+    memcpy(data[side ^ 1] + indx, buf, first);
+    memcpy(data[side ^ 1], buf + first, sz - first);
+    out.tail.store(tail + sz);
+
+    // the ring was empty, the reader might be asleep. (both stores & loads are seq_cst, so either we see the
+    // reader's head or it sees our tail before it sleeps)
+    if (out.head.load() == tail)
+        signal(wakeFds[side ^ 1]);
+
+    return (int)sz;
+}
+
+void FoxShmTransport::close() {
+    if (closed || header == nullptr)
+        return;
+
+    closed = true;
+    outRing().writerClosed.store(1);
+    inRing().readerClosed.store(1);
+    signal(wakeFds[side ^ 1]);
+}
+
+bool FoxShmTransport::readable() {
+    Ring &in = inRing();
+
+    return in.tail.load() != in.head.load(std::memory_order_relaxed) || in.writerClosed.load();
+}
+
+bool FoxShmTransport::writable() {
+    Ring &out = outRing();
+
+    // a closed ring is "writable" so the writer finds out about it
+    return out.readerClosed.load() || out.tail.load(std::memory_order_relaxed) - out.head.load() < ringSize;
+}
+
+int FoxShmTransport::getWakeFd() {
+    return wakeFds[side];
+}
+
+void FoxShmTransport::setPollList(FoxPollList *) {
+    // the other end is in another process, it wakes us through our eventfd instead
+}
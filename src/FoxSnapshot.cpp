@@ -0,0 +1,85 @@
+#include "FoxSnapshot.hpp"
+
+using namespace FoxNet;
+
+FoxSnapshot::FoxSnapshot(size_t count): fields(count, 0) {}
+
+void FoxSnapshot::resize(size_t count) {
+    fields.resize(count, 0);
+}
+
+size_t FoxSnapshot::size() const {
+    return fields.size();
+}
+
+void FoxSnapshot::set(size_t i, int64_t val) {
+    if (i >= fields.size())
+        fields.resize(i + 1, 0);
+
+    fields[i] = val;
+}
+
+int64_t FoxSnapshot::get(size_t i) const {
+    return i < fields.size() ? fields[i] : 0;
+}
+
+void FoxSnapshot::setSeq(uint32_t s) {
+    seq = s;
+}
+
+uint32_t FoxSnapshot::getSeq() const {
+    return seq;
+}
+
+void FoxSnapshot::encodeDelta(const FoxSnapshot *baseline, ByteStream &out) const {
+    size_t count = fields.size();
+
+    out.writeVarint(count);
+
+    // a bit per field for whether it changed, then the deltas of the ones that did
+    {
+        BitWriter mask(out);
+
+        for (size_t i = 0; i < count; i++)
+            mask.writeBool(fields[i] != (baseline != nullptr ? baseline->get(i) : 0));
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        int64_t base = baseline != nullptr ? baseline->get(i) : 0;
+
+        if (fields[i] != base)
+            out.writeSignedVarint((int64_t)((uint64_t)fields[i] - (uint64_t)base));
+    }
+}
+
+bool FoxSnapshot::decodeDelta(const FoxSnapshot *baseline, ByteView &data) {
+    uint64_t count;
+    int64_t delta;
+    ByteView maskData;
+
+    // (the mask alone takes a bit per field, so a count the data can't hold is bogus)
+    if (!data.readVarint(count) || count > data.sizeRemaining() * 8 || !data.readView(maskData, (count + 7) / 8))
+        return false;
+
+    BitReader mask(maskData);
+    fields.assign(count, 0);
+    for (size_t i = 0; i < count; i++) {
+        int64_t base = baseline != nullptr ? baseline->get(i) : 0;
+        bool changed;
+
+        if (!mask.readBool(changed))
+            return false;
+
+        if (!changed) {
+            fields[i] = base;
+            continue;
+        }
+
+        if (!data.readSignedVarint(delta))
+            return false;
+
+        fields[i] = (int64_t)((uint64_t)base + (uint64_t)delta);
+    }
+
+    return true;
+}
@@ -0,0 +1,64 @@
+#include "FoxSnapshotSender.hpp"
+
+using namespace FoxNet;
+
+FoxSnapshotSender::FoxSnapshotSender(PktLane l): lane(l) {}
+
+const FoxSnapshot *FoxSnapshotSender::findBaseline(uint32_t seq) {
+    if (seq == 0)
+        return nullptr;
+
+    for (const FoxSnapshot &snap : history) {
+        if (snap.getSeq() == seq)
+            return &snap;
+    }
+
+    return nullptr;
+}
+
+uint32_t FoxSnapshotSender::publish(const FoxSnapshot &snap) {
+    history.push_back(snap);
+    history.back().setSeq(nextSeq);
+
+    if (history.size() > FOXNET_SNAPSHOT_HISTORY)
+        history.pop_front();
+
+    // 0 means 'no baseline', it's never handed out
+    if (++nextSeq == 0)
+        nextSeq = 1;
+
+    encodings.clear();
+    return history.back().getSeq();
+}
+
+void FoxSnapshotSender::sendTo(FoxPeer *peer) {
+    if (history.empty())
+        return;
+
+    const FoxSnapshot &snap = history.back();
+    const FoxSnapshot *baseline = findBaseline(peer->getSnapshotAck());
+    uint32_t baseSeq = baseline != nullptr ? baseline->getSeq() : 0;
+
+    auto iter = encodings.find(baseSeq);
+    if (iter == encodings.end()) {
+        iter = encodings.emplace(baseSeq, ByteStream()).first;
+        snap.encodeDelta(baseline, iter->second);
+    }
+
+    std::vector<Byte> &encoded = iter->second.getOutBuffer();
+    if (encoded.size() + sizeof(uint32_t) * 2 > MAX_PACKET_SIZE) {
+        FOXFATAL("snapshot is too large for a packet!")
+    }
+
+    PktLane prev = peer->setLane(lane);
+    size_t indx = peer->prepareVarPacket(PKTID_SNAPSHOT);
+    peer->writeInt<uint32_t>(snap.getSeq());
+    peer->writeInt<uint32_t>(baseSeq);
+    peer->writeBytes(encoded.data(), encoded.size());
+    peer->patchVarPacket(indx);
+    peer->setLane(prev);
+}
+
+size_t FoxSnapshotSender::getEncodingCount() {
+    return encodings.size();
+}
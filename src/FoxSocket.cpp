@@ -1,7 +1,26 @@
 #include "FoxSocket.hpp"
+#include "FoxMetrics.hpp"
+#include "FoxTrace.hpp"
 
+#include <algorithm>
+#include <climits>
+#include <cstddef>
+#include <cstring>
 #include <mutex>
 
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <sys/stat.h>
+#endif
+
+#ifdef __linux__
+#include <sys/sendfile.h>
+#include <linux/errqueue.h>
+#include <signal.h>
+#include <pthread.h>
+#endif
+
 using namespace FoxNet;
 
 // if _FNSetup > 0, WSA has already been started. if _FNSetup == 0, WSA needs to be cleaned up
@@ -35,40 +54,172 @@ void FoxNet::_FoxNet_Cleanup() {
 #endif
 }
 
+#ifndef _WIN32
+static int sendWithFds(SOCKET sock, const Byte *buf, size_t sz, const std::vector<int> &fds) {
+    std::vector<char> control(CMSG_SPACE(sizeof(int) * fds.size()));
+    struct msghdr msg;
+    struct iovec iov;
+    struct cmsghdr *cmsg;
+
+    memset(&msg, 0, sizeof(msg));
+    iov.iov_base = (void*)buf;
+    iov.iov_len = sz;
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.data();
+    msg.msg_controllen = control.size();
+
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int) * fds.size());
+    memcpy(CMSG_DATA(cmsg), fds.data(), sizeof(int) * fds.size());
+
+    return ::sendmsg(sock, &msg, FN_MSG_NOSIGNAL);
+}
+
+static int recvWithFds(SOCKET sock, Byte *buf, size_t sz, std::vector<int> &fds) {
+    union {
+        char buf[CMSG_SPACE(sizeof(int) * FOXNET_MAX_PASSED_FDS)];
+        struct cmsghdr align;
+    } control;
+    struct msghdr msg;
+    struct iovec iov;
+    int flags = 0;
+    int rcvd;
+
+    memset(&msg, 0, sizeof(msg));
+    iov.iov_base = buf;
+    iov.iov_len = sz;
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
+#ifdef MSG_CMSG_CLOEXEC
+    flags |= MSG_CMSG_CLOEXEC;
+#endif
+
+    if ((rcvd = ::recvmsg(sock, &msg, flags)) < 0)
+        return rcvd;
+
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+            continue;
+
+        size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        size_t indx = fds.size();
+
+        fds.resize(indx + count);
+        memcpy(fds.data() + indx, CMSG_DATA(cmsg), sizeof(int) * count);
+    }
+
+    return rcvd;
+}
+#endif
+
 FoxSocket::RawSockReturn FoxSocket::rawRecv(size_t sz) {
+    size_t start = inBuffer.size();
+    RawSockReturn ret = rawRecv(inBuffer, sz);
+
+    if (ret.code == RAWSOCK_OK)
+        onRecv(inBuffer.data() + start, ret.processed);
+
+    return ret;
+}
+
+FoxSocket::RawSockReturn FoxSocket::rawRecv(std::vector<Byte> &buf, size_t sz) {
     RawSockCode errCode = RAWSOCK_OK;
     int rcvd;
-    int start = inBuffer.size();
+    size_t start = buf.size();
+    FOXTRACE_SCOPE(trace, "rawRecv")
 
-    inBuffer.resize(start + sz);
-    rcvd = ::recv(sock, (buffer_t*)(inBuffer.data() + start), sz, FN_MSG_NOSIGNAL);
+    buf.resize(start + sz);
+
+    if (recvTransport) {
+        rcvd = transport->recv(buf.data() + start, sz);
+
+        if (rcvd == 0) {
+            errCode = RAWSOCK_CLOSED;
+        } else if (rcvd == FoxTransport::TRANSPORT_WOULDBLOCK) {
+            errCode = RAWSOCK_POLL;
+        } else if (rcvd < 0) {
+            errCode = RAWSOCK_ERROR;
+        } else {
+            FOXMETRIC(addSocketIn(rcvd))
+            FOXTRACE_ARG(trace, rcvd)
+        }
+
+        buf.resize(start + (rcvd > 0 ? rcvd : 0));
+        return {errCode, rcvd};
+    }
+
+#ifndef _WIN32
+    if (acceptFds) {
+        rcvd = recvWithFds(sock, buf.data() + start, sz, recvFds);
+    } else
+#endif
+    rcvd = ::recv(sock, (buffer_t*)(buf.data() + start), sz, FN_MSG_NOSIGNAL);
 
     if (rcvd == 0) {
         errCode = RAWSOCK_CLOSED;
-    } else if (SOCKETERROR(rcvd) && FN_ERRNO != FN_EWOULD
+    } else if (SOCKETERROR(rcvd)) {
+        if (FN_ERRNO != FN_EWOULD
 #ifndef _WIN32
-        // if it's a posix system, also make sure its not a EAGAIN result (which is a recoverable error, there's just nothing to read lol)
-        && FN_ERRNO != EAGAIN
+            // if it's a posix system, also make sure its not a EAGAIN result (which is a recoverable error, there's just nothing to read lol)
+            && FN_ERRNO != EAGAIN
 #endif
-    ) {
-        // if the socket closed or an error occurred, return the error result
-        errCode = RAWSOCK_ERROR;
-    } else if (rcvd > 0) {
-        // trim excess
-        inBuffer.resize(start + rcvd);
+        ) {
+            // if the socket closed or an error occurred, return the error result
+            errCode = RAWSOCK_ERROR;
+        } else {
+            // nothing to read right now
+            errCode = RAWSOCK_POLL;
+        }
+    } else {
+        FOXMETRIC(addSocketIn(rcvd))
+        FOXTRACE_ARG(trace, rcvd)
     }
 
+    // trim excess
+    buf.resize(start + (rcvd > 0 ? rcvd : 0));
     return {errCode, rcvd};
 }
 
 FoxSocket::RawSockReturn FoxSocket::rawSend(size_t sz) {
+    return rawSend(outBuffer, sz);
+}
+
+FoxSocket::RawSockReturn FoxSocket::rawSend(std::vector<Byte> &buf, size_t sz) {
     RawSockCode errCode = RAWSOCK_OK;
     int sentBytes = 0;
     int sent;
+    FOXTRACE_SCOPE(trace, "rawSend")
 
     // write bytes to the socket until an error occurs or we finish sending
     do {
-        sent = ::send(sock, (buffer_t*)(outBuffer.data() + sentBytes), sz - sentBytes, FN_MSG_NOSIGNAL);
+        if (sendTransport) {
+            sent = transport->send(buf.data() + sentBytes, sz - sentBytes);
+
+            if (sent == FoxTransport::TRANSPORT_WOULDBLOCK) {
+                errCode = RAWSOCK_POLL;
+                goto _rawWriteExit;
+            } else if (sent <= 0) {
+                errCode = RAWSOCK_ERROR;
+                goto _rawWriteExit;
+            }
+
+            continue;
+        }
+
+#ifndef _WIN32
+        if (!sendFds.empty()) {
+            // the fds ride along with the first byte of this send
+            if ((sent = sendWithFds(sock, buf.data() + sentBytes, sz - sentBytes, sendFds)) > 0)
+                sendFds.clear();
+        } else
+#endif
+        sent = ::send(sock, (buffer_t*)(buf.data() + sentBytes), sz - sentBytes, FN_MSG_NOSIGNAL);
 
         // check for error result
         if (sent == 0) { // connection closed gracefully
@@ -79,6 +230,8 @@ FoxSocket::RawSockReturn FoxSocket::rawSend(size_t sz) {
 #ifndef _WIN32
                 // posix also has some platforms which define EAGAIN as a different value than EWOULD, might as well support it.
                 && FN_ERRNO != EAGAIN
+                // a fast open connect that's still waiting on its SYN-ACK
+                && FN_ERRNO != FN_EINPROGRESS
 #endif
             ) { // socket error!
                 errCode = RAWSOCK_ERROR;
@@ -94,11 +247,200 @@ FoxSocket::RawSockReturn FoxSocket::rawSend(size_t sz) {
 
 _rawWriteExit:
     // trim
-    if (sentBytes > 0)
-        outBuffer.erase(outBuffer.begin(), outBuffer.begin() + sentBytes);
+    if (sentBytes > 0) {
+        buf.erase(buf.begin(), buf.begin() + sentBytes);
+        FOXMETRIC(addSocketOut(sentBytes))
+        FOXTRACE_ARG(trace, sentBytes)
+    }
     return {errCode, sentBytes};
 }
 
+// reads up to sz bytes of fd at offset, without moving its position where we can
+static int readAt(int fd, Byte *buf, size_t sz, uint64_t offset) {
+#ifdef _WIN32
+    if (_lseeki64(fd, (__int64)offset, SEEK_SET) < 0)
+        return -1;
+
+    return _read(fd, buf, (unsigned int)sz);
+#else
+    return (int)::pread(fd, buf, sz, (off_t)offset);
+#endif
+}
+
+#ifdef __linux__
+// sendfile() has no MSG_NOSIGNAL, so a dead peer would SIGPIPE us. block it around the call & eat the one it raised
+static ssize_t sendfileNoSignal(int sock, int fd, off_t *off, size_t sz) {
+    struct timespec zero = {0, 0};
+    sigset_t pipeSet, oldSet;
+    ssize_t sent;
+    int err;
+
+    sigemptyset(&pipeSet);
+    sigaddset(&pipeSet, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &pipeSet, &oldSet);
+
+    sent = ::sendfile(sock, fd, off, sz);
+    err = errno;
+
+    // (if it was already blocked, a pending SIGPIPE isn't ours to eat)
+    if (sent == -1 && err == EPIPE && !sigismember(&oldSet, SIGPIPE))
+        sigtimedwait(&pipeSet, NULL, &zero);
+
+    pthread_sigmask(SIG_SETMASK, &oldSet, NULL);
+    errno = err;
+    return sent;
+}
+#endif
+
+FoxSocket::RawSockReturn FoxSocket::sendOnce(const Byte *data, size_t sz, int flags) {
+    int sent;
+
+    if (sendTransport) {
+        sent = transport->send(data, sz);
+
+        if (sent == FoxTransport::TRANSPORT_WOULDBLOCK)
+            return {RAWSOCK_POLL, 0};
+
+        return sentReturn(sent > 0 ? sent : -2);
+    }
+
+    return sentReturn(::send(sock, (const buffer_t*)data, sz, FN_MSG_NOSIGNAL | flags));
+}
+
+FoxSocket::RawSockReturn FoxSocket::sentReturn(int sent) {
+    if (sent > 0) {
+        FOXMETRIC(addSocketOut(sent))
+        return {RAWSOCK_OK, sent};
+    }
+
+    if (sent == 0)
+        return {RAWSOCK_CLOSED, 0};
+
+    // (-2 is a failed transport, errno means nothing then)
+    if (sent == -1 && (FN_ERRNO == FN_EWOULD
+#ifndef _WIN32
+            || FN_ERRNO == EAGAIN || FN_ERRNO == FN_EINPROGRESS
+#endif
+        ))
+        return {RAWSOCK_POLL, 0};
+
+    return {RAWSOCK_ERROR, 0};
+}
+
+FoxSocket::RawSockReturn FoxSocket::rawSendFile(int fd, uint64_t offset, size_t sz) {
+    FOXTRACE_SCOPE(trace, "rawSendFile")
+
+    sz = std::min<size_t>(sz, INT_MAX);
+
+#ifdef __linux__
+    if (!sendTransport) {
+        off_t off = (off_t)offset;
+        int sent = (int)sendfileNoSignal(sock, fd, &off, sz);
+
+        // the file ended early, we can't make up the rest of the payload
+        if (sent == 0 && sz > 0)
+            return {RAWSOCK_ERROR, 0};
+
+        FOXMETRIC(addSendfileOut(sent > 0 ? sent : 0))
+        FOXTRACE_ARG(trace, sent)
+        return sentReturn(sent);
+    }
+#endif
+
+    Byte bounce[16384];
+    int rd = readAt(fd, bounce, std::min(sz, sizeof(bounce)), offset);
+
+    if (rd <= 0)
+        return {RAWSOCK_ERROR, 0};
+
+    // whatever the socket didn't take is read again next time
+    return sendOnce(bounce, rd);
+}
+
+FoxSocket::RawSockReturn FoxSocket::rawSendZeroCopy(const Byte *data, size_t sz, int64_t &zeroCopyID) {
+    FOXTRACE_SCOPE(trace, "rawSendZeroCopy")
+
+    zeroCopyID = -1;
+    sz = std::min<size_t>(sz, INT_MAX);
+
+#if defined(__linux__) && defined(SO_ZEROCOPY) && defined(MSG_ZEROCOPY)
+    if (!sendTransport && zeroCopyMode == 0) {
+        int one = 1;
+
+        // only tcp (& udp) sockets have it, unix sockets don't
+        zeroCopyMode = setsockopt(sock, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) == 0 ? 1 : -1;
+    }
+
+    if (!sendTransport && zeroCopyMode == 1) {
+        RawSockReturn ret = sendOnce(data, sz, MSG_ZEROCOPY);
+
+        if (ret.code == RAWSOCK_OK) {
+            zeroCopyID = zeroCopySent++;
+            FOXMETRIC(addZeroCopyOut(ret.processed))
+            FOXTRACE_ARG(trace, ret.processed)
+            return ret;
+        }
+
+        // ENOBUFS means we've pinned as many pages as the socket allows, copy this one instead
+        if (ret.code != RAWSOCK_ERROR || errno != ENOBUFS)
+            return ret;
+    }
+#endif
+
+    return sendOnce(data, sz);
+}
+
+bool FoxSocket::readZeroCopyDone(std::vector<std::pair<uint32_t, uint32_t>> &done) {
+    bool failed = false;
+    int err = 0;
+    socklen_t errLen = sizeof(err);
+
+    if (SOCKETINVALID(sock))
+        return false;
+
+#if defined(__linux__) && defined(SO_EE_ORIGIN_ZEROCOPY)
+    // every completion is its own message, read until the queue is empty
+    for (;;) {
+        char control[CMSG_SPACE(sizeof(struct sock_extended_err) + sizeof(struct sockaddr_in6))];
+        struct msghdr msg;
+        struct cmsghdr *cmsg;
+
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        if (::recvmsg(sock, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) == -1)
+            break;
+
+        for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            struct sock_extended_err ee;
+
+            if (!(cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR) && !(cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR))
+                continue;
+
+            memcpy(&ee, CMSG_DATA(cmsg), sizeof(ee));
+            if (ee.ee_origin != SO_EE_ORIGIN_ZEROCOPY || ee.ee_errno != 0) {
+                failed = true;
+                continue;
+            }
+
+            // the kernel had to copy them after all (eg. over loopback), they still complete the same way
+            if (ee.ee_code & SO_EE_CODE_ZEROCOPY_COPIED) {
+                FOXMETRIC(addZeroCopyCopied(ee.ee_data - ee.ee_info + 1))
+            }
+
+            done.push_back({ee.ee_info, ee.ee_data});
+        }
+    }
+#endif
+
+    // a reset (or any other pending error) shows up here
+    if (SOCKETERROR(::getsockopt(sock, SOL_SOCKET, SO_ERROR, (buffer_t*)&err, &errLen)) || err != 0)
+        failed = true;
+
+    return !failed;
+}
+
 FoxSocket::FoxSocket(void) {
     _FoxNet_Init();
 }
@@ -106,24 +448,19 @@ FoxSocket::FoxSocket(void) {
 // the base class is deconstructed last, so it's the perfect place to cleanup WSA (if we're on windows)
 FoxSocket::~FoxSocket(void) {
     kill();
+    delete transport;
     _FoxNet_Cleanup();
 }
 
-bool FoxSocket::readBytes(Byte *out, size_t sz) {
-    if (ByteStream::readBytes(out, sz)) {
-        onRecv(out, sz);
-        return true;
-    }
-
-    return false;
-}
-
-void FoxSocket::writeBytes(Byte *in, size_t sz) {
-    ByteStream::writeBytes(in, sz);
-    onSend((outBuffer.data() + outBuffer.size() - sz), sz);
+static bool setIntOpt(SOCKET sock, int level, int name, int val) {
+#ifdef _WIN32
+    return ::setsockopt(sock, level, name, (const char*)&val, sizeof(val)) == 0;
+#else
+    return ::setsockopt(sock, level, name, &val, sizeof(val)) == 0;
+#endif
 }
 
-void FoxSocket::connect(std::string ip, std::string port) {
+void FoxSocket::connect(std::string ip, std::string port, bool fastOpen) {
     struct addrinfo res, *result, *curr;
 
     if (!SOCKETINVALID(sock)) {
@@ -147,7 +484,13 @@ void FoxSocket::connect(std::string ip, std::string port) {
         // if it failed, try the next sock
         if (SOCKETINVALID(sock))
             continue;
-        
+
+#ifdef TCP_FASTOPEN_CONNECT
+        // connect() returns right away, the SYN goes out with our first write
+        if (fastOpen && !setIntOpt(sock, IPPROTO_TCP, TCP_FASTOPEN_CONNECT, 1))
+            FOXWARN("couldn't set TCP_FASTOPEN_CONNECT");
+#endif
+
         // if it's not an invalid socket, break and exit the loop, we found a working addr!
         if (!SOCKETINVALID(::connect(sock, curr->ai_addr, curr->ai_addrlen)))
             break;
@@ -162,55 +505,370 @@ void FoxSocket::connect(std::string ip, std::string port) {
     }
 }
 
-void FoxSocket::bind(uint16_t port) {
+bool FoxSocket::beginConnect(const struct sockaddr *addr, socklen_t addrLen) {
+    if (!SOCKETINVALID(sock)) {
+        FOXFATAL("socket already setup!")
+    }
+
+    sock = ::socket(addr->sa_family, SOCK_STREAM, 0);
+    if (SOCKETINVALID(sock))
+        return false;
+
+    // (it closes the socket if it fails)
+    if (!setNonBlocking())
+        return false;
+
+    // a non-blocking connect() either finishes right away (loopback) or tells us it's in progress
+    if (SOCKETERROR(::connect(sock, addr, addrLen)) && FN_ERRNO != FN_EINPROGRESS) {
+        kill();
+        return false;
+    }
+
+    return true;
+}
+
+bool FoxSocket::finishConnect(void) {
+    int err = 0;
+    socklen_t errSize = sizeof(err);
+
+    if (SOCKETERROR(::getsockopt(sock, SOL_SOCKET, SO_ERROR, (char*)&err, &errSize)))
+        return false;
+
+    return err == 0;
+}
+
+void FoxSocket::takeSock(FoxSocket *other) {
+    if (isAlive()) {
+        FOXFATAL("socket already setup!")
+    }
+
+    delete transport;
+    sock = other->sock;
+    transport = other->transport;
+    transportOpen = other->transportOpen;
+    recvTransport = other->recvTransport;
+    sendTransport = other->sendTransport;
+    zeroCopyMode = other->zeroCopyMode;
+    zeroCopySent = other->zeroCopySent;
+    other->sock = INVALID_SOCKET;
+    other->transport = nullptr;
+    other->transportOpen = other->recvTransport = other->sendTransport = false;
+}
+
+void FoxSocket::openBound(int type, uint16_t port, const FoxBindOptions &opts) {
+    struct sockaddr_storage address;
     socklen_t addressSize;
-    struct sockaddr_in address;
 
-    if (!SOCKETINVALID(sock)) {
+    if (isAlive()) {
         FOXFATAL("socket already setup!")
     }
 
-    // open our socket
-    sock = ::socket(AF_INET, SOCK_STREAM, 0);
+    memset(&address, 0, sizeof(address));
+    if (opts.address.empty()) {
+        // any address, ipv6 first so a dual-stack socket covers both
+        struct sockaddr_in6 *addr6 = (struct sockaddr_in6 *)&address;
+        struct sockaddr_in *addr4 = (struct sockaddr_in *)&address;
+
+        sock = ::socket(AF_INET6, type, 0);
+        if (!SOCKETINVALID(sock)) {
+            addr6->sin6_family = AF_INET6;
+            addr6->sin6_addr = in6addr_any;
+            addr6->sin6_port = htons(port);
+            addressSize = sizeof(struct sockaddr_in6);
+        } else {
+            // no ipv6 on this host
+            sock = ::socket(AF_INET, type, 0);
+            addr4->sin_family = AF_INET;
+            addr4->sin_addr.s_addr = INADDR_ANY;
+            addr4->sin_port = htons(port);
+            addressSize = sizeof(struct sockaddr_in);
+        }
+    } else {
+        struct addrinfo hints, *result;
+        std::string service = std::to_string(port);
+
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = type;
+        hints.ai_flags = AI_PASSIVE | AI_NUMERICHOST | AI_NUMERICSERV;
+
+        if (::getaddrinfo(opts.address.c_str(), service.c_str(), &hints, &result) != 0) {
+            FOXFATAL("invalid bind address!");
+        }
+
+        memcpy(&address, result->ai_addr, result->ai_addrlen);
+        addressSize = result->ai_addrlen;
+        freeaddrinfo(result);
+
+        sock = ::socket(address.ss_family, type, 0);
+    }
+
     if (SOCKETINVALID(sock)) {
         FOXFATAL("socket() failed!");
     }
 
-    // attach socket to the port
-    int opt = 1;
-#ifdef _WIN32
-    if (::setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, (const char*)&opt, sizeof(opt)) != 0) {
+    if (type == SOCK_STREAM && !setIntOpt(sock, SOL_SOCKET, SO_REUSEADDR, 1)) {
+        kill();
+        FOXFATAL("setsockopt() failed!");
+    }
+
+    // (the default depends on the host, so it's always set)
+    if (address.ss_family == AF_INET6 && !setIntOpt(sock, IPPROTO_IPV6, IPV6_V6ONLY, !opts.dualStack))
+        FOXWARN("couldn't set IPV6_V6ONLY");
+
+    if (opts.reusePort) {
+#ifdef SO_REUSEPORT
+        if (!setIntOpt(sock, SOL_SOCKET, SO_REUSEPORT, 1)) {
+            kill();
+            FOXFATAL("setsockopt() failed!");
+        }
 #else
-    if (::setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) != 0) {
+        FOXWARN("SO_REUSEPORT isn't supported on this platform");
 #endif
-        FOXFATAL("setsockopt() failed!");
     }
-    address.sin_family = AF_INET;
-    address.sin_addr.s_addr = INADDR_ANY;
-    address.sin_port = htons(port);
 
-    addressSize = sizeof(address);
+    if (SOCKETERROR(::bind(sock, (struct sockaddr *)&address, addressSize))) {
+        kill();
+        FOXFATAL("bind() failed!");
+    }
+}
+
+void FoxSocket::bind(uint16_t port, const FoxBindOptions &opts) {
+    openBound(SOCK_STREAM, port, opts);
+
+    // these only save latency, a kernel without them still works
+    if (opts.deferAccept > 0) {
+#ifdef TCP_DEFER_ACCEPT
+        if (!setIntOpt(sock, IPPROTO_TCP, TCP_DEFER_ACCEPT, opts.deferAccept))
+            FOXWARN("couldn't set TCP_DEFER_ACCEPT");
+#else
+        FOXWARN("TCP_DEFER_ACCEPT isn't supported on this platform");
+#endif
+    }
+
+    if (opts.fastOpen > 0) {
+#ifdef TCP_FASTOPEN
+        if (!setIntOpt(sock, IPPROTO_TCP, TCP_FASTOPEN, opts.fastOpen))
+            FOXWARN("couldn't set TCP_FASTOPEN");
+#else
+        FOXWARN("TCP_FASTOPEN isn't supported on this platform");
+#endif
+    }
+
+    if (SOCKETERROR(::listen(sock, opts.backlog))) {
+        kill();
+        FOXFATAL("listen() failed!");
+    }
+}
+
+#ifndef _WIN32
+static socklen_t fillUnixAddress(const std::string &path, struct sockaddr_un &address) {
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+
+    if (path.empty() || path.size() >= sizeof(address.sun_path)) {
+        FOXFATAL("invalid unix socket path!")
+    }
+
+    memcpy(address.sun_path, path.data(), path.size());
+    if (path[0] != '@')
+        return offsetof(struct sockaddr_un, sun_path) + path.size() + 1;
+
+#ifdef __linux__
+    // abstract sockets start with a NUL and aren't NUL terminated, the length is all the kernel goes by
+    address.sun_path[0] = '\0';
+    return offsetof(struct sockaddr_un, sun_path) + path.size();
+#else
+    FOXFATAL("abstract unix sockets are only supported on linux!")
+#endif
+}
+#endif
+
+void FoxSocket::bindUnix(const std::string &path) {
+#ifdef _WIN32
+    FOXFATAL("unix sockets aren't supported on this platform!")
+#else
+    struct sockaddr_un address;
+    struct stat info;
+    socklen_t addressSize = fillUnixAddress(path, address);
+
+    if (isAlive()) {
+        FOXFATAL("socket already setup!")
+    }
+
+    // a socket file left behind by a previous run would make bind() fail. it's only removed once a connect() to it
+    // is refused, so a server that's still listening on it keeps it
+    if (path[0] != '@' && ::lstat(path.c_str(), &info) == 0) {
+        if (!S_ISSOCK(info.st_mode)) {
+            FOXFATAL("bindUnix() path exists and isn't a socket!")
+        }
+
+        SOCKET probe = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (SOCKETINVALID(probe)) {
+            FOXFATAL("socket() failed!");
+        }
+
+        // (non-blocking, a live server with a full backlog would otherwise keep us waiting)
+        int err = 0;
+        if (::fcntl(probe, F_SETFL, (::fcntl(probe, F_GETFL, 0) | O_NONBLOCK)) != 0 ||
+                SOCKETERROR(::connect(probe, (struct sockaddr *)&address, addressSize)))
+            err = FN_ERRNO;
+        closeSock(probe);
+
+        if (err != ECONNREFUSED) {
+            FOXFATAL("bindUnix() path is in use!")
+        }
+
+        ::unlink(path.c_str());
+    }
+
+    sock = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (SOCKETINVALID(sock)) {
+        FOXFATAL("socket() failed!");
+    }
 
-    // bind to the port
     if (SOCKETERROR(::bind(sock, (struct sockaddr *)&address, addressSize))) {
+        kill();
         FOXFATAL("bind() failed!");
     }
 
     if (SOCKETERROR(::listen(sock, SOMAXCONN))) {
+        kill();
         FOXFATAL("listen() failed!");
     }
+#endif
+}
+
+void FoxSocket::connectUnix(const std::string &path) {
+#ifdef _WIN32
+    FOXFATAL("unix sockets aren't supported on this platform!")
+#else
+    struct sockaddr_un address;
+    socklen_t addressSize = fillUnixAddress(path, address);
+
+    if (isAlive()) {
+        FOXFATAL("socket already setup!")
+    }
+
+    sock = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (SOCKETINVALID(sock)) {
+        FOXFATAL("socket() failed!");
+    }
+
+    if (SOCKETERROR(::connect(sock, (struct sockaddr *)&address, addressSize))) {
+        kill();
+        FOXFATAL("couldn't connect to unix socket!");
+    }
+#endif
+}
+
+void FoxSocket::bindDatagram(uint16_t port, const FoxBindOptions &opts) {
+    openBound(SOCK_DGRAM, port, opts);
+}
+
+void FoxSocket::connectDatagram(const struct sockaddr *addr, socklen_t addrLen) {
+    if (isAlive()) {
+        FOXFATAL("socket already setup!")
+    }
+
+    sock = ::socket(addr->sa_family, SOCK_DGRAM, 0);
+    if (SOCKETINVALID(sock)) {
+        FOXFATAL("socket() failed!");
+    }
+
+    if (SOCKETERROR(::connect(sock, addr, addrLen))) {
+        kill();
+        FOXFATAL("couldn't connect datagram socket!");
+    }
 }
 
 void FoxSocket::acceptFrom(FoxSocket *host) {
-    socklen_t addressSize;
-    struct sockaddr address;
+    struct sockaddr_storage address;
+    socklen_t addressSize = sizeof(address);
 
-    sock = ::accept(host->getRawSock(), &address, &addressSize);
+    sock = ::accept(host->getRawSock(), (struct sockaddr *)&address, &addressSize);
     if (SOCKETINVALID(sock)) {
         FOXFATAL("accept() failed!")
     }
 }
 
+FoxSocket::AcceptCode FoxSocket::acceptNext(SOCKET &out, struct sockaddr_storage &address, socklen_t &addressSize) {
+    for (;;) {
+        addressSize = sizeof(address);
+
+#ifdef __linux__
+        out = ::accept4(sock, (struct sockaddr *)&address, &addressSize, SOCK_NONBLOCK | SOCK_CLOEXEC);
+#else
+        out = ::accept(sock, (struct sockaddr *)&address, &addressSize);
+#endif
+        if (!SOCKETINVALID(out))
+            break;
+
+        switch (FN_ERRNO) {
+#ifdef _WIN32
+        case WSAEWOULDBLOCK:
+            return ACCEPT_EMPTY;
+        case WSAECONNRESET: // (winsock's name for an aborted connection)
+        case WSAEINTR:
+            continue;
+        case WSAEMFILE:
+        case WSAENOBUFS:
+            return ACCEPT_FULL;
+#else
+        case EAGAIN:
+#if EWOULDBLOCK != EAGAIN
+        case EWOULDBLOCK:
+#endif
+            return ACCEPT_EMPTY;
+        case ECONNABORTED:
+        case EINTR:
+#ifdef __linux__
+        case EPROTO: // (linux can report an aborted handshake as EPROTO)
+#endif
+            continue;
+        case EMFILE:
+        case ENFILE:
+        case ENOBUFS:
+        case ENOMEM:
+            return ACCEPT_FULL;
+#endif
+        default:
+            return ACCEPT_ERROR;
+        }
+    }
+
+#ifndef __linux__
+#ifdef _WIN32
+    unsigned long mode = 1;
+    if (::ioctlsocket(out, FIONBIO, &mode) != 0) {
+#else
+    if (::fcntl(out, F_SETFL, (::fcntl(out, F_GETFL, 0) | O_NONBLOCK)) != 0) {
+#endif
+        FOXWARN("fcntl failed on new connection");
+        closeSock(out);
+        return ACCEPT_ERROR;
+    }
+#endif
+
+    return ACCEPT_OK;
+}
+
+void FoxSocket::adoptSock(SOCKET s) {
+    if (isAlive()) {
+        FOXFATAL("socket already setup!")
+    }
+
+    sock = s;
+}
+
+void FoxSocket::closeSock(SOCKET s) {
+#ifdef _WIN32
+    closesocket(s);
+#else
+    close(s);
+#endif
+}
+
 bool FoxSocket::setNonBlocking(void) {
 #ifdef _WIN32
     unsigned long mode = 1;
@@ -226,21 +884,92 @@ bool FoxSocket::setNonBlocking(void) {
         shutdown(sock, SHUT_RDWR);
         close(sock);
 #endif
+        // don't leave the closed fd around, kill() would close it again (by then maybe someone else's)
+        sock = INVALID_SOCKET;
         return false;
     }
 
     return true;
 }
 
+void FoxSocket::setTransport(FoxTransport *t) {
+    if (isAlive()) {
+        FOXFATAL("socket already setup!")
+    }
+
+    // (a transport is kept around after we're killed, see kill())
+    delete transport;
+    transport = t;
+    transportOpen = recvTransport = sendTransport = true;
+}
+
+void FoxSocket::upgradeTransport(FoxTransport *t) {
+    if (!isAlive() || transport != nullptr) {
+        FOXFATAL("upgradeTransport() needs a connected socket without a transport!")
+    }
+
+    transport = t;
+    transportOpen = true;
+}
+
+void FoxSocket::switchRecv(void) {
+    recvTransport = transport != nullptr;
+}
+
+void FoxSocket::switchSend(void) {
+    sendTransport = transport != nullptr;
+}
+
+bool FoxSocket::isRecvOnTransport(void) {
+    return recvTransport;
+}
+
+bool FoxSocket::isSendOnTransport(void) {
+    return sendTransport;
+}
+
+bool FoxSocket::isUnixSocket(void) {
+#ifdef _WIN32
+    return false;
+#else
+    struct sockaddr_storage address;
+    socklen_t addressSize = sizeof(address);
+
+    if (SOCKETINVALID(sock) || SOCKETERROR(::getsockname(sock, (struct sockaddr *)&address, &addressSize)))
+        return false;
+
+    return address.ss_family == AF_UNIX;
+#endif
+}
+
+void FoxSocket::passFds(const std::vector<int> &fds) {
+    sendFds = fds;
+}
+
+void FoxSocket::setAcceptFds(bool accept) {
+    acceptFds = accept;
+}
+
+std::vector<int> FoxSocket::takeFds(void) {
+    std::vector<int> fds;
+
+    fds.swap(recvFds);
+    return fds;
+}
+
+FoxTransport *FoxSocket::getTransport(void) {
+    return transport;
+}
+
 void FoxSocket::onKilled(void) {
     // stubbed
 }
 
-void FoxSocket::onSend(Byte *data, size_t sz) {
+void FoxSocket::onSend(Byte *, size_t) {
     // stubbed
 }
 
-void FoxSocket::onRecv(Byte *data, size_t sz) {
+void FoxSocket::onRecv(Byte *, size_t) {
     // stubbed
 }
 
@@ -250,6 +979,22 @@ void FoxSocket::kill(void) {
 
     onKilled();
 
+    // the transport isn't freed until we are, our poll list might still be polling its wake fd
+    if (transportOpen) {
+        transport->close();
+        transportOpen = recvTransport = sendTransport = false;
+    }
+
+#ifndef _WIN32
+    // fds passed to us that nobody took
+    for (int fd : recvFds)
+        ::close(fd);
+    recvFds.clear();
+#endif
+
+    if (SOCKETINVALID(sock))
+        return;
+
 #ifdef _WIN32
     shutdown(sock, SD_BOTH);
     closesocket(sock);
@@ -262,7 +1007,7 @@ void FoxSocket::kill(void) {
 }
 
 bool FoxSocket::isAlive(void) {
-    return sock != INVALID_SOCKET;
+    return sock != INVALID_SOCKET || transportOpen;
 }
 
 SOCKET FoxSocket::getRawSock(void) {
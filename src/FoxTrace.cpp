@@ -0,0 +1,152 @@
+#include "FoxTrace.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <vector>
+
+using namespace FoxNet;
+
+namespace {
+    std::mutex ringLock;
+    std::vector<FoxTraceRing*> rings; // never freed, a dump can read them at any time
+    std::vector<FoxTraceRing*> retiredRings; // rings whose thread exited, handed to the next new thread
+    uint32_t nextTid = 1;
+
+    // timestamps are converted to wall time using two reference points: the first ring attach, and the dump
+    uint64_t refTicks = 0;
+    int64_t refNanos = 0;
+
+    int64_t steadyNanos() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // hands our ring back when the thread exits
+    struct RingOwner {
+        FoxTraceRing *ring = nullptr;
+
+        ~RingOwner(void) {
+            if (ring == nullptr)
+                return;
+
+            std::lock_guard<std::mutex> lock(ringLock);
+            retiredRings.push_back(ring);
+        }
+    };
+
+    thread_local RingOwner owner;
+
+    void writeEscaped(std::ostringstream &out, const std::string &str) {
+        for (char c : str) {
+            if (c == '"' || c == '\\')
+                out << '\\';
+            out << c;
+        }
+    }
+}
+
+thread_local FoxTraceRing *FoxTrace::ring = nullptr;
+
+FoxTraceRing *FoxTrace::attach() {
+    std::lock_guard<std::mutex> lock(ringLock);
+
+    if (refNanos == 0) {
+        refTicks = now();
+        refNanos = steadyNanos();
+    }
+
+    if (!retiredRings.empty()) {
+        ring = retiredRings.back();
+        retiredRings.pop_back();
+    } else {
+        ring = new FoxTraceRing();
+        rings.push_back(ring);
+    }
+
+    ring->tid = nextTid++;
+    ring->threadName.clear();
+    owner.ring = ring;
+    return ring;
+}
+
+void FoxTrace::setThreadName(const std::string &name) {
+    // don't allocate a ring that'll never be written to
+    if (!isEnabled())
+        return;
+
+    FoxTraceRing &r = local();
+    std::lock_guard<std::mutex> lock(ringLock);
+
+    r.threadName = name;
+}
+
+std::string FoxTrace::toChromeJSON() {
+    std::ostringstream out;
+    std::vector<FoxTraceEvent> events;
+    std::lock_guard<std::mutex> lock(ringLock);
+    bool first = true;
+    double ticksPerUs;
+
+    // nothing has been traced yet
+    if (refNanos == 0)
+        return "{\"traceEvents\": []}\n";
+
+    // calibrate the timestamp rate against the steady clock
+    ticksPerUs = (double)(now() - refTicks) / ((steadyNanos() - refNanos) / 1000.0);
+    if (!(ticksPerUs > 0))
+        ticksPerUs = 1000.0;
+
+    out.precision(3);
+    out << std::fixed << "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [";
+    for (FoxTraceRing *r : rings) {
+        uint64_t start, end = r->head.load(std::memory_order_acquire);
+
+        if (!r->threadName.empty()) {
+            out << (first ? "\n" : ",\n") << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << r->tid
+                << ", \"args\": {\"name\": \"";
+            writeEscaped(out, r->threadName);
+            out << "\"}}";
+            first = false;
+        }
+
+        // copy what's in the ring, then throw away anything the writer might've lapped while we were copying
+        start = end > FOXTRACE_RING_SIZE ? end - FOXTRACE_RING_SIZE : 0;
+        events.clear();
+        for (uint64_t i = start; i < end; i++)
+            events.push_back(r->events[i & (FOXTRACE_RING_SIZE - 1)]);
+
+        uint64_t lapped = r->head.load(std::memory_order_acquire);
+        uint64_t valid = lapped > FOXTRACE_RING_SIZE ? lapped - FOXTRACE_RING_SIZE : 0;
+
+        for (uint64_t i = std::max(start, valid); i < end; i++) {
+            FoxTraceEvent &ev = events[i - start];
+
+            out << (first ? "\n" : ",\n") << "{\"name\": \"" << ev.name << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << r->tid
+                << ", \"ts\": " << (int64_t)(ev.begin - refTicks) / ticksPerUs << ", \"dur\": " << (ev.end - ev.begin) / ticksPerUs
+                << ", \"args\": {\"arg\": " << ev.arg << "}}";
+            first = false;
+        }
+    }
+    out << "\n]}\n";
+
+    return out.str();
+}
+
+bool FoxTrace::dumpChrome(const std::string &path) {
+    std::ofstream file(path);
+
+    if (!file)
+        return false;
+
+    file << toChromeJSON();
+    return file.good();
+}
+
+bool FoxTrace::isEnabled() {
+#ifdef FOXNET_ENABLE_TRACING
+    return true;
+#else
+    return false;
+#endif
+}
@@ -0,0 +1,119 @@
+#include "FoxServer.hpp"
+#include "FoxClient.hpp"
+
+#include <memory>
+#include <vector>
+
+#include <sys/resource.h>
+
+#include "../FoxTest.hpp"
+
+/*
+ * an edge-triggered listener with a backlog bigger than the accept budget gets all of it accepted, and accept()
+ * running out of file descriptors: the server backs off instead of spinning on the listener, and once fds are free
+ * again it picks up every connection that waited in the backlog
+ */
+
+using namespace FoxNet;
+
+#define TEST_PORT 13395
+#define TEST_CLIENTS 8
+#define TEST_BUDGET 2
+
+class TestServer : public FoxServer<FoxServerPeer> {
+public:
+    int peers = 0;
+
+    TestServer(): FoxServer<FoxServerPeer>(TEST_PORT) {}
+
+    void onNewPeer(FoxServerPeer *) {
+        peers++;
+    }
+
+    void onPeerDisconnect(FoxServerPeer *) {
+        peers--;
+    }
+};
+
+class TestClient : public FoxClient {
+public:
+    int *ready;
+
+    TestClient(int *r): ready(r) {}
+
+    void onReady() {
+        (*ready)++;
+    }
+};
+
+// the lowest free fd, any limit at or below it makes the next accept() fail with EMFILE
+static rlim_t nextFd() {
+    int fd = dup(0);
+
+    close(fd);
+    return (rlim_t)fd;
+}
+
+// nothing new connects after the first poll, so the only thing bringing the server back to the backlog is the re-arm
+static void testEdgeTriggered() {
+    TestServer server;
+    std::vector<std::unique_ptr<TestClient>> clients;
+    int ready = 0;
+
+    server.enableEdgeTriggered();
+    server.setAcceptBudget(TEST_BUDGET);
+
+    for (int i = 0; i < TEST_CLIENTS; i++) {
+        clients.emplace_back(new TestClient(&ready));
+        clients.back()->connect("127.0.0.1", std::to_string(TEST_PORT));
+    }
+
+    for (int i = 0; i < 1000 && ready < TEST_CLIENTS; i++) {
+        server.pollPeers(1);
+        for (std::unique_ptr<TestClient> &client : clients)
+            client->pollPeer(0);
+    }
+
+    FOXCHECK(server.peers == TEST_CLIENTS)
+    FOXCHECK(ready == TEST_CLIENTS)
+}
+
+int main() {
+    testEdgeTriggered();
+
+    TestServer server;
+    std::vector<std::unique_ptr<TestClient>> clients;
+    struct rlimit limit, starved;
+    int ready = 0, polls = 0;
+
+    // the connections land in the backlog, nothing's accepted until the server polls
+    for (int i = 0; i < TEST_CLIENTS; i++) {
+        clients.emplace_back(new TestClient(&ready));
+        clients.back()->connect("127.0.0.1", std::to_string(TEST_PORT));
+    }
+
+    FOXCHECK(getrlimit(RLIMIT_NOFILE, &limit) == 0)
+    starved = limit;
+    starved.rlim_cur = nextFd();
+    FOXCHECK(setrlimit(RLIMIT_NOFILE, &starved) == 0)
+
+    // the listener is out of the poll list while it backs off, a level-triggered one would otherwise wake every poll
+    for (int64_t end = getTicks() + FOXNET_ACCEPT_BACKOFF / 2; getTicks() < end; polls++)
+        server.pollPeers(FOXNET_ACCEPT_BACKOFF);
+
+    FOXCHECK(server.peers == 0)
+    FOXCHECK(polls < 5)
+
+    FOXCHECK(setrlimit(RLIMIT_NOFILE, &limit) == 0)
+
+    for (int i = 0; i < 1000 && ready < TEST_CLIENTS; i++) {
+        server.pollPeers(1);
+        for (std::unique_ptr<TestClient> &client : clients)
+            client->pollPeer(0);
+    }
+
+    FOXCHECK(server.peers == TEST_CLIENTS)
+    FOXCHECK(ready == TEST_CLIENTS)
+
+    return FOXTEST_RESULT();
+}
@@ -0,0 +1,288 @@
+#include "FoxClient.hpp"
+#include "FoxServer.hpp"
+#include "FoxPipe.hpp"
+
+#include <vector>
+
+#include "../FoxTest.hpp"
+
+/*
+ * Small var packets bundled into PKTID_AGGREGATE frames arrive intact & in order (mixed with fixed & oversized
+ * packets and other lanes), with or without onSend()/onRecv() changing the bytes, hand made frames parse, and
+ * malformed ones drop the connection
+ */
+
+using namespace FoxNet;
+
+enum {
+    PKT_SMALL = PKTID_USER_PACKET_START, // (var) uint32_t (seq) follows, then filler bytes derived from it
+    PKT_FIXED, // uint32_t (seq)
+    PKT_CONTROL, // (var) uint32_t (seq), written to the control lane
+};
+
+#define TEST_PACKETS 3000
+
+static void xorData(Byte *data, size_t sz) {
+    for (size_t i = 0; i < sz; i++)
+        data[i] ^= 0x5a;
+}
+
+// every packet carries the next sequence number of its kind, the filler bytes are checked too
+struct Checker {
+    uint32_t seq[3] = {0, 0, 0};
+    int got = 0, bad = 0;
+
+    void check(FoxPeer *peer, int kind, size_t size) {
+        uint32_t s;
+        Byte b;
+
+        peer->readInt(s);
+        if (s != seq[kind]++)
+            bad++;
+
+        for (size_t i = sizeof(uint32_t); i < size; i++) {
+            peer->readByte(b);
+            if (b != (Byte)(s + i))
+                bad++;
+        }
+
+        got++;
+    }
+};
+
+class TestPeer : public FoxServerPeer {
+    DEF_FOXNET_VAR_PACKET(PKT_SMALL)
+    DEF_FOXNET_PACKET(PKT_FIXED)
+    DEF_FOXNET_VAR_PACKET(PKT_CONTROL)
+
+public:
+    Checker checker;
+    size_t bytesIn = 0;
+    bool xorred = false;
+
+    TestPeer() {
+        INIT_FOXNET_VAR_PACKET(PKT_SMALL)
+        INIT_FOXNET_PACKET(PKT_FIXED, sizeof(uint32_t))
+        INIT_FOXNET_VAR_PACKET(PKT_CONTROL)
+    }
+
+    void onSend(Byte *data, size_t sz) {
+        if (xorred)
+            xorData(data, sz);
+    }
+
+    void onRecv(Byte *data, size_t sz) {
+        bytesIn += sz;
+        if (xorred)
+            xorData(data, sz);
+    }
+};
+
+DECLARE_FOXNET_VAR_PACKET(PKT_SMALL, TestPeer) {
+    ((TestPeer*)peer)->checker.check(peer, 0, varSize);
+}
+
+DECLARE_FOXNET_PACKET(PKT_FIXED, TestPeer) {
+    ((TestPeer*)peer)->checker.check(peer, 1, sizeof(uint32_t));
+}
+
+DECLARE_FOXNET_VAR_PACKET(PKT_CONTROL, TestPeer) {
+    ((TestPeer*)peer)->checker.check(peer, 2, varSize);
+}
+
+class TestServer : public FoxServer<TestPeer> {
+public:
+    TestPeer *peer = nullptr;
+    bool xorred = false;
+
+    void onNewPeer(TestPeer *p) {
+        peer = p;
+        p->xorred = xorred;
+    }
+
+    void onPeerDisconnect(TestPeer *) {
+        peer = nullptr;
+    }
+};
+
+class TestClient : public FoxClient {
+    DEF_FOXNET_VAR_PACKET(PKT_SMALL)
+    DEF_FOXNET_PACKET(PKT_FIXED)
+
+public:
+    Checker checker;
+    bool xorred = false;
+
+    TestClient() {
+        INIT_FOXNET_VAR_PACKET(PKT_SMALL)
+        INIT_FOXNET_PACKET(PKT_FIXED, sizeof(uint32_t))
+    }
+
+    void onSend(Byte *data, size_t sz) {
+        if (xorred)
+            xorData(data, sz);
+    }
+
+    void onRecv(Byte *data, size_t sz) {
+        if (xorred)
+            xorData(data, sz);
+    }
+};
+
+DECLARE_FOXNET_VAR_PACKET(PKT_SMALL, TestClient) {
+    ((TestClient*)peer)->checker.check(peer, 0, varSize);
+}
+
+DECLARE_FOXNET_PACKET(PKT_FIXED, TestClient) {
+    ((TestClient*)peer)->checker.check(peer, 1, sizeof(uint32_t));
+}
+
+static void pollBoth(TestServer &server, TestClient &client) {
+    for (int i = 0; i < 8; i++) {
+        if (client.isAlive())
+            client.pollPeer(0);
+        server.pollPeers(0);
+    }
+}
+
+static bool connectPipe(TestServer &server, TestClient &client) {
+    auto pipe = FoxPipe::create();
+
+    server.acceptTransport(pipe.first);
+    client.connectTransport(pipe.second);
+    for (int i = 0; i < 100 && !(client.getHandshake() && server.peer != nullptr); i++)
+        pollBoth(server, client);
+
+    return client.getHandshake() && server.peer != nullptr;
+}
+
+static void writeVar(FoxPeer *peer, PktID id, uint32_t seq, size_t size) {
+    size_t indx = peer->prepareVarPacket(id);
+
+    peer->writeInt<uint32_t>(seq);
+    for (size_t i = sizeof(uint32_t); i < size; i++)
+        peer->writeByte((Byte)(seq + i));
+    peer->patchVarPacket(indx);
+}
+
+// returns how many bytes the server got, 0 if something went wrong
+static size_t sendMix(bool aggregate, bool xorred) {
+    TestServer server;
+    TestClient client;
+    uint32_t seq[3] = {0, 0, 0};
+
+    server.xorred = client.xorred = xorred;
+    client.setAggregation(aggregate);
+    if (!connectPipe(server, client)) {
+        FOXCHECK(!"couldn't connect over the pipe")
+        return 0;
+    }
+
+    server.peer->bytesIn = 0;
+    for (int i = 0; i < TEST_PACKETS; i++) {
+        switch (i % 10) {
+            case 0: // fixed packets end the run
+                client.writeByte(PKT_FIXED);
+                client.writeInt<uint32_t>(seq[1]++);
+                break;
+            case 1: // too big to bundle, sent as is
+                writeVar(&client, PKT_SMALL, seq[0]++, FOXNET_AGGREGATE_ENTRY + 1 + i % 200);
+                break;
+            case 2: { // another lane has its own frames
+                PktLane lane = client.setLane(PKTLANE_CONTROL);
+                writeVar(&client, PKT_CONTROL, seq[2]++, sizeof(uint32_t) + i % 8);
+                client.setLane(lane);
+                break;
+            }
+            default:
+                writeVar(&client, PKT_SMALL, seq[0]++, sizeof(uint32_t) + i % 30);
+                break;
+        }
+
+        if (i % 100 == 99)
+            pollBoth(server, client);
+    }
+    pollBoth(server, client);
+
+    FOXCHECK(client.getCapabilities() & CAP_AGGREGATE)
+    FOXCHECK(server.peer != nullptr)
+    if (server.peer == nullptr)
+        return 0;
+
+    FOXCHECK(server.peer->checker.got == TEST_PACKETS)
+    FOXCHECK(server.peer->checker.bad == 0)
+    return server.peer->bytesIn;
+}
+
+static void testRoundTrip() {
+    size_t plain = sendMix(false, false);
+    size_t bundled = sendMix(true, false);
+    size_t xorred = sendMix(true, true);
+
+    // a bundled packet's header is 2 bytes smaller (less its share of the frame's), so if the small packets were
+    // really bundled the server got well over a byte less per packet. overriding onSend() doesn't turn it off
+    FOXCHECK(bundled > 0 && bundled + TEST_PACKETS / 2 < plain)
+    FOXCHECK(xorred == bundled)
+}
+
+static void writeFrame(FoxPeer *peer, std::vector<Byte> body) {
+    peer->writeByte(PKTID_AGGREGATE);
+    peer->writeInt<uint16_t>((uint16_t)body.size());
+    peer->writeBytes(body.data(), body.size());
+}
+
+static void testHandmadeFrames() {
+    TestServer server;
+    TestClient client;
+    ByteStream body;
+
+    if (!connectPipe(server, client)) {
+        FOXCHECK(!"couldn't connect over the pipe")
+        return;
+    }
+
+    // a fixed packet, a var packet (its size is a varint) & another fixed packet
+    body.writeByte(PKT_FIXED);
+    body.writeInt<uint32_t>(0);
+    body.writeByte(PKT_SMALL);
+    body.writeVarint(sizeof(uint32_t) + 2);
+    body.writeInt<uint32_t>(0);
+    body.writeByte((Byte)(0 + 4));
+    body.writeByte((Byte)(0 + 5));
+    body.writeByte(PKT_FIXED);
+    body.writeInt<uint32_t>(1);
+
+    writeFrame(server.peer, body.getOutBuffer());
+    pollBoth(server, client);
+    FOXCHECK(client.checker.got == 3)
+    FOXCHECK(client.checker.bad == 0)
+    FOXCHECK(client.isAlive())
+
+    // a var packet claiming more than the frame holds
+    writeFrame(server.peer, {PKT_SMALL, 200, 0, 0, 0, 0});
+    pollBoth(server, client);
+    FOXCHECK(!client.isAlive())
+}
+
+static void testNestedFrame() {
+    TestServer server;
+    TestClient client;
+
+    if (!connectPipe(server, client)) {
+        FOXCHECK(!"couldn't connect over the pipe")
+        return;
+    }
+
+    // frames can't carry frames
+    writeFrame(server.peer, {PKTID_AGGREGATE, 0, 0});
+    pollBoth(server, client);
+    FOXCHECK(!client.isAlive())
+}
+
+int main() {
+    testRoundTrip();
+    testHandmadeFrames();
+    testNestedFrame();
+
+    return FOXTEST_RESULT();
+}
@@ -0,0 +1,121 @@
+#include "FoxClient.hpp"
+#include "FoxServer.hpp"
+
+#include <functional>
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "../FoxTest.hpp"
+
+/*
+ * Bind options against loopback: by default one socket takes ipv4 & ipv6 clients, an ipv6 only socket turns ipv4
+ * clients away, an ipv4 address keeps ipv6 clients out, and a bad address is refused
+ */
+
+using namespace FoxNet;
+
+#define TEST_PORT 13397
+
+class TestPeer : public FoxServerPeer {};
+
+class TestServer : public FoxServer<TestPeer> {
+public:
+    int peers = 0;
+
+    TestServer(const FoxBindOptions &opts): FoxServer<TestPeer>(TEST_PORT, opts) {}
+
+    void onNewPeer(TestPeer *) {
+        peers++;
+    }
+
+    void onPeerDisconnect(TestPeer *) {}
+};
+
+class TestClient : public FoxClient {};
+
+// does the host have ipv6 loopback at all? (some containers don't)
+static bool hasIPv6() {
+    struct sockaddr_in6 addr = {};
+    int sock = ::socket(AF_INET6, SOCK_STREAM, 0);
+    bool ok;
+
+    if (sock == -1)
+        return false;
+
+    addr.sin6_family = AF_INET6;
+    addr.sin6_addr = in6addr_loopback;
+    ok = ::bind(sock, (struct sockaddr*)&addr, sizeof(addr)) == 0;
+    ::close(sock);
+    return ok;
+}
+
+// connects & waits for the handshake, false if the connection was refused
+static bool handshake(TestServer &server, const std::string &ip) {
+    TestClient client;
+
+    try {
+        client.connect(ip, std::to_string(TEST_PORT));
+    } catch(FoxException &) {
+        return false;
+    }
+
+    for (int i = 0; i < 1000 && !client.getHandshake() && client.isAlive(); i++) {
+        server.pollPeers(1);
+        client.pollPeer(1);
+    }
+
+    return client.getHandshake();
+}
+
+int main() {
+    bool ipv6 = hasIPv6();
+
+    {
+        TestServer server((FoxBindOptions()));
+
+        FOXCHECK(handshake(server, "127.0.0.1"))
+        if (ipv6)
+            FOXCHECK(handshake(server, "::1"))
+        FOXCHECK(server.peers == (ipv6 ? 2 : 1))
+    }
+
+    if (ipv6) {
+        FoxBindOptions opts;
+        opts.address = "::";
+        opts.dualStack = false;
+
+        TestServer server(opts);
+
+        FOXCHECK(handshake(server, "::1"))
+        FOXCHECK(!handshake(server, "127.0.0.1"))
+        FOXCHECK(server.peers == 1)
+    }
+
+    {
+        FoxBindOptions opts;
+        opts.address = "127.0.0.1";
+        opts.backlog = 16;
+
+        TestServer server(opts);
+
+        FOXCHECK(handshake(server, "127.0.0.1"))
+        if (ipv6)
+            FOXCHECK(!handshake(server, "::1"))
+        FOXCHECK(server.peers == 1)
+    }
+
+    bool refused = false;
+    try {
+        FoxBindOptions opts;
+        opts.address = "not-an-address";
+
+        TestServer server(opts);
+    } catch(FoxException &) {
+        refused = true;
+    }
+    FOXCHECK(refused)
+
+    return FOXTEST_RESULT();
+}
@@ -0,0 +1,172 @@
+#include "FoxClient.hpp"
+#include "FoxServer.hpp"
+#include "FoxReplay.hpp"
+
+#include <functional>
+
+#include "../FoxTest.hpp"
+
+/*
+ * Traffic captured from a loopback server & replayed without sockets: the replayed peers dispatch exactly the
+ * packets the live ones did (after going through onRecv() again), one replayed peer per captured connection
+ */
+
+using namespace FoxNet;
+
+#define TEST_PORT 13394
+#define TEST_PACKETS 2000
+#define TEST_CAPTURE "capture-test.foxcap"
+
+enum {
+    C2S_FIXED = PKTID_USER_PACKET_START, // uint32_t (seq)
+    C2S_VAR, // (var) seq % 5 bytes derived from the seq
+};
+
+// tallies of what the peers dispatched, live & replayed peers have to end up with the same ones
+struct Tally {
+    int fixed = 0, var = 0, bad = 0;
+    uint64_t sum = 0;
+};
+
+static Tally tally;
+
+static void xorData(Byte *data, size_t sz) {
+    for (size_t i = 0; i < sz; i++)
+        data[i] ^= 0x5a;
+}
+
+class TestPeer : public FoxServerPeer {
+    DEF_FOXNET_PACKET(C2S_FIXED)
+    DEF_FOXNET_VAR_PACKET(C2S_VAR)
+
+public:
+    uint32_t seq = 0;
+
+    TestPeer() {
+        INIT_FOXNET_PACKET(C2S_FIXED, sizeof(uint32_t))
+        INIT_FOXNET_VAR_PACKET(C2S_VAR)
+    }
+
+    void onSend(Byte *data, size_t sz) {
+        xorData(data, sz);
+    }
+
+    void onRecv(Byte *data, size_t sz) {
+        xorData(data, sz);
+    }
+};
+
+DECLARE_FOXNET_PACKET(C2S_FIXED, TestPeer) {
+    TestPeer *p = (TestPeer*)peer;
+    uint32_t s;
+
+    peer->readInt(s);
+    if (s != p->seq)
+        tally.bad++;
+
+    tally.fixed++;
+    tally.sum += s;
+}
+
+DECLARE_FOXNET_VAR_PACKET(C2S_VAR, TestPeer) {
+    TestPeer *p = (TestPeer*)peer;
+    Byte b;
+
+    if (varSize != p->seq % 5)
+        tally.bad++;
+
+    for (PktSize i = 0; i < varSize; i++) {
+        peer->readByte(b);
+        if (b != (Byte)(p->seq + i))
+            tally.bad++;
+        tally.sum += b;
+    }
+
+    tally.var++;
+    p->seq++;
+}
+
+class TestServer : public FoxServer<TestPeer> {
+public:
+    TestServer(): FoxServer<TestPeer>(TEST_PORT) {}
+
+    void onNewPeer(TestPeer *) {}
+    void onPeerDisconnect(TestPeer *) {}
+};
+
+class TestClient : public FoxClient {
+public:
+    void onSend(Byte *data, size_t sz) {
+        xorData(data, sz);
+    }
+
+    void onRecv(Byte *data, size_t sz) {
+        xorData(data, sz);
+    }
+};
+
+static void pump(TestServer &server, TestClient &client, const std::function<bool()> &done) {
+    for (int i = 0; i < 2000 && !done(); i++) {
+        server.pollPeers(1);
+        if (client.isAlive())
+            client.pollPeer(1);
+    }
+}
+
+int main() {
+    Tally live;
+
+    {
+        TestServer server;
+
+        server.startCapture(TEST_CAPTURE);
+
+        for (int c = 0; c < 2; c++) {
+            TestClient client;
+
+            client.connect("127.0.0.1", std::to_string(TEST_PORT));
+            pump(server, client, [&]() { return client.getHandshake(); });
+            FOXCHECK(client.getHandshake())
+
+            for (uint32_t s = 0; s < TEST_PACKETS; s++) {
+                client.writeByte(C2S_FIXED);
+                client.writeInt(s);
+                client.commitPacket();
+
+                size_t indx = client.prepareVarPacket(C2S_VAR);
+                for (uint32_t i = 0; i < s % 5; i++)
+                    client.writeByte((Byte)(s + i));
+                client.patchVarPacket(indx);
+
+                if (s % 100 == 0)
+                    client.pollPeer(0);
+            }
+
+            pump(server, client, [&]() { return tally.var == (c + 1) * TEST_PACKETS; });
+            client.kill();
+        }
+
+        // (writes out whatever is still buffered)
+        server.stopCapture();
+    }
+
+    FOXCHECK(tally.fixed == TEST_PACKETS * 2)
+    FOXCHECK(tally.var == TEST_PACKETS * 2)
+    FOXCHECK(tally.bad == 0)
+
+    live = tally;
+    tally = Tally();
+
+    FoxReplay<TestPeer> replay(TEST_CAPTURE);
+    FoxReplayStats stats = replay.replay();
+
+    FOXCHECK(stats.peers == 2)
+    FOXCHECK(stats.failedPeers == 0)
+    FOXCHECK(stats.records > 2)
+    FOXCHECK(tally.fixed == live.fixed)
+    FOXCHECK(tally.var == live.var)
+    FOXCHECK(tally.sum == live.sum)
+    FOXCHECK(tally.bad == 0)
+
+    return FOXTEST_RESULT();
+}
@@ -0,0 +1,112 @@
+#include "FoxClientGroup.hpp"
+#include "FoxServer.hpp"
+
+#include <chrono>
+#include <memory>
+#include <vector>
+
+#include "../FoxTest.hpp"
+
+/*
+ * connectAsync() to a hostname: a client blocked in pollPeer() is woken up as soon as its lookup is done, more clients
+ * than there are resolver threads in one group all get through, and a client destroyed while its lookup is still
+ * running doesn't get woken up after it's gone
+ */
+
+using namespace FoxNet;
+
+#define TEST_PORT 13398
+#define TEST_CLIENTS (FOXNET_RESOLVER_THREADS * 4)
+
+class TestServer : public FoxServer<FoxServerPeer> {
+public:
+    int peers = 0;
+
+    TestServer(): FoxServer<FoxServerPeer>(TEST_PORT) {}
+
+    void onNewPeer(FoxServerPeer *) {
+        peers++;
+    }
+
+    void onPeerDisconnect(FoxServerPeer *) {
+        peers--;
+    }
+};
+
+class TestClient : public FoxClient {
+public:
+    int *ready, *failed;
+
+    TestClient(int *r, int *f): ready(r), failed(f) {}
+
+    void onReady() {
+        (*ready)++;
+    }
+
+    void onConnectFailed() {
+        (*failed)++;
+    }
+};
+
+static void testWake(TestServer &server) {
+    int ready = 0, failed = 0;
+    TestClient client(&ready, &failed);
+    auto start = std::chrono::steady_clock::now();
+
+    // nothing else wakes the poll, without the resolver's wake it'd sleep until the connect timed out
+    client.connectAsync("localhost", std::to_string(TEST_PORT));
+    for (int i = 0; i < 10 && client.isConnecting(); i++)
+        client.pollPeer(-1);
+
+    FOXCHECK(client.isAlive())
+    FOXCHECK(std::chrono::steady_clock::now() - start < std::chrono::milliseconds(FOXNET_CONNECT_TIMEOUT / 2))
+
+    for (int i = 0; i < 1000 && ready == 0 && client.isAlive(); i++) {
+        server.pollPeers(1);
+        client.pollPeer(1);
+    }
+    FOXCHECK(ready == 1)
+    FOXCHECK(failed == 0)
+
+    client.kill();
+    for (int i = 0; i < 100 && server.peers > 0; i++)
+        server.pollPeers(1);
+}
+
+int main() {
+    TestServer server;
+    FoxClientGroup group;
+    std::vector<std::unique_ptr<TestClient>> clients;
+    int ready = 0, failed = 0;
+
+    testWake(server);
+
+    for (int i = 0; i < TEST_CLIENTS; i++) {
+        clients.emplace_back(new TestClient(&ready, &failed));
+        group.addClient(clients.back().get());
+        clients.back()->connectAsync("localhost", std::to_string(TEST_PORT));
+    }
+
+    // these go away before their lookups are done
+    for (int i = 0; i < TEST_CLIENTS; i++) {
+        TestClient gone(&ready, &failed);
+
+        gone.connectAsync("localhost", std::to_string(TEST_PORT));
+    }
+
+    for (int i = 0; i < 5000 && ready + failed < TEST_CLIENTS; i++) {
+        group.pollClients(1);
+        server.pollPeers(1);
+    }
+
+    FOXCHECK(ready == TEST_CLIENTS)
+    FOXCHECK(failed == 0)
+    FOXCHECK(server.peers == TEST_CLIENTS)
+
+    for (std::unique_ptr<TestClient> &client : clients) {
+        FOXCHECK(client->isAlive())
+        group.rmvClient(client.get());
+    }
+
+    return FOXTEST_RESULT();
+}
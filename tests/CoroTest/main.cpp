@@ -0,0 +1,175 @@
+#include "FoxCoro.hpp"
+#include "FoxServer.hpp"
+
+#include <thread>
+
+#include "../FoxTest.hpp"
+
+/*
+ * FoxTask round trips against a loopback server, a coroutine whose peer is killed under it, and frames finishing
+ * on a thread other than the one that made them (or after their thread's pool is gone)
+ */
+
+using namespace FoxNet;
+
+#define TEST_PORT 13390
+
+enum {
+    C2S_REQ_ADD = PKTID_USER_PACKET_START,
+    S2C_NUM_RESPONSE,
+    C2S_NEVER_SENT
+};
+
+class TestPeer : public FoxServerPeer {
+    DEF_FOXNET_PACKET(C2S_REQ_ADD)
+
+public:
+    TestPeer() {
+        INIT_FOXNET_PACKET(C2S_REQ_ADD, sizeof(uint32_t) * 2)
+        registerPacket(C2S_NEVER_SENT, 0);
+    }
+};
+
+DECLARE_FOXNET_PACKET(C2S_REQ_ADD, TestPeer) {
+    uint32_t a, b;
+
+    peer->readInt(a);
+    peer->readInt(b);
+
+    peer->writeByte(S2C_NUM_RESPONSE);
+    peer->writeInt(a + b);
+}
+
+static int serverSessions = 0;
+static bool serverSessionFailed = false;
+
+// waits on a packet the client never sends, so it's still suspended when the client disconnects
+static FoxTask serverSession(TestPeer *peer) {
+    serverSessions++;
+
+    try {
+        co_await FoxNet::recv(*peer, C2S_NEVER_SENT);
+    } catch(FoxException &) {
+        serverSessionFailed = true;
+    }
+}
+
+// lets the killed peer's exception escape, the server has to survive it
+static FoxTask serverSessionUncaught(TestPeer *peer) {
+    co_await FoxNet::recv(*peer, C2S_NEVER_SENT);
+}
+
+class TestServer : public FoxServer<TestPeer> {
+public:
+    TestServer(): FoxServer<TestPeer>(TEST_PORT) {}
+
+    void onNewPeer(TestPeer *peer) {
+        spawn(serverSession, peer);
+        spawn(serverSessionUncaught, peer);
+    }
+
+    void onPeerDisconnect(TestPeer *) {}
+};
+
+class TestClient : public FoxClient {
+public:
+    TestClient() {
+        registerPacket(S2C_NUM_RESPONSE, sizeof(uint32_t));
+    }
+};
+
+static int sums = 0;
+static bool clientDone = false;
+
+static FoxTask clientSession(TestClient *client) {
+    co_await FoxNet::connect(*client, "127.0.0.1", std::to_string(TEST_PORT));
+
+    for (uint32_t i = 0; i < 3; i++) {
+        uint32_t sum;
+
+        client->writeByte(C2S_REQ_ADD);
+        client->writeInt<uint32_t>(i);
+        client->writeInt<uint32_t>(100);
+        co_await FoxNet::flush(*client);
+
+        co_await FoxNet::recv(*client, S2C_NUM_RESPONSE);
+        client->readInt(sum);
+        FOXCHECK(sum == i + 100)
+        sums++;
+    }
+
+    clientDone = true;
+}
+
+static int orphansFailed = 0;
+
+// waits on a client that never connects, cancelWaiters() is what wakes it
+static FoxTask orphanSession(TestClient *client) {
+    try {
+        co_await FoxNet::recv(*client, S2C_NUM_RESPONSE);
+    } catch(FoxException &) {
+        orphansFailed++;
+    }
+}
+
+// destroyed after the thread's frame pool if it was made before it
+struct OrphanReaper {
+    TestClient *client = nullptr;
+
+    ~OrphanReaper() {
+        if (client != nullptr)
+            client->cancelWaiters();
+    }
+};
+
+static thread_local OrphanReaper reaper;
+
+static void testRoundTrip() {
+    TestServer server;
+    TestClient *client = new TestClient();
+
+    spawn(clientSession, client);
+    for (int i = 0; i < 500 && !clientDone; i++) {
+        server.pollPeers(1);
+        client->pollPeer(1);
+    }
+
+    FOXCHECK(clientDone)
+    FOXCHECK(sums == 3)
+    FOXCHECK(serverSessions == 1)
+
+    // the server's coroutines are still waiting on the peer, dropping the connection fails them
+    delete client;
+    for (int i = 0; i < 500 && server.getPeerList().size() > 0; i++)
+        server.pollPeers(1);
+
+    FOXCHECK(server.getPeerList().size() == 0)
+    FOXCHECK(serverSessionFailed)
+}
+
+static void testCrossThread() {
+    TestClient client, lateClient;
+
+    // made on another thread, finished on this one
+    std::thread([&client]() {
+        spawn(orphanSession, &client);
+    }).join();
+
+    client.cancelWaiters();
+    FOXCHECK(orphansFailed == 1)
+
+    // finished while its thread is being torn down, after the thread's pool is gone
+    std::thread([&lateClient]() {
+        reaper.client = &lateClient;
+        spawn(orphanSession, &lateClient);
+    }).join();
+
+    FOXCHECK(orphansFailed == 2)
+}
+
+int main() {
+    testRoundTrip();
+    testCrossThread();
+
+    return FOXTEST_RESULT();
+}
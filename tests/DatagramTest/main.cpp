@@ -0,0 +1,191 @@
+#include "FoxClient.hpp"
+#include "FoxServer.hpp"
+
+#include <functional>
+
+#include "../FoxTest.hpp"
+
+/*
+ * The datagram channel against a loopback server: the offer, hello & ack bring it up, sequenced packets go both ways
+ * over it without ever going back in time, reliable ids sent over it are ignored, and a client that didn't take the
+ * offer gets the datagram lane over the stream instead
+ */
+
+using namespace FoxNet;
+
+#define TEST_PORT 13396
+#define TEST_PACKETS 200
+
+enum {
+    PKT_POSITION = PKTID_USER_PACKET_START, // uint32_t (seq), sequenced. the server echoes it on the datagram lane
+    C2S_RELIABLE, // uint32_t, only allowed over the stream
+};
+
+// counts the packets of one side, sequenced packets must never arrive older than the newest one
+struct Received {
+    int positions = 0, stale = 0;
+    int64_t last = -1;
+
+    void position(FoxPeer *peer) {
+        uint32_t seq;
+
+        peer->readInt(seq);
+        if ((int64_t)seq <= last)
+            stale++;
+
+        last = seq;
+        positions++;
+    }
+};
+
+class TestPeer : public FoxServerPeer {
+    DEF_FOXNET_PACKET(PKT_POSITION)
+    DEF_FOXNET_PACKET(C2S_RELIABLE)
+
+public:
+    Received received;
+    int reliable = 0;
+
+    TestPeer() {
+        INIT_FOXNET_PACKET(PKT_POSITION, sizeof(uint32_t))
+        INIT_FOXNET_PACKET(C2S_RELIABLE, sizeof(uint32_t))
+        setPacketDelivery(PKT_POSITION, PKTDELIVERY_SEQUENCED);
+    }
+};
+
+DECLARE_FOXNET_PACKET(PKT_POSITION, TestPeer) {
+    TestPeer *p = (TestPeer*)peer;
+
+    p->received.position(peer);
+
+    PktLane prev = peer->setLane(PKTLANE_DATAGRAM);
+    peer->writeByte(PKT_POSITION);
+    peer->writeInt<uint32_t>((uint32_t)p->received.last);
+    peer->setLane(prev);
+}
+
+DECLARE_FOXNET_PACKET(C2S_RELIABLE, TestPeer) {
+    uint32_t val;
+
+    peer->readInt(val);
+    ((TestPeer*)peer)->reliable++;
+}
+
+class TestServer : public FoxServer<TestPeer> {
+public:
+    TestPeer *peer = nullptr;
+
+    TestServer(): FoxServer<TestPeer>(TEST_PORT) {
+        enableDatagrams();
+    }
+
+    void onNewPeer(TestPeer *p) {
+        peer = p;
+    }
+
+    void onPeerDisconnect(TestPeer *p) {
+        if (p == peer)
+            peer = nullptr;
+    }
+};
+
+class TestClient : public FoxClient {
+    DEF_FOXNET_PACKET(PKT_POSITION)
+
+public:
+    Received received;
+
+    TestClient() {
+        INIT_FOXNET_PACKET(PKT_POSITION, sizeof(uint32_t))
+        setPacketDelivery(PKT_POSITION, PKTDELIVERY_SEQUENCED);
+    }
+
+    void send(PktID id, uint32_t val) {
+        PktLane prev = setLane(PKTLANE_DATAGRAM);
+        writeByte(id);
+        writeInt(val);
+        setLane(prev);
+    }
+};
+
+DECLARE_FOXNET_PACKET(PKT_POSITION, TestClient) {
+    ((TestClient*)peer)->received.position(peer);
+}
+
+static void pump(TestServer &server, TestClient &client, const std::function<bool()> &done, int rounds = 1000) {
+    for (int i = 0; i < rounds && !done(); i++) {
+        server.pollPeers(1);
+        if (client.isAlive())
+            client.pollPeer(1);
+    }
+}
+
+static void testChannel(TestServer &server) {
+    TestClient client;
+
+    client.enableDatagrams();
+    client.connect("127.0.0.1", std::to_string(TEST_PORT));
+    pump(server, client, [&]() {
+        return client.isDatagramReady() && server.peer != nullptr && server.peer->isDatagramReady();
+    });
+    FOXCHECK(client.isDatagramReady())
+    FOXCHECK(server.peer != nullptr && server.peer->isDatagramReady())
+    if (server.peer == nullptr)
+        return;
+
+    for (uint32_t seq = 0; seq < TEST_PACKETS; seq++) {
+        client.send(PKT_POSITION, seq);
+        if (seq % 10 == 0) {
+            client.pollPeer(0);
+            server.pollPeers(0);
+        }
+    }
+
+    // a datagram can always get lost, but loopback doesn't lose much
+    pump(server, client, [&]() { return client.received.last == TEST_PACKETS - 1; });
+    FOXCHECK(server.peer->received.positions > TEST_PACKETS / 2)
+    FOXCHECK(server.peer->received.stale == 0)
+    FOXCHECK(client.received.positions > TEST_PACKETS / 2)
+    FOXCHECK(client.received.stale == 0)
+
+    // a reliable id is never taken from a datagram, whoever sent it
+    client.send(C2S_RELIABLE, 1);
+    client.writeByte(C2S_RELIABLE);
+    client.writeInt<uint32_t>(2);
+    pump(server, client, [&]() { return server.peer->reliable > 0; });
+    pump(server, client, [&]() { return false; }, 20);
+    FOXCHECK(server.peer->reliable == 1)
+
+    client.kill();
+    pump(server, client, [&]() { return server.peer == nullptr; });
+}
+
+static void testFallback(TestServer &server) {
+    TestClient client;
+
+    // the offer is never taken up, so the datagram lane goes over the stream
+    client.connect("127.0.0.1", std::to_string(TEST_PORT));
+    pump(server, client, [&]() { return client.getHandshake() && server.peer != nullptr; });
+    FOXCHECK(client.getHandshake())
+    FOXCHECK(!client.isDatagramReady())
+
+    for (uint32_t seq = 0; seq < TEST_PACKETS; seq++)
+        client.send(PKT_POSITION, seq);
+
+    pump(server, client, [&]() { return client.received.positions == TEST_PACKETS; });
+    FOXCHECK(server.peer != nullptr && server.peer->received.positions == TEST_PACKETS)
+    FOXCHECK(client.received.positions == TEST_PACKETS)
+    FOXCHECK(client.received.stale == 0)
+
+    client.kill();
+    pump(server, client, [&]() { return server.peer == nullptr; });
+}
+
+int main() {
+    TestServer server;
+
+    testChannel(server);
+    testFallback(server);
+
+    return FOXTEST_RESULT();
+}
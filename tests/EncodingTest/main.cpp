@@ -0,0 +1,195 @@
+#include "ByteStream.hpp"
+
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "../FoxTest.hpp"
+
+/*
+ * varint, zigzag & bit-packing round trips through ByteStream & ByteView (one at a time & in runs), and truncated
+ * or overlong input being turned down
+ */
+
+using namespace FoxNet;
+
+static std::vector<uint64_t> sampleValues() {
+    std::vector<uint64_t> vals = {0, 1, 127, 128, 16383, 16384, (1ull << 56) - 1, 1ull << 56, 1ull << 63, UINT64_MAX};
+    std::mt19937_64 rng(1);
+
+    // every length, small ones are the common case
+    for (int i = 0; i < 10000; i++)
+        vals.push_back(rng() >> (rng() % 64));
+
+    return vals;
+}
+
+static void testVarints() {
+    std::vector<uint64_t> vals = sampleValues();
+    std::vector<uint64_t> run(vals.size());
+    ByteStream stream;
+    uint64_t val;
+    bool ok = true;
+
+    for (uint64_t v : vals)
+        stream.writeVarint(v);
+
+    std::vector<Byte> encoded = stream.getOutBuffer();
+
+    // one at a time out of a ByteStream
+    stream.getInBuffer() = encoded;
+    for (uint64_t v : vals) {
+        if (!(ok = stream.readVarint(val) && val == v))
+            break;
+    }
+    FOXCHECK(ok)
+    FOXCHECK(stream.sizeIn() == 0)
+    FOXCHECK(!stream.readVarint(val))
+
+    // as a run out of a ByteView, and out of a ByteStream
+    ByteView view(encoded.data(), encoded.size());
+    FOXCHECK(view.readVarints(run.data(), run.size()))
+    FOXCHECK(run == vals)
+    FOXCHECK(view.sizeRemaining() == 0)
+
+    stream.getInBuffer() = encoded;
+    std::fill(run.begin(), run.end(), 0);
+    FOXCHECK(stream.readVarints(run.data(), run.size()))
+    FOXCHECK(run == vals)
+
+    // a run that's one byte short reads nothing
+    ByteView shortView(encoded.data(), encoded.size() - 1);
+    FOXCHECK(!shortView.readVarints(run.data(), run.size()))
+    FOXCHECK(shortView.sizeRemaining() == encoded.size() - 1)
+}
+
+static void testMalformedVarints() {
+    Byte buf[16];
+    uint64_t val;
+    size_t sz = encodeVarint(buf, UINT64_MAX);
+
+    FOXCHECK(sz == 10)
+    FOXCHECK(decodeVarint(buf, sz, val) == sz && val == UINT64_MAX)
+
+    // cut short anywhere
+    for (size_t avail = 0; avail < sz; avail++)
+        FOXCHECK(decodeVarint(buf, avail, val) == 0)
+
+    // more than 64 bits, and longer than 10 bytes
+    memset(buf, 0xFF, sizeof(buf));
+    buf[9] = 0x02;
+    FOXCHECK(decodeVarint(buf, sizeof(buf), val) == 0)
+
+    memset(buf, 0x80, sizeof(buf));
+    FOXCHECK(decodeVarint(buf, sizeof(buf), val) == 0)
+
+    ByteView view(buf, sizeof(buf));
+    FOXCHECK(!view.readVarint(val))
+    FOXCHECK(view.sizeRemaining() == sizeof(buf))
+}
+
+static void testZigzag() {
+    std::vector<int64_t> vals = {0, -1, 1, -2, 2, -64, 63, -1000000, INT64_MIN, INT64_MAX};
+    ByteStream stream;
+    int64_t val;
+
+    FOXCHECK(zigzagEncode(0) == 0)
+    FOXCHECK(zigzagEncode(-1) == 1)
+    FOXCHECK(zigzagEncode(1) == 2)
+    FOXCHECK(zigzagEncode(INT64_MIN) == UINT64_MAX)
+
+    for (int64_t v : vals) {
+        FOXCHECK(zigzagDecode(zigzagEncode(v)) == v)
+        stream.writeSignedVarint(v);
+    }
+
+    // small magnitudes stay a byte either way
+    FOXCHECK(stream.sizeOut() < vals.size() * 10)
+
+    stream.getInBuffer() = stream.getOutBuffer();
+    for (int64_t v : vals) {
+        FOXCHECK(stream.readSignedVarint(val) && val == v)
+    }
+    FOXCHECK(!stream.readSignedVarint(val))
+}
+
+static void testBits() {
+    std::vector<std::pair<uint64_t, int>> vals;
+    std::mt19937_64 rng(2);
+    ByteStream stream;
+
+    {
+        BitWriter writer(stream);
+
+        for (int i = 0; i < 5000; i++) {
+            int width = 1 + (int)(rng() % 64);
+            uint64_t val = rng();
+
+            if (width < 64)
+                val &= (1ull << width) - 1;
+
+            vals.push_back({val, width});
+            writer.write(val, width);
+        }
+
+        writer.writeFloat(0.3f, -1.0f, 1.0f, 12);
+        writer.writeBool(true);
+    }
+
+    std::vector<Byte> packed = stream.getOutBuffer();
+
+    // out of a ByteView
+    {
+        ByteView view(packed.data(), packed.size());
+        BitReader reader(view);
+        uint64_t val;
+        float f;
+        bool b, ok = true;
+
+        for (auto &v : vals) {
+            if (!(ok = reader.read(val, v.second) && val == v.first))
+                break;
+        }
+        FOXCHECK(ok)
+
+        FOXCHECK(reader.readFloat(f, -1.0f, 1.0f, 12) && std::fabs(f - 0.3f) <= 2.0f / 4095)
+        FOXCHECK(reader.readBool(b) && b)
+
+        // past the padding of the last byte
+        FOXCHECK(!reader.read(val, 8))
+    }
+
+    // out of a ByteStream
+    {
+        BitReader reader(stream);
+        uint64_t val;
+
+        stream.getInBuffer() = packed;
+        FOXCHECK(reader.read(val, vals[0].second) && val == vals[0].first)
+    }
+
+    // cut short, the last value can't be read
+    {
+        ByteView view(packed.data(), packed.size() / 2);
+        BitReader reader(view);
+        uint64_t val;
+        bool ok = true;
+
+        for (auto &v : vals) {
+            if (!(ok = reader.read(val, v.second)))
+                break;
+        }
+
+        FOXCHECK(!ok)
+    }
+}
+
+int main() {
+    testVarints();
+    testMalformedVarints();
+    testZigzag();
+    testBits();
+
+    return FOXTEST_RESULT();
+}
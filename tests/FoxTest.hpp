@@ -0,0 +1,18 @@
+#pragma once
+
+#include <iostream>
+
+/*
+ * Bare bones checks for the FoxNet tests, each test is its own executable. a failed check is printed and the test
+ * keeps going, main() returns FOXTEST_RESULT() so ctest sees the failure
+ */
+
+inline int foxTestFailures = 0;
+
+#define FOXCHECK(x) \
+    if (!(x)) { \
+        std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: " #x << std::endl; \
+        foxTestFailures++; \
+    }
+
+#define FOXTEST_RESULT() (foxTestFailures == 0 ? 0 : 1)
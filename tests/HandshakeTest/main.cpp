@@ -0,0 +1,116 @@
+#include "FoxClient.hpp"
+#include "FoxServer.hpp"
+#include "FoxPipe.hpp"
+
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <vector>
+
+#include "../FoxTest.hpp"
+
+/*
+ * Handshakes over a FoxPipe with everything xored in onSend()/onRecv(): a matching version gets through, and a
+ * client claiming another major version gets a refusal it can read (it went through the server's onSend() like
+ * everything else) before it's dropped
+ */
+
+using namespace FoxNet;
+
+static void xorData(Byte *data, size_t sz) {
+    for (size_t i = 0; i < sz; i++)
+        data[i] ^= 0x5a;
+}
+
+class TestPeer : public FoxServerPeer {
+public:
+    void onSend(Byte *data, size_t sz) {
+        xorData(data, sz);
+    }
+
+    void onRecv(Byte *data, size_t sz) {
+        xorData(data, sz);
+    }
+};
+
+class TestServer : public FoxServer<TestPeer> {
+public:
+    int disconnects = 0;
+
+    void onNewPeer(TestPeer *) {}
+
+    void onPeerDisconnect(TestPeer *) {
+        disconnects++;
+    }
+};
+
+class TestClient : public FoxClient {
+public:
+    bool wrongMajor;
+    bool sent = false;
+    std::vector<Byte> received; // everything we got, after onRecv()
+
+    TestClient(bool wrong): wrongMajor(wrong) {}
+
+    void onSend(Byte *data, size_t sz) {
+        // the request leads our first send, its major version is right after the magic
+        if (wrongMajor && !sent && sz > sizeof(PktID) + FOXMAGICLEN)
+            data[sizeof(PktID) + FOXMAGICLEN]++;
+
+        sent = true;
+        xorData(data, sz);
+    }
+
+    void onRecv(Byte *data, size_t sz) {
+        xorData(data, sz);
+        received.insert(received.end(), data, data + sz);
+    }
+};
+
+static void pump(TestServer &server, TestClient &client, const std::function<bool()> &done) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+
+    while (!done() && std::chrono::steady_clock::now() < deadline) {
+        server.pollPeers(0);
+        if (client.isAlive())
+            client.pollPeer(1);
+    }
+}
+
+static void testHandshake(bool wrongMajor) {
+    TestServer server;
+    TestClient client(wrongMajor);
+    auto pipe = FoxPipe::create(FoxPipeOptions());
+
+    server.acceptTransport(pipe.first);
+    client.connectTransport(pipe.second);
+
+    if (!wrongMajor) {
+        pump(server, client, [&]() { return client.getHandshake(); });
+        FOXCHECK(client.getHandshake())
+        FOXCHECK(client.isAlive())
+        FOXCHECK(server.disconnects == 0)
+        return;
+    }
+
+    pump(server, client, [&]() { return !client.isAlive() && server.disconnects > 0; });
+    FOXCHECK(!client.isAlive())
+    FOXCHECK(!client.getHandshake())
+    FOXCHECK(server.disconnects == 1)
+
+    // PKTID_HANDSHAKE_RES, our magic echoed back & the refusal
+    std::vector<Byte> &res = client.received;
+    FOXCHECK(res.size() >= sizeof(PktID) + FOXMAGICLEN + 1)
+    if (res.size() >= sizeof(PktID) + FOXMAGICLEN + 1) {
+        FOXCHECK(res[0] == PKTID_HANDSHAKE_RES)
+        FOXCHECK(memcmp(res.data() + sizeof(PktID), FOXMAGIC, FOXMAGICLEN) == 0)
+        FOXCHECK(res[sizeof(PktID) + FOXMAGICLEN] == 0)
+    }
+}
+
+int main() {
+    testHandshake(false);
+    testHandshake(true);
+
+    return FOXTEST_RESULT();
+}
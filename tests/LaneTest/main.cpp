@@ -0,0 +1,185 @@
+#include "FoxClient.hpp"
+#include "FoxServer.hpp"
+
+#include <functional>
+
+#include "../FoxTest.hpp"
+
+/*
+ * Packets queued on every lane at once against a loopback server: the control lane goes out first, the realtime &
+ * bulk lanes share the connection by weight without starving each other, and each lane keeps its own order. both
+ * ends run a keystream through onSend()/onRecv(), so it only decodes if onSend() sees the bytes in wire order
+ */
+
+using namespace FoxNet;
+
+#define TEST_PORT 13392
+#define TEST_PACKETS 400
+#define TEST_BODY 1000
+
+enum {
+    C2S_START = PKTID_USER_PACKET_START, // uint16_t (bulk share)
+    S2C_PACKET, // (var) uint8_t (lane) & uint32_t (seq) follows, then filler bytes
+};
+
+// every byte gets a different key, depending on how many came before it
+class KeyStream {
+    Byte key = 0x5a;
+
+public:
+    void apply(Byte *data, size_t sz) {
+        for (size_t i = 0; i < sz; i++) {
+            data[i] ^= key;
+            key = (Byte)(key * 5 + 1);
+        }
+    }
+};
+
+class TestPeer : public FoxServerPeer {
+    DEF_FOXNET_PACKET(C2S_START)
+
+    KeyStream sendKeys, recvKeys;
+
+public:
+    TestPeer() {
+        INIT_FOXNET_PACKET(C2S_START, sizeof(uint16_t))
+    }
+
+    void onSend(Byte *data, size_t sz) {
+        sendKeys.apply(data, sz);
+    }
+
+    void onRecv(Byte *data, size_t sz) {
+        recvKeys.apply(data, sz);
+    }
+
+    void queue(PktLane lane, uint32_t seq) {
+        Byte filler[TEST_BODY] = {0};
+
+        setLane(lane);
+        size_t indx = prepareVarPacket(S2C_PACKET);
+        writeByte(lane);
+        writeInt<uint32_t>(seq);
+        writeBytes(filler, sizeof(filler));
+        patchVarPacket(indx);
+    }
+};
+
+// everything is queued before anything is flushed, so the order on the wire is all up to the scheduler
+DECLARE_FOXNET_PACKET(C2S_START, TestPeer) {
+    TestPeer *p = (TestPeer*)peer;
+    uint16_t share;
+
+    peer->readInt(share);
+    p->setLaneShare(PKTLANE_BULK, share);
+
+    for (uint32_t i = 0; i < TEST_PACKETS; i++)
+        p->queue(PKTLANE_BULK, i);
+    for (uint32_t i = 0; i < TEST_PACKETS; i++)
+        p->queue(PKTLANE_REALTIME, i);
+    p->queue(PKTLANE_CONTROL, 0);
+
+    p->setLane(PKTLANE_REALTIME);
+}
+
+class TestServer : public FoxServer<TestPeer> {
+public:
+    TestServer(): FoxServer<TestPeer>(TEST_PORT) {}
+
+    void onNewPeer(TestPeer *) {}
+    void onPeerDisconnect(TestPeer *) {}
+};
+
+class TestClient : public FoxClient {
+    DEF_FOXNET_VAR_PACKET(S2C_PACKET)
+
+    KeyStream sendKeys, recvKeys;
+
+public:
+    uint32_t seq[PKTLANE_MAX] = {0};
+    int got = 0, bad = 0;
+    int controlAt = -1; // packets received before the control packet
+    int bulkAtRealtimeEnd = -1; // bulk packets received before the last realtime packet
+
+    uint16_t bulkShare;
+
+    TestClient(uint16_t share): bulkShare(share) {
+        INIT_FOXNET_VAR_PACKET(S2C_PACKET)
+    }
+
+    void onReady() {
+        writeByte(C2S_START);
+        writeInt<uint16_t>(bulkShare);
+    }
+
+    void onSend(Byte *data, size_t sz) {
+        sendKeys.apply(data, sz);
+    }
+
+    void onRecv(Byte *data, size_t sz) {
+        recvKeys.apply(data, sz);
+    }
+};
+
+DECLARE_FOXNET_VAR_PACKET(S2C_PACKET, TestClient) {
+    TestClient *c = (TestClient*)peer;
+    Byte lane, filler[TEST_BODY];
+    uint32_t s;
+
+    if (varSize != sizeof(Byte) + sizeof(uint32_t) + TEST_BODY) {
+        c->bad++;
+        return;
+    }
+
+    peer->readByte(lane);
+    peer->readInt(s);
+    peer->readBytes(filler, sizeof(filler));
+
+    if (lane >= PKTLANE_MAX || s != c->seq[lane]++) {
+        c->bad++;
+        return;
+    }
+
+    if (lane == PKTLANE_CONTROL)
+        c->controlAt = c->got;
+    if (lane == PKTLANE_REALTIME && s == TEST_PACKETS - 1)
+        c->bulkAtRealtimeEnd = c->seq[PKTLANE_BULK];
+
+    c->got++;
+}
+
+static void pump(TestServer &server, TestClient &client, const std::function<bool()> &done) {
+    for (int i = 0; i < 5000 && !done() && client.isAlive(); i++) {
+        server.pollPeers(1);
+        client.pollPeer(1);
+    }
+}
+
+static void testShares(TestServer &server, uint16_t bulkShare, int minBulk, int maxBulk) {
+    TestClient client(bulkShare);
+
+    client.connect("127.0.0.1", std::to_string(TEST_PORT));
+    pump(server, client, [&]() { return client.got == TEST_PACKETS * 2 + 1; });
+
+    FOXCHECK(client.getHandshake())
+    FOXCHECK(client.got == TEST_PACKETS * 2 + 1)
+    FOXCHECK(client.bad == 0)
+    FOXCHECK(client.controlAt == 0)
+
+    // with the default shares the realtime lane gets 8x the bandwidth, so it's done long before the bulk lane,
+    // but the bulk lane still made progress in the meantime
+    FOXCHECK(client.bulkAtRealtimeEnd >= minBulk && client.bulkAtRealtimeEnd <= maxBulk)
+
+    client.kill();
+}
+
+int main() {
+    TestServer server;
+
+    testShares(server, FOXNET_LANE_SHARE_BULK, TEST_PACKETS / 16, TEST_PACKETS / 4);
+
+    // equal shares take turns
+    testShares(server, FOXNET_LANE_SHARE_REALTIME, TEST_PACKETS - 2, TEST_PACKETS);
+
+    return FOXTEST_RESULT();
+}
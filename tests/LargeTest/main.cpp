@@ -0,0 +1,222 @@
+#include "FoxClient.hpp"
+#include "FoxServer.hpp"
+
+#include <cerrno>
+#include <cstdio>
+#include <functional>
+#include <map>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#endif
+
+#include "../FoxTest.hpp"
+
+/*
+ * Large sends against a loopback server: file ranges (sendfile()) & buffers (MSG_ZEROCOPY, done once their
+ * completions come back on the error queue) arrive intact next to regular packets, a socket out of zerocopy room
+ * falls back to copying, and discarded sends fire as not sent
+ */
+
+using namespace FoxNet;
+
+#define TEST_PORT 13399
+#define TEST_FILE "large-test.bin"
+#define TEST_FILE_SIZE (3 * 1024 * 1024 + 17)
+#define TEST_BUFFER_SIZE (2 * 1024 * 1024 + 123)
+
+enum {
+    C2S_ECHO = PKTID_USER_PACKET_START, // uint32_t (seq)
+    C2S_FILE, // large, pattern(offset in the file)
+    C2S_BUFFER, // large, pattern(offset in the buffer)
+};
+
+static Byte pattern(uint64_t i, PktID id) {
+    return (Byte)(i * 7 + i / 251 + id);
+}
+
+#if defined(__linux__) && defined(MSG_ZEROCOPY)
+// while set, MSG_ZEROCOPY sends fail like on a socket that already pinned as many pages as it's allowed to
+static bool zeroCopyFull = false;
+static int zeroCopySends = 0, zeroCopyRefused = 0;
+
+extern "C" ssize_t send(int sock, const void *buf, size_t len, int flags) {
+    if (flags & MSG_ZEROCOPY) {
+        zeroCopySends++;
+
+        if (zeroCopyFull) {
+            zeroCopyRefused++;
+            errno = ENOBUFS;
+            return -1;
+        }
+    }
+
+    return syscall(SYS_sendto, sock, buf, len, flags, nullptr, 0);
+}
+#endif
+
+class TestPeer : public FoxServerPeer {
+    DEF_FOXNET_PACKET(C2S_ECHO)
+
+public:
+    std::map<std::pair<PktID, uint32_t>, uint32_t> next; // next offset of each (id, total) in flight
+    int done = 0, bad = 0;
+    uint32_t echoes = 0;
+    uint32_t fileBase = 0; // where the file range being sent starts
+
+    TestPeer() {
+        INIT_FOXNET_PACKET(C2S_ECHO, sizeof(uint32_t))
+    }
+
+    void onLargePacket(PktID id, uint32_t offset, uint32_t total, ByteView data) {
+        uint32_t &at = next[{id, total}];
+        uint64_t base = id == C2S_FILE ? fileBase : 0;
+
+        if (offset != at)
+            bad++;
+
+        for (size_t i = 0; i < data.getSize(); i++) {
+            if (data.getData()[i] != pattern(base + offset + i, id)) {
+                bad++;
+                break;
+            }
+        }
+
+        at = offset + data.getSize();
+        if (at == total) {
+            next.erase({id, total});
+            done++;
+        }
+    }
+};
+
+DECLARE_FOXNET_PACKET(C2S_ECHO, TestPeer) {
+    TestPeer *p = (TestPeer*)peer;
+    uint32_t seq;
+
+    peer->readInt(seq);
+    if (seq != p->echoes++)
+        p->bad++;
+}
+
+class TestServer : public FoxServer<TestPeer> {
+public:
+    TestPeer *peer = nullptr;
+
+    TestServer(): FoxServer<TestPeer>(TEST_PORT) {}
+
+    void onNewPeer(TestPeer *p) {
+        peer = p;
+    }
+
+    void onPeerDisconnect(TestPeer *p) {
+        if (p == peer)
+            peer = nullptr;
+    }
+};
+
+class TestClient : public FoxClient {
+public:
+    int callbacks = 0, sent = 0;
+
+    LargeSendCallback callback() {
+        return [this](FoxPeer *, bool wasSent) {
+            callbacks++;
+            sent += wasSent;
+        };
+    }
+};
+
+static void pump(TestServer &server, TestClient &client, const std::function<bool()> &done) {
+    for (int i = 0; i < 20000 && !done() && client.isAlive(); i++) {
+        server.pollPeers(0);
+        client.pollPeer(1);
+    }
+}
+
+int main() {
+    TestServer server;
+    TestClient client;
+    std::vector<Byte> file(TEST_FILE_SIZE), buffer(TEST_BUFFER_SIZE);
+    int fd;
+
+    for (size_t i = 0; i < file.size(); i++)
+        file[i] = pattern(i, C2S_FILE);
+    for (size_t i = 0; i < buffer.size(); i++)
+        buffer[i] = pattern(i, C2S_BUFFER);
+
+    FILE *out = fopen(TEST_FILE, "wb");
+    FOXCHECK(out != nullptr)
+    if (out == nullptr)
+        return FOXTEST_RESULT();
+    fwrite(file.data(), 1, file.size(), out);
+    fclose(out);
+
+    fd = ::open(TEST_FILE, O_RDONLY);
+    FOXCHECK(fd != -1)
+
+    client.connect("127.0.0.1", std::to_string(TEST_PORT));
+    pump(server, client, [&]() { return client.getHandshake() && server.peer != nullptr; });
+    FOXCHECK(server.peer != nullptr)
+    if (server.peer == nullptr)
+        return FOXTEST_RESULT();
+
+    // the whole file & a buffer on the bulk lane with regular packets going past them on the realtime lane
+    client.sendFile(C2S_FILE, fd, 0, TEST_FILE_SIZE, client.callback());
+    for (uint32_t seq = 0; seq < 200; seq++) {
+        client.writeByte(C2S_ECHO);
+        client.writeInt(seq);
+        client.commitPacket();
+
+        if (seq == 100)
+            client.sendZeroCopy(C2S_BUFFER, buffer.data(), TEST_BUFFER_SIZE, client.callback());
+    }
+
+    pump(server, client, [&]() { return server.peer->done == 2 && client.callbacks == 2; });
+    FOXCHECK(server.peer->done == 2)
+    FOXCHECK(server.peer->echoes == 200)
+    FOXCHECK(server.peer->bad == 0)
+    FOXCHECK(client.callbacks == 2 && client.sent == 2)
+
+    // a range out of the middle of the file
+    server.peer->fileBase = 1000;
+    client.sendFile(C2S_FILE, fd, 1000, 10000, client.callback(), PKTLANE_REALTIME);
+    pump(server, client, [&]() { return server.peer->done == 3 && client.callbacks == 3; });
+    FOXCHECK(server.peer->done == 3)
+    FOXCHECK(client.callbacks == 3 && client.sent == 3)
+
+#if defined(__linux__) && defined(MSG_ZEROCOPY)
+    // out of zerocopy room, every piece is copied instead (the socket might not do zerocopy at all, then there's
+    // nothing to refuse)
+    bool zeroCopy = zeroCopySends > 0;
+
+    zeroCopyFull = true;
+    client.sendZeroCopy(C2S_BUFFER, buffer.data(), TEST_BUFFER_SIZE, client.callback());
+    pump(server, client, [&]() { return server.peer->done == 4 && client.callbacks == 4; });
+    zeroCopyFull = false;
+
+    FOXCHECK(server.peer->done == 4)
+    FOXCHECK(server.peer->bad == 0)
+    FOXCHECK(client.callbacks == 4 && client.sent == 4)
+    FOXCHECK(!zeroCopy || zeroCopyRefused > 0)
+#endif
+
+    // dropped before any of it was sent
+    client.sendZeroCopy(C2S_BUFFER, buffer.data(), TEST_BUFFER_SIZE, client.callback());
+    int callbacks = client.callbacks, sent = client.sent;
+    client.discardOut();
+    FOXCHECK(client.callbacks == callbacks + 1 && client.sent == sent)
+    FOXCHECK(client.pendingOut() == 0)
+    FOXCHECK(client.isAlive())
+
+    client.kill();
+    ::close(fd);
+    ::unlink(TEST_FILE);
+
+    return FOXTEST_RESULT();
+}
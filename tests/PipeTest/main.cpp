@@ -0,0 +1,184 @@
+#include "FoxClient.hpp"
+#include "FoxMetrics.hpp"
+#include "FoxServer.hpp"
+#include "FoxPipe.hpp"
+
+#include <chrono>
+#include <functional>
+#include <vector>
+
+#include "../FoxTest.hpp"
+
+/*
+ * Packets echoed back over a FoxPipe, as is & with tiny reads/writes and capacity (so sends hit the POLLOUT path)
+ * or with latency & a bandwidth cap: everything arrives intact & in order, and a hang up reaches the other end
+ */
+
+using namespace FoxNet;
+
+#define TEST_PACKETS 5000
+#define TEST_BODY 3000
+
+enum {
+    PKT_ECHO = PKTID_USER_PACKET_START, // uint32_t (seq), echoed back
+    PKT_BLOB, // (var) TEST_BODY bytes derived from their offset, echoed back
+};
+
+class TestPeer : public FoxServerPeer {
+    DEF_FOXNET_PACKET(PKT_ECHO)
+    DEF_FOXNET_VAR_PACKET(PKT_BLOB)
+
+public:
+    TestPeer() {
+        INIT_FOXNET_PACKET(PKT_ECHO, sizeof(uint32_t))
+        INIT_FOXNET_VAR_PACKET(PKT_BLOB)
+    }
+};
+
+DECLARE_FOXNET_PACKET(PKT_ECHO, TestPeer) {
+    uint32_t seq;
+
+    peer->readInt(seq);
+    peer->writeByte(PKT_ECHO);
+    peer->writeInt(seq);
+}
+
+DECLARE_FOXNET_VAR_PACKET(PKT_BLOB, TestPeer) {
+    std::vector<Byte> body(varSize);
+
+    peer->readBytes(body.data(), body.size());
+    size_t indx = peer->prepareVarPacket(PKT_BLOB);
+    peer->writeBytes(body.data(), body.size());
+    peer->patchVarPacket(indx);
+}
+
+class TestServer : public FoxServer<TestPeer> {
+public:
+    int disconnects = 0;
+
+    void onNewPeer(TestPeer *) {}
+
+    void onPeerDisconnect(TestPeer *) {
+        disconnects++;
+    }
+};
+
+class TestClient : public FoxClient {
+    DEF_FOXNET_PACKET(PKT_ECHO)
+    DEF_FOXNET_VAR_PACKET(PKT_BLOB)
+
+public:
+    uint32_t echoes = 0;
+    int blobs = 0, bad = 0;
+
+    TestClient() {
+        INIT_FOXNET_PACKET(PKT_ECHO, sizeof(uint32_t))
+        INIT_FOXNET_VAR_PACKET(PKT_BLOB)
+    }
+};
+
+DECLARE_FOXNET_PACKET(PKT_ECHO, TestClient) {
+    TestClient *c = (TestClient*)peer;
+    uint32_t seq;
+
+    peer->readInt(seq);
+    if (seq != c->echoes++)
+        c->bad++;
+}
+
+DECLARE_FOXNET_VAR_PACKET(PKT_BLOB, TestClient) {
+    TestClient *c = (TestClient*)peer;
+    std::vector<Byte> body(varSize);
+
+    peer->readBytes(body.data(), body.size());
+    if (body.size() != TEST_BODY)
+        c->bad++;
+
+    for (size_t i = 0; i < body.size(); i++) {
+        if (body[i] != (Byte)i)
+            c->bad++;
+    }
+
+    c->blobs++;
+}
+
+static void pump(TestServer &server, TestClient &client, const std::function<bool()> &done) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+
+    while (!done() && std::chrono::steady_clock::now() < deadline) {
+        server.pollPeers(0);
+        if (client.isAlive())
+            client.pollPeer(1);
+    }
+}
+
+static void testEcho(const FoxPipeOptions &opts) {
+    TestServer server;
+    TestClient client;
+    std::vector<Byte> body(TEST_BODY);
+    auto pipe = FoxPipe::create(opts);
+
+    for (size_t i = 0; i < body.size(); i++)
+        body[i] = (Byte)i;
+
+#ifdef FOXNET_ENABLE_METRICS
+    FoxMetricsSnapshot before = FoxMetrics::snapshot();
+#endif
+
+    server.acceptTransport(pipe.first);
+    client.connectTransport(pipe.second);
+
+    for (uint32_t seq = 0; seq < TEST_PACKETS; seq++) {
+        client.writeByte(PKT_ECHO);
+        client.writeInt(seq);
+        client.commitPacket();
+
+        if (seq % 50 == 0) {
+            size_t indx = client.prepareVarPacket(PKT_BLOB);
+            client.writeBytes(body.data(), body.size());
+            client.patchVarPacket(indx);
+        }
+
+        if (seq % 100 == 0) {
+            client.pollPeer(0);
+            server.pollPeers(0);
+        }
+    }
+
+    pump(server, client, [&]() { return client.echoes == TEST_PACKETS && client.blobs == TEST_PACKETS / 50; });
+    FOXCHECK(client.getHandshake())
+    FOXCHECK(client.echoes == TEST_PACKETS)
+    FOXCHECK(client.blobs == TEST_PACKETS / 50)
+    FOXCHECK(client.bad == 0)
+
+#ifdef FOXNET_ENABLE_METRICS
+    // the echoes are fixed length packets, both ends count theirs
+    FoxMetricsSnapshot after = FoxMetrics::snapshot();
+    FOXCHECK(after.packetsOut[PKT_ECHO] - before.packetsOut[PKT_ECHO] == TEST_PACKETS * 2)
+    FOXCHECK(after.bytesOut[PKT_ECHO] - before.bytesOut[PKT_ECHO] ==
+        TEST_PACKETS * 2 * (sizeof(PktID) + sizeof(uint32_t)))
+#endif
+
+    // closing our end closes the pipe
+    client.kill();
+    pump(server, client, [&]() { return server.disconnects > 0; });
+    FOXCHECK(server.disconnects == 1)
+}
+
+int main() {
+    FoxPipeOptions opts;
+
+    testEcho(opts);
+
+    opts.capacity = 100;
+    opts.maxRead = 7;
+    opts.maxWrite = 13;
+    testEcho(opts);
+
+    FoxPipeOptions shaped;
+    shaped.latency = 2;
+    shaped.bandwidth = 64 * 1024 * 1024;
+    testEcho(shaped);
+
+    return FOXTEST_RESULT();
+}
@@ -0,0 +1,319 @@
+#include "FoxClient.hpp"
+#include "FoxServer.hpp"
+
+#include <functional>
+
+#include "../FoxTest.hpp"
+
+/*
+ * Sessions detached by a dropped connection & taken back over with their token against a loopback server: what
+ * was queued for the session is replayed in order (including what never made it out of our send buffer), what the
+ * client pipelined behind its handshake reaches the session, and a token only works once. a session that breaks the
+ * protocol is dropped for good instead of detached. everything is xored in onSend()/onRecv(), a kept packet that
+ * went through onSend() twice would come out garbled
+ */
+
+using namespace FoxNet;
+
+#define TEST_PORT 13391
+
+enum {
+    C2S_LOGIN = PKTID_USER_PACKET_START,
+    C2S_CHECK, // uint32_t (echoed back)
+    S2C_PUSH, // uint32_t (seq)
+    S2C_CHECK, // uint32_t (echoed) & uint8_t (is the session logged in)
+};
+
+static void xorData(Byte *data, size_t sz) {
+    for (size_t i = 0; i < sz; i++)
+        data[i] ^= 0x5a;
+}
+
+class TestPeer : public FoxServerPeer {
+    DEF_FOXNET_PACKET(C2S_LOGIN)
+    DEF_FOXNET_PACKET(C2S_CHECK)
+
+public:
+    bool loggedIn = false;
+
+    TestPeer() {
+        INIT_FOXNET_PACKET(C2S_LOGIN, 0)
+        INIT_FOXNET_PACKET(C2S_CHECK, sizeof(uint32_t))
+    }
+
+    void push(uint32_t seq) {
+        writeByte(S2C_PUSH);
+        writeInt<uint32_t>(seq);
+        commitPacket();
+    }
+
+    void onSend(Byte *data, size_t sz) {
+        xorData(data, sz);
+    }
+
+    void onRecv(Byte *data, size_t sz) {
+        xorData(data, sz);
+    }
+};
+
+DECLARE_FOXNET_PACKET(C2S_LOGIN, TestPeer) {
+    ((TestPeer*)peer)->loggedIn = true;
+}
+
+DECLARE_FOXNET_PACKET(C2S_CHECK, TestPeer) {
+    uint32_t val;
+
+    peer->readInt(val);
+    peer->writeByte(S2C_CHECK);
+    peer->writeInt<uint32_t>(val);
+    peer->writeByte(((TestPeer*)peer)->loggedIn);
+}
+
+class TestServer : public FoxServer<TestPeer> {
+public:
+    bool integrity;
+    TestPeer *peer = nullptr; // the newest (or newest resumed) session
+    int detached = 0, resumed = 0, disconnected = 0;
+
+    TestServer(bool i): FoxServer<TestPeer>(TEST_PORT), integrity(i) {
+        enableResumption(2000, 4);
+    }
+
+    void onNewPeer(TestPeer *p) {
+        peer = p;
+        p->setIntegrity(integrity);
+    }
+
+    void onPeerDisconnect(TestPeer *p) {
+        disconnected++;
+        if (p == peer)
+            peer = nullptr;
+    }
+
+    void onPeerDetached(TestPeer *) {
+        detached++;
+    }
+
+    void onPeerResumed(TestPeer *p) {
+        resumed++;
+        peer = p;
+    }
+};
+
+class TestClient : public FoxClient {
+    DEF_FOXNET_PACKET(S2C_PUSH)
+    DEF_FOXNET_PACKET(S2C_CHECK)
+
+public:
+    int64_t first = -1, last = -1;
+    bool gap = false;
+    int checks = 0, checkLoggedIn = -1;
+
+    TestClient(bool integrity, uint64_t token) {
+        INIT_FOXNET_PACKET(S2C_PUSH, sizeof(uint32_t))
+        INIT_FOXNET_PACKET(S2C_CHECK, sizeof(uint32_t) + sizeof(Byte))
+        setIntegrity(integrity);
+        enableResumption(token);
+    }
+
+    void check() {
+        writeByte(C2S_CHECK);
+        writeInt<uint32_t>(7);
+        commitPacket();
+    }
+
+    // a var packet claiming to be bigger than MAX_PACKET_SIZE
+    void violate() {
+        writeByte(PKTID_VAR_LENGTH);
+        writeInt<PktSize>(MAX_PACKET_SIZE + 1);
+        commitPacket();
+    }
+
+    void onSend(Byte *data, size_t sz) {
+        xorData(data, sz);
+    }
+
+    void onRecv(Byte *data, size_t sz) {
+        xorData(data, sz);
+    }
+};
+
+DECLARE_FOXNET_PACKET(S2C_PUSH, TestClient) {
+    TestClient *c = (TestClient*)peer;
+    uint32_t seq;
+
+    peer->readInt(seq);
+    if (c->first < 0)
+        c->first = seq;
+    else if (seq != c->last + 1)
+        c->gap = true;
+
+    c->last = seq;
+}
+
+DECLARE_FOXNET_PACKET(S2C_CHECK, TestClient) {
+    TestClient *c = (TestClient*)peer;
+    uint32_t val;
+    Byte loggedIn;
+
+    peer->readInt(val);
+    peer->readByte(loggedIn);
+    if (val == 7)
+        c->checks++;
+    c->checkLoggedIn = loggedIn;
+}
+
+static void pump(TestServer &server, TestClient *client, const std::function<bool()> &done) {
+    for (int i = 0; i < 1000 && !done(); i++) {
+        server.pollPeers(1);
+        if (client != nullptr && client->isAlive())
+            client->pollPeer(1);
+    }
+}
+
+static void testResume(bool integrity) {
+    TestServer server(integrity);
+    TestClient *client = new TestClient(integrity, 0);
+    TestPeer *session;
+    uint64_t token;
+
+    client->connect("127.0.0.1", std::to_string(TEST_PORT));
+    pump(server, client, [&]() { return client->getHandshake() && server.peer != nullptr; });
+    FOXCHECK(client->getCapabilities() & CAP_RESUME)
+    FOXCHECK(client->getResumeToken() != 0)
+    FOXCHECK(!client->isResumed())
+
+    client->writeByte(C2S_LOGIN);
+    pump(server, client, [&]() { return server.peer != nullptr && server.peer->loggedIn; });
+    session = server.peer;
+    token = client->getResumeToken();
+    if (session == nullptr || !session->loggedIn) {
+        FOXCHECK(!"the session never logged in")
+        delete client;
+        return;
+    }
+
+    for (uint32_t i = 0; i < 10; i++)
+        session->push(i);
+    pump(server, client, [&]() { return client->last == 9; });
+    FOXCHECK(client->last == 9)
+
+    // drop the connection, the session is kept & keeps getting packets
+    delete client;
+    pump(server, nullptr, [&]() { return server.detached == 1; });
+    FOXCHECK(server.detached == 1)
+    FOXCHECK(server.getDetachedCount() == 1)
+
+    for (uint32_t i = 10; i < 60; i++)
+        session->push(i);
+
+    // the check is pipelined behind the handshake, so it's answered by the session (which is logged in)
+    client = new TestClient(integrity, token);
+    client->check();
+    client->connect("127.0.0.1", std::to_string(TEST_PORT));
+    pump(server, client, [&]() { return client->last == 59 && client->checks == 1; });
+
+    FOXCHECK(client->isResumed())
+    FOXCHECK(server.resumed == 1)
+    FOXCHECK(server.peer == session)
+    FOXCHECK(client->first == 10 && client->last == 59 && !client->gap)
+    FOXCHECK(client->checks == 1 && client->checkLoggedIn == 1)
+    FOXCHECK(client->getResumeToken() != 0 && client->getResumeToken() != token)
+    FOXCHECK(server.getDetachedCount() == 0)
+
+    // the old token was used up, it gets a fresh session
+    TestClient *replay = new TestClient(integrity, token);
+    replay->check();
+    replay->connect("127.0.0.1", std::to_string(TEST_PORT));
+    pump(server, replay, [&]() { return replay->checks == 1; });
+
+    FOXCHECK(!replay->isResumed())
+    FOXCHECK(replay->checks == 1 && replay->checkLoggedIn == 0)
+    FOXCHECK(server.resumed == 1)
+
+    delete replay;
+    delete client;
+}
+
+static void testBacklogReplay(bool integrity) {
+    TestServer server(integrity);
+    TestClient *client = new TestClient(integrity, 0);
+    TestPeer *session;
+    uint32_t seq = 0;
+    uint64_t token;
+
+    client->connect("127.0.0.1", std::to_string(TEST_PORT));
+    pump(server, client, [&]() { return client->getHandshake() && server.peer != nullptr; });
+    session = server.peer;
+    token = client->getResumeToken();
+    if (session == nullptr) {
+        FOXCHECK(!"never connected")
+        delete client;
+        return;
+    }
+
+    // the client stops reading, so the kernel's buffers fill up & the rest waits on us
+    for (int round = 0; round < 10000 && session->pendingOut() < 256 * 1024; round++) {
+        for (int i = 0; i < 200; i++)
+            session->push(seq++);
+        server.pollPeers(0);
+    }
+    FOXCHECK(session->pendingOut() >= 256 * 1024)
+
+    // whatever was in the kernel's buffers is lost with the connection, everything after it is replayed
+    delete client;
+    pump(server, nullptr, [&]() { return server.detached == 1; });
+
+    client = new TestClient(integrity, token);
+    client->connect("127.0.0.1", std::to_string(TEST_PORT));
+    pump(server, client, [&]() { return client->last == (int64_t)seq - 1; });
+
+    FOXCHECK(client->isResumed())
+    FOXCHECK(client->first >= 0 && !client->gap)
+    FOXCHECK(client->last == (int64_t)seq - 1)
+    FOXCHECK(client->isAlive())
+
+    delete client;
+}
+
+static void testViolation(bool integrity) {
+    TestServer server(integrity);
+    TestClient *client = new TestClient(integrity, 0);
+    uint64_t token;
+
+    client->connect("127.0.0.1", std::to_string(TEST_PORT));
+    client->writeByte(C2S_LOGIN);
+    pump(server, client, [&]() { return server.peer != nullptr && server.peer->loggedIn; });
+    token = client->getResumeToken();
+    FOXCHECK(token != 0)
+
+    // the connection is dropped over it, but that's not the kind of drop that keeps the session
+    client->violate();
+    pump(server, client, [&]() { return server.disconnected == 1; });
+    FOXCHECK(server.disconnected == 1)
+    FOXCHECK(server.detached == 0)
+    FOXCHECK(server.getDetachedCount() == 0)
+    delete client;
+
+    client = new TestClient(integrity, token);
+    client->check();
+    client->connect("127.0.0.1", std::to_string(TEST_PORT));
+    pump(server, client, [&]() { return client->checks == 1; });
+
+    FOXCHECK(!client->isResumed())
+    FOXCHECK(client->checks == 1 && client->checkLoggedIn == 0)
+    FOXCHECK(server.resumed == 0)
+
+    delete client;
+}
+
+int main() {
+    testResume(false);
+    testResume(true);
+    testBacklogReplay(false);
+    testBacklogReplay(true);
+    testViolation(false);
+    testViolation(true);
+
+    return FOXTEST_RESULT();
+}
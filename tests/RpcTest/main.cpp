@@ -0,0 +1,154 @@
+#include "FoxClient.hpp"
+#include "FoxServer.hpp"
+
+#include <functional>
+#include <vector>
+
+#include "../FoxTest.hpp"
+
+/*
+ * Pipelined rpcs against a loopback server: responses sent in reverse order still reach the callback of the request
+ * they answer, unknown methods are refused, and requests nobody answers time out (or fail once we disconnect)
+ */
+
+using namespace FoxNet;
+
+#define TEST_PORT 13393
+#define TEST_REQUESTS 8
+
+enum {
+    RPC_ECHO = 1, // uint32_t, echoed back right away
+    RPC_DEFERRED, // uint32_t, echoed back in reverse order once TEST_REQUESTS of them are pending
+    RPC_IGNORED, // never answered
+    RPC_UNKNOWN, // no handler
+};
+
+class TestPeer : public FoxServerPeer {
+    DEF_FOXNET_RPC(RPC_ECHO)
+    DEF_FOXNET_RPC(RPC_DEFERRED)
+    DEF_FOXNET_RPC(RPC_IGNORED)
+
+public:
+    std::vector<std::pair<RPCID, uint32_t>> deferred;
+
+    TestPeer() {
+        INIT_FOXNET_RPC(RPC_ECHO)
+        INIT_FOXNET_RPC(RPC_DEFERRED)
+        INIT_FOXNET_RPC(RPC_IGNORED)
+    }
+};
+
+DECLARE_FOXNET_RPC(RPC_ECHO, TestPeer) {
+    uint32_t val;
+
+    peer->readInt(val);
+    size_t indx = peer->prepareRPCResponse(rpcID);
+    peer->writeInt(val);
+    peer->patchVarPacket(indx);
+}
+
+DECLARE_FOXNET_RPC(RPC_DEFERRED, TestPeer) {
+    TestPeer *p = (TestPeer*)peer;
+    uint32_t val;
+
+    peer->readInt(val);
+    p->deferred.push_back({rpcID, val});
+    if (p->deferred.size() < TEST_REQUESTS)
+        return;
+
+    while (!p->deferred.empty()) {
+        size_t indx = peer->prepareRPCResponse(p->deferred.back().first);
+        peer->writeInt(p->deferred.back().second);
+        peer->patchVarPacket(indx);
+        p->deferred.pop_back();
+    }
+}
+
+DECLARE_FOXNET_RPC(RPC_IGNORED, TestPeer) {}
+
+class TestServer : public FoxServer<TestPeer> {
+public:
+    TestServer(): FoxServer<TestPeer>(TEST_PORT) {}
+
+    void onNewPeer(TestPeer *) {}
+    void onPeerDisconnect(TestPeer *) {}
+};
+
+// requests are written from handlers so they go out with the next flush
+class TestClient : public FoxClient {
+public:
+    std::vector<uint32_t> answered; // the values of the requests answered so far, in the order they completed
+    int bad = 0, refused = 0, timedOut = 0, disconnected = 0;
+
+    void request(RPCMethod method, uint32_t val, int timeout = -1) {
+        size_t indx = prepareRPC(method, [this, val](FoxPeer *, RPCStatus status, PktSize size) {
+            uint32_t resp;
+
+            switch (status) {
+                case RPC_OK:
+                    if (size != sizeof(uint32_t) || !readInt(resp) || resp != val)
+                        bad++;
+                    answered.push_back(val);
+                    break;
+                case RPC_NOMETHOD:
+                    refused++;
+
+                    // the refusal is the last answer of the first batch, nobody answers the next two: the one with a
+                    // deadline times out & the other one fails when we hang up. the connection carries on meanwhile
+                    request(RPC_IGNORED, 400, 50);
+                    request(RPC_IGNORED, 500);
+                    request(RPC_ECHO, 600);
+                    break;
+                case RPC_TIMEOUT: timedOut++; break;
+                case RPC_DISCONNECTED: disconnected++; break;
+            }
+        }, timeout);
+        writeInt(val);
+        patchVarPacket(indx);
+    }
+
+    void onReady() {
+        // the ids keep the responses apart, whatever order they come back in
+        request(RPC_ECHO, 100);
+        for (uint32_t i = 0; i < TEST_REQUESTS; i++)
+            request(RPC_DEFERRED, i);
+        request(RPC_ECHO, 200);
+        request(RPC_UNKNOWN, 300);
+    }
+};
+
+static void pump(TestServer &server, TestClient &client, const std::function<bool()> &done) {
+    for (int i = 0; i < 2000 && !done() && client.isAlive(); i++) {
+        server.pollPeers(1);
+        client.pollPeer(1);
+    }
+}
+
+int main() {
+    TestServer server;
+    TestClient client;
+
+    client.connect("127.0.0.1", std::to_string(TEST_PORT));
+    pump(server, client, [&]() { return client.timedOut > 0 && client.answered.size() == TEST_REQUESTS + 3; });
+    FOXCHECK(client.getHandshake())
+    FOXCHECK(client.bad == 0)
+    FOXCHECK(client.refused == 1)
+    FOXCHECK(client.timedOut == 1)
+    FOXCHECK(client.getPendingRPCs() == 1)
+    FOXCHECK(client.answered.size() == TEST_REQUESTS + 3)
+
+    if (client.answered.size() == TEST_REQUESTS + 3) {
+        FOXCHECK(client.answered[0] == 100)
+        for (uint32_t i = 0; i < TEST_REQUESTS; i++)
+            FOXCHECK(client.answered[1 + i] == TEST_REQUESTS - 1 - i)
+        FOXCHECK(client.answered[TEST_REQUESTS + 1] == 200)
+        FOXCHECK(client.answered[TEST_REQUESTS + 2] == 600)
+    }
+
+    client.kill();
+    client.checkRPCTimeouts();
+    FOXCHECK(client.disconnected == 1)
+    FOXCHECK(client.getPendingRPCs() == 0)
+
+    return FOXTEST_RESULT();
+}
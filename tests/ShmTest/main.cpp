@@ -0,0 +1,199 @@
+#include "FoxClient.hpp"
+#include "FoxServer.hpp"
+#include "FoxShmTransport.hpp"
+
+#include <functional>
+#include <vector>
+
+#include <unistd.h>
+
+#include "../FoxTest.hpp"
+
+/*
+ * A FoxShmTransport segment & the end attached to it move bytes both ways (wrapping around the end of a small ring,
+ * and refusing writes while it's full), and a unix socket connection moved onto shared memory after its handshake
+ * keeps every packet in order across the switch
+ */
+
+using namespace FoxNet;
+
+#define TEST_RING 4096
+#define TEST_PATH "@foxnet-shm-test"
+#define TEST_PACKETS 20000
+
+enum {
+    PKT_ECHO = PKTID_USER_PACKET_START, // uint32_t (seq), echoed back
+};
+
+static void testRing() {
+    FoxShmTransport *a = FoxShmTransport::create(TEST_RING);
+    std::vector<Byte> out(TEST_RING * 3), in(TEST_RING * 3);
+    std::vector<int> fds;
+    size_t sent = 0, rcvd = 0;
+
+    FOXCHECK(a != nullptr)
+    if (a == nullptr)
+        return;
+
+    // the ring size has to be a power of 2
+    FOXCHECK(FoxShmTransport::create(TEST_RING + 1) == nullptr)
+
+    // (passing them over a socket would dup them)
+    for (int fd : a->getSharedFds())
+        fds.push_back(::dup(fd));
+
+    FoxShmTransport *b = FoxShmTransport::attach(fds);
+    FOXCHECK(b != nullptr)
+    if (b == nullptr) {
+        delete a;
+        return;
+    }
+
+    for (size_t i = 0; i < out.size(); i++)
+        out[i] = (Byte)(i * 7 + i / 256);
+
+    FOXCHECK(b->recv(in.data(), in.size()) == FoxTransport::TRANSPORT_WOULDBLOCK)
+
+    // fill it up, it takes exactly a ring's worth
+    FOXCHECK(a->send(out.data(), TEST_RING + 100) == TEST_RING)
+    FOXCHECK(!a->writable())
+    FOXCHECK(a->send(out.data() + TEST_RING, 100) == FoxTransport::TRANSPORT_WOULDBLOCK)
+    sent = TEST_RING;
+
+    // then move the rest through in odd sized pieces, so reads & writes wrap around the end of the ring
+    while (rcvd < out.size()) {
+        int ret = b->recv(in.data() + rcvd, 1000);
+
+        FOXCHECK(ret > 0)
+        if (ret <= 0)
+            break;
+        rcvd += ret;
+
+        if (sent < out.size()) {
+            ret = a->send(out.data() + sent, std::min<size_t>(out.size() - sent, 1500));
+            FOXCHECK(ret > 0)
+            if (ret > 0)
+                sent += ret;
+        }
+    }
+
+    FOXCHECK(rcvd == out.size())
+    FOXCHECK(in == out)
+
+    // the other direction is its own ring
+    FOXCHECK(b->send(out.data(), 10) == 10)
+    FOXCHECK(a->recv(in.data(), in.size()) == 10)
+
+    // a close is seen once everything before it was read
+    FOXCHECK(a->send(out.data(), 10) == 10)
+    a->close();
+    FOXCHECK(b->recv(in.data(), 5) == 5)
+    FOXCHECK(b->recv(in.data(), in.size()) == 5)
+    FOXCHECK(b->recv(in.data(), in.size()) == 0)
+
+    delete a;
+    delete b;
+}
+
+class TestPeer : public FoxServerPeer {
+    DEF_FOXNET_PACKET(PKT_ECHO)
+
+public:
+    TestPeer() {
+        INIT_FOXNET_PACKET(PKT_ECHO, sizeof(uint32_t))
+    }
+};
+
+DECLARE_FOXNET_PACKET(PKT_ECHO, TestPeer) {
+    uint32_t seq;
+
+    peer->readInt(seq);
+    peer->writeByte(PKT_ECHO);
+    peer->writeInt(seq);
+}
+
+class TestServer : public FoxServer<TestPeer> {
+public:
+    int disconnects = 0;
+
+    void onNewPeer(TestPeer *) {}
+
+    void onPeerDisconnect(TestPeer *) {
+        disconnects++;
+    }
+};
+
+class TestClient : public FoxClient {
+    DEF_FOXNET_PACKET(PKT_ECHO)
+
+public:
+    uint32_t echoes = 0;
+    int bad = 0;
+
+    TestClient() {
+        INIT_FOXNET_PACKET(PKT_ECHO, sizeof(uint32_t))
+    }
+};
+
+DECLARE_FOXNET_PACKET(PKT_ECHO, TestClient) {
+    TestClient *c = (TestClient*)peer;
+    uint32_t seq;
+
+    peer->readInt(seq);
+    if (seq != c->echoes++)
+        c->bad++;
+}
+
+static void pump(TestServer &server, TestClient &client, const std::function<bool()> &done) {
+    for (int i = 0; i < 5000 && !done(); i++) {
+        server.pollPeers(1);
+        if (client.isAlive())
+            client.pollPeer(1);
+    }
+}
+
+static void testSwitch() {
+    TestServer server;
+    TestClient client;
+    uint32_t seq = 0;
+
+    server.listenUnix(TEST_PATH);
+    client.connectUnix(TEST_PATH, true);
+
+    // some packets are queued before the switch, the rest go over shared memory
+    for (; seq < 1000; seq++) {
+        client.writeByte(PKT_ECHO);
+        client.writeInt(seq);
+        client.commitPacket();
+    }
+
+    pump(server, client, [&]() { return client.isShmActive() && client.echoes == seq; });
+    FOXCHECK(client.isShmActive())
+
+    for (; seq < TEST_PACKETS; seq++) {
+        client.writeByte(PKT_ECHO);
+        client.writeInt(seq);
+        client.commitPacket();
+
+        if (seq % 500 == 0) {
+            client.pollPeer(0);
+            server.pollPeers(0);
+        }
+    }
+
+    pump(server, client, [&]() { return client.echoes == TEST_PACKETS; });
+    FOXCHECK(client.echoes == TEST_PACKETS)
+    FOXCHECK(client.bad == 0)
+
+    // the socket is still watched, so hanging up reaches the server
+    client.kill();
+    pump(server, client, [&]() { return server.disconnects > 0; });
+    FOXCHECK(server.disconnects == 1)
+}
+
+int main() {
+    testRing();
+    testSwitch();
+
+    return FOXTEST_RESULT();
+}
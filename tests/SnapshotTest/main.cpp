@@ -0,0 +1,191 @@
+#include "FoxClient.hpp"
+#include "FoxServer.hpp"
+#include "FoxSnapshotSender.hpp"
+#include "FoxPipe.hpp"
+
+#include <map>
+
+#include "../FoxTest.hpp"
+
+/*
+ * FoxSnapshot delta round trips (with & without a baseline, across resizes, truncated), and a FoxSnapshotSender
+ * whose peer's baseline fell out of its history or was never received
+ */
+
+using namespace FoxNet;
+
+static bool sameFields(const FoxSnapshot &a, const FoxSnapshot &b) {
+    if (a.size() != b.size())
+        return false;
+
+    for (size_t i = 0; i < a.size(); i++) {
+        if (a.get(i) != b.get(i))
+            return false;
+    }
+
+    return true;
+}
+
+static bool roundTrip(const FoxSnapshot &snap, const FoxSnapshot *baseline) {
+    ByteStream out;
+    FoxSnapshot decoded;
+
+    snap.encodeDelta(baseline, out);
+    ByteView data(out.getOutBuffer().data(), out.getOutBuffer().size());
+    return decoded.decodeDelta(baseline, data) && data.sizeRemaining() == 0 && sameFields(decoded, snap);
+}
+
+static void testCodec() {
+    FoxSnapshot base(40), next, empty;
+
+    for (size_t i = 0; i < base.size(); i++)
+        base.set(i, (int64_t)i * 1000 - 20000);
+    base.set(7, INT64_MIN);
+    base.set(8, INT64_MAX);
+
+    // no baseline, then against one with a few fields changed
+    FOXCHECK(roundTrip(base, nullptr))
+    FOXCHECK(roundTrip(empty, nullptr))
+    next = base;
+    next.set(3, -3);
+    next.set(8, INT64_MIN);
+    FOXCHECK(roundTrip(next, &base))
+    FOXCHECK(roundTrip(base, &base))
+
+    // growing past & shrinking under the baseline
+    next.set(60, 5);
+    FOXCHECK(roundTrip(next, &base))
+    next.resize(10);
+    FOXCHECK(roundTrip(next, &base))
+    FOXCHECK(roundTrip(empty, &base))
+
+    // every cut short encoding is rejected
+    ByteStream out;
+    next = base;
+    next.set(39, 1);
+    next.encodeDelta(&base, out);
+    for (size_t sz = 0; sz < out.getOutBuffer().size(); sz++) {
+        FoxSnapshot decoded;
+        ByteView data(out.getOutBuffer().data(), sz);
+
+        FOXCHECK(!decoded.decodeDelta(&base, data))
+    }
+
+    // a field count the data can't possibly hold
+    ByteStream bogus;
+    bogus.writeVarint(UINT64_MAX);
+    ByteView data(bogus.getOutBuffer().data(), bogus.getOutBuffer().size());
+    FOXCHECK(!empty.decodeDelta(nullptr, data))
+}
+
+class TestServer : public FoxServer<FoxServerPeer> {
+public:
+    FoxServerPeer *peer = nullptr;
+
+    void onNewPeer(FoxServerPeer *p) {
+        peer = p;
+    }
+
+    void onPeerDisconnect(FoxServerPeer *) {
+        peer = nullptr;
+    }
+};
+
+class TestClient : public FoxClient {
+public:
+    std::map<uint32_t, FoxSnapshot> *published = nullptr;
+    uint32_t last = 0;
+    int got = 0, bad = 0;
+
+    void onSnapshot(const FoxSnapshot &snap) {
+        got++;
+        last = snap.getSeq();
+
+        if (!sameFields(snap, (*published)[snap.getSeq()]))
+            bad++;
+    }
+};
+
+static void pollBoth(TestServer &server, TestClient &client) {
+    for (int i = 0; i < 8; i++) {
+        server.pollPeers(0);
+        client.pollPeer(0);
+    }
+}
+
+static void testMissingBaselines() {
+    TestServer server;
+    TestClient client;
+    FoxSnapshotSender sender;
+    std::map<uint32_t, FoxSnapshot> published;
+    FoxSnapshot state(64);
+    uint32_t seq;
+    auto pipe = FoxPipe::create();
+
+    client.published = &published;
+    server.acceptTransport(pipe.first);
+    client.connectTransport(pipe.second);
+    for (int i = 0; i < 100 && !client.getHandshake(); i++)
+        pollBoth(server, client);
+
+    FOXCHECK(client.getHandshake())
+    FOXCHECK(server.peer != nullptr)
+    if (server.peer == nullptr)
+        return;
+
+    // nothing acked yet, so it's a full snapshot
+    for (size_t i = 0; i < state.size(); i++)
+        state.set(i, (int64_t)i * 7);
+    seq = sender.publish(state);
+    published[seq] = state;
+    server.broadcastSnapshot(sender);
+    pollBoth(server, client);
+    FOXCHECK(client.last == seq)
+    FOXCHECK(server.peer->getSnapshotAck() == seq)
+
+    // the client stops answering while the server's history moves past the snapshot it acked, the deltas against
+    // it are still good and the full snapshots sent after it's dropped are too
+    for (int i = 0; i < FOXNET_SNAPSHOT_HISTORY + 8; i++) {
+        state.set(i % state.size(), -i);
+        seq = sender.publish(state);
+        published[seq] = state;
+        server.broadcastSnapshot(sender);
+        server.pollPeers(0);
+    }
+
+    pollBoth(server, client);
+    FOXCHECK(client.got == FOXNET_SNAPSHOT_HISTORY + 9)
+    FOXCHECK(client.bad == 0)
+    FOXCHECK(client.last == seq)
+
+    // a delta against a snapshot the client never got is dropped, the connection is fine
+    ByteStream delta;
+    FoxSnapshot unknown(64);
+    state.encodeDelta(&unknown, delta);
+
+    size_t indx = server.peer->prepareVarPacket(PKTID_SNAPSHOT);
+    server.peer->writeInt<uint32_t>(seq + 100);
+    server.peer->writeInt<uint32_t>(seq + 99);
+    server.peer->writeBytes(delta.getOutBuffer().data(), delta.getOutBuffer().size());
+    server.peer->patchVarPacket(indx);
+    pollBoth(server, client);
+
+    FOXCHECK(client.last == seq)
+    FOXCHECK(client.isAlive())
+
+    // and the next real one still lands
+    state.set(0, 12345);
+    seq = sender.publish(state);
+    published[seq] = state;
+    server.broadcastSnapshot(sender);
+    pollBoth(server, client);
+    FOXCHECK(client.last == seq)
+    FOXCHECK(client.bad == 0)
+}
+
+int main() {
+    testCodec();
+    testMissingBaselines();
+
+    return FOXTEST_RESULT();
+}
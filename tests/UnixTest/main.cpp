@@ -0,0 +1,167 @@
+#include "FoxClient.hpp"
+#include "FoxServer.hpp"
+
+#include <fstream>
+#include <functional>
+
+#include <sys/stat.h>
+
+#include "../FoxTest.hpp"
+
+/*
+ * One server listening on a unix socket file & an abstract one (linux): clients connect to both & get their packets
+ * echoed, a stale socket file is replaced, a live one or a file that isn't a socket is left alone, and the file is
+ * removed with the server
+ */
+
+using namespace FoxNet;
+
+#define TEST_PATH "unix-test.sock"
+#define TEST_ABSTRACT "@foxnet-unix-test"
+#define TEST_PACKETS 1000
+
+enum {
+    PKT_ECHO = PKTID_USER_PACKET_START, // uint32_t (seq), echoed back
+};
+
+class TestPeer : public FoxServerPeer {
+    DEF_FOXNET_PACKET(PKT_ECHO)
+
+public:
+    TestPeer() {
+        INIT_FOXNET_PACKET(PKT_ECHO, sizeof(uint32_t))
+    }
+};
+
+DECLARE_FOXNET_PACKET(PKT_ECHO, TestPeer) {
+    uint32_t seq;
+
+    peer->readInt(seq);
+    peer->writeByte(PKT_ECHO);
+    peer->writeInt(seq);
+}
+
+class TestServer : public FoxServer<TestPeer> {
+public:
+    int peers = 0;
+
+    void onNewPeer(TestPeer *) {
+        peers++;
+    }
+
+    void onPeerDisconnect(TestPeer *) {}
+};
+
+class TestClient : public FoxClient {
+    DEF_FOXNET_PACKET(PKT_ECHO)
+
+public:
+    uint32_t echoes = 0;
+    int bad = 0;
+
+    TestClient() {
+        INIT_FOXNET_PACKET(PKT_ECHO, sizeof(uint32_t))
+    }
+};
+
+DECLARE_FOXNET_PACKET(PKT_ECHO, TestClient) {
+    TestClient *c = (TestClient*)peer;
+    uint32_t seq;
+
+    peer->readInt(seq);
+    if (seq != c->echoes++)
+        c->bad++;
+}
+
+static void pump(TestServer &server, TestClient &client, const std::function<bool()> &done) {
+    for (int i = 0; i < 2000 && !done() && client.isAlive(); i++) {
+        server.pollPeers(1);
+        client.pollPeer(1);
+    }
+}
+
+static void testEcho(TestServer &server, const std::string &path) {
+    TestClient client;
+
+    client.connectUnix(path);
+
+    for (uint32_t seq = 0; seq < TEST_PACKETS; seq++) {
+        client.writeByte(PKT_ECHO);
+        client.writeInt(seq);
+        client.commitPacket();
+    }
+
+    pump(server, client, [&]() { return client.echoes == TEST_PACKETS; });
+    FOXCHECK(client.getHandshake())
+    FOXCHECK(client.echoes == TEST_PACKETS)
+    FOXCHECK(client.bad == 0)
+}
+
+static bool fileExists(const char *path) {
+    struct stat st;
+
+    return ::stat(path, &st) == 0;
+}
+
+static bool bindFails(const char *path) {
+    try {
+        FoxSocket sock;
+
+        sock.bindUnix(path);
+    } catch(FoxException &) {
+        return true;
+    }
+
+    return false;
+}
+
+int main() {
+    // a socket file left behind by a listener that's gone is replaced
+    {
+        FoxSocket stale;
+
+        stale.bindUnix(TEST_PATH);
+    }
+    FOXCHECK(fileExists(TEST_PATH))
+
+    {
+        TestServer server;
+
+        server.listenUnix(TEST_PATH);
+        testEcho(server, TEST_PATH);
+        FOXCHECK(server.peers == 1)
+
+        // someone's listening on it, so it isn't stale (the check's connection shows up as a peer)
+        FOXCHECK(bindFails(TEST_PATH))
+        FOXCHECK(fileExists(TEST_PATH))
+        testEcho(server, TEST_PATH);
+
+#ifdef __linux__
+        int peers = server.peers;
+        server.listenUnix(TEST_ABSTRACT);
+        testEcho(server, TEST_ABSTRACT);
+        FOXCHECK(server.peers == peers + 1)
+#endif
+    }
+
+    FOXCHECK(!fileExists(TEST_PATH))
+
+    // nobody is listening anymore
+    bool refused = false;
+    try {
+        TestClient client;
+
+        client.connectUnix(TEST_PATH);
+    } catch(FoxException &) {
+        refused = true;
+    }
+    FOXCHECK(refused)
+
+    // only socket files are ever replaced
+    std::ofstream(TEST_PATH) << "not a socket";
+    FOXCHECK(bindFails(TEST_PATH))
+    FOXCHECK(fileExists(TEST_PATH))
+    ::unlink(TEST_PATH);
+
+    return FOXTEST_RESULT();
+}
@@ -0,0 +1,223 @@
+#include "FoxClient.hpp"
+#include "FoxServer.hpp"
+#include "FoxPipe.hpp"
+
+#include <algorithm>
+#include <functional>
+#include <vector>
+
+#include "../FoxTest.hpp"
+
+/*
+ * ByteView reads stay in bounds, and a relay forwards fixed & var packets from one client to another straight out of
+ * getPacketView() with writePacket(). each connection xors its bytes with its own key, so what's forwarded has to be
+ * the decoded body
+ */
+
+using namespace FoxNet;
+
+#define TEST_PACKETS 2000
+
+enum {
+    PKT_MSG = PKTID_USER_PACKET_START, // (var) uint32_t (seq) follows, then seq % 3000 bytes derived from it
+    PKT_FIXED, // uint32_t (seq) & uint64_t (seq * 3)
+};
+
+static void xorData(Byte *data, size_t sz, Byte key) {
+    for (size_t i = 0; i < sz; i++)
+        data[i] ^= key;
+}
+
+static void testView() {
+    Byte data[] = {1, 0, 0, 0, 2, 3, 4, 5};
+    ByteView view(data, sizeof(data));
+    ByteView sub;
+    uint32_t val;
+    Byte b;
+
+    FOXCHECK(view.getSize() == sizeof(data))
+    FOXCHECK(view.readInt(val) && val == 1)
+    FOXCHECK(view.readView(sub, 3))
+    FOXCHECK(sub.getSize() == 3 && sub.getData() == data + 4)
+    FOXCHECK(sub.readByte(b) && b == 2)
+    FOXCHECK(sub.sizeRemaining() == 2)
+
+    // reads past the end fail without moving the cursor
+    FOXCHECK(!view.readInt(val))
+    FOXCHECK(!view.readView(sub, 2))
+    FOXCHECK(!view.skip(2))
+    FOXCHECK(view.sizeRemaining() == 1)
+    FOXCHECK(view.readByte(b) && b == 5)
+    FOXCHECK(view.sizeRemaining() == 0)
+
+    // the other byte order
+    ByteView flipped(data, sizeof(uint32_t), true);
+    FOXCHECK(flipped.readInt(val) && val == 0x01000000)
+}
+
+class TestPeer : public FoxServerPeer {
+    DEF_FOXNET_VAR_PACKET(PKT_MSG)
+    DEF_FOXNET_PACKET(PKT_FIXED)
+
+public:
+    Byte key = 0;
+    TestPeer *relayTo = nullptr;
+
+    TestPeer() {
+        INIT_FOXNET_VAR_PACKET(PKT_MSG)
+        INIT_FOXNET_PACKET(PKT_FIXED, sizeof(uint32_t) + sizeof(uint64_t))
+    }
+
+    void onSend(Byte *data, size_t sz) {
+        xorData(data, sz, key);
+    }
+
+    void onRecv(Byte *data, size_t sz) {
+        xorData(data, sz, key);
+    }
+};
+
+DECLARE_FOXNET_VAR_PACKET(PKT_MSG, TestPeer) {
+    TestPeer *p = (TestPeer*)peer;
+    ByteView body = peer->getPacketView();
+    uint32_t seq;
+
+    // reading through a view doesn't move the stream, the whole body is still forwarded
+    body.readInt(seq);
+    if (p->relayTo != nullptr)
+        p->relayTo->writePacket(PKT_MSG, peer->getPacketView());
+}
+
+DECLARE_FOXNET_PACKET(PKT_FIXED, TestPeer) {
+    TestPeer *p = (TestPeer*)peer;
+
+    if (p->relayTo != nullptr)
+        p->relayTo->writePacket(PKT_FIXED, peer->getPacketView());
+}
+
+class TestServer : public FoxServer<TestPeer> {
+public:
+    std::vector<TestPeer*> peers;
+
+    void onNewPeer(TestPeer *peer) {
+        // (the keys match the order the clients connect in)
+        peer->key = peers.empty() ? 0x5a : 0xa5;
+        peers.push_back(peer);
+
+        if (peers.size() == 2)
+            peers[0]->relayTo = peers[1];
+    }
+
+    void onPeerDisconnect(TestPeer *peer) {
+        for (TestPeer *p : peers) {
+            if (p->relayTo == peer)
+                p->relayTo = nullptr;
+        }
+
+        peers.erase(std::find(peers.begin(), peers.end(), peer));
+    }
+};
+
+class TestClient : public FoxClient {
+    DEF_FOXNET_VAR_PACKET(PKT_MSG)
+    DEF_FOXNET_PACKET(PKT_FIXED)
+
+public:
+    Byte key;
+    uint32_t msgs = 0, fixed = 0;
+    int bad = 0;
+
+    TestClient(Byte k): key(k) {
+        INIT_FOXNET_VAR_PACKET(PKT_MSG)
+        INIT_FOXNET_PACKET(PKT_FIXED, sizeof(uint32_t) + sizeof(uint64_t))
+    }
+
+    void onSend(Byte *data, size_t sz) {
+        xorData(data, sz, key);
+    }
+
+    void onRecv(Byte *data, size_t sz) {
+        xorData(data, sz, key);
+    }
+};
+
+DECLARE_FOXNET_VAR_PACKET(PKT_MSG, TestClient) {
+    TestClient *c = (TestClient*)peer;
+    uint32_t seq;
+    Byte b;
+
+    peer->readInt(seq);
+    if (seq != c->msgs++ || varSize != sizeof(uint32_t) + seq % 3000)
+        c->bad++;
+
+    for (uint32_t i = 0; i < seq % 3000; i++) {
+        if (!peer->readByte(b) || b != (Byte)(seq + i))
+            c->bad++;
+    }
+}
+
+DECLARE_FOXNET_PACKET(PKT_FIXED, TestClient) {
+    TestClient *c = (TestClient*)peer;
+    uint32_t seq;
+    uint64_t triple;
+
+    peer->readInt(seq);
+    peer->readInt(triple);
+    if (seq != c->fixed++ || triple != (uint64_t)seq * 3)
+        c->bad++;
+}
+
+static void pump(TestServer &server, TestClient &a, TestClient &b, const std::function<bool()> &done) {
+    for (int i = 0; i < 5000 && !done(); i++) {
+        server.pollPeers(0);
+        a.pollPeer(0);
+        b.pollPeer(1);
+    }
+}
+
+int main() {
+    TestServer server;
+    TestClient a(0x5a), b(0xa5);
+    auto pipeA = FoxPipe::create();
+    auto pipeB = FoxPipe::create();
+
+    testView();
+
+    server.acceptTransport(pipeA.first);
+    a.connectTransport(pipeA.second);
+    pump(server, a, b, [&]() { return server.peers.size() == 1; });
+    server.acceptTransport(pipeB.first);
+    b.connectTransport(pipeB.second);
+    pump(server, a, b, [&]() { return server.peers.size() == 2 && a.getHandshake() && b.getHandshake(); });
+    FOXCHECK(server.peers.size() == 2)
+
+    // outside of a handler there's no packet to look at
+    FOXCHECK(a.getPacketView().getSize() == 0)
+
+    for (uint32_t seq = 0; seq < TEST_PACKETS; seq++) {
+        size_t indx = a.prepareVarPacket(PKT_MSG);
+        a.writeInt(seq);
+        for (uint32_t i = 0; i < seq % 3000; i++)
+            a.writeByte((Byte)(seq + i));
+        a.patchVarPacket(indx);
+
+        if (seq % 10 == 0) {
+            a.writeByte(PKT_FIXED);
+            a.writeInt(seq / 10);
+            a.writeInt<uint64_t>((uint64_t)(seq / 10) * 3);
+            a.commitPacket();
+        }
+
+        if (seq % 100 == 0) {
+            a.pollPeer(0);
+            server.pollPeers(0);
+        }
+    }
+
+    pump(server, a, b, [&]() { return b.msgs == TEST_PACKETS && b.fixed == TEST_PACKETS / 10; });
+    FOXCHECK(b.msgs == TEST_PACKETS)
+    FOXCHECK(b.fixed == TEST_PACKETS / 10)
+    FOXCHECK(b.bad == 0)
+
+    return FOXTEST_RESULT();
+}
@@ -0,0 +1,696 @@
+#include "FoxServer.hpp"
+#include "FoxClient.hpp"
+#include "FoxClientGroup.hpp"
+#include "FoxPipe.hpp"
+#include "FoxMetrics.hpp"
+#include "FoxTrace.hpp"
+#include "FoxChecksum.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+ * foxnet-bench
+ *
+ *  Reproducible loopback benchmarks, results are written as JSON so they can be diffed between builds.
+ *
+ *  usage: foxnet-bench [--quick] [--port <port>] [--out <file.json>] [--trace <file.json>]
+ *
+ *  --trace dumps the trace rings as Chrome trace JSON, FoxNet must be built with FOXNET_ENABLE_TRACING
+ */
+
+using namespace FoxNet;
+
+enum {
+    BENCH_ECHO = PKTID_USER_PACKET_START, // int64_t, echoed back to the sender
+    BENCH_SINK, // int64_t, just counted
+    BENCH_VAR_SINK, // (var) just counted
+    BENCH_BROADCAST_REQ, // int64_t, server sends BENCH_BROADCAST to every peer
+    BENCH_BROADCAST, // int64_t
+};
+
+struct BenchConfig {
+    bool quick = false;
+    uint16_t port = 13377;
+    std::string out;
+    std::string trace;
+};
+
+static std::atomic<uint64_t> serverRecv(0);
+
+static int64_t getNanos() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// ============================================= [[ Server ]] =============================================
+
+class BenchPeer : public FoxServerPeer {
+private:
+    DEF_FOXNET_PACKET(BENCH_ECHO)
+    DEF_FOXNET_PACKET(BENCH_SINK)
+    DEF_FOXNET_VAR_PACKET(BENCH_VAR_SINK)
+    DEF_FOXNET_PACKET(BENCH_BROADCAST_REQ)
+
+public:
+    BenchPeer() {
+        INIT_FOXNET_PACKET(BENCH_ECHO, sizeof(int64_t))
+        INIT_FOXNET_PACKET(BENCH_SINK, sizeof(int64_t))
+        INIT_FOXNET_VAR_PACKET(BENCH_VAR_SINK)
+        INIT_FOXNET_PACKET(BENCH_BROADCAST_REQ, sizeof(int64_t))
+    }
+};
+
+class BenchServer : public FoxServer<BenchPeer> {
+public:
+    static BenchServer *instance;
+
+    BenchServer(uint16_t port): FoxServer<BenchPeer>(port) {
+        instance = this;
+    }
+
+    // only reachable through acceptTransport()
+    BenchServer() {
+        instance = this;
+    }
+
+    void onNewPeer(BenchPeer *) {}
+    void onPeerDisconnect(BenchPeer *) {}
+};
+
+BenchServer *BenchServer::instance = nullptr;
+
+DECLARE_FOXNET_PACKET(BENCH_ECHO, BenchPeer) {
+    int64_t stamp;
+
+    peer->readInt(stamp);
+    peer->writeByte(BENCH_ECHO);
+    peer->writeInt(stamp);
+}
+
+DECLARE_FOXNET_PACKET(BENCH_SINK, BenchPeer) {
+    int64_t dummy;
+
+    peer->readInt(dummy);
+    serverRecv.fetch_add(1, std::memory_order_relaxed);
+}
+
+DECLARE_FOXNET_VAR_PACKET(BENCH_VAR_SINK, BenchPeer) {
+    serverRecv.fetch_add(1, std::memory_order_relaxed);
+}
+
+DECLARE_FOXNET_PACKET(BENCH_BROADCAST_REQ, BenchPeer) {
+    int64_t stamp;
+
+    peer->readInt(stamp);
+
+    // fan the packet out to every peer, they're flushed once pollPeers() is done with the current events
+    for (BenchPeer *p : BenchServer::instance->getPeerList()) {
+        p->writeByte(BENCH_BROADCAST);
+        p->writeInt(stamp);
+    }
+
+    serverRecv.fetch_add(1, std::memory_order_relaxed);
+}
+
+// runs a server on its own thread for the lifetime of the object
+class ServerThread {
+private:
+    std::atomic<bool> running;
+    std::thread thread;
+
+public:
+    ServerThread(uint16_t port, const std::string &unixPath = ""): running(true) {
+        std::atomic<bool> ready(false);
+
+        serverRecv = 0;
+        thread = std::thread([this, port, unixPath, &ready]() {
+            BenchServer server(port);
+            if (!unixPath.empty())
+                server.listenUnix(unixPath);
+            FoxTrace::setThreadName("bench server");
+            ready = true;
+
+            while (running.load(std::memory_order_relaxed))
+                server.pollPeers(1);
+        });
+
+        while (!ready)
+            std::this_thread::yield();
+    }
+
+    ~ServerThread() {
+        running = false;
+        thread.join();
+    }
+};
+
+// ============================================= [[ Client ]] =============================================
+
+class BenchClient : public FoxClient {
+private:
+    DEF_FOXNET_PACKET(BENCH_ECHO)
+    DEF_FOXNET_PACKET(BENCH_BROADCAST)
+
+public:
+    int64_t lastEcho = 0;
+    uint64_t broadcasts = 0;
+    bool ready = false;
+    bool failed = false;
+
+    BenchClient() {
+        INIT_FOXNET_PACKET(BENCH_ECHO, sizeof(int64_t))
+        INIT_FOXNET_PACKET(BENCH_BROADCAST, sizeof(int64_t))
+    }
+
+    void onReady() {
+        ready = true;
+    }
+
+    void onConnectFailed() {
+        failed = true;
+    }
+
+    void waitReady() {
+        while (!ready && isAlive())
+            pollPeer(-1);
+
+        if (!ready) {
+            FOXFATAL("couldn't connect to the bench server!")
+        }
+    }
+
+    // writes & flushes, making sure we don't queue more than the kernel can take
+    void send() {
+        pollPeer(0);
+        while (pendingOut() > 1024 * 1024 && isAlive())
+            pollPeer(1);
+    }
+};
+
+DECLARE_FOXNET_PACKET(BENCH_ECHO, BenchClient) {
+    int64_t stamp;
+
+    peer->readInt(stamp);
+    ((BenchClient*)peer)->lastEcho = stamp;
+}
+
+DECLARE_FOXNET_PACKET(BENCH_BROADCAST, BenchClient) {
+    int64_t stamp;
+
+    peer->readInt(stamp);
+    ((BenchClient*)peer)->broadcasts++;
+}
+
+// ============================================= [[ Benchmarks ]] =============================================
+
+class JsonWriter {
+private:
+    std::ostringstream out;
+    bool first = true;
+
+public:
+    JsonWriter() {
+        out << "{\n  \"foxnet_version\": \"" << FOXNET_MAJOR << "." << FOXNET_MINOR << "\",\n  \"results\": [";
+    }
+
+    void add(const std::string &name, const std::vector<std::pair<std::string, double>> &fields) {
+        out << (first ? "\n" : ",\n") << "    {\"name\": \"" << name << "\"";
+        for (auto &field : fields)
+            out << ", \"" << field.first << "\": " << field.second;
+        out << "}";
+        first = false;
+
+        // progress for whoever is watching
+        std::cerr << name;
+        for (auto &field : fields)
+            std::cerr << " " << field.first << "=" << field.second;
+        std::cerr << std::endl;
+    }
+
+    std::string finish() {
+        out << "\n  ]";
+
+        // everything FoxNet counted over the whole run
+        if (FoxMetrics::isEnabled())
+            out << ",\n  \"metrics\": " << FoxMetrics::snapshot().toJSON();
+
+        out << "\n}\n";
+        return out.str();
+    }
+};
+
+static double percentile(std::vector<int64_t> &sorted, double p) {
+    size_t indx = (size_t)(p * (sorted.size() - 1));
+    return sorted[indx] / 1000.0; // ns -> us
+}
+
+// the abstract namespace doesn't leave a socket file behind, and can't collide with a stale one
+static std::string benchUnixPath(BenchConfig &cfg) {
+#ifdef __linux__
+    return "@foxnet-bench-" + std::to_string(cfg.port);
+#else
+    return "/tmp/foxnet-bench-" + std::to_string(cfg.port) + ".sock";
+#endif
+}
+
+enum BenchPath {
+    PATH_TCP, // tcp loopback
+    PATH_UNIX, // unix domain socket
+    PATH_SHM // unix domain socket, moved onto shared memory after the handshake
+};
+
+static void benchLatency(BenchConfig &cfg, JsonWriter &json, BenchPath path) {
+    static const char *names[] = {"pingpong_latency", "unix_pingpong_latency", "shm_pingpong_latency"};
+    std::string unixPath = path != PATH_TCP ? benchUnixPath(cfg) : "";
+    ServerThread server(cfg.port, unixPath);
+    BenchClient client;
+    int iterations = cfg.quick ? 2000 : 50000;
+    std::vector<int64_t> samples;
+
+    if (path != PATH_TCP) {
+        client.connectUnix(unixPath, path == PATH_SHM);
+    } else {
+        client.connect("127.0.0.1", std::to_string(cfg.port));
+    }
+    client.waitReady();
+
+    // the switch happens right after the handshake, make sure it's done before we start timing
+    while (path == PATH_SHM && !client.isShmActive() && client.isAlive())
+        client.pollPeer(10);
+
+    samples.reserve(iterations);
+    for (int i = 0; i < iterations + 100; i++) {
+        int64_t start = getNanos();
+
+        client.writeByte(BENCH_ECHO);
+        client.writeInt(start);
+        while (client.lastEcho != start && client.isAlive())
+            client.pollPeer(-1);
+
+        // skip the warmup
+        if (i >= 100)
+            samples.push_back(getNanos() - start);
+    }
+
+    std::sort(samples.begin(), samples.end());
+    json.add(names[path], {
+        {"iterations", iterations},
+        {"p50_us", percentile(samples, 0.50)},
+        {"p90_us", percentile(samples, 0.90)},
+        {"p99_us", percentile(samples, 0.99)},
+        {"p999_us", percentile(samples, 0.999)},
+        {"max_us", samples.back() / 1000.0},
+    });
+}
+
+static void benchSmallThroughput(BenchConfig &cfg, JsonWriter &json) {
+    ServerThread server(cfg.port);
+    BenchClient client;
+    uint64_t packets = cfg.quick ? 200000 : 5000000;
+    int64_t start;
+
+    client.connect("127.0.0.1", std::to_string(cfg.port));
+    client.waitReady();
+
+    start = getNanos();
+    for (uint64_t i = 0; i < packets; i++) {
+        client.writeByte(BENCH_SINK);
+        client.writeInt<int64_t>(i);
+
+        if (i % 1024 == 1023)
+            client.send();
+    }
+    client.send();
+
+    while (serverRecv.load() < packets && client.isAlive())
+        client.pollPeer(1);
+
+    double secs = (getNanos() - start) / 1e9;
+    json.add("small_packet_throughput", {
+        {"packets", (double)packets},
+        {"packet_bytes", 1 + sizeof(int64_t)},
+        {"seconds", secs},
+        {"packets_per_sec", packets / secs},
+    });
+}
+
+// same as small_packet_throughput, but the server & client share a thread & talk over a FoxPipe. no kernel, so
+// this is just FoxNet's own framing & dispatch overhead
+static void benchPipeThroughput(BenchConfig &cfg, JsonWriter &json) {
+    BenchServer server;
+    BenchClient client;
+    uint64_t packets = cfg.quick ? 200000 : 5000000;
+    auto pipe = FoxPipe::create();
+    int64_t start;
+
+    serverRecv = 0;
+    server.acceptTransport(pipe.first);
+    client.connectTransport(pipe.second);
+    while (!client.getHandshake() && client.isAlive()) {
+        server.pollPeers(0);
+        client.pollPeer(0);
+    }
+
+    start = getNanos();
+    for (uint64_t i = 0; i < packets; i++) {
+        client.writeByte(BENCH_SINK);
+        client.writeInt<int64_t>(i);
+
+        if (i % 1024 == 1023) {
+            client.pollPeer(0);
+            server.pollPeers(0);
+        }
+    }
+
+    while (serverRecv.load() < packets && client.isAlive()) {
+        client.pollPeer(0);
+        server.pollPeers(0);
+    }
+
+    double secs = (getNanos() - start) / 1e9;
+    json.add("pipe_small_packet_throughput", {
+        {"packets", (double)packets},
+        {"packet_bytes", 1 + sizeof(int64_t)},
+        {"seconds", secs},
+        {"packets_per_sec", packets / secs},
+    });
+}
+
+static void benchVarThroughput(BenchConfig &cfg, JsonWriter &json, size_t size) {
+    ServerThread server(cfg.port);
+    BenchClient client;
+    uint64_t bytes = cfg.quick ? 16 * 1024 * 1024 : 512 * 1024 * 1024;
+    uint64_t packets = std::min<uint64_t>(bytes / size, cfg.quick ? 200000 : 5000000);
+    std::vector<Byte> body(size, 0xAB);
+    int64_t start;
+
+    client.connect("127.0.0.1", std::to_string(cfg.port));
+    client.waitReady();
+
+    start = getNanos();
+    for (uint64_t i = 0; i < packets; i++) {
+        size_t indx = client.prepareVarPacket(BENCH_VAR_SINK);
+        client.writeBytes(body.data(), size);
+        client.patchVarPacket(indx);
+
+        if (i % 64 == 63)
+            client.send();
+    }
+    client.send();
+
+    while (serverRecv.load() < packets && client.isAlive())
+        client.pollPeer(1);
+
+    double secs = (getNanos() - start) / 1e9;
+    json.add("var_packet_throughput_" + std::to_string(size), {
+        {"packets", (double)packets},
+        {"packet_bytes", (double)size},
+        {"seconds", secs},
+        {"packets_per_sec", packets / secs},
+        {"mb_per_sec", (packets * size) / secs / (1024 * 1024)},
+    });
+}
+
+static void benchFanout(BenchConfig &cfg, JsonWriter &json, int peers) {
+    ServerThread server(cfg.port);
+    FoxClientGroup group(peers);
+    std::vector<BenchClient*> clients;
+    BenchClient *sender;
+    int rounds = cfg.quick ? 50 : 500;
+    int64_t start;
+
+    for (int i = 0; i < peers; i++) {
+        BenchClient *client = new BenchClient();
+        group.addClient(client);
+        client->connectAsync("127.0.0.1", std::to_string(cfg.port));
+        clients.push_back(client);
+    }
+
+    // wait for everyone to connect
+    for (bool allReady = false; !allReady;) {
+        group.pollClients(10);
+
+        allReady = true;
+        for (BenchClient *client : clients) {
+            if (client->failed) {
+                FOXFATAL("couldn't connect to the bench server!")
+            }
+            allReady &= client->ready;
+        }
+    }
+
+    sender = clients[0];
+    start = getNanos();
+    for (int r = 0; r < rounds; r++) {
+        sender->writeByte(BENCH_BROADCAST_REQ);
+        sender->writeInt<int64_t>(r);
+
+        // wait for the round to reach every peer
+        for (bool done = false; !done;) {
+            group.pollClients(1);
+
+            done = true;
+            for (BenchClient *client : clients)
+                done &= client->broadcasts > (uint64_t)r;
+        }
+    }
+
+    double secs = (getNanos() - start) / 1e9;
+    json.add("broadcast_fanout_" + std::to_string(peers), {
+        {"peers", (double)peers},
+        {"rounds", (double)rounds},
+        {"seconds", secs},
+        {"rounds_per_sec", rounds / secs},
+        {"deliveries_per_sec", (rounds * (double)peers) / secs},
+    });
+
+    for (BenchClient *client : clients)
+        delete client;
+}
+
+static void benchConnectRate(BenchConfig &cfg, JsonWriter &json) {
+    ServerThread server(cfg.port);
+    FoxClientGroup group;
+    std::vector<BenchClient*> clients;
+    int conns = cfg.quick ? 500 : 5000;
+    int done = 0;
+    int64_t start;
+
+    start = getNanos();
+    for (int i = 0; i < conns; i++) {
+        BenchClient *client = new BenchClient();
+        group.addClient(client);
+        client->connectAsync("127.0.0.1", std::to_string(cfg.port));
+        clients.push_back(client);
+    }
+
+    while (done < conns) {
+        group.pollClients(10);
+
+        done = 0;
+        for (BenchClient *client : clients) {
+            if (client->failed) {
+                FOXFATAL("couldn't connect to the bench server!")
+            }
+            done += client->ready;
+        }
+    }
+
+    double secs = (getNanos() - start) / 1e9;
+    json.add("connect_accept_rate", {
+        {"connections", (double)conns},
+        {"seconds", secs},
+        {"connections_per_sec", conns / secs},
+    });
+
+    for (BenchClient *client : clients)
+        delete client;
+}
+
+// exposes the stream's buffers so reads can be benchmarked without a socket
+class BenchStream : public ByteStream {
+public:
+    using ByteStream::setInView;
+
+    void swapBuffers() {
+        inBuffer.swap(outBuffer);
+        outBuffer.clear();
+    }
+};
+
+static void benchByteStream(BenchConfig &cfg, JsonWriter &json) {
+    BenchStream stream;
+    uint64_t rounds = cfg.quick ? 20000 : 500000;
+    const int batch = 256;
+    uint64_t checksum = 0;
+    int64_t start, writeNanos = 0, readNanos = 0;
+
+    for (uint64_t r = 0; r < rounds; r++) {
+        start = getNanos();
+        for (int i = 0; i < batch; i++)
+            stream.writeInt<uint32_t>((uint32_t)(r + i));
+        writeNanos += getNanos() - start;
+
+        stream.swapBuffers();
+
+        start = getNanos();
+        for (int i = 0; i < batch; i++) {
+            uint32_t val;
+            stream.readInt(val);
+            checksum += val;
+        }
+        readNanos += getNanos() - start;
+    }
+
+    double ops = (double)rounds * batch;
+    json.add("bytestream_int", {
+        {"ops", ops},
+        {"write_ns_per_op", writeNanos / ops},
+        {"read_ns_per_op", readNanos / ops},
+        {"checksum", (double)(checksum & 0xFFFF)},
+    });
+}
+
+static void benchVarint(BenchConfig &cfg, JsonWriter &json) {
+    BenchStream stream;
+    uint64_t rounds = cfg.quick ? 20000 : 500000;
+    const int batch = 256;
+    uint64_t checksum = 0, vals[batch];
+    std::vector<Byte> encoded;
+    int64_t start, writeNanos = 0, readNanos = 0, runNanos = 0;
+    size_t bytes = 0;
+
+    for (uint64_t r = 0; r < rounds; r++) {
+        // a mix of 1-4 byte values, like deltas & counts usually are
+        start = getNanos();
+        for (int i = 0; i < batch; i++)
+            stream.writeVarint(((r * 2654435761u + i) & 0xFFFFFFF) >> (i % 4 * 7));
+        writeNanos += getNanos() - start;
+
+        // read the same bytes twice, one at a time & then as a run
+        bytes += stream.sizeOut();
+        encoded.swap(stream.getOutBuffer());
+        stream.flushOut();
+        stream.setInView(encoded.data(), encoded.size());
+
+        start = getNanos();
+        for (int i = 0; i < batch; i++) {
+            uint64_t val;
+            stream.readVarint(val);
+            checksum += val;
+        }
+        readNanos += getNanos() - start;
+
+        stream.setInView(encoded.data(), encoded.size());
+        start = getNanos();
+        stream.readVarints(vals, batch);
+        runNanos += getNanos() - start;
+        checksum += vals[batch - 1];
+    }
+
+    double ops = (double)rounds * batch;
+    json.add("bytestream_varint", {
+        {"ops", ops},
+        {"bytes_per_value", bytes / ops},
+        {"write_ns_per_op", writeNanos / ops},
+        {"read_ns_per_op", readNanos / ops},
+        {"run_read_ns_per_op", runNanos / ops},
+        {"checksum", (double)(checksum & 0xFFFF)},
+    });
+}
+
+static void benchChecksum(BenchConfig &cfg, JsonWriter &json) {
+    std::vector<Byte> buf(FOXNET_INTEGRITY_FRAME);
+    uint64_t rounds = cfg.quick ? 2000 : 50000;
+    uint32_t crc = 0;
+    int64_t start;
+
+    for (size_t i = 0; i < buf.size(); i++)
+        buf[i] = (Byte)(i * 31);
+
+    // one integrity frame at a time, chained so nothing gets optimized out
+    start = getNanos();
+    for (uint64_t r = 0; r < rounds; r++)
+        crc = FoxChecksum::crc32c(buf.data(), buf.size(), crc);
+    int64_t nanos = getNanos() - start;
+
+    json.add("crc32c", {
+        {"bytes", (double)rounds * buf.size()},
+        {"gb_per_sec", (double)rounds * buf.size() / nanos},
+        {"accelerated", FoxChecksum::isAccelerated() ? 1.0 : 0.0},
+        {"checksum", (double)(crc & 0xFFFF)},
+    });
+}
+
+int main(int argc, char **argv) {
+    BenchConfig cfg;
+    JsonWriter json;
+
+    FoxTrace::setThreadName("bench client");
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+
+        if (arg == "--quick") {
+            cfg.quick = true;
+        } else if (arg == "--port" && i + 1 < argc) {
+            cfg.port = (uint16_t)std::stoi(argv[++i]);
+        } else if (arg == "--out" && i + 1 < argc) {
+            cfg.out = argv[++i];
+        } else if (arg == "--trace" && i + 1 < argc) {
+            cfg.trace = argv[++i];
+        } else {
+            std::cerr << "usage: " << argv[0] << " [--quick] [--port <port>] [--out <file.json>] [--trace <file.json>]" << std::endl;
+            return 1;
+        }
+    }
+
+    try {
+        benchLatency(cfg, json, PATH_TCP);
+#ifndef _WIN32
+        benchLatency(cfg, json, PATH_UNIX);
+#endif
+#ifdef __linux__
+        benchLatency(cfg, json, PATH_SHM);
+#endif
+        benchSmallThroughput(cfg, json);
+        benchPipeThroughput(cfg, json);
+        for (size_t size : {16, 256, 1024, MAX_PACKET_SIZE})
+            benchVarThroughput(cfg, json, size);
+        for (int peers : {10, 100, 1000})
+            benchFanout(cfg, json, peers);
+        benchConnectRate(cfg, json);
+        benchByteStream(cfg, json);
+        benchVarint(cfg, json);
+        benchChecksum(cfg, json);
+    } catch(FoxNet::FoxException &e) {
+        std::cerr << "Fatal Error! : " << e.what() << std::endl;
+        return 1;
+    }
+
+    std::string result = json.finish();
+    if (cfg.out.empty()) {
+        std::cout << result;
+    } else {
+        std::ofstream file(cfg.out);
+        file << result;
+    }
+
+    if (!cfg.trace.empty()) {
+        if (!FoxTrace::isEnabled())
+            std::cerr << "FoxNet was built without FOXNET_ENABLE_TRACING, the trace will be empty" << std::endl;
+
+        if (!FoxTrace::dumpChrome(cfg.trace)) {
+            std::cerr << "couldn't write the trace to " << cfg.trace << std::endl;
+            return 1;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,623 @@
+#include "FoxClient.hpp"
+#include "FoxClientGroup.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <deque>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/resource.h>
+#endif
+
+/*
+ * foxnet-loadgen
+ *
+ *  Opens a lot of concurrent connections to a FoxServer, replays a packet mix on each of them & reports the
+ * achieved rates and latency histograms. Every thread drives its share of the clients from one FoxClientGroup.
+ *
+ *  Latency is the round trip of a PKTID_PING, which every FoxPeer answers. pings are written in line with the
+ * rest of the mix, so they also measure how long the server takes to get through everything queued in front of
+ * them. the server must know every packet in the mix, and anything it sends back has to be declared with --recv
+ * (with the right size) or the stream falls out of sync.
+ *
+ *  usage: foxnet-loadgen [options]
+ *      --host <ip>                 server address (default 127.0.0.1)
+ *      --port <port>               server port (default 1337)
+ *      --clients <n>               concurrent connections (default 100)
+ *      --threads <n>               poll loops to spread the clients over (default 1)
+ *      --connect-rate <n>          new connections per second (default 1000)
+ *      --duration <secs>           how long to run for (default 10)
+ *      --ping <rate>               pings per client per second (default 1)
+ *      --packet <id>:<size>:<rate> fixed length packet with a <size> byte body, <rate> per client per second
+ *      --var <id>:<min>[-<max>]:<rate>
+ *                                  var length packet with a random body size in [min, max]
+ *      --recv <id>:<size|var>      packet the server sends us, its body is discarded
+ *      --xor <key>                 xor every byte sent & received with key (for the Arith examples)
+ */
+
+using namespace FoxNet;
+
+// packets aren't written to a client with more than this many bytes still queued, they're counted as skipped
+#define LOADGEN_MAX_QUEUED (256 * 1024)
+
+static int64_t getNanos() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct MixEntry {
+    PktID id;
+    bool variable;
+    PktSize minSize;
+    PktSize maxSize;
+    double rate; // per client, per second
+};
+
+struct RecvEntry {
+    PktID id;
+    bool variable;
+    PktSize size;
+};
+
+struct LoadConfig {
+    std::string host = "127.0.0.1";
+    std::string port = "1337";
+    int clients = 100;
+    int threads = 1;
+    double connectRate = 1000;
+    double duration = 10;
+    double pingRate = 1;
+    std::vector<MixEntry> mix;
+    std::vector<RecvEntry> recv;
+    bool useXor = false;
+    Byte xorKey = 0;
+};
+
+// ============================================= [[ Histogram ]] =============================================
+
+/*
+ * log-linear histogram of microsecond values, every power of two is split into 16 buckets so values are kept with
+ * ~6% precision no matter how large they get
+ */
+class Histogram {
+private:
+    static const int SUB_BITS = 4;
+    static const int SUB_COUNT = 1 << SUB_BITS;
+
+    std::vector<uint64_t> buckets;
+    uint64_t count = 0;
+    uint64_t sum = 0;
+    uint64_t max = 0;
+
+    static int bucketOf(uint64_t val) {
+        int exp;
+
+        if (val < SUB_COUNT)
+            return (int)val;
+
+        exp = 63 - __builtin_clzll(val);
+        return SUB_COUNT + (exp - SUB_BITS) * SUB_COUNT + (int)((val >> (exp - SUB_BITS)) & (SUB_COUNT - 1));
+    }
+
+    // largest value that lands in the bucket
+    static uint64_t bucketMax(int indx) {
+        int exp, sub;
+
+        if (indx < SUB_COUNT)
+            return indx;
+
+        exp = (indx - SUB_COUNT) / SUB_COUNT + SUB_BITS;
+        sub = (indx - SUB_COUNT) % SUB_COUNT;
+        return (((uint64_t)(SUB_COUNT + sub + 1)) << (exp - SUB_BITS)) - 1;
+    }
+
+public:
+    Histogram(): buckets(SUB_COUNT * (64 - SUB_BITS + 1), 0) {}
+
+    void record(uint64_t val) {
+        buckets[bucketOf(val)]++;
+        count++;
+        sum += val;
+        max = std::max(max, val);
+    }
+
+    void merge(const Histogram &other) {
+        for (size_t i = 0; i < buckets.size(); i++)
+            buckets[i] += other.buckets[i];
+
+        count += other.count;
+        sum += other.sum;
+        max = std::max(max, other.max);
+    }
+
+    uint64_t percentile(double p) {
+        uint64_t target = (uint64_t)std::ceil(p * count);
+        uint64_t seen = 0;
+
+        for (size_t i = 0; i < buckets.size(); i++) {
+            seen += buckets[i];
+            if (seen >= target && seen > 0)
+                return std::min(bucketMax((int)i), max);
+        }
+
+        return max;
+    }
+
+    void print(const std::string &name) {
+        std::cout << name << " (us): ";
+        if (count == 0) {
+            std::cout << "no samples" << std::endl;
+            return;
+        }
+
+        std::cout << "count=" << count << " mean=" << sum / count << " p50=" << percentile(0.50)
+            << " p90=" << percentile(0.90) << " p99=" << percentile(0.99) << " p99.9=" << percentile(0.999)
+            << " max=" << max << std::endl;
+
+        // coarse distribution, one row per power of two
+        uint64_t rowStart = 0;
+        uint64_t rowCount = 0;
+        for (size_t i = 0; i < buckets.size(); i++) {
+            uint64_t top = bucketMax((int)i);
+            rowCount += buckets[i];
+
+            // rows end right before a power of two
+            if (((top + 1) & top) != 0 && i + 1 != buckets.size())
+                continue;
+
+            if (rowCount > 0) {
+                int bar = (int)std::ceil(50.0 * rowCount / count);
+                std::cout << "  " << std::setw(10) << rowStart << " - " << std::setw(10) << top << " | "
+                    << std::setw(10) << rowCount << " " << std::string(bar, '#') << std::endl;
+            }
+
+            rowStart = top + 1;
+            rowCount = 0;
+        }
+    }
+};
+
+// ============================================= [[ Clients ]] =============================================
+
+struct WorkerStats {
+    std::atomic<uint64_t> connected{0};
+    std::atomic<uint64_t> connectFailed{0};
+    std::atomic<uint64_t> disconnected{0};
+    std::atomic<uint64_t> packetsOut{0};
+    std::atomic<uint64_t> bytesOut{0};
+    std::atomic<uint64_t> bytesIn{0};
+    std::atomic<uint64_t> pongs{0};
+    std::atomic<uint64_t> skipped{0}; // packets we didn't write because the client was backed up
+};
+
+class LoadWorker;
+
+class LoadClient : public FoxClient {
+public:
+    LoadWorker *worker;
+    bool useXor;
+    Byte xorKey;
+    int64_t connectStart = 0;
+    std::deque<int64_t> pings; // send times of the pings still in flight, pongs come back in order
+
+    LoadClient(LoadWorker *worker, LoadConfig &cfg);
+
+    void onReady();
+    void onConnectFailed();
+    void onPong(int64_t peerTime, int64_t currTime);
+    void onSend(Byte *data, size_t sz);
+    void onRecv(Byte *data, size_t sz);
+};
+
+class LoadWorker : public FoxClientGroup {
+private:
+    LoadConfig &cfg;
+    int clientCount;
+    std::vector<LoadClient*> clients;
+    std::vector<LoadClient*> readyClients;
+    std::vector<double> owed; // packets we're behind on, per mix entry (the last one is pings)
+    std::vector<Byte> body;
+    std::mt19937 rng;
+    size_t cursor = 0;
+
+    void openClients(int64_t start, int64_t now);
+    void sendMix(double elapsed);
+    void sendPacket(LoadClient *client, size_t entry);
+    LoadClient *nextClient(void);
+
+public:
+    WorkerStats stats;
+    Histogram latency;
+    Histogram connectTime;
+
+    LoadWorker(LoadConfig &cfg, int clients, int seed);
+    ~LoadWorker(void);
+
+    void onClientKilled(FoxClient *client);
+    void clientReady(LoadClient *client);
+
+    void run(std::atomic<bool> &running);
+};
+
+LoadClient::LoadClient(LoadWorker *w, LoadConfig &cfg): worker(w), useXor(cfg.useXor), xorKey(cfg.xorKey) {
+    for (RecvEntry &entry : cfg.recv) {
+        if (entry.variable)
+            registerVarPacket(entry.id);
+        else
+            registerPacket(entry.id, entry.size);
+    }
+}
+
+void LoadClient::onReady() {
+    worker->connectTime.record((getNanos() - connectStart) / 1000);
+    worker->clientReady(this);
+}
+
+void LoadClient::onConnectFailed() {
+    worker->stats.connectFailed.fetch_add(1, std::memory_order_relaxed);
+}
+
+void LoadClient::onPong(int64_t, int64_t) {
+    if (pings.empty())
+        return;
+
+    worker->latency.record((getNanos() - pings.front()) / 1000);
+    worker->stats.pongs.fetch_add(1, std::memory_order_relaxed);
+    pings.pop_front();
+}
+
+void LoadClient::onSend(Byte *data, size_t sz) {
+    if (!useXor)
+        return;
+
+    for (size_t i = 0; i < sz; i++)
+        data[i] ^= xorKey;
+}
+
+void LoadClient::onRecv(Byte *data, size_t sz) {
+    worker->stats.bytesIn.fetch_add(sz, std::memory_order_relaxed);
+
+    if (useXor) {
+        for (size_t i = 0; i < sz; i++)
+            data[i] ^= xorKey;
+    }
+}
+
+LoadWorker::LoadWorker(LoadConfig &c, int count, int seed):
+    FoxClientGroup(count), cfg(c), clientCount(count), owed(c.mix.size() + 1, 0), body(MAX_PACKET_SIZE, 0), rng(seed) {}
+
+LoadWorker::~LoadWorker() {
+    for (LoadClient *client : clients)
+        delete client;
+}
+
+void LoadWorker::onClientKilled(FoxClient *client) {
+    // dead clients are dropped from readyClients by nextClient()
+    if (client->getHandshake())
+        stats.disconnected.fetch_add(1, std::memory_order_relaxed);
+}
+
+void LoadWorker::clientReady(LoadClient *client) {
+    readyClients.push_back(client);
+    stats.connected.fetch_add(1, std::memory_order_relaxed);
+}
+
+void LoadWorker::openClients(int64_t start, int64_t now) {
+    double rate = cfg.connectRate / cfg.threads;
+    int64_t due = (int64_t)((now - start) / 1e9 * rate) + 1;
+
+    while ((int64_t)clients.size() < std::min<int64_t>(due, clientCount)) {
+        LoadClient *client = new LoadClient(this, cfg);
+
+        clients.push_back(client);
+        addClient(client);
+        client->connectStart = getNanos();
+        client->connectAsync(cfg.host, cfg.port);
+    }
+}
+
+LoadClient *LoadWorker::nextClient() {
+    while (!readyClients.empty()) {
+        if (cursor >= readyClients.size())
+            cursor = 0;
+
+        LoadClient *client = readyClients[cursor];
+        if (client->isAlive()) {
+            cursor++;
+            return client;
+        }
+
+        // swap & pop the dead client
+        readyClients[cursor] = readyClients.back();
+        readyClients.pop_back();
+    }
+
+    return nullptr;
+}
+
+void LoadWorker::sendPacket(LoadClient *client, size_t entry) {
+    size_t start = client->pendingOut();
+
+    if (start > LOADGEN_MAX_QUEUED) {
+        stats.skipped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    if (entry == cfg.mix.size()) {
+        client->pings.push_back(getNanos());
+        client->writeByte(PKTID_PING);
+        client->writeInt<int64_t>(getTimestamp());
+        stats.bytesOut.fetch_add(sizeof(PktID) + sizeof(int64_t), std::memory_order_relaxed);
+    } else {
+        MixEntry &pkt = cfg.mix[entry];
+        PktSize size = pkt.minSize;
+
+        if (pkt.maxSize > pkt.minSize)
+            size = (PktSize)std::uniform_int_distribution<int>(pkt.minSize, pkt.maxSize)(rng);
+
+        if (pkt.variable) {
+            size_t indx = client->prepareVarPacket(pkt.id);
+            client->writeBytes(body.data(), size);
+            client->patchVarPacket(indx);
+            stats.bytesOut.fetch_add(sizeof(PktID) * 2 + sizeof(PktSize) + size, std::memory_order_relaxed);
+        } else {
+            client->writeByte(pkt.id);
+            client->writeBytes(body.data(), size);
+            stats.bytesOut.fetch_add(sizeof(PktID) + size, std::memory_order_relaxed);
+        }
+    }
+
+    stats.packetsOut.fetch_add(1, std::memory_order_relaxed);
+}
+
+void LoadWorker::sendMix(double elapsed) {
+    double ready = (double)readyClients.size();
+
+    for (size_t i = 0; i < owed.size(); i++) {
+        double rate = (i == cfg.mix.size()) ? cfg.pingRate : cfg.mix[i].rate;
+
+        // don't let a stall turn into a huge burst, cap what we owe at a second's worth
+        owed[i] = std::min(owed[i] + rate * ready * elapsed, std::max(rate * ready, 1.0));
+
+        while (owed[i] >= 1) {
+            LoadClient *client = nextClient();
+            if (client == nullptr)
+                break;
+
+            sendPacket(client, i);
+            owed[i] -= 1;
+        }
+    }
+}
+
+void LoadWorker::run(std::atomic<bool> &running) {
+    int64_t start = getNanos();
+    int64_t last = start;
+
+    while (running.load(std::memory_order_relaxed)) {
+        int64_t now = getNanos();
+
+        openClients(start, now);
+        sendMix((now - last) / 1e9);
+        last = now;
+
+        // 1ms of pacing granularity is plenty
+        pollClients(1);
+    }
+}
+
+// ============================================= [[ Main ]] =============================================
+
+static void usage(const char *name) {
+    std::cerr << "usage: " << name << " [--host <ip>] [--port <port>] [--clients <n>] [--threads <n>]"
+        << " [--connect-rate <n>] [--duration <secs>] [--ping <rate>] [--packet <id>:<size>:<rate>]"
+        << " [--var <id>:<min>[-<max>]:<rate>] [--recv <id>:<size|var>] [--xor <key>]" << std::endl;
+}
+
+static std::vector<std::string> splitArg(const std::string &arg, char delim) {
+    std::vector<std::string> parts;
+    size_t start = 0, end;
+
+    while ((end = arg.find(delim, start)) != std::string::npos) {
+        parts.push_back(arg.substr(start, end - start));
+        start = end + 1;
+    }
+    parts.push_back(arg.substr(start));
+
+    return parts;
+}
+
+static PktID parseID(const std::string &str) {
+    int id = std::stoi(str, nullptr, 0);
+
+    if (id < PKTID_USER_PACKET_START || id > 255) {
+        FOXFATAL("packet id isn't a user packet id!")
+    }
+
+    return (PktID)id;
+}
+
+static PktSize parseSize(const std::string &str) {
+    int size = std::stoi(str);
+
+    if (size < 0 || size > MAX_PACKET_SIZE) {
+        FOXFATAL("packet size is out of range!")
+    }
+
+    return (PktSize)size;
+}
+
+static bool parseArgs(int argc, char **argv, LoadConfig &cfg) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+
+        if (i + 1 >= argc)
+            return false;
+
+        std::string val = argv[++i];
+        std::vector<std::string> parts = splitArg(val, ':');
+
+        if (arg == "--host") {
+            cfg.host = val;
+        } else if (arg == "--port") {
+            cfg.port = val;
+        } else if (arg == "--clients") {
+            cfg.clients = std::stoi(val);
+        } else if (arg == "--threads") {
+            cfg.threads = std::max(1, std::stoi(val));
+        } else if (arg == "--connect-rate") {
+            cfg.connectRate = std::stod(val);
+        } else if (arg == "--duration") {
+            cfg.duration = std::stod(val);
+        } else if (arg == "--ping") {
+            cfg.pingRate = std::stod(val);
+        } else if (arg == "--packet" && parts.size() == 3) {
+            PktSize size = parseSize(parts[1]);
+            cfg.mix.push_back({parseID(parts[0]), false, size, size, std::stod(parts[2])});
+        } else if (arg == "--var" && parts.size() == 3) {
+            std::vector<std::string> range = splitArg(parts[1], '-');
+            PktSize minSize = parseSize(range[0]);
+            PktSize maxSize = range.size() > 1 ? parseSize(range[1]) : minSize;
+
+            if (maxSize < minSize) {
+                FOXFATAL("bad packet size range!")
+            }
+
+            cfg.mix.push_back({parseID(parts[0]), true, minSize, maxSize, std::stod(parts[2])});
+        } else if (arg == "--recv" && parts.size() == 2) {
+            if (parts[1] == "var")
+                cfg.recv.push_back({parseID(parts[0]), true, 0});
+            else
+                cfg.recv.push_back({parseID(parts[0]), false, parseSize(parts[1])});
+        } else if (arg == "--xor") {
+            cfg.useXor = true;
+            cfg.xorKey = (Byte)std::stoi(val, nullptr, 0);
+        } else {
+            return false;
+        }
+    }
+
+    return cfg.clients > 0 && cfg.connectRate > 0 && cfg.duration > 0;
+}
+
+// we'll need a descriptor per connection, bump our limit as far as we're allowed
+static void raiseFileLimit(int clients) {
+#ifdef __linux__
+    struct rlimit limit;
+
+    if (getrlimit(RLIMIT_NOFILE, &limit) != 0)
+        return;
+
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+
+    if (limit.rlim_cur != RLIM_INFINITY && limit.rlim_cur < (rlim_t)clients + 64)
+        std::cerr << "warning: file descriptor limit is " << limit.rlim_cur << ", not every client will be able to connect" << std::endl;
+#endif
+}
+
+int main(int argc, char **argv) {
+    LoadConfig cfg;
+    std::vector<LoadWorker*> workers;
+    std::vector<std::thread> threads;
+    std::atomic<bool> running(true);
+
+    try {
+        if (!parseArgs(argc, argv, cfg)) {
+            usage(argv[0]);
+            return 1;
+        }
+    } catch(std::exception &e) {
+        std::cerr << "bad arguments : " << e.what() << std::endl;
+        usage(argv[0]);
+        return 1;
+    }
+
+    raiseFileLimit(cfg.clients);
+
+    for (int i = 0; i < cfg.threads; i++) {
+        int count = cfg.clients / cfg.threads + (i < cfg.clients % cfg.threads ? 1 : 0);
+        workers.push_back(new LoadWorker(cfg, count, i + 1));
+    }
+
+    int64_t start = getNanos();
+    for (LoadWorker *worker : workers) {
+        threads.emplace_back([worker, &running]() {
+            try {
+                worker->run(running);
+            } catch(FoxNet::FoxException &e) {
+                std::cerr << "Fatal Error! : " << e.what() << std::endl;
+            }
+        });
+    }
+
+    // progress report every second
+    uint64_t lastPackets = 0, lastBytes = 0;
+    for (int sec = 1; sec <= (int)std::ceil(cfg.duration); sec++) {
+        int64_t wake = start + (int64_t)(std::min<double>(sec, cfg.duration) * 1e9);
+        std::this_thread::sleep_for(std::chrono::nanoseconds(std::max<int64_t>(0, wake - getNanos())));
+
+        uint64_t connected = 0, failed = 0, disconnected = 0, packets = 0, bytes = 0;
+        for (LoadWorker *worker : workers) {
+            connected += worker->stats.connected.load(std::memory_order_relaxed);
+            failed += worker->stats.connectFailed.load(std::memory_order_relaxed);
+            disconnected += worker->stats.disconnected.load(std::memory_order_relaxed);
+            packets += worker->stats.packetsOut.load(std::memory_order_relaxed);
+            bytes += worker->stats.bytesOut.load(std::memory_order_relaxed);
+        }
+
+        std::cerr << "[" << sec << "s] connected=" << connected - disconnected << " failed=" << failed
+            << " dropped=" << disconnected << " pkts/s=" << packets - lastPackets
+            << " KB/s=" << (bytes - lastBytes) / 1024 << std::endl;
+        lastPackets = packets;
+        lastBytes = bytes;
+    }
+
+    running = false;
+    for (std::thread &thread : threads)
+        thread.join();
+    double secs = (getNanos() - start) / 1e9;
+
+    // merge everything & report
+    WorkerStats total;
+    Histogram latency, connectTime;
+    for (LoadWorker *worker : workers) {
+        total.connected += worker->stats.connected;
+        total.connectFailed += worker->stats.connectFailed;
+        total.disconnected += worker->stats.disconnected;
+        total.packetsOut += worker->stats.packetsOut;
+        total.bytesOut += worker->stats.bytesOut;
+        total.bytesIn += worker->stats.bytesIn;
+        total.pongs += worker->stats.pongs;
+        total.skipped += worker->stats.skipped;
+        latency.merge(worker->latency);
+        connectTime.merge(worker->connectTime);
+    }
+
+    double target = cfg.pingRate;
+    for (MixEntry &entry : cfg.mix)
+        target += entry.rate;
+
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << "duration: " << secs << "s, threads: " << cfg.threads << std::endl;
+    std::cout << "connections: " << total.connected << "/" << cfg.clients << " connected, "
+        << total.connectFailed << " failed, " << total.disconnected << " dropped by the server" << std::endl;
+    std::cout << "sent: " << total.packetsOut << " packets (" << total.packetsOut / secs << "/s, target "
+        << target * cfg.clients << "/s at full ramp), " << total.bytesOut / secs / 1024 << " KB/s, "
+        << total.skipped << " skipped while backed up" << std::endl;
+    std::cout << "received: " << total.bytesIn / secs / 1024 << " KB/s, " << total.pongs << " pongs" << std::endl;
+    connectTime.print("connect + handshake");
+    latency.print("ping rtt");
+
+    for (LoadWorker *worker : workers)
+        delete worker;
+
+    return 0;
+}